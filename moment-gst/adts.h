@@ -0,0 +1,133 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__ADTS__H__
+#define MOMENT_GST__ADTS__H__
+
+
+#include <libmary/libmary.h>
+
+
+// For reference, see http://wiki.multimedia.cx/index.php?title=ADTS
+
+namespace MomentGst {
+
+using namespace M;
+
+struct AdtsHeader
+{
+    // 7 or 9 bytes, depending on CRC presence.
+    Size header_len;
+    // Length of the whole frame, header included.
+    Size frame_len;
+    // 1024 samples per raw data block.
+    Count num_samples;
+    // 0 for reserved sampling frequency indexes.
+    unsigned rate;
+    // Profile, sampling frequency index and channel configuration bits.
+    // AudioSpecificConfig is derived from these bits only.
+    Uint32 config_bits;
+};
+
+// Returns false if 'mem' does not start with a complete ADTS frame.
+static inline bool
+parseAdtsHeader (ConstMemory   const mem,
+                 AdtsHeader  * const mt_nonnull ret_hdr)
+{
+    static unsigned const rates [16] = {
+        96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+        16000, 12000, 11025,  8000,  7350,     0,     0,     0
+    };
+
+    if (mem.len() < 7)
+        return false;
+
+    Byte const * const h = mem.mem();
+
+    // 12-bit syncword.
+    if (h [0] != 0xff || (h [1] & 0xf0) != 0xf0)
+        return false;
+
+    bool const protection_absent = h [1] & 0x1;
+    ret_hdr->header_len = (protection_absent ? 7 : 9);
+
+    ret_hdr->frame_len = ((Size) (h [3] & 0x3) << 11) | ((Size) h [4] << 3) | ((Size) h [5] >> 5);
+    if (ret_hdr->frame_len < ret_hdr->header_len || ret_hdr->frame_len > mem.len())
+        return false;
+
+    ret_hdr->num_samples = ((h [6] & 0x3) + 1) * 1024;
+    ret_hdr->rate = rates [(h [2] >> 2) & 0xf];
+
+    // The private bit is masked out.
+    ret_hdr->config_bits = ((Uint32) (h [2] & 0xfd) << 8) | (h [3] & 0xc0);
+
+    return true;
+}
+
+// Makes a two-byte AudioSpecificConfig out of an ADTS header.
+static inline void
+adtsMakeCodecData (Byte const * const mt_nonnull adts_header,
+                   Byte       * const mt_nonnull codec_data)
+{
+    // Bit packing example:
+    // AAAA BBBB  CCCC DDDD
+    // 4321 4321  4321 4321
+    //
+    // 1234
+    // 0001 0010  0011 0100
+    // [] = { 0x12, 0x34 }
+
+    // AAC codec data:
+    //
+    // AAAA ABBB  BDDD DEFG
+    // 5432 1432  1432 1111
+    //
+    // A 5 AudioObjectType
+    // B 4 samplingFrequencyIndex
+    // if (samplingFrequencyIndex == 15) - forbidden
+    //     C 24 samplingFrequency
+    // D 4 channelConfiguration (0-7, last bit reserved)
+    // E 1 frameLengthFlag
+    // F 1 dependsOnCoreCoder = 0
+    // G 1 extensionFlag = 0
+
+    codec_data [0] = 0;
+    codec_data [1] = 0;
+
+    // 2 bits for object type in ADTS => possible values: 1 2 3 4
+    Byte const obj_type = ((adts_header [2] >> 6) & 0x3) + 1;
+    codec_data [0] |= obj_type << 3;
+
+    Byte const rate_idx = (adts_header [2] >> 2) & 0xf;
+    codec_data [0] |= rate_idx >> 1;
+    codec_data [1] |= (rate_idx & 0x1) << 7;
+
+    Byte const channel_config = ((adts_header [2] & 0x1) << 2) | ((adts_header [3] >> 6) & 0x3);
+    codec_data [1] |= channel_config << 3;
+
+    // Just use 1024 samples per frame.
+    // See http://spectralhole.blogspot.ru/2010/09/aac-bistream-flaws-part-2-aac-960-zero.html
+    codec_data [1] |= 0;
+}
+
+}
+
+
+#endif /* MOMENT_GST__ADTS__H__ */
+
@@ -0,0 +1,688 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/chain_template.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_chain_template ("mod_gst.chain_template", LogLevel::I);
+
+namespace {
+
+struct TokenType
+{
+    enum Value {
+        Link,
+        Element,
+        Caps,
+        Property,
+        // Anything which only gst_parse_launch() understands.
+        Other
+    };
+};
+
+}
+
+static Byte const *
+findByte (ConstMemory const mem,
+          Byte        const c)
+{
+    return (Byte const *) memchr (mem.mem(), c, mem.len());
+}
+
+static bool
+isNameByte (Byte const c)
+{
+    return (c >= 'a' && c <= 'z')
+           || (c >= 'A' && c <= 'Z')
+           || (c >= '0' && c <= '9')
+           || c == '_' || c == '-';
+}
+
+static TokenType::Value
+getTokenType (ConstMemory const token)
+{
+    if (equal (token, "!"))
+        return TokenType::Link;
+
+    Byte const * const slash = findByte (token, '/');
+    Byte const * const eq    = findByte (token, '=');
+
+    // Caps start with a media type: "video/x-h264,stream-format=avc".
+    if (slash && (!eq || slash < eq)) {
+        Byte const * const colon = findByte (token, ':');
+        if (colon && colon < slash)
+            return TokenType::Other; // URI
+        return TokenType::Caps;
+    }
+
+    if (eq) {
+        for (Byte const *p = token.mem(); p != eq; ++p) {
+            if (!isNameByte (*p))
+                return TokenType::Other; // Child properties, "name::prop".
+        }
+
+        return (eq == token.mem() ? TokenType::Other : TokenType::Property);
+    }
+
+    for (Size i = 0; i < token.len(); ++i) {
+        if (!isNameByte (token.mem() [i]))
+            return TokenType::Other; // References to named elements, bins.
+    }
+
+    return TokenType::Element;
+}
+
+// Splits 'mem' into whitespace-separated tokens. Quoted strings are kept
+// within their tokens, '!' is always a token of its own.
+static void
+tokenize (ConstMemory            const mem,
+          List< Ref<String> >  * const mt_nonnull ret_tokens)
+{
+    Byte const *p = mem.mem();
+    Byte const * const end = mem.mem() + mem.len();
+
+    for (;;) {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            ++p;
+
+        if (p == end)
+            break;
+
+        if (*p == '!') {
+            ret_tokens->append (grab (new (std::nothrow) String ("!")));
+            ++p;
+            continue;
+        }
+
+        Byte const * const token_start = p;
+        bool quoted = false;
+        while (p != end) {
+            if (quoted) {
+                if (*p == '\\' && p + 1 != end)
+                    ++p;
+                else
+                if (*p == '"')
+                    quoted = false;
+            } else {
+                if (*p == '"')
+                    quoted = true;
+                else
+                if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '!')
+                    break;
+            }
+
+            ++p;
+        }
+
+        ret_tokens->append (grab (new (std::nothrow) String (ConstMemory (token_start, p - token_start))));
+    }
+}
+
+ChainTemplate::PropertySpec::PropertySpec ()
+{
+    memset (&value, 0, sizeof (value));
+}
+
+ChainTemplate::PropertySpec::~PropertySpec ()
+{
+    if (G_IS_VALUE (&value))
+        g_value_unset (&value);
+}
+
+ChainTemplate::ElementSpec::ElementSpec ()
+    : factory (NULL),
+      caps (NULL)
+{
+}
+
+ChainTemplate::ElementSpec::~ElementSpec ()
+{
+    List<PropertySpec*>::Element *el = prop_list.getFirstElement();
+    while (el) {
+        delete el->data;
+        el = el->next;
+    }
+
+    if (factory)
+        gst_object_unref (factory);
+
+    if (caps)
+        gst_caps_unref (caps);
+}
+
+ChainTemplate::ChainSpec::~ChainSpec ()
+{
+    List<ElementSpec*>::Element *el = element_list.getFirstElement();
+    while (el) {
+        delete el->data;
+        el = el->next;
+    }
+}
+
+void
+ChainTemplate::delayedLinkPadAdded (GstElement * const element,
+                                    GstPad     * const new_pad,
+                                    gpointer     const _sink_el)
+{
+    GstElement * const sink_el = static_cast <GstElement*> (_sink_el);
+
+    if (GST_PAD_DIRECTION (new_pad) != GST_PAD_SRC)
+        return;
+
+    // Pads which do not fit, e.g. audio pads of a demuxer in a video chain,
+    // are left unlinked, as with gst_parse_launch().
+    if (!gst_element_link_pads (element, GST_OBJECT_NAME (new_pad), sink_el, NULL)) {
+        logD (chain_template, _func, "could not link ", GST_OBJECT_NAME (new_pad));
+        return;
+    }
+
+    // The sink element has been linked, later pads are of no interest.
+    g_signal_handlers_disconnect_by_func (element, (gpointer) delayedLinkPadAdded, _sink_el);
+}
+
+Result
+ChainTemplate::linkElements (GstElement * const src_el,
+                             GstElement * const sink_el)
+{
+    if (gst_element_link (src_el, sink_el))
+        return Result::Success;
+
+    // Sometimes pads appear later on, linking them as they come.
+    GList *templ = gst_element_class_get_pad_template_list (GST_ELEMENT_GET_CLASS (src_el));
+    for (; templ; templ = templ->next) {
+        GstPadTemplate * const pad_templ = GST_PAD_TEMPLATE (templ->data);
+        if (GST_PAD_TEMPLATE_DIRECTION (pad_templ) == GST_PAD_SRC
+            && GST_PAD_TEMPLATE_PRESENCE (pad_templ) == GST_PAD_SOMETIMES)
+        {
+            g_signal_connect (src_el, "pad-added", G_CALLBACK (delayedLinkPadAdded), sink_el);
+            return Result::Success;
+        }
+    }
+
+    logE_ (_func, "could not link ", GST_OBJECT_NAME (src_el), " to ", GST_OBJECT_NAME (sink_el));
+    return Result::Failure;
+}
+
+GstElement*
+ChainTemplate::createElement (ElementSpec * const mt_nonnull element_spec)
+{
+    GstElement * const el = gst_element_factory_create (element_spec->factory, NULL);
+    if (!el) {
+        logE_ (_func, "gst_element_factory_create() failed: ",
+               GST_PLUGIN_FEATURE_NAME (element_spec->factory));
+        return NULL;
+    }
+
+    if (element_spec->caps)
+        g_object_set (G_OBJECT (el), "caps", element_spec->caps, NULL);
+
+    List<PropertySpec*>::Element *prop_el = element_spec->prop_list.getFirstElement();
+    while (prop_el) {
+        PropertySpec * const prop_spec = prop_el->data;
+        g_object_set_property (G_OBJECT (el), prop_spec->name->cstr(), &prop_spec->value);
+        prop_el = prop_el->next;
+    }
+
+    return el;
+}
+
+Result
+ChainTemplate::fillBin (GstBin * const mt_nonnull bin)
+{
+    List<ChainSpec*>::Element *chain_el = chain_list.getFirstElement();
+    while (chain_el) {
+        GstElement *prv_el = NULL;
+
+        List<ElementSpec*>::Element *spec_el = chain_el->data->element_list.getFirstElement();
+        while (spec_el) {
+            GstElement * const el = createElement (spec_el->data);
+            if (!el)
+                return Result::Failure;
+
+            gst_bin_add (bin, el);
+
+            if (prv_el) {
+                if (!linkElements (prv_el, el))
+                    return Result::Failure;
+            }
+
+            prv_el = el;
+            spec_el = spec_el->next;
+        }
+
+        chain_el = chain_el->next;
+    }
+
+    return Result::Success;
+}
+
+GstElement*
+ChainTemplate::createPipeline ()
+{
+    if (use_parser) {
+        GError *err = NULL;
+        GstElement * const pipeline = gst_parse_launch (description->cstr(), &err);
+        if (!pipeline) {
+            if (err) {
+                logE_ (_func, "gst_parse_launch() failed: ", err->code, " ", err->message);
+                g_error_free (err);
+            } else {
+                logE_ (_func, "gst_parse_launch() failed");
+            }
+
+            return NULL;
+        }
+
+        if (err) {
+            logW_ (_func, "gst_parse_launch() recoverable error: ", err->message);
+            g_error_free (err);
+        }
+
+        return pipeline;
+    }
+
+    // A single element is returned as is, the way gst_parse_launch() does it.
+    if (chain_list.getFirstElement() == chain_list.getLastElement()) {
+        ChainSpec * const chain_spec = chain_list.getFirst();
+        if (chain_spec->element_list.getFirstElement() == chain_spec->element_list.getLastElement())
+            return createElement (chain_spec->element_list.getFirst());
+    }
+
+    GstElement * const pipeline = gst_pipeline_new (NULL);
+    if (!fillBin (GST_BIN (pipeline))) {
+        gst_object_unref (pipeline);
+        return NULL;
+    }
+
+    return pipeline;
+}
+
+GstElement*
+ChainTemplate::createBin ()
+{
+    if (use_parser) {
+        GError *err = NULL;
+        GstElement * const bin = gst_parse_bin_from_description (description->cstr(),
+                                                                 TRUE /* ghost_unlinked_pads */,
+                                                                 &err);
+        if (!bin) {
+            if (err) {
+                logE_ (_func, "gst_parse_bin_from_description() failed: ", err->message);
+                g_error_free (err);
+            } else {
+                logE_ (_func, "gst_parse_bin_from_description() failed");
+            }
+
+            return NULL;
+        }
+
+        if (err) {
+            logE_ (_func, "gst_parse_bin_from_description() recoverable error: ", err->message);
+            g_error_free (err);
+        }
+
+        return bin;
+    }
+
+    GstElement * const bin = gst_bin_new (NULL);
+    if (!fillBin (GST_BIN (bin))) {
+        gst_object_unref (bin);
+        return NULL;
+    }
+
+    // Same as gst_parse_bin_from_description() does with ghost_unlinked_pads.
+    GstPad * const sink_pad = gst_bin_find_unlinked_pad (GST_BIN (bin), GST_PAD_SINK);
+    if (sink_pad) {
+        gst_element_add_pad (bin, gst_ghost_pad_new ("sink", sink_pad));
+        gst_object_unref (sink_pad);
+    }
+
+    GstPad * const src_pad = gst_bin_find_unlinked_pad (GST_BIN (bin), GST_PAD_SRC);
+    if (src_pad) {
+        gst_element_add_pad (bin, gst_ghost_pad_new ("src", src_pad));
+        gst_object_unref (src_pad);
+    }
+
+    return bin;
+}
+
+bool
+ChainTemplate::compileProperty (GstElement  * const mt_nonnull proto_el,
+                                ElementSpec * const mt_nonnull element_spec,
+                                ConstMemory   const token)
+{
+    Byte const * const eq = findByte (token, '=');
+    assert (eq);
+
+    ConstMemory const name (token.mem(), eq - token.mem());
+    ConstMemory value (eq + 1, token.len() - (eq - token.mem()) - 1);
+
+    Ref<String> const name_str = grab (new (std::nothrow) String (name));
+
+    GParamSpec * const pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (proto_el), name_str->cstr());
+    if (!pspec) {
+      // gst_parse_launch() treats this as a recoverable error.
+        logD (chain_template, _func, "no property \"", name, "\" in element ",
+              GST_PLUGIN_FEATURE_NAME (element_spec->factory));
+        return false;
+    }
+
+    // Strings are unquoted by gst_value_deserialize().
+    if (pspec->value_type != G_TYPE_STRING
+        && value.len() >= 2
+        && value.mem() [0] == '"'
+        && value.mem() [value.len() - 1] == '"')
+    {
+        value = ConstMemory (value.mem() + 1, value.len() - 2);
+    }
+
+    PropertySpec * const prop_spec = new (std::nothrow) PropertySpec;
+    assert (prop_spec);
+    prop_spec->name = name_str;
+    g_value_init (&prop_spec->value, pspec->value_type);
+
+    Ref<String> const value_str = grab (new (std::nothrow) String (value));
+    if (!gst_value_deserialize (&prop_spec->value, value_str->cstr())) {
+        logD (chain_template, _func, "could not convert \"", value, "\" "
+              "for property \"", name, "\"");
+        delete prop_spec;
+        return false;
+    }
+
+    element_spec->prop_list.append (prop_spec);
+    return true;
+}
+
+bool
+ChainTemplate::doCompile (bool * const mt_nonnull ret_invalid)
+{
+    *ret_invalid = false;
+
+    List< Ref<String> > tokens;
+    tokenize (description->mem(), &tokens);
+
+    ChainSpec *chain_spec = NULL;
+    ElementSpec *element_spec = NULL;
+    // Prototype of the last element, for property lookups.
+    GstElement *proto_el = NULL;
+    bool link_pending = false;
+
+    bool ok = true;
+
+    List< Ref<String> >::Element *token_el = tokens.getFirstElement();
+    while (token_el) {
+        ConstMemory const token = token_el->data->mem();
+        token_el = token_el->next;
+
+        TokenType::Value const token_type = getTokenType (token);
+        switch (token_type) {
+            case TokenType::Link: {
+                if (!element_spec || link_pending) {
+                    ok = false;
+                    goto _return;
+                }
+
+                link_pending = true;
+            } break;
+            case TokenType::Element:
+            case TokenType::Caps: {
+                if (!link_pending) {
+                    if (token_type == TokenType::Caps) {
+                        ok = false;
+                        goto _return;
+                    }
+
+                    chain_spec = new (std::nothrow) ChainSpec;
+                    assert (chain_spec);
+                    chain_list.append (chain_spec);
+                }
+                link_pending = false;
+
+                element_spec = new (std::nothrow) ElementSpec;
+                assert (element_spec);
+                chain_spec->element_list.append (element_spec);
+
+                if (proto_el) {
+                    gst_object_unref (proto_el);
+                    proto_el = NULL;
+                }
+
+                if (token_type == TokenType::Caps) {
+                    Ref<String> const caps_str = grab (new (std::nothrow) String (token));
+                    element_spec->caps = gst_caps_from_string (caps_str->cstr());
+                    if (!element_spec->caps) {
+                        logE_ (_func, "could not parse caps \"", token, "\"");
+                        *ret_invalid = true;
+                        ok = false;
+                        goto _return;
+                    }
+
+                    element_spec->factory = gst_element_factory_find ("capsfilter");
+                } else {
+                    Ref<String> const factory_name = grab (new (std::nothrow) String (token));
+                    element_spec->factory = gst_element_factory_find (factory_name->cstr());
+                    if (!element_spec->factory) {
+                        logE_ (_func, "no element \"", token, "\"");
+                        *ret_invalid = true;
+                        ok = false;
+                        goto _return;
+                    }
+
+                    proto_el = gst_element_factory_create (element_spec->factory, NULL);
+                }
+
+                if (!element_spec->factory) {
+                    ok = false;
+                    goto _return;
+                }
+            } break;
+            case TokenType::Property: {
+                if (!proto_el || link_pending) {
+                    ok = false;
+                    goto _return;
+                }
+
+                if (!compileProperty (proto_el, element_spec, token)) {
+                    ok = false;
+                    goto _return;
+                }
+            } break;
+            case TokenType::Other: {
+                ok = false;
+                goto _return;
+            } break;
+        }
+    }
+
+    if (link_pending || chain_list.isEmpty())
+        ok = false;
+
+_return:
+    if (proto_el)
+        gst_object_unref (proto_el);
+
+    return ok;
+}
+
+void
+ChainTemplate::releaseChains ()
+{
+    while (!chain_list.isEmpty()) {
+        delete chain_list.getFirst();
+        chain_list.remove (chain_list.getFirstElement());
+    }
+}
+
+mt_const Result
+ChainTemplate::compile (ConstMemory const description,
+                        bool        const validate)
+{
+    this->description = grab (new (std::nothrow) String (description));
+
+    bool invalid;
+    if (doCompile (&invalid)) {
+        logD (chain_template, _func, "compiled: ", description);
+        return Result::Success;
+    }
+
+    releaseChains ();
+
+    if (invalid) {
+        logE_ (_func, "invalid chain: ", description);
+        return Result::Failure;
+    }
+
+    use_parser = true;
+
+    if (!validate) {
+        logD (chain_template, _func, "parsed on every use: ", description);
+        return Result::Success;
+    }
+
+    // Checking the description with the parser once, so that errors are
+    // reported now and not when the chain is first used.
+
+    GError *err = NULL;
+    GstElement * const el = gst_parse_launch (this->description->cstr(), &err);
+    if (!el) {
+        if (err) {
+            logE_ (_func, "invalid chain: ", description, ": ", err->message);
+            g_error_free (err);
+        } else {
+            logE_ (_func, "invalid chain: ", description);
+        }
+
+        return Result::Failure;
+    }
+
+    if (err) {
+        logW_ (_func, "chain: ", description, ": ", err->message);
+        g_error_free (err);
+    }
+
+    gst_object_unref (el);
+
+    logD (chain_template, _func, "parsed on every use: ", description);
+    return Result::Success;
+}
+
+ChainTemplate::ChainTemplate ()
+    : use_parser (false)
+{
+}
+
+ChainTemplate::~ChainTemplate ()
+{
+    releaseChains ();
+}
+
+Ref<ChainTemplate>
+ChainTemplateCache::getTemplate (ConstMemory const description,
+                                 bool        const validate)
+{
+    mutex.lock ();
+    if (Entry * const entry = entry_hash.lookup (description)) {
+        Ref<ChainTemplate> const chain_template = entry->chain_template;
+        mutex.unlock ();
+        return chain_template;
+    }
+    mutex.unlock ();
+
+    // Compiling without the lock: falling back to the parser creates a whole
+    // pipeline, which shouldn't hold up streams using other chains.
+    Ref<ChainTemplate> const chain_template = grab (new (std::nothrow) ChainTemplate);
+    if (!chain_template->compile (description, validate)) {
+      // Not cached, the description may be fixed by a config reload.
+        return NULL;
+    }
+
+    mutex.lock ();
+
+    // Another stream may have compiled the same description meanwhile.
+    if (Entry * const entry = entry_hash.lookup (description)) {
+        Ref<ChainTemplate> const existing_template = entry->chain_template;
+        mutex.unlock ();
+        return existing_template;
+    }
+
+    // Chains which are not in the config, e.g. with URIs of playlist items,
+    // would otherwise pile up between reloads.
+    if (num_entries >= MaxEntries) {
+        logD (chain_template, _func, "cache is full, clearing");
+        releaseEntries ();
+    }
+
+    Entry * const entry = new (std::nothrow) Entry;
+    assert (entry);
+    entry->description = grab (new (std::nothrow) String (description));
+    entry->chain_template = chain_template;
+    entry_hash.add (entry);
+    ++num_entries;
+
+    mutex.unlock ();
+
+    return chain_template;
+}
+
+mt_mutex (mutex) void
+ChainTemplateCache::releaseEntries ()
+{
+    List<Entry*> tmp_list;
+    {
+        EntryHash::iter iter (entry_hash);
+        while (!entry_hash.iter_done (iter))
+            tmp_list.append (entry_hash.iter_next (iter));
+    }
+
+    while (!tmp_list.isEmpty()) {
+        Entry * const entry = tmp_list.getFirst();
+        entry_hash.remove (entry);
+        delete entry;
+        tmp_list.remove (tmp_list.getFirstElement());
+    }
+
+    num_entries = 0;
+}
+
+void
+ChainTemplateCache::clear ()
+{
+    mutex.lock ();
+    releaseEntries ();
+    mutex.unlock ();
+}
+
+ChainTemplateCache::ChainTemplateCache ()
+    : num_entries (0)
+{
+}
+
+ChainTemplateCache::~ChainTemplateCache ()
+{
+    mutex.lock ();
+    releaseEntries ();
+    mutex.unlock ();
+}
+
+}
+
@@ -0,0 +1,183 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__CHAIN_TEMPLATE__H__
+#define MOMENT_GST__CHAIN_TEMPLATE__H__
+
+
+#include <libmary/libmary.h>
+#include <gst/gst.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// A pipeline description in gst-launch syntax, parsed once.
+//
+// Descriptions made of linear chains ("a prop=val ! caps ! b  c ! d") are
+// compiled: element factories are resolved and property values are
+// converted to GValues in advance, so instantiating the template is only
+// a matter of creating and linking elements. Anything more involved
+// (bins, references to named elements, URIs, child properties) is handed
+// over to gst_parse_launch() on every instantiation, as before.
+class ChainTemplate : public Referenced
+{
+private:
+    class PropertySpec
+    {
+    public:
+        mt_const Ref<String> name;
+        GValue value;
+
+        PropertySpec ();
+        ~PropertySpec ();
+    };
+
+    class ElementSpec
+    {
+    public:
+        mt_const GstElementFactory *factory;
+        // For capsfilters made out of bare caps in the description.
+        mt_const GstCaps *caps;
+
+        List<PropertySpec*> prop_list;
+
+        ElementSpec ();
+        ~ElementSpec ();
+    };
+
+    class ChainSpec
+    {
+    public:
+        List<ElementSpec*> element_list;
+
+        ~ChainSpec ();
+    };
+
+    mt_const Ref<String> description;
+
+    // 'true' if the description could not be compiled and should be passed
+    // to gst_parse_*() as is.
+    mt_const bool use_parser;
+
+    mt_const List<ChainSpec*> chain_list;
+
+    static void delayedLinkPadAdded (GstElement *element,
+                                     GstPad     *new_pad,
+                                     gpointer    _sink_el);
+
+    static Result linkElements (GstElement *src_el,
+                                GstElement *sink_el);
+
+    GstElement* createElement (ElementSpec * mt_nonnull element_spec);
+
+    Result fillBin (GstBin * mt_nonnull bin);
+
+    // Returns 'false' if the property can't be pre-set, in which case
+    // the description should be passed to the parser.
+    bool compileProperty (GstElement  * mt_nonnull proto_el,
+                          ElementSpec * mt_nonnull element_spec,
+                          ConstMemory   token);
+
+    // Returns 'false' if the description should be passed to the parser.
+    // Sets 'ret_invalid' if the description is certainly invalid.
+    bool doCompile (bool * mt_nonnull ret_invalid);
+
+    void releaseChains ();
+
+public:
+    ConstMemory getDescription () const { return description->mem(); }
+
+    // Returns a new top-level pipeline, as gst_parse_launch() does.
+    // Returns NULL on error.
+    GstElement* createPipeline ();
+
+    // Returns a new bin with unlinked sink and src pads ghosted as "sink" and
+    // "src", as gst_parse_bin_from_description() does with ghost_unlinked_pads
+    // set. Returns NULL on error.
+    GstElement* createBin ();
+
+    // Parses 'description' and checks that all elements and properties
+    // exist. Errors are logged. Descriptions which can't be compiled are
+    // only checked with the parser if 'validate' is set: that creates a whole
+    // pipeline, which is a waste when the template is about to be used.
+    mt_const Result compile (ConstMemory description,
+                             bool        validate);
+
+     ChainTemplate ();
+    ~ChainTemplate ();
+};
+
+// Compiled templates keyed by description. Failed compilations are not
+// remembered, so that a chain fixed by a config reload is picked up.
+// The cache is cleared on config reload, and when it grows over
+// 'MaxEntries' with descriptions which are not in the config.
+class ChainTemplateCache : public Object
+{
+private:
+    enum { MaxEntries = 4096 };
+
+    class Entry : public HashEntry<>
+    {
+    public:
+        mt_const Ref<String> description;
+        mt_const Ref<ChainTemplate> chain_template;
+    };
+
+    typedef Hash< Entry,
+                  Memory,
+                  MemberExtractor< Entry,
+                                   Ref<String>,
+                                   &Entry::description,
+                                   Memory,
+                                   AccessorExtractor< String,
+                                                      Memory,
+                                                      &String::mem > >,
+                  MemoryComparator<> >
+            EntryHash;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      EntryHash entry_hash;
+      Count num_entries;
+    mt_end
+
+    mt_mutex (mutex) void releaseEntries ();
+
+public:
+    // Returns NULL if 'description' is invalid. 'validate' should be set
+    // when parsing the config, see ChainTemplate::compile().
+    Ref<ChainTemplate> getTemplate (ConstMemory description,
+                                    bool        validate = false);
+
+    // Drops all templates. Templates which are in use stay valid.
+    void clear ();
+
+     ChainTemplateCache ();
+    ~ChainTemplateCache ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__CHAIN_TEMPLATE__H__ */
+
@@ -0,0 +1,88 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__COARSE_CLOCK__H__
+#define MOMENT_GST__COARSE_CLOCK__H__
+
+
+#include <libmary/libmary.h>
+
+#ifndef PLATFORM_WIN32
+#include <time.h>
+#endif
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Monotonic time in seconds, cheap enough to be read for every frame.
+// On Linux, CLOCK_MONOTONIC_COARSE is served from the vDSO without entering
+// the kernel. Values are only comparable with other getCoarseTime() values.
+static inline Time getCoarseTime ()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    if (clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) != 0) {
+      // Kernels older than 2.6.32 lack CLOCK_MONOTONIC_COARSE.
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+    }
+
+    return (Time) ts.tv_sec;
+#else
+    updateTime ();
+    return getTime ();
+#endif
+}
+
+// Same as getCoarseTime(), in milliseconds. The resolution is that of the
+// kernel tick, which is fine for measuring pipeline startup stages.
+static inline Time getCoarseTimeMilliseconds ()
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec ts;
+    if (clock_gettime (CLOCK_MONOTONIC_COARSE, &ts) != 0)
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return (Time) ts.tv_sec * 1000 + (Time) ts.tv_nsec / 1000000;
+#else
+    updateTime ();
+    return getTimeMilliseconds ();
+#endif
+}
+
+// Precise monotonic time in microseconds, for measuring per-frame latency.
+// Costs a bit more than getCoarseTimeMilliseconds().
+static inline Time getMonotonicTimeMicroseconds ()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (Time) ts.tv_sec * 1000000 + (Time) ts.tv_nsec / 1000;
+#else
+    updateTime ();
+    return getTimeMilliseconds () * 1000;
+#endif
+}
+
+}
+
+
+#endif /* MOMENT_GST__COARSE_CLOCK__H__ */
+
@@ -0,0 +1,359 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <unistd.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <moment-gst/coarse_clock.h>
+
+#include <moment-gst/encoder_scheduler.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_encsched ("mod_gst.encoder_scheduler", LogLevel::I);
+
+// An encoder is reported as slow when it encodes less than 90% of the input
+// frame rate, and as recovered at 95%.
+static Uint64 const slow_fps_percent      = 90;
+static Uint64 const recovered_fps_percent = 95;
+
+// Picks the 'cpu_count' consecutive cores which are used by the least number
+// of registered encoders. 'encoder' is not in 'encoder_list' yet.
+mt_mutex (mutex) void
+EncoderScheduler::placeEncoder (Encoder * const mt_nonnull encoder)
+{
+    Count cpu_count = encoder->num_threads;
+    if (cpu_count > num_cpus)
+        cpu_count = num_cpus;
+
+    Count best_first = 0;
+    Count best_load = 0;
+    for (Count cpu_first = 0; cpu_first + cpu_count <= num_cpus; ++cpu_first) {
+        Count load = 0;
+        List< Ref<Encoder> >::Element *el = encoder_list.getFirstElement();
+        while (el) {
+            Encoder * const other = el->data;
+
+            Count const first = (cpu_first > other->cpu_first ? cpu_first : other->cpu_first);
+            Count const last  = (cpu_first + cpu_count < other->cpu_first + other->cpu_count ?
+                                         cpu_first + cpu_count : other->cpu_first + other->cpu_count);
+            if (last > first)
+                load += last - first;
+
+            el = el->next;
+        }
+
+        if (cpu_first == 0 || load < best_load) {
+            best_first = cpu_first;
+            best_load = load;
+        }
+    }
+
+    encoder->cpu_first = best_first;
+    encoder->cpu_count = cpu_count;
+
+    logD (encsched, _func, "encoder \"", encoder->name, "\": "
+          "cores ", best_first, "-", best_first + cpu_count - 1, ", load ", best_load);
+}
+
+void
+EncoderScheduler::applyAffinity (Encoder * const mt_nonnull encoder)
+{
+    if (encoder->affinity_applied)
+        return;
+
+    encoder->affinity_applied = true;
+
+    mutex.lock ();
+    Count const cpu_first = encoder->cpu_first;
+    Count const cpu_count = encoder->cpu_count;
+    mutex.unlock ();
+
+    if (cpu_count == 0)
+        return;
+
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO (&cpu_set);
+    for (Count i = cpu_first; i < cpu_first + cpu_count; ++i)
+        CPU_SET (i, &cpu_set);
+
+    int const res = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set), &cpu_set);
+    if (res != 0) {
+        logW_ (_func, "encoder \"", encoder->name, "\": pthread_setaffinity_np() failed: ", res);
+        return;
+    }
+
+    logD (encsched, _func, "encoder \"", encoder->name, "\": cores ", cpu_first, "-", cpu_first + cpu_count - 1);
+#endif
+}
+
+// Runs before the buffer reaches the encoder, hence the first buffer binds
+// the thread before the encoder is opened by the buffer's caps.
+gboolean
+EncoderScheduler::queueOutputCb (GstPad    * const /* pad */,
+                                 GstBuffer * const /* buffer */,
+                                 gpointer    const _encoder)
+{
+    Encoder * const encoder = static_cast <Encoder*> (_encoder);
+    encoder->scheduler->applyAffinity (encoder);
+    return TRUE;
+}
+
+gboolean
+EncoderScheduler::encoderInputCb (GstPad    * const /* pad */,
+                                  GstBuffer * const buffer,
+                                  gpointer    const _encoder)
+{
+    Encoder * const encoder = static_cast <Encoder*> (_encoder);
+
+    if (encoder->target_fps_milli.load (std::memory_order_relaxed) == 0) {
+        GstCaps * const caps = GST_BUFFER_CAPS (buffer);
+        if (caps && gst_caps_get_size (caps) > 0) {
+            GstStructure * const st = gst_caps_get_structure (caps, 0);
+            gint fps_n = 0;
+            gint fps_d = 0;
+            if (gst_structure_get_fraction (st, "framerate", &fps_n, &fps_d)
+                && fps_n > 0 && fps_d > 0)
+            {
+                encoder->target_fps_milli.store ((Uint64) fps_n * 1000 / (Uint64) fps_d,
+                                                 std::memory_order_relaxed);
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+gboolean
+EncoderScheduler::encoderOutputCb (GstPad    * const /* pad */,
+                                   GstBuffer * const buffer,
+                                   gpointer    const _encoder)
+{
+    Encoder * const encoder = static_cast <Encoder*> (_encoder);
+
+    if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS))
+        encoder->num_frames.fetch_add (1, std::memory_order_relaxed);
+
+    return TRUE;
+}
+
+void
+EncoderScheduler::statsTimerTick (void * const _self)
+{
+    EncoderScheduler * const self = static_cast <EncoderScheduler*> (_self);
+
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    self->mutex.lock ();
+
+    List< Ref<Encoder> >::Element *el = self->encoder_list.getFirstElement();
+    while (el) {
+        Encoder * const encoder = el->data;
+        el = el->next;
+
+        Uint64 const num_frames = encoder->num_frames.load (std::memory_order_relaxed);
+        if (encoder->prv_stat_time == 0 || cur_time <= encoder->prv_stat_time) {
+            encoder->prv_stat_time = cur_time;
+            encoder->prv_num_frames = num_frames;
+            continue;
+        }
+
+        encoder->fps_milli = (num_frames - encoder->prv_num_frames) * 1000000
+                                     / (cur_time - encoder->prv_stat_time);
+        encoder->prv_stat_time = cur_time;
+        encoder->prv_num_frames = num_frames;
+
+        Uint64 const target_fps_milli = encoder->target_fps_milli.load (std::memory_order_relaxed);
+        if (target_fps_milli == 0)
+            continue;
+
+        if (!encoder->reported_slow
+            && encoder->fps_milli * 100 < target_fps_milli * slow_fps_percent)
+        {
+            encoder->reported_slow = true;
+            logW_ (_func, "encoder \"", encoder->name, "\" is falling behind: ",
+                   encoder->fps_milli / 1000, " fps, "
+                   "target ", target_fps_milli / 1000, " fps, "
+                   "threads: ", encoder->num_threads, ", cores: ", encoder->cpu_count);
+        } else
+        if (encoder->reported_slow
+            && encoder->fps_milli * 100 >= target_fps_milli * recovered_fps_percent)
+        {
+            encoder->reported_slow = false;
+            logI_ (_func, "encoder \"", encoder->name, "\" has caught up: ",
+                   encoder->fps_milli / 1000, " fps");
+        }
+    }
+
+    self->mutex.unlock ();
+}
+
+Ref<EncoderScheduler::Encoder>
+EncoderScheduler::addEncoder (ConstMemory const name)
+{
+    Ref<Encoder> const encoder = grab (new (std::nothrow) Encoder);
+    encoder->scheduler = this;
+    encoder->name = grab (new (std::nothrow) String (name));
+
+    mutex.lock ();
+
+    ++num_encoders;
+
+    Count num_threads = num_cpus / num_encoders;
+    if (num_threads == 0)
+        num_threads = 1;
+    if (num_threads > max_threads)
+        num_threads = max_threads;
+    encoder->num_threads = (Uint32) num_threads;
+
+    placeEncoder (encoder);
+    encoder->list_el = encoder_list.append (encoder);
+
+    mutex.unlock ();
+
+    logD (encsched, _func, "encoder \"", name, "\": ", num_threads, " threads");
+
+    return encoder;
+}
+
+void
+EncoderScheduler::removeEncoder (Encoder * const mt_nonnull encoder)
+{
+    mutex.lock ();
+
+    if (!encoder->list_el) {
+        mutex.unlock ();
+        return;
+    }
+
+    encoder_list.remove (encoder->list_el);
+    encoder->list_el = NULL;
+
+    assert (num_encoders > 0);
+    --num_encoders;
+
+    mutex.unlock ();
+}
+
+void
+EncoderScheduler::attach (Encoder    * const mt_nonnull encoder,
+                          GstElement * const mt_nonnull encoder_el,
+                          GstElement * const mt_nonnull queue_el)
+{
+    GstPad * const queue_src_pad = gst_element_get_static_pad (queue_el, "src");
+    if (queue_src_pad) {
+        gst_pad_add_buffer_probe (queue_src_pad, G_CALLBACK (queueOutputCb), encoder);
+        gst_object_unref (queue_src_pad);
+    }
+
+    GstPad * const sink_pad = gst_element_get_static_pad (encoder_el, "sink");
+    if (sink_pad) {
+        gst_pad_add_buffer_probe (sink_pad, G_CALLBACK (encoderInputCb), encoder);
+        gst_object_unref (sink_pad);
+    }
+
+    GstPad * const src_pad = gst_element_get_static_pad (encoder_el, "src");
+    if (src_pad) {
+        gst_pad_add_buffer_probe (src_pad, G_CALLBACK (encoderOutputCb), encoder);
+        gst_object_unref (src_pad);
+    }
+}
+
+void
+EncoderScheduler::getStats (List<EncoderStats> * const mt_nonnull ret_list)
+{
+    mutex.lock ();
+
+    List< Ref<Encoder> >::Element *el = encoder_list.getFirstElement();
+    while (el) {
+        Encoder * const encoder = el->data;
+
+        EncoderStats stats;
+        stats.name = encoder->name;
+        stats.num_threads = encoder->num_threads;
+        stats.cpu_first = encoder->cpu_first;
+        stats.cpu_count = encoder->cpu_count;
+        stats.fps_milli = encoder->fps_milli;
+        stats.target_fps_milli = encoder->target_fps_milli.load (std::memory_order_relaxed);
+        ret_list->append (stats);
+
+        el = el->next;
+    }
+
+    mutex.unlock ();
+}
+
+mt_const void
+EncoderScheduler::init (Count    const num_cpus,
+                        Uint32   const max_threads,
+                        Timers * const mt_nonnull timers)
+{
+    if (num_cpus > 0) {
+        this->num_cpus = num_cpus;
+    } else {
+        long const num_online = sysconf (_SC_NPROCESSORS_ONLN);
+        this->num_cpus = (num_online > 0 ? (Count) num_online : 1);
+    }
+
+    this->max_threads = (max_threads > 0 ? max_threads : 1);
+    this->timers = timers;
+
+    logI_ (_func, "cores: ", this->num_cpus, ", max threads per encoder: ", this->max_threads);
+
+    stats_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (statsTimerTick,
+                                                                   this /* cb_data */,
+                                                                   this /* coderef_container */),
+                                    5     /* time_seconds */,
+                                    true  /* periodical */,
+                                    false /* auto_delete */);
+}
+
+void
+EncoderScheduler::release ()
+{
+    mutex.lock ();
+    if (stats_timer) {
+        timers->deleteTimer (stats_timer);
+        stats_timer = NULL;
+    }
+    mutex.unlock ();
+}
+
+EncoderScheduler::EncoderScheduler ()
+    : num_cpus (1),
+      max_threads (1),
+      timers (NULL),
+      num_encoders (0),
+      stats_timer (NULL)
+{
+}
+
+EncoderScheduler::~EncoderScheduler ()
+{
+}
+
+}
+
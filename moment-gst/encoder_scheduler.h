@@ -0,0 +1,177 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__ENCODER_SCHEDULER__H__
+#define MOMENT_GST__ENCODER_SCHEDULER__H__
+
+
+#include <libmary/libmary.h>
+#include <atomic>
+#include <gst/gst.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Spreads video encoders of transcoded streams over CPU cores.
+//
+// Each encoder gets a share of 'num_cpus' cores when it is created: its
+// thread count and its core range are chosen then, the range being the least
+// loaded one at the time. Every encoder is fed by a queue, and the queue's
+// streaming thread is bound to the encoder's cores with the first frame,
+// before the encoder opens and spawns its worker threads, which inherit
+// the binding. Source and decoder threads are not affected.
+//
+// Placement is final for the lifetime of an encoder. Worker threads can't be
+// found once they've been spawned, hence the cores of running encoders are
+// never reassigned: when encoders go away, their cores are taken by encoders
+// created later. Load evens out as streams restart.
+//
+// Encoding frame rate of every encoder is measured against the input frame
+// rate.
+class EncoderScheduler : public Object
+{
+public:
+    class Encoder : public Referenced
+    {
+        friend class EncoderScheduler;
+
+    private:
+        mt_const EncoderScheduler *scheduler;
+        mt_const Ref<String> name;
+        mt_const Uint32 num_threads;
+
+        mt_mutex (EncoderScheduler::mutex)
+        mt_begin
+          List< Ref<Encoder> >::Element *list_el;
+          // First core and the number of cores assigned.
+          Count cpu_first;
+          Count cpu_count;
+          Uint64 prv_num_frames;
+          Time   prv_stat_time;
+          // Frames per second * 1000, as of the last stats tick.
+          Uint64 fps_milli;
+          bool   reported_slow;
+        mt_end
+
+        // Accessed from the queue's streaming thread only.
+        bool affinity_applied;
+
+        std::atomic<Uint64> num_frames;
+        std::atomic<Uint64> target_fps_milli;
+
+    public:
+        Uint32 getNumThreads () const { return num_threads; }
+
+        Encoder ()
+            : scheduler (NULL),
+              num_threads (1),
+              list_el (NULL),
+              cpu_first (0),
+              cpu_count (0),
+              prv_num_frames (0),
+              prv_stat_time (0),
+              fps_milli (0),
+              reported_slow (false),
+              affinity_applied (false),
+              num_frames (0),
+              target_fps_milli (0)
+        {}
+    };
+
+    struct EncoderStats
+    {
+        Ref<String> name;
+        Uint32 num_threads;
+        Count  cpu_first;
+        Count  cpu_count;
+        Uint64 fps_milli;
+        Uint64 target_fps_milli;
+    };
+
+private:
+    mt_const Count num_cpus;
+    mt_const Uint32 max_threads;
+    mt_const Timers *timers;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      List< Ref<Encoder> > encoder_list;
+      Count num_encoders;
+      Timers::TimerKey stats_timer;
+    mt_end
+
+    mt_mutex (mutex) void placeEncoder (Encoder * mt_nonnull encoder);
+
+    void applyAffinity (Encoder * mt_nonnull encoder);
+
+    static gboolean queueOutputCb (GstPad    *pad,
+                                   GstBuffer *buffer,
+                                   gpointer   _encoder);
+
+    static gboolean encoderInputCb (GstPad    *pad,
+                                    GstBuffer *buffer,
+                                    gpointer   _encoder);
+
+    static gboolean encoderOutputCb (GstPad    *pad,
+                                     GstBuffer *buffer,
+                                     gpointer   _encoder);
+
+    static void statsTimerTick (void *_self);
+
+public:
+    // Registers a new encoder. The thread count of the returned encoder
+    // should be used for the encoder element.
+    Ref<Encoder> addEncoder (ConstMemory name);
+
+    // Frees the encoder's cores for encoders created later.
+    // May be called more than once.
+    void removeEncoder (Encoder * mt_nonnull encoder);
+
+    // Installs pad probes which apply core binding on the output of
+    // 'queue_el', the last queue upstream of 'encoder_el', and count frames.
+    // 'encoder' should outlive both elements.
+    void attach (Encoder    * mt_nonnull encoder,
+                 GstElement * mt_nonnull encoder_el,
+                 GstElement * mt_nonnull queue_el);
+
+    // Fills 'ret_list' with stats of all registered encoders.
+    void getStats (List<EncoderStats> * mt_nonnull ret_list);
+
+    Count getNumCpus () const { return num_cpus; }
+
+    // 'num_cpus' of 0 stands for all online cores.
+    mt_const void init (Count   num_cpus,
+                        Uint32  max_threads,
+                        Timers * mt_nonnull timers);
+
+    void release ();
+
+     EncoderScheduler ();
+    ~EncoderScheduler ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__ENCODER_SCHEDULER__H__ */
+
@@ -0,0 +1,226 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/frame_delivery.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_delivery ("mod_gst.delivery", LogLevel::I);
+
+// Returns 'true' if any of the consumers has more frames pending.
+bool
+FrameDeliveryPool::deliverRound (Worker * const mt_nonnull worker)
+{
+    bool more = false;
+
+    worker->mutex.lock ();
+    List< Ref<Consumer> >::Element *el = worker->consumer_list.getFirstElement ();
+    while (el) {
+        Consumer * const consumer = el->data;
+        if (consumer->removed.load (std::memory_order_acquire)) {
+            List< Ref<Consumer> >::Element * const next_el = el->next;
+            worker->consumer_list.remove (el);
+            --worker->num_consumers;
+            el = next_el;
+            continue;
+        }
+
+        // 'el' stays valid while 'mutex' is released: elements are only
+        // unlinked by this thread.
+        worker->mutex.unlock ();
+
+        bool consumer_more = false;
+        if (consumer->frontend.call_ret<bool> (&consumer_more, consumer->frontend->deliverFrames)) {
+            if (consumer_more)
+                more = true;
+        }
+
+        worker->mutex.lock ();
+        el = el->next;
+    }
+    worker->mutex.unlock ();
+
+    return more;
+}
+
+void
+FrameDeliveryPool::workerThreadFunc (void * const _worker)
+{
+    Worker * const worker = static_cast <Worker*> (_worker);
+
+    logD (delivery, _func, "worker 0x", fmt_hex, (UintPtr) worker, " started");
+
+    for (;;) {
+        if (deliverRound (worker))
+            continue;
+
+        // The producer checks 'sleeping' after pushing a frame, and we check
+        // the rings after setting 'sleeping'. At least one of the two sides
+        // is guaranteed to see the other's update.
+        worker->sleeping.store (true, std::memory_order_seq_cst);
+        if (deliverRound (worker)) {
+            worker->sleeping.store (false, std::memory_order_relaxed);
+            continue;
+        }
+
+        worker->mutex.lock ();
+        while (!worker->wakeup_pending && !worker->stop)
+            worker->cond.wait (worker->mutex);
+
+        worker->wakeup_pending = false;
+        worker->sleeping.store (false, std::memory_order_relaxed);
+
+        if (worker->stop) {
+            worker->mutex.unlock ();
+            break;
+        }
+        worker->mutex.unlock ();
+    }
+
+    logD (delivery, _func, "worker 0x", fmt_hex, (UintPtr) worker, " stopped");
+}
+
+mt_mutex (mutex) void
+FrameDeliveryPool::startWorkers ()
+{
+    if (started)
+        return;
+
+    started = true;
+
+    logD (delivery, _func, "spawning ", num_workers, " delivery threads");
+
+    for (Count i = 0; i < num_workers; ++i) {
+        Worker * const worker = &workers [i];
+        worker->thread = grab (new (std::nothrow) Thread (
+                CbDesc<Thread::ThreadFunc> (workerThreadFunc, worker, this)));
+        if (!worker->thread->spawn (true /* joinable */))
+            logE_ (_func, "Failed to spawn delivery thread: ", exc->toString());
+    }
+}
+
+Ref<FrameDeliveryPool::Consumer>
+FrameDeliveryPool::addConsumer (CbDesc<Frontend> const &frontend)
+{
+    Ref<Consumer> const consumer = grab (new (std::nothrow) Consumer);
+    consumer->frontend = frontend;
+
+    mutex.lock ();
+    startWorkers ();
+    mutex.unlock ();
+
+    // Picking the least loaded worker.
+    Worker *worker = &workers [0];
+    worker->mutex.lock ();
+    Count min_consumers = worker->num_consumers;
+    worker->mutex.unlock ();
+    for (Count i = 1; i < num_workers; ++i) {
+        workers [i].mutex.lock ();
+        Count const cur_consumers = workers [i].num_consumers;
+        workers [i].mutex.unlock ();
+
+        if (cur_consumers < min_consumers) {
+            worker = &workers [i];
+            min_consumers = cur_consumers;
+        }
+    }
+
+    consumer->worker = worker;
+
+    worker->mutex.lock ();
+    worker->consumer_list.append (consumer);
+    ++worker->num_consumers;
+    worker->mutex.unlock ();
+
+    return consumer;
+}
+
+void
+FrameDeliveryPool::removeConsumer (Consumer * const mt_nonnull consumer)
+{
+    Worker * const worker = consumer->worker;
+
+    consumer->removed.store (true, std::memory_order_release);
+
+    // Waking up the worker so that the consumer gets unlinked.
+    worker->mutex.lock ();
+    worker->wakeup_pending = true;
+    worker->cond.signal ();
+    worker->mutex.unlock ();
+}
+
+void
+FrameDeliveryPool::wakeup (Consumer * const mt_nonnull consumer)
+{
+    Worker * const worker = consumer->worker;
+
+    // Pairs with the seq_cst store to 'sleeping' in workerThreadFunc().
+    std::atomic_thread_fence (std::memory_order_seq_cst);
+    if (!worker->sleeping.load (std::memory_order_seq_cst))
+        return;
+
+    worker->mutex.lock ();
+    worker->wakeup_pending = true;
+    worker->cond.signal ();
+    worker->mutex.unlock ();
+}
+
+mt_const void
+FrameDeliveryPool::init (Count const num_workers)
+{
+    this->num_workers = (num_workers > 0 ? num_workers : 1);
+    workers = new (std::nothrow) Worker [this->num_workers];
+    assert (workers);
+}
+
+void
+FrameDeliveryPool::release ()
+{
+    for (Count i = 0; i < num_workers; ++i) {
+        Worker * const worker = &workers [i];
+
+        worker->mutex.lock ();
+        worker->stop = true;
+        worker->cond.signal ();
+        Ref<Thread> const thread = worker->thread;
+        worker->thread = NULL;
+        worker->mutex.unlock ();
+
+        if (thread)
+            thread->join ();
+    }
+}
+
+FrameDeliveryPool::FrameDeliveryPool ()
+    : num_workers (0),
+      workers (NULL),
+      started (false)
+{
+}
+
+FrameDeliveryPool::~FrameDeliveryPool ()
+{
+    delete[] workers;
+}
+
+}
+
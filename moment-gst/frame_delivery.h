@@ -0,0 +1,134 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__FRAME_DELIVERY__H__
+#define MOMENT_GST__FRAME_DELIVERY__H__
+
+
+#include <libmary/libmary.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// A shared pool of delivery threads. Each consumer (a GstStream with
+// asynchronous delivery enabled) is bound to a single thread of the pool,
+// which makes that thread the only reader of the consumer's frame rings.
+class FrameDeliveryPool : public Object
+{
+public:
+    struct Frontend
+    {
+        // Fires a batch of queued frames. Should return 'true' if there are
+        // more frames pending.
+        bool (*deliverFrames) (void *cb_data);
+    };
+
+private:
+    class Worker;
+
+public:
+    class Consumer : public Referenced
+    {
+        friend class FrameDeliveryPool;
+
+    private:
+        mt_const Cb<Frontend> frontend;
+        mt_const Worker *worker;
+
+        std::atomic<bool> removed;
+
+    public:
+        Consumer ()
+            : worker  (NULL),
+              removed (false)
+        {}
+    };
+
+private:
+    class Worker
+    {
+    public:
+        StateMutex mutex;
+
+        mt_const Ref<Thread> thread;
+
+        // Set by the worker before going to sleep. Producers only take
+        // 'mutex' to wake the worker up when this is 'true'.
+        std::atomic<bool> sleeping;
+
+        mt_mutex (mutex)
+        mt_begin
+          Cond cond;
+          bool wakeup_pending;
+          bool stop;
+
+          // Elements are unlinked by the worker thread only.
+          List< Ref<Consumer> > consumer_list;
+          Count num_consumers;
+        mt_end
+
+        Worker ()
+            : sleeping (false),
+              wakeup_pending (false),
+              stop (false),
+              num_consumers (0)
+        {}
+    };
+
+    mt_const Count num_workers;
+    mt_const Worker *workers;
+
+    StateMutex mutex;
+    mt_mutex (mutex) bool started;
+
+    static void workerThreadFunc (void *_worker);
+
+    static bool deliverRound (Worker * mt_nonnull worker);
+
+    mt_mutex (mutex) void startWorkers ();
+
+public:
+    // Binds 'frontend' to one of the delivery threads. The threads are
+    // spawned when the first consumer is added.
+    Ref<Consumer> addConsumer (CbDesc<Frontend> const &frontend);
+
+    // Frames which are still queued will not be delivered after this call.
+    void removeConsumer (Consumer * mt_nonnull consumer);
+
+    // Called by the producer after pushing frames to the consumer's rings.
+    // Takes no locks unless the delivery thread is idle.
+    void wakeup (Consumer * mt_nonnull consumer);
+
+    mt_const void init (Count num_workers);
+
+    // Stops and joins delivery threads.
+    void release ();
+
+     FrameDeliveryPool ();
+    ~FrameDeliveryPool ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__FRAME_DELIVERY__H__ */
+
@@ -0,0 +1,299 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/coarse_clock.h>
+
+#include <moment-gst/frame_timeout_wheel.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_wheel ("mod_gst.novideo_wheel", LogLevel::I);
+
+mt_mutex (mutex) void
+FrameTimeoutWheel::insertWatch (Watch * const mt_nonnull watch)
+{
+    // Deadlines of the current second come from cascades only, which are
+    // made before the current slot is processed.
+    Time const deadline = (watch->deadline >= cur_time ? watch->deadline : cur_time + 1);
+
+    // The lowest level at which the deadline falls into the current turn
+    // of the wheel, so that its slot is still ahead. Deadlines beyond the
+    // top level pop out early and are inserted again.
+    unsigned level = 0;
+    while (level < NumLevels - 1
+           && (deadline >> (SlotBits * (level + 1))) != (cur_time >> (SlotBits * (level + 1))))
+    {
+        ++level;
+    }
+
+    unsigned const slot_idx = (unsigned) (deadline >> (SlotBits * level)) & (NumSlots - 1);
+
+    watch->slot = &slots [level] [slot_idx];
+    watch->slot_el = watch->slot->append (watch);
+}
+
+mt_mutex (mutex) void
+FrameTimeoutWheel::unlinkWatch (Watch * const mt_nonnull watch)
+{
+    if (!watch->slot)
+        return;
+
+    List< Ref<Watch> > * const slot = watch->slot;
+    List< Ref<Watch> >::Element * const slot_el = watch->slot_el;
+    watch->slot = NULL;
+    watch->slot_el = NULL;
+
+    // May release the last reference to the watch.
+    slot->remove (slot_el);
+}
+
+mt_mutex (mutex) void
+FrameTimeoutWheel::cascade (unsigned const level)
+{
+    List< Ref<Watch> > * const slot =
+            &slots [level] [(cur_time >> (SlotBits * level)) & (NumSlots - 1)];
+
+    List< Ref<Watch> > tmp_list;
+    while (!slot->isEmpty()) {
+        tmp_list.append (slot->getFirst());
+        slot->remove (slot->getFirstElement());
+    }
+
+    while (!tmp_list.isEmpty()) {
+        Watch * const watch = tmp_list.getFirst();
+        insertWatch (watch);
+        tmp_list.remove (tmp_list.getFirstElement());
+    }
+}
+
+mt_mutex (mutex) void
+FrameTimeoutWheel::advance (List< Ref<Watch> > * const mt_nonnull timeout_list,
+                            List< Ref<Watch> > * const mt_nonnull flowing_list)
+{
+    ++cur_time;
+
+    // Higher levels are cascaded when the lower level wraps around, top
+    // down, so that watches land in slots which have not been processed.
+    unsigned num_wrapped = 0;
+    while (num_wrapped < NumLevels - 1
+           && (cur_time & (((Time) 1 << (SlotBits * (num_wrapped + 1))) - 1)) == 0)
+    {
+        ++num_wrapped;
+    }
+
+    for (unsigned level = num_wrapped; level > 0; --level)
+        cascade (level);
+
+    List< Ref<Watch> > * const slot = &slots [0] [cur_time & (NumSlots - 1)];
+
+    List< Ref<Watch> > due_list;
+    while (!slot->isEmpty()) {
+        due_list.append (slot->getFirst());
+        slot->remove (slot->getFirstElement());
+    }
+
+    while (!due_list.isEmpty()) {
+        Ref<Watch> const watch = due_list.getFirst();
+        due_list.remove (due_list.getFirstElement());
+
+        watch->slot = NULL;
+        watch->slot_el = NULL;
+
+        if (watch->deadline > cur_time) {
+          // Popped out early from the top level.
+            insertWatch (watch);
+            continue;
+        }
+
+        Time const last_frame_time = watch->last_frame_time.load (std::memory_order_relaxed);
+        bool const got_frames = (last_frame_time != 0 && last_frame_time >= watch->start_time);
+        Time const ref_time = (got_frames ? last_frame_time : watch->start_time);
+
+        if (ref_time + watch->timeout > cur_time) {
+            watch->deadline = ref_time + watch->timeout;
+            insertWatch (watch);
+            ++num_rescheduled;
+
+            if (!watch->frames_reported) {
+                watch->frames_reported = true;
+                flowing_list->append (watch);
+            }
+
+            continue;
+        }
+
+        logD (wheel, _func, "watch 0x", fmt_hex, (UintPtr) watch.ptr(), " timed out");
+
+        watch->active = false;
+        --num_watches;
+        ++num_timeouts;
+        timeout_list->append (watch);
+    }
+}
+
+void
+FrameTimeoutWheel::tickTimer (void * const _self)
+{
+    FrameTimeoutWheel * const self = static_cast <FrameTimeoutWheel*> (_self);
+
+    Time const time = getCoarseTime ();
+
+    List< Ref<Watch> > timeout_list;
+    List< Ref<Watch> > flowing_list;
+
+    self->mutex.lock ();
+    while (self->cur_time < time)
+        self->advance (&timeout_list, &flowing_list);
+    self->mutex.unlock ();
+
+    while (!flowing_list.isEmpty()) {
+        Watch * const watch = flowing_list.getFirst();
+        watch->frontend.call (watch->frontend->framesFlowing);
+        flowing_list.remove (flowing_list.getFirstElement());
+    }
+
+    while (!timeout_list.isEmpty()) {
+        Watch * const watch = timeout_list.getFirst();
+        watch->frontend.call (watch->frontend->timeout);
+        timeout_list.remove (timeout_list.getFirstElement());
+    }
+}
+
+Ref<FrameTimeoutWheel::Watch>
+FrameTimeoutWheel::createWatch (CbDesc<Frontend> const &frontend)
+{
+    Ref<Watch> const watch = grab (new (std::nothrow) Watch);
+    watch->frontend = frontend;
+    return watch;
+}
+
+void
+FrameTimeoutWheel::start (Watch * const mt_nonnull watch,
+                          Time    const timeout)
+{
+    mutex.lock ();
+
+    if (watch->active)
+        unlinkWatch (watch);
+    else
+        ++num_watches;
+
+    watch->active = true;
+    watch->frames_reported = false;
+    watch->timeout = (timeout > 0 ? timeout : 1);
+    watch->start_time = cur_time;
+    watch->deadline = cur_time + watch->timeout;
+    insertWatch (watch);
+
+    mutex.unlock ();
+}
+
+void
+FrameTimeoutWheel::stop (Watch * const mt_nonnull watch)
+{
+    mutex.lock ();
+
+    if (watch->active) {
+        watch->active = false;
+        --num_watches;
+        unlinkWatch (watch);
+    }
+
+    mutex.unlock ();
+}
+
+void
+FrameTimeoutWheel::getStats (Stats * const mt_nonnull ret_stats)
+{
+    mutex.lock ();
+    ret_stats->num_watches     = num_watches;
+    ret_stats->num_timeouts    = num_timeouts;
+    ret_stats->num_rescheduled = num_rescheduled;
+    mutex.unlock ();
+}
+
+mt_const void
+FrameTimeoutWheel::init (Timers * const mt_nonnull timers)
+{
+    this->timers = timers;
+
+    mutex.lock ();
+    cur_time = getCoarseTime ();
+    tick_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (tickTimer,
+                                                                  this /* cb_data */,
+                                                                  this /* coderef_container */),
+                                   1     /* time_seconds */,
+                                   true  /* periodical */,
+                                   false /* auto_delete */);
+    mutex.unlock ();
+}
+
+void
+FrameTimeoutWheel::release ()
+{
+    mutex.lock ();
+
+    if (tick_timer) {
+        timers->deleteTimer (tick_timer);
+        tick_timer = NULL;
+    }
+
+    // Watches are released after unlocking: they may hold the last
+    // references to their streams.
+    List< Ref<Watch> > tmp_list;
+    for (unsigned level = 0; level < NumLevels; ++level) {
+        for (unsigned i = 0; i < NumSlots; ++i) {
+            List< Ref<Watch> > * const slot = &slots [level] [i];
+            while (!slot->isEmpty()) {
+                Watch * const watch = slot->getFirst();
+                watch->active = false;
+                watch->slot = NULL;
+                watch->slot_el = NULL;
+                tmp_list.append (watch);
+                slot->remove (slot->getFirstElement());
+            }
+        }
+    }
+    num_watches = 0;
+
+    mutex.unlock ();
+
+    while (!tmp_list.isEmpty())
+        tmp_list.remove (tmp_list.getFirstElement());
+}
+
+FrameTimeoutWheel::FrameTimeoutWheel ()
+    : timers (NULL),
+      cur_time (0),
+      num_watches (0),
+      num_timeouts (0),
+      num_rescheduled (0),
+      tick_timer (NULL)
+{
+}
+
+FrameTimeoutWheel::~FrameTimeoutWheel ()
+{
+}
+
+}
+
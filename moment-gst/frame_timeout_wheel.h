@@ -0,0 +1,160 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__FRAME_TIMEOUT_WHEEL__H__
+#define MOMENT_GST__FRAME_TIMEOUT_WHEEL__H__
+
+
+#include <libmary/libmary.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Detects streams which have stopped delivering frames, for all streams of
+// the module with a single timer.
+//
+// Watches sit in a hierarchical timing wheel with one second resolution,
+// keyed by their deadline: the time of the last frame plus the timeout.
+// Frames only update an atomic timestamp in the watch; the wheel is not
+// touched. When a deadline comes, the watch is moved to the new deadline if
+// frames have arrived meanwhile, and the frontend is called only for
+// watches which have actually timed out.
+class FrameTimeoutWheel : public Object
+{
+public:
+    struct Frontend
+    {
+        // No frames for the watch's timeout. The watch is stopped.
+        void (*timeout) (void *cb_data);
+
+        // Frames have been seen by the first deadline after start().
+        void (*framesFlowing) (void *cb_data);
+    };
+
+    class Watch : public Referenced
+    {
+        friend class FrameTimeoutWheel;
+
+    private:
+        mt_const Cb<Frontend> frontend;
+
+        // getCoarseTime() of the last frame, 0 if there were none.
+        std::atomic<Time> last_frame_time;
+
+        mt_mutex (FrameTimeoutWheel::mutex)
+        mt_begin
+          bool active;
+          bool frames_reported;
+          Time timeout;
+          Time start_time;
+          Time deadline;
+          // Slot list and element, valid if 'active'.
+          List< Ref<Watch> > *slot;
+          List< Ref<Watch> >::Element *slot_el;
+        mt_end
+
+    public:
+        // Called from streaming threads for every frame.
+        void frameReceived (Time const cur_time)
+            { last_frame_time.store (cur_time, std::memory_order_relaxed); }
+
+        Watch ()
+            : last_frame_time (0),
+              active (false),
+              frames_reported (false),
+              timeout (0),
+              start_time (0),
+              deadline (0),
+              slot (NULL),
+              slot_el (NULL)
+        {}
+    };
+
+    struct Stats
+    {
+        Count  num_watches;
+        Uint64 num_timeouts;
+        // Deadlines which have been moved because of new frames.
+        Uint64 num_rescheduled;
+    };
+
+private:
+    enum {
+        SlotBits  = 6,
+        NumSlots  = 1 << SlotBits,
+        // Three levels cover deadlines up to 64^3 seconds (about 3 days)
+        // away. Watches which are further away are cascaded repeatedly.
+        NumLevels = 3
+    };
+
+    mt_const Timers *timers;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      List< Ref<Watch> > slots [NumLevels] [NumSlots];
+      // The wheel has been advanced up to this time, in getCoarseTime() units.
+      Time cur_time;
+      Count  num_watches;
+      Uint64 num_timeouts;
+      Uint64 num_rescheduled;
+      Timers::TimerKey tick_timer;
+    mt_end
+
+    mt_mutex (mutex) void insertWatch (Watch * mt_nonnull watch);
+
+    mt_mutex (mutex) void unlinkWatch (Watch * mt_nonnull watch);
+
+    mt_mutex (mutex) void cascade (unsigned level);
+
+    // Moves the wheel one second forward. Watches which have timed out or
+    // which should report flowing frames are appended to the lists.
+    mt_mutex (mutex) void advance (List< Ref<Watch> > * mt_nonnull timeout_list,
+                                   List< Ref<Watch> > * mt_nonnull flowing_list);
+
+    static void tickTimer (void *_self);
+
+public:
+    Ref<Watch> createWatch (CbDesc<Frontend> const &frontend);
+
+    // Starts or restarts the watch with 'timeout' seconds from now.
+    void start (Watch * mt_nonnull watch,
+                Time    timeout);
+
+    void stop (Watch * mt_nonnull watch);
+
+    void getStats (Stats * mt_nonnull ret_stats);
+
+    mt_const void init (Timers * mt_nonnull timers);
+
+    void release ();
+
+     FrameTimeoutWheel ();
+    ~FrameTimeoutWheel ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__FRAME_TIMEOUT_WHEEL__H__ */
+
@@ -0,0 +1,244 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <atomic>
+
+#ifdef MOMENT_GST_FRAME_TRACE
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <moment-gst/frame_trace.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static std::atomic<Uint32> next_trace_stream_id (1);
+
+Uint32
+frameTraceNewStreamId ()
+{
+    return next_trace_stream_id.fetch_add (1, std::memory_order_relaxed);
+}
+
+#ifndef MOMENT_GST_FRAME_TRACE
+
+bool
+frameTraceEnabled ()
+{
+    return false;
+}
+
+void
+frameTraceDump (PagePool               * const mt_nonnull /* page_pool */,
+                PagePool::PageListHead * const mt_nonnull /* page_list */)
+{
+}
+
+#else
+
+namespace {
+
+class TraceRing
+{
+public:
+    enum { NumRecords = 4096 };
+
+    mt_const Uint32 ring_id;
+
+    // Written by the owning thread only.
+    std::atomic<Uint64> num_written;
+    FrameTraceRecord records [NumRecords];
+
+    // 'false' when the owning thread has exited and the ring may be taken
+    // over by a new thread. Old records are kept until overwritten.
+    mt_mutex (trace_mutex) bool in_use;
+
+    TraceRing ()
+        : ring_id (0),
+          num_written (0),
+          in_use (false)
+    {}
+};
+
+}
+
+// A plain pthread mutex: it has to be usable before libmary is initialized.
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+mt_mutex (trace_mutex) static List<TraceRing*> trace_ring_list;
+mt_mutex (trace_mutex) static Count num_trace_rings = 0;
+
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t  trace_key;
+
+static __thread TraceRing *thread_trace_ring = NULL;
+
+static void
+traceRingThreadExit (void * const _ring)
+{
+    TraceRing * const ring = static_cast <TraceRing*> (_ring);
+
+    pthread_mutex_lock (&trace_mutex);
+    ring->in_use = false;
+    pthread_mutex_unlock (&trace_mutex);
+}
+
+static void
+createTraceKey ()
+{
+    pthread_key_create (&trace_key, traceRingThreadExit);
+}
+
+static TraceRing*
+grabTraceRing ()
+{
+    pthread_once (&trace_key_once, createTraceKey);
+
+    TraceRing *ring = NULL;
+
+    pthread_mutex_lock (&trace_mutex);
+    {
+        List<TraceRing*>::Element *el = trace_ring_list.getFirstElement();
+        while (el) {
+            if (!el->data->in_use) {
+                ring = el->data;
+                break;
+            }
+            el = el->next;
+        }
+    }
+
+    if (!ring) {
+        ring = new (std::nothrow) TraceRing;
+        assert (ring);
+        ring->ring_id = (Uint32) num_trace_rings;
+        trace_ring_list.append (ring);
+        ++num_trace_rings;
+    }
+
+    ring->in_use = true;
+    pthread_mutex_unlock (&trace_mutex);
+
+    pthread_setspecific (trace_key, ring);
+    return ring;
+}
+
+bool
+frameTraceEnabled ()
+{
+    return true;
+}
+
+void
+frameTrace (FrameTraceEvent::Value const event,
+            Uint32                 const stream_id,
+            Uint64                 const timestamp_nanosec,
+            Size                   const size,
+            Uint32                 const buffer_flags,
+            Uint32                 const flags)
+{
+    TraceRing *ring = thread_trace_ring;
+    if (!ring) {
+        ring = grabTraceRing ();
+        thread_trace_ring = ring;
+    }
+
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC_COARSE, &ts);
+
+    Uint64 const idx = ring->num_written.load (std::memory_order_relaxed);
+    FrameTraceRecord * const record = &ring->records [idx % TraceRing::NumRecords];
+
+    record->time_microsec     = (Uint64) ts.tv_sec * 1000000 + (Uint64) ts.tv_nsec / 1000;
+    record->timestamp_nanosec = timestamp_nanosec;
+    record->stream_id         = stream_id;
+    record->size              = (uint32_t) size;
+    record->buffer_flags      = buffer_flags;
+    record->event             = (uint16_t) event;
+    record->flags             = (uint16_t) flags;
+
+    ring->num_written.store (idx + 1, std::memory_order_release);
+}
+
+static void
+dumpTraceRing (TraceRing              * const mt_nonnull ring,
+               PagePool               * const mt_nonnull page_pool,
+               PagePool::PageListHead * const mt_nonnull page_list)
+{
+    Uint64 const end = ring->num_written.load (std::memory_order_acquire);
+    Uint64 begin = (end > TraceRing::NumRecords ? end - TraceRing::NumRecords : 0);
+
+    // Copying first, then checking which of the copied records could have
+    // been overwritten by the owning thread in the meantime.
+    FrameTraceRecord * const snapshot = new (std::nothrow) FrameTraceRecord [TraceRing::NumRecords];
+    assert (snapshot);
+    for (Uint64 i = begin; i < end; ++i)
+        snapshot [i - begin] = ring->records [i % TraceRing::NumRecords];
+
+    std::atomic_thread_fence (std::memory_order_acquire);
+    Uint64 const new_end = ring->num_written.load (std::memory_order_relaxed);
+    Uint64 const valid_begin = (new_end >= TraceRing::NumRecords ? new_end - TraceRing::NumRecords + 1 : 0);
+    Size skip = 0;
+    if (valid_begin > begin) {
+        skip = (Size) (valid_begin > end ? end - begin : valid_begin - begin);
+        begin += skip;
+    }
+
+    FrameTraceRingHeader ring_header;
+    ring_header.ring_id       = ring->ring_id;
+    ring_header.num_records   = (uint32_t) (end - begin);
+    ring_header.total_records = end;
+
+    page_pool->getFillPages (page_list, ConstMemory ((Byte const *) &ring_header, sizeof (ring_header)));
+    page_pool->getFillPages (page_list,
+                             ConstMemory ((Byte const *) (snapshot + skip),
+                                          (Size) (end - begin) * sizeof (FrameTraceRecord)));
+
+    delete[] snapshot;
+}
+
+void
+frameTraceDump (PagePool               * const mt_nonnull page_pool,
+                PagePool::PageListHead * const mt_nonnull page_list)
+{
+    pthread_mutex_lock (&trace_mutex);
+
+    FrameTraceFileHeader file_header;
+    memcpy (file_header.magic, MOMENT_GST__FRAME_TRACE_MAGIC, sizeof (file_header.magic));
+    file_header.version     = FrameTraceFormatVersion;
+    file_header.record_size = sizeof (FrameTraceRecord);
+    file_header.num_rings   = (uint32_t) num_trace_rings;
+
+    page_pool->getFillPages (page_list, ConstMemory ((Byte const *) &file_header, sizeof (file_header)));
+
+    List<TraceRing*>::Element *el = trace_ring_list.getFirstElement();
+    while (el) {
+        dumpTraceRing (el->data, page_pool, page_list);
+        el = el->next;
+    }
+
+    pthread_mutex_unlock (&trace_mutex);
+}
+
+#endif // MOMENT_GST_FRAME_TRACE
+
+}
+
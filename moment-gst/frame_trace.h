@@ -0,0 +1,69 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__FRAME_TRACE__H__
+#define MOMENT_GST__FRAME_TRACE__H__
+
+
+#include <libmary/libmary.h>
+
+#include <moment-gst/frame_trace_format.h>
+
+
+// Tracepoints compile to nothing unless the module is configured with
+// --enable-frame-trace. Arguments are not evaluated in that case.
+#ifdef MOMENT_GST_FRAME_TRACE
+  #define MOMENT_GST__FRAME_TRACE(event, stream_id, timestamp_nanosec, size, buffer_flags, flags) \
+          ::MomentGst::frameTrace ((event), (stream_id), (timestamp_nanosec), (size), (buffer_flags), (flags))
+#else
+  #define MOMENT_GST__FRAME_TRACE(event, stream_id, timestamp_nanosec, size, buffer_flags, flags) \
+          do {} while (0)
+#endif
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Returns a new id for a GstStream to tag its trace records with.
+Uint32 frameTraceNewStreamId ();
+
+#ifdef MOMENT_GST_FRAME_TRACE
+// Appends a record to the calling thread's trace ring. Lock-free; takes
+// a lock only once per thread, when its ring is allocated.
+void frameTrace (FrameTraceEvent::Value event,
+                 Uint32                 stream_id,
+                 Uint64                 timestamp_nanosec,
+                 Size                   size,
+                 Uint32                 buffer_flags,
+                 Uint32                 flags);
+#endif
+
+bool frameTraceEnabled ();
+
+// Fills 'page_list' with a binary snapshot of all trace rings.
+// Records which are overwritten while the snapshot is taken are omitted.
+void frameTraceDump (PagePool               * mt_nonnull page_pool,
+                     PagePool::PageListHead * mt_nonnull page_list);
+
+}
+
+
+#endif /* MOMENT_GST__FRAME_TRACE__H__ */
+
@@ -0,0 +1,155 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+// Decodes frame trace dumps made with mod_gst_admin/frame_trace.
+//
+// Usage: moment-gst-trace-decode [-s stream_id] [dump_file]
+// Reads the dump from stdin if no file is given.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <inttypes.h>
+
+#include <moment-gst/frame_trace_format.h>
+
+
+using namespace MomentGst;
+
+static char const *
+eventName (unsigned const event)
+{
+    switch (event) {
+        case FrameTraceEvent::AudioFrame:     return "audio";
+        case FrameTraceEvent::VideoFrame:     return "video";
+        case FrameTraceEvent::AudioCodecData: return "audio_codec_data";
+        case FrameTraceEvent::VideoCodecData: return "video_codec_data";
+        case FrameTraceEvent::AudioSkip:      return "audio_skip";
+        case FrameTraceEvent::VideoSkip:      return "video_skip";
+        case FrameTraceEvent::AudioDrop:      return "audio_drop";
+        case FrameTraceEvent::VideoDrop:      return "video_drop";
+    }
+
+    return "unknown";
+}
+
+static char const *
+skipReasonName (unsigned const reason)
+{
+    switch (reason) {
+        case FrameTraceSkipReason::SkipCounter:         return "skip_counter";
+        case FrameTraceSkipReason::Preroll:             return "preroll";
+        case FrameTraceSkipReason::InCapsOrNoTimestamp: return "in_caps_or_no_timestamp";
+        case FrameTraceSkipReason::NoCodecData:         return "no_codec_data";
+        case FrameTraceSkipReason::Qos:                 return "qos";
+    }
+
+    return "unknown";
+}
+
+int main (int argc, char **argv)
+{
+    bool     filter_stream = false;
+    uint32_t stream_id     = 0;
+    char const *filename   = NULL;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp (argv [i], "-s") && i + 1 < argc) {
+            filter_stream = true;
+            stream_id = (uint32_t) strtoul (argv [i + 1], NULL, 10);
+            ++i;
+        } else
+        if (!filename) {
+            filename = argv [i];
+        } else {
+            fprintf (stderr, "Usage: %s [-s stream_id] [dump_file]\n", argv [0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE * const file = (filename ? fopen (filename, "rb") : stdin);
+    if (!file) {
+        fprintf (stderr, "Could not open %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    FrameTraceFileHeader file_header;
+    if (fread (&file_header, sizeof (file_header), 1, file) != 1
+        || memcmp (file_header.magic, MOMENT_GST__FRAME_TRACE_MAGIC, sizeof (file_header.magic)))
+    {
+        fprintf (stderr, "Not a frame trace dump\n");
+        return EXIT_FAILURE;
+    }
+
+    if (file_header.version != FrameTraceFormatVersion
+        || file_header.record_size != sizeof (FrameTraceRecord))
+    {
+        fprintf (stderr, "Unsupported dump format: version %u, record size %u\n",
+                 (unsigned) file_header.version, (unsigned) file_header.record_size);
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < file_header.num_rings; ++i) {
+        FrameTraceRingHeader ring_header;
+        if (fread (&ring_header, sizeof (ring_header), 1, file) != 1) {
+            fprintf (stderr, "Truncated dump\n");
+            return EXIT_FAILURE;
+        }
+
+        printf ("# ring %u: %u records, %" PRIu64 " total\n",
+                (unsigned) ring_header.ring_id,
+                (unsigned) ring_header.num_records,
+                ring_header.total_records);
+
+        for (uint32_t j = 0; j < ring_header.num_records; ++j) {
+            FrameTraceRecord record;
+            if (fread (&record, sizeof (record), 1, file) != 1) {
+                fprintf (stderr, "Truncated dump\n");
+                return EXIT_FAILURE;
+            }
+
+            if (filter_stream && record.stream_id != stream_id)
+                continue;
+
+            printf ("%" PRIu64 ".%06" PRIu64 " ring %u stream %u %s ts %" PRIu64 " size %u buffer_flags 0x%x",
+                    record.time_microsec / 1000000,
+                    record.time_microsec % 1000000,
+                    (unsigned) ring_header.ring_id,
+                    (unsigned) record.stream_id,
+                    eventName (record.event),
+                    record.timestamp_nanosec,
+                    (unsigned) record.size,
+                    (unsigned) record.buffer_flags);
+
+            if (record.event == FrameTraceEvent::AudioSkip
+                || record.event == FrameTraceEvent::VideoSkip)
+            {
+                printf (" reason %s", skipReasonName (record.flags));
+            }
+
+            printf ("\n");
+        }
+    }
+
+    if (file != stdin)
+        fclose (file);
+
+    return 0;
+}
+
@@ -0,0 +1,106 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__FRAME_TRACE_FORMAT__H__
+#define MOMENT_GST__FRAME_TRACE_FORMAT__H__
+
+
+// Binary layout of frame trace dumps (mod_gst_admin/frame_trace).
+// Shared with moment-gst-trace-decode, hence no libmary dependencies.
+//
+// A dump is a FrameTraceFileHeader followed by 'num_rings' sections.
+// Each section is a FrameTraceRingHeader followed by 'num_records'
+// FrameTraceRecords, oldest first. All fields are in host byte order.
+
+#include <stdint.h>
+
+
+namespace MomentGst {
+
+enum {
+    FrameTraceFormatVersion = 1
+};
+
+#define MOMENT_GST__FRAME_TRACE_MAGIC "MGFT"
+
+struct FrameTraceFileHeader
+{
+    char     magic [4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_rings;
+};
+
+struct FrameTraceRingHeader
+{
+    // One ring per thread that has emitted trace records.
+    uint32_t ring_id;
+    uint32_t num_records;
+    // Records written to the ring since it was created, including the ones
+    // which have been overwritten.
+    uint64_t total_records;
+};
+
+struct FrameTraceEvent
+{
+    enum Value {
+        AudioFrame = 1,
+        VideoFrame,
+        AudioCodecData,
+        VideoCodecData,
+        AudioSkip,
+        VideoSkip,
+        AudioDrop,
+        VideoDrop
+    };
+};
+
+// 'flags' values for AudioSkip/VideoSkip events.
+struct FrameTraceSkipReason
+{
+    enum Value {
+        SkipCounter = 1,
+        Preroll,
+        InCapsOrNoTimestamp,
+        NoCodecData,
+        // Non-reference frame dropped by QosController.
+        Qos
+    };
+};
+
+struct FrameTraceRecord
+{
+    // CLOCK_MONOTONIC_COARSE at the moment the record was written.
+    uint64_t time_microsec;
+    // GST_BUFFER_TIMESTAMP of the traced buffer.
+    uint64_t timestamp_nanosec;
+    // GstStream trace id, reported by mod_gst_admin/stream_stats.
+    uint32_t stream_id;
+    uint32_t size;
+    uint32_t buffer_flags;
+    uint16_t event;
+    // Event-specific. Skip reason for AudioSkip/VideoSkip.
+    uint16_t flags;
+};
+
+}
+
+
+#endif /* MOMENT_GST__FRAME_TRACE_FORMAT__H__ */
+
@@ -17,6 +17,11 @@
 */
 
 
+#include <moment-gst/adts.h>
+#include <moment-gst/coarse_clock.h>
+#include <moment-gst/frame_trace.h>
+#include <moment-gst/h264.h>
+
 #include <moment-gst/gst_stream.h>
 
 
@@ -47,53 +52,53 @@ GstStream::deferredTask (void * const _self)
     return false /* do not reschedule */;
 }
 
-void
-GstStream::workqueueThreadFunc (void * const _self)
+PipelineControlPool::Frontend const GstStream::pipeline_pool_frontend = {
+    processWorkItem
+};
+
+// Called by one pipeline control thread at a time.
+bool
+GstStream::processWorkItem (void * const _self)
 {
     GstStream * const self = static_cast <GstStream*> (_self);
 
-    updateTime ();
-
     logD (pipeline, _self_func_);
 
     self->mutex.lock ();
 
-    self->tlocal = libMary_getThreadLocal();
+    // Once the stream is closed, pending items are dropped.
+    if (self->stream_closed || self->workqueue_list.isEmpty()) {
+        self->mutex.unlock ();
+        return false;
+    }
 
-    for (;;) {
-        if (self->stream_closed) {
-            self->mutex.unlock ();
-            return;
-        }
+    Ref<WorkqueueItem> const workqueue_item = self->workqueue_list.getFirst();
+    self->workqueue_list.remove (self->workqueue_list.getFirstElement());
 
-        while (self->workqueue_list.isEmpty()) {
-            self->workqueue_cond.wait (self->mutex);
-            updateTime ();
+    self->mutex.unlock ();
 
-            if (self->stream_closed) {
-                self->mutex.unlock ();
-                return;
-            }
-        }
+    switch (workqueue_item->item_type) {
+        case WorkqueueItem::ItemType_CreatePipeline:
+            self->doCreatePipeline ();
+            break;
+        case WorkqueueItem::ItemType_ReleasePipeline:
+            self->doReleasePipeline ();
+            break;
+        default:
+            unreachable ();
+    }
 
-        Ref<WorkqueueItem> const workqueue_item = self->workqueue_list.getFirst();
-        self->workqueue_list.remove (self->workqueue_list.getFirstElement());
+    self->mutex.lock ();
 
-        self->mutex.unlock ();
+    if (workqueue_item->item_type == WorkqueueItem::ItemType_ReleasePipeline) {
+        self->pipeline_released = true;
+        self->release_cond.signal ();
+    }
 
-        switch (workqueue_item->item_type) {
-            case WorkqueueItem::ItemType_CreatePipeline:
-                self->doCreatePipeline ();
-                break;
-            case WorkqueueItem::ItemType_ReleasePipeline:
-                self->doReleasePipeline ();
-                break;
-            default:
-                unreachable ();
-        }
+    bool const more = !self->stream_closed && !self->workqueue_list.isEmpty();
+    self->mutex.unlock ();
 
-        self->mutex.lock ();
-    }
+    return more;
 }
 
 void
@@ -114,16 +119,13 @@ GstStream::createPipelineForChainSpec ()
     GstElement *mix_audio_el = NULL;
 
   {
-    GError *error = NULL;
-    chain_el = gst_parse_launch (playback_item->stream_spec->cstr(), &error);
-    if (!chain_el) {
-	if (error) {
-	    logE_ (_func, "gst_parse_launch() failed: ", error->code,
-		   " ", error->message);
-	} else {
-	    logE_ (_func, "gst_parse_launch() failed");
-	}
+    Ref<ChainTemplate> const chain_template = chain_cache->getTemplate (playback_item->stream_spec->mem());
+    if (chain_template)
+        chain_el = chain_template->createPipeline ();
 
+    if (!chain_el) {
+        logE_ (_func, "could not create chain \"", channel_opts->channel_name, "\". "
+               "Chain spec: ", playback_item->stream_spec);
 	mutex.lock ();
 	goto _failure;
     }
@@ -552,6 +554,11 @@ GstStream::createSmartPipelineForUri ()
     g_signal_connect (decodebin, "autoplug-continue", G_CALLBACK (decodebinAutoplugContinue), this);
     g_signal_connect (decodebin, "pad-added", G_CALLBACK (decodebinPadAdded), this);
 
+    if (stream_opts->low_latency) {
+        g_signal_connect (decodebin, "notify::source", G_CALLBACK (uriDecodebinSourceNotify), this);
+        g_signal_connect (decodebin, "element-added", G_CALLBACK (uriDecodebinElementAdded), this);
+    }
+
     this->playbin = pipeline;
 //    logD_ (_this_func, "this->playbin: 0x", fmt_hex, (UintPtr) this->playbin);
     gst_object_ref (this->playbin);
@@ -641,34 +648,90 @@ static bool isRawVideoCaps (GstCaps * const caps)
     return false;
 }
 
-static bool isMpegAudioCaps (GstCaps * const caps)
+namespace {
+struct PassthroughFormat
 {
-    for (guint i = 0, i_end = gst_caps_get_size (caps); i < i_end; ++i) {
-        GstStructure * const ref_structure = gst_caps_get_structure (caps, i);
-        gchar const * const name = gst_structure_get_name (ref_structure);
-        if (equal (ConstMemory (name, strlen (name)), "audio/mpeg")) {
-            gboolean val = false;
-            if (gst_structure_get_boolean (ref_structure, "framed", &val) && val)
-                return true;
+    char const *media_type;
+    bool is_video;
+    // Boolean field which should be set in caps, NULL if none.
+    char const *required_flag;
+    // Required value of "layout" field, NULL if any.
+    char const *layout;
+    // Zero-terminated list of sample rates which RTMP can carry for
+    // the codec, NULL if any.
+    gint const *rates;
+    char const *codec_name;
+};
+}
+
+static gint const speex_rates      [] = { 16000, 0 };
+static gint const nellymoser_rates [] = { 5512, 8000, 11025, 16000, 22050, 44100, 0 };
+static gint const adpcm_rates      [] = { 5512, 11025, 22050, 44100, 0 };
+static gint const g711_rates       [] = { 8000, 0 };
+
+// Compressed formats which doAudioData() and doVideoData() map to RTMP
+// codec ids. decodebin stops at these instead of decoding them.
+static PassthroughFormat const passthrough_formats [] = {
+    { "audio/mpeg",           false, "framed", NULL,  NULL,             "mpeg audio"   },
+    { "audio/x-speex",        false, NULL,     NULL,  speex_rates,      "speex"        },
+    { "audio/x-nellymoser",   false, NULL,     NULL,  nellymoser_rates, "nellymoser"   },
+    { "audio/x-adpcm",        false, NULL,     "swf", adpcm_rates,      "adpcm"        },
+    { "audio/x-alaw",         false, NULL,     NULL,  g711_rates,       "g.711 a-law"  },
+    { "audio/x-mulaw",        false, NULL,     NULL,  g711_rates,       "g.711 mu-law" },
+
+    { "video/x-h264",         true,  "parsed", NULL,  NULL,             "h.264"        },
+    { "video/x-flash-video",  true,  NULL,     NULL,  NULL,             "sorenson"     },
+    { "video/x-vp6-flash",    true,  NULL,     NULL,  NULL,             "vp6"          },
+    { "video/x-flash-screen", true,  NULL,     NULL,  NULL,             "screen video" }
+};
+
+static bool structureMatchesPassthroughFormat (GstStructure            * const st,
+                                               PassthroughFormat const * const format)
+{
+    gchar const * const name = gst_structure_get_name (st);
+    if (!equal (ConstMemory (name, strlen (name)), format->media_type))
+        return false;
+
+    if (format->required_flag) {
+        gboolean val = false;
+        if (!gst_structure_get_boolean (st, format->required_flag, &val) || !val)
+            return false;
+    }
+
+    if (format->layout) {
+        gchar const * const layout = gst_structure_get_string (st, "layout");
+        if (!layout || !equal (ConstMemory (layout, strlen (layout)), format->layout))
+            return false;
+    }
+
+    if (format->rates) {
+        // Unfixed rate is left for the parser to settle.
+        gint rate = 0;
+        if (gst_structure_get_int (st, "rate", &rate)) {
+            gint const *cur_rate = format->rates;
+            while (*cur_rate && *cur_rate != rate)
+                ++cur_rate;
+
+            if (!*cur_rate)
+                return false;
         }
     }
 
-    return false;
+    return true;
 }
 
-static bool isH264VideoCaps (GstCaps * const caps)
+// Returns NULL if the stream should be decoded.
+static PassthroughFormat const * findPassthroughFormat (GstCaps * const caps)
 {
     for (guint i = 0, i_end = gst_caps_get_size (caps); i < i_end; ++i) {
-        GstStructure * const ref_structure = gst_caps_get_structure (caps, i);
-        gchar const * const name = gst_structure_get_name (ref_structure);
-        if (equal (ConstMemory (name, strlen (name)), "video/x-h264")) {
-            gboolean val = false;
-            if (gst_structure_get_boolean (ref_structure, "parsed", &val) && val)
-                return true;
+        GstStructure * const st = gst_caps_get_structure (caps, i);
+        for (unsigned j = 0; j < sizeof (passthrough_formats) / sizeof (passthrough_formats [0]); ++j) {
+            if (structureMatchesPassthroughFormat (st, &passthrough_formats [j]))
+                return &passthrough_formats [j];
         }
     }
 
-    return false;
+    return NULL;
 }
 
 gboolean
@@ -687,21 +750,21 @@ GstStream::decodebinAutoplugContinue (GstElement * const /* bin */,
         g_free (str);
     }
 
-    if (!self->playback_item->force_transcode && !self->playback_item->force_transcode_audio) {
-        if (isMpegAudioCaps (caps)) {
-            logD (plug, _func, "autoplugged mpeg audio");
-            return FALSE;
-        }
-    }
+    if (self->playback_item->force_transcode)
+        return TRUE;
 
-    if (!self->playback_item->force_transcode && !self->playback_item->force_transcode_video) {
-        if (isH264VideoCaps (caps)) {
-            logD (plug, _func, "autoplugged h.264 video");
-            return FALSE;
-        }
+    PassthroughFormat const * const format = findPassthroughFormat (caps);
+    if (!format)
+        return TRUE;
+
+    if (format->is_video ? self->playback_item->force_transcode_video
+                         : self->playback_item->force_transcode_audio)
+    {
+        return TRUE;
     }
 
-    return TRUE;
+    logD (plug, _func, "autoplugged ", format->codec_name);
+    return FALSE;
 }
 
 void
@@ -753,15 +816,12 @@ GstStream::decodebinPadAdded (GstElement * const /* element */,
         return;
     }
 
-    if (isMpegAudioCaps (caps)) {
-        // TODO Process AAC and MP3
-        self->setAudioPad (new_pad);
-        gst_caps_unref (caps);
-        return;
-    }
+    if (PassthroughFormat const * const format = findPassthroughFormat (caps)) {
+        if (format->is_video)
+            self->setVideoPad (new_pad);
+        else
+            self->setAudioPad (new_pad);
 
-    if (isH264VideoCaps (caps)) {
-        self->setVideoPad (new_pad);
         gst_caps_unref (caps);
         return;
     }
@@ -770,6 +830,63 @@ GstStream::decodebinPadAdded (GstElement * const /* element */,
     gst_caps_unref (caps);
 }
 
+static bool hasProperty (gpointer      const obj,
+                         gchar const * const name)
+{
+    return g_object_class_find_property (G_OBJECT_GET_CLASS (obj), name) != NULL;
+}
+
+void
+GstStream::uriDecodebinSourceNotify (GObject    * const uridecodebin,
+                                     GParamSpec * const /* pspec */,
+                                     gpointer     const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+
+    GObject *source = NULL;
+    g_object_get (uridecodebin, "source", &source, NULL);
+    if (!source)
+        return;
+
+    // rtspsrc holds packets for 2 seconds by default.
+    if (hasProperty (source, "latency")) {
+        logD (plug, _func, "source latency: ", self->stream_opts->source_latency_millisec);
+        g_object_set (source, "latency", (guint) self->stream_opts->source_latency_millisec, NULL);
+    }
+
+    // Packets which come too late are dropped instead of delaying the rest.
+    if (hasProperty (source, "drop-on-latency"))
+        g_object_set (source, "drop-on-latency", TRUE, NULL);
+
+    g_object_unref (source);
+}
+
+void
+GstStream::uriDecodebinElementAdded (GstBin     * const /* bin */,
+                                     GstElement * const element,
+                                     gpointer     const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+
+    GstElementFactory * const factory = gst_element_get_factory (element);
+    if (!factory)
+        return;
+
+    gchar const * const factory_name = gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory));
+    if (!equal (ConstMemory (factory_name, strlen (factory_name)), "decodebin2")
+        || !hasProperty (element, "max-size-time"))
+    {
+        return;
+    }
+
+    // Multiqueue raises its limits when one of the streams runs dry, so
+    // a small time limit doesn't stall interleaved streams.
+    logD (plug, _func, "decodebin max-size-time: ", self->stream_opts->source_latency_millisec, " ms");
+    g_object_set (G_OBJECT (element),
+                  "max-size-time", (guint64) self->stream_opts->source_latency_millisec * 1000000,
+                  NULL);
+}
+
 mt_unlocks (mutex) void
 GstStream::doSetPad (GstPad            * const pad,
                      ConstMemory         const sink_el_name,
@@ -781,21 +898,34 @@ GstStream::doSetPad (GstPad            * const pad,
     GstElement *encoder_bin = NULL;
 
     {
-        GError *err = NULL;
         // TODO configurable encoder
-        String const chain_str (chain);
-        logD (plug, _func, "calling gst_parse_bin_from_description()");
-        encoder_bin = gst_parse_bin_from_description (chain_str.cstr(),
-                                                      TRUE /* ghost_unlinked_pads */,
-                                                      &err);
-        logD (plug, _func, "gst_parse_bin_from_description() returned");
+        Ref<ChainTemplate> const chain_template = chain_cache->getTemplate (chain);
+        if (chain_template)
+            encoder_bin = chain_template->createBin ();
+
         if (!encoder_bin) {
-            logE_ (_func, "gst_parse_bin_from_description() failed: ", err->message);
+            logE_ (_func, "could not create bin for chain: ", chain);
             goto _failure;
         }
+    }
 
-        if (err)
-            logE_ (_func, "gst_parse_bin_from_description() recoverable error: ", err->message);
+    if (equal (sink_el_name, "video")) {
+        List<ScheduledEncoder>::Element *el = scheduled_encoders.getFirstElement();
+        while (el) {
+            GstElement * const encoder_el =
+                    gst_bin_get_by_name (GST_BIN (encoder_bin), el->data.element_name->cstr());
+            GstElement * const queue_el =
+                    gst_bin_get_by_name (GST_BIN (encoder_bin), el->data.queue_name->cstr());
+            if (encoder_el && queue_el)
+                encoder_scheduler->attach (el->data.encoder, encoder_el, queue_el);
+
+            if (encoder_el)
+                gst_object_unref (encoder_el);
+            if (queue_el)
+                gst_object_unref (queue_el);
+
+            el = el->next;
+        }
     }
 
     if (media_data_cb) {
@@ -818,6 +948,27 @@ GstStream::doSetPad (GstPad            * const pad,
 
         gst_object_unref (sink_pad);
         gst_object_unref (sink_el);
+
+        // Rendition sinks are only present in chains made by setRawVideoPad().
+        if (equal (sink_el_name, "video")) {
+            for (Count i = 0; i < num_rendition_outputs; ++i) {
+                Ref<String> const rendition_sink_name = makeString ("video_r", i);
+                GstElement * const rendition_sink_el =
+                        gst_bin_get_by_name (GST_BIN (encoder_bin), rendition_sink_name->cstr());
+                if (!rendition_sink_el)
+                    break;
+
+                GstPad * const rendition_sink_pad = gst_element_get_static_pad (rendition_sink_el, "sink");
+                if (rendition_sink_pad) {
+                    gst_pad_add_buffer_probe (rendition_sink_pad,
+                                              G_CALLBACK (renditionVideoDataCb),
+                                              &rendition_outputs [i]);
+                    gst_object_unref (rendition_sink_pad);
+                }
+
+                gst_object_unref (rendition_sink_el);
+            }
+        }
     }
 
     {
@@ -827,6 +978,16 @@ GstStream::doSetPad (GstPad            * const pad,
             goto _failure;
         }
 
+        if (latency.isEnabled() && equal (sink_el_name, "video"))
+            gst_pad_add_buffer_probe (sink_pad, G_CALLBACK (latencyStampCb), this);
+
+        // Raw frames are dropped ahead of the tee, so that all renditions
+        // get the same frames.
+        if (video_transcoded && qos.isEnabled() && equal (sink_el_name, "video")) {
+            gst_pad_add_buffer_probe (sink_pad, G_CALLBACK (qosRawVideoDataCb), this);
+            qos.setCanReduceFrameRate ();
+        }
+
         GstElement * const tmp_playbin = this->playbin;
         gst_object_ref (tmp_playbin);
         // TODO unref
@@ -959,30 +1120,111 @@ GstStream::doSetVideoPad (GstPad      * const pad,
 void
 GstStream::setRawAudioPad (GstPad * const pad)
 {
-    // TODO Configurable bitrate for faac
     StRef<String> const chain =
-            st_makeString ("audioconvert ! audioresample ! audio/x-raw-int,channels=2 ! "
-                           "faac",
-                           (playback_item->aac_perfect_timestamp ? " perfect-timestamp=true" : ""),
-                           " ! audio/mpeg,mpegversion=4,channels=2,base-profile=lc ! "
-                           "fakesink name=audio",
-                           (playback_item->sync_to_clock ? " sync=true" : ""));
-    logD_ (_func, "chain: ", chain);
+            stream_opts->transcode_profile->makeAudioChain (playback_item->aac_perfect_timestamp,
+                                                            syncToClock ());
+    logD_ (_func, "profile \"", stream_opts->transcode_profile->name, "\", chain: ", chain);
     doSetAudioPad (pad, chain->mem());
 }
 
+// Returns the thread count for the encoder element of the video chain which
+// ends with 'sink_name', 0 to leave it to the transcoding profile.
+Uint32
+GstStream::scheduleEncoder (ConstMemory                  const sink_name,
+                            List<ScheduledEncoder>     * const mt_nonnull encoder_list)
+{
+    if (!encoder_scheduler)
+        return 0;
+
+    ScheduledEncoder scheduled;
+    scheduled.encoder = encoder_scheduler->addEncoder (
+            makeString (channel_opts->channel_name->mem(), "/", sink_name)->mem());
+    scheduled.element_name = makeString (sink_name, "_enc");
+    scheduled.queue_name = makeString (sink_name, "_encq");
+    encoder_list->append (scheduled);
+
+    return scheduled.encoder->getNumThreads();
+}
+
 void
 GstStream::setRawVideoPad (GstPad * const pad)
 {
-    // TODO Configurable bitrate for x264enc
-    StRef<String> const chain =
-            st_makeString ("ffmpegcolorspace ! "
-                           "x264enc bitrate=500 speed-preset=veryfast profile=baseline "
-                                   "key-int-max=30 threads=1 sliced-threads=true ! "
-                           "video/x-h264,alignment=au,stream-format=avc,profile=constrained-baseline ! "
-                           "fakesink name=video",
-                           playback_item->sync_to_clock ? " sync=true" : "");
-    logD_ (_func, "chain: ", chain);
+    List<ScheduledEncoder> encoder_list;
+
+    StRef<String> chain;
+    if (num_rendition_outputs == 0) {
+        Uint32 const threads = scheduleEncoder ("video", &encoder_list);
+        StRef<String> const encoder_chain =
+                stream_opts->transcode_profile->makeVideoEncoderChain ("video",
+                                                                       syncToClock (),
+                                                                       0 /* gop_size */,
+                                                                       threads,
+                                                                       stream_opts->low_latency);
+
+        // A scheduled encoder is fed by a thread of its own, which is bound
+        // to the encoder's cores before the encoder starts its threads.
+        ConstMemory const queue = (!encoder_scheduler ? ConstMemory () :
+                stream_opts->low_latency ?
+                        ConstMemory ("queue name=video_encq max-size-buffers=2 max-size-bytes=0 max-size-time=0 ! ") :
+                        ConstMemory ("queue name=video_encq ! "));
+        chain = st_makeString ("ffmpegcolorspace ! ", queue, encoder_chain->mem());
+        logD_ (_func, "profile \"", stream_opts->transcode_profile->name, "\", chain: ", chain);
+    } else {
+      // Decoded frames are teed to the main encoder and to an encoder per
+      // rendition, all with the same fixed GOP size.
+
+        RenditionSet * const renditions = stream_opts->renditions;
+        Uint32 const gop_size = renditions->getGopSize();
+
+        // In low latency mode, frames are dropped by a single leaky queue
+        // ahead of the tee when any encoder can't keep up, so that all
+        // renditions get the same frames and keep their keyframes aligned.
+        // Short branch queues make a slow encoder push back on it quickly.
+        ConstMemory const head_queue = (stream_opts->low_latency ?
+                ConstMemory ("queue max-size-buffers=2 max-size-bytes=0 max-size-time=0 leaky=downstream ! ") :
+                ConstMemory (""));
+        ConstMemory const queue = (stream_opts->low_latency ?
+                ConstMemory ("queue max-size-buffers=2 max-size-bytes=0 max-size-time=0") :
+                ConstMemory ("queue"));
+
+        {
+            Uint32 const threads = scheduleEncoder ("video", &encoder_list);
+            StRef<String> const main_chain =
+                    stream_opts->transcode_profile->makeVideoEncoderChain ("video",
+                                                                           syncToClock (),
+                                                                           gop_size,
+                                                                           threads,
+                                                                           stream_opts->low_latency);
+            chain = st_makeString (head_queue, "ffmpegcolorspace ! tee name=ladder "
+                                   "ladder. ! ", queue, " name=video_encq ! ", main_chain->mem());
+        }
+
+        for (Count i = 0; i < num_rendition_outputs; ++i) {
+            StRef<String> const sink_name = st_makeString ("video_r", i);
+            Uint32 const threads = scheduleEncoder (sink_name->mem(), &encoder_list);
+            StRef<String> const rendition_chain =
+                    renditions->getRendition (i)->profile->makeVideoEncoderChain (sink_name->mem(),
+                                                                                  syncToClock (),
+                                                                                  gop_size,
+                                                                                  threads,
+                                                                                  stream_opts->low_latency);
+            chain = st_makeString (chain->mem(), " ladder. ! ", queue, " name=", sink_name, "_encq ! ",
+                                   rendition_chain->mem());
+        }
+
+        logD_ (_func, "profile \"", stream_opts->transcode_profile->name, "\", "
+               "renditions: ", num_rendition_outputs, ", chain: ", chain);
+    }
+
+    // doSetPad() binds the encoders to their elements.
+    mutex.lock ();
+    video_transcoded = true;
+    while (!encoder_list.isEmpty()) {
+        scheduled_encoders.append (encoder_list.getFirst());
+        encoder_list.remove (encoder_list.getFirstElement());
+    }
+    mutex.unlock ();
+
     doSetVideoPad (pad, chain->mem());
 }
 
@@ -991,17 +1233,60 @@ GstStream::setAudioPad (GstPad * const pad)
 {
     StRef<String> const chain =
             st_makeString ("fakesink name=audio",
-                           playback_item->sync_to_clock ? " sync=true" : "");
+                           syncToClock () ? " sync=true" : "");
     doSetAudioPad (pad, chain->mem());
 }
 
+// Returns true for H.264 caps which doVideoData() can handle without
+// h264parse: AVC with codec data, or Annex B aligned to access units.
+static bool isAuAlignedH264Caps (GstCaps * const caps)
+{
+    if (gst_caps_get_size (caps) != 1)
+        return false;
+
+    GstStructure * const st = gst_caps_get_structure (caps, 0);
+    gchar const * const name = gst_structure_get_name (st);
+    if (!equal (ConstMemory (name, strlen (name)), "video/x-h264"))
+        return false;
+
+    gchar const * const stream_format = gst_structure_get_string (st, "stream-format");
+    gchar const * const alignment = gst_structure_get_string (st, "alignment");
+
+    if (!stream_format || equal (ConstMemory (stream_format, strlen (stream_format)), "avc")) {
+        GValue const * const val = gst_structure_get_value (st, "codec_data");
+        return val && GST_VALUE_HOLDS_BUFFER (val);
+    }
+
+    return equal (ConstMemory (stream_format, strlen (stream_format)), "byte-stream")
+           && alignment
+           && equal (ConstMemory (alignment, strlen (alignment)), "au");
+}
+
 void
 GstStream::setVideoPad (GstPad * const pad)
 {
+    bool need_parser = false;
+    if (!playback_item->no_video) {
+        GstCaps *caps = gst_pad_get_negotiated_caps (pad);
+        if (!caps)
+            caps = gst_pad_get_caps (pad);
+
+        need_parser = !caps
+                      || (isAnyCaps (caps, "video/x-h264") && !isAuAlignedH264Caps (caps));
+
+        if (caps)
+            gst_caps_unref (caps);
+    }
+
+    logD (plug, _func, "need_parser: ", need_parser);
+
+    // Annex B to AVC conversion is done in doVideoData(). h264parse is only
+    // needed to split NAL-aligned or otherwise unusual byte streams into
+    // access units.
     StRef<String> const chain =
-            st_makeString ("h264parse ! video/x-h264,stream-format=avc,alignment=au ! "
+            st_makeString ((need_parser ? "h264parse ! video/x-h264,stream-format=avc,alignment=au ! " : ""),
                            "fakesink name=video",
-                           playback_item->sync_to_clock ? " sync=true" : "");
+                           syncToClock () ? " sync=true" : "");
     doSetVideoPad (pad, chain->mem());
 }
 
@@ -1014,16 +1299,15 @@ GstStream::setPipelinePlaying ()
     assert (chain_el);
     gst_object_ref (chain_el);
 
-    if (channel_opts->no_video_timeout > 0) {
-	no_video_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (noVideoTimerTick,
-                                                                          this /* cb_data */,
-                                                                          this /* coderef_container */),
-					   channel_opts->no_video_timeout,
-					   true  /* periodical */,
-                                           false /* auto_delete */);
+    if (channel_opts->no_video_timeout > 0)
+        timeout_wheel->start (no_video_watch, stream_opts->no_video_threshold);
+
+    if (qos.isEnabled() && !qos_entry) {
+        qos_entry = qos_ticker->addEntry (
+                CbDesc<QosTicker::Frontend> (&qos_ticker_frontend, this, this));
     }
 
-    changing_state_to_playing = true;
+    setPipelineState (PipelineState::SettingPaused);
     mutex.unlock ();
 
     {
@@ -1040,26 +1324,27 @@ GstStream::setPipelinePlaying ()
     }
 
     mutex.lock ();
-    changing_state_to_playing = false;
     if (stream_closed) {
         mutex.unlock ();
 
-	logD (pipeline, _func, "Setting pipeline state to NULL");
-	if (gst_element_set_state (chain_el, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
-	    logE_ (_func, "gst_element_set_state() failed (NULL)");
-    } else {
-      mutex.unlock ();
+        // doReleasePipeline() has left the NULL transition to us.
+	logD (pipeline, _func, "Handing the pipeline over to the reaper");
+        reaper->reap (chain_el, this, channel_opts->channel_name->mem());
+        return Result::Success;
     }
 
+  // Live pipelines reach PAUSED state (and busSyncHandler() moves on)
+  // before gst_element_set_state() returns.
+    if (pipeline_state == PipelineState::SettingPaused)
+        setPipelineState (PipelineState::Prerolling);
+    mutex.unlock ();
+
     gst_object_unref (chain_el);
     return Result::Success;
 
 _failure:
-    logD (pipeline, _func, "Setting pipeline state to NULL");
-    if (gst_element_set_state (chain_el, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
-	logE_ (_func, "gst_element_set_state() failed (NULL #2)");
-
-    gst_object_unref (chain_el);
+    logD (pipeline, _func, "Handing the pipeline over to the reaper");
+    reaper->reap (chain_el, this, channel_opts->channel_name->mem());
     return Result::Failure;
 }
 
@@ -1068,6 +1353,8 @@ GstStream::pipelineCreationFailed ()
 {
     logD (pipeline, _this_func_);
 
+    reportStreamFailure (false /* is_eos */);
+
     eos_pending = true;
     mutex.unlock ();
 
@@ -1081,9 +1368,21 @@ GstStream::doReleasePipeline ()
 
     mutex.lock ();
 
-    if (no_video_timer) {
-	timers->deleteTimer (no_video_timer);
-	no_video_timer = NULL;
+    timeout_wheel->stop (no_video_watch);
+
+    if (qos_entry) {
+        qos_ticker->removeEntry (qos_entry);
+        qos_entry = NULL;
+    }
+
+    // Encoders stay referenced until the pipeline is gone: their pad probes
+    // may still be called.
+    {
+        List<ScheduledEncoder>::Element *el = scheduled_encoders.getFirstElement();
+        while (el) {
+            encoder_scheduler->removeEncoder (el->data.encoder);
+            el = el->next;
+        }
     }
 
     GstElement * const tmp_playbin = playbin;
@@ -1096,22 +1395,30 @@ GstStream::doReleasePipeline ()
     mix_video_src = NULL;
 
     bool to_null_state = false;
-    if (!changing_state_to_playing)
+    if (pipeline_state != PipelineState::SettingPaused)
 	to_null_state = true;
 
+    // Stopped without an error after delivering frames. If there was an
+    // error, it has been reported already, and this is a no-op.
+    if (start_request && timings.first_frame_time)
+        reconnect_scheduler->streamSucceeded (start_request);
+
+    setPipelineState (PipelineState::Closed);
     stream_closed = true;
+    frames_closed.store (true, std::memory_order_relaxed);
     mutex.unlock ();
 
     reportStatusEvents ();
 
     if (tmp_playbin) {
 	if (to_null_state) {
-	    logD (pipeline, _func, "Setting pipeline state to NULL");
-	    if (gst_element_set_state (tmp_playbin, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
-		logE_ (_func, "gst_element_set_state() failed (NULL)");
-	}
-
-	gst_object_unref (tmp_playbin);
+          // The reaper keeps this GstStream alive until the pipeline is in
+          // NULL state, since the pipeline's callbacks refer to it.
+	    logD (pipeline, _func, "Handing the pipeline over to the reaper");
+            reaper->reap (tmp_playbin, this, channel_opts->channel_name->mem());
+	} else {
+	    gst_object_unref (tmp_playbin);
+        }
     }
 
     if (tmp_mix_audio_src)
@@ -1126,11 +1433,6 @@ GstStream::releasePipeline ()
 {
     logD (pipeline, _this_func_);
 
-//#error Two bugs here:
-//#error   1. If the pipeline is being released (got an item in the workqueue),
-//#error      then we should wait for the thread to join, but we don't.
-//#error   2. Simultaneous joining of the same thread is undefined behavior.
-
     mutex.lock ();
 
     while (!workqueue_list.isEmpty()) {
@@ -1151,106 +1453,338 @@ GstStream::releasePipeline ()
     new_item->item_type = WorkqueueItem::ItemType_ReleasePipeline;
 
     workqueue_list.prepend (new_item);
-    workqueue_cond.signal ();
-
-    bool const join = (tlocal != libMary_getThreadLocal());
-
-    Ref<Thread> const tmp_workqueue_thread = workqueue_thread;
-    workqueue_thread = NULL;
     mutex.unlock ();
 
-    if (join) {
-        if (tmp_workqueue_thread)
-            tmp_workqueue_thread->join ();
+    if (!pipeline_pool->schedule (workqueue_task)) {
+      // The pool has been stopped and won't process the item.
+        logD (pipeline, _func, "pipeline pool stopped, releasing the pipeline inline");
+        while (processWorkItem (this))
+            ;
+        return;
+    }
+
+    // Waiting for doReleasePipeline() to complete, which is what joining
+    // the workqueue thread used to achieve. Pool threads never wait: the
+    // release could be queued behind the calling thread's own work item.
+    if (!PipelineControlPool::isWorkerThread ()) {
+        mutex.lock ();
+        while (!pipeline_released)
+            release_cond.wait (mutex);
+        mutex.unlock ();
     }
 }
 
+char const *
+GstStream::pipelineStateToString (PipelineState::Value const state)
+{
+    switch (state) {
+        case PipelineState::Idle:             return "idle";
+        case PipelineState::Creating:         return "creating";
+        case PipelineState::SettingPaused:    return "setting_paused";
+        case PipelineState::Prerolling:       return "prerolling";
+        case PipelineState::SeekPending:      return "seek_pending";
+        case PipelineState::Seeking:          return "seeking";
+        case PipelineState::Warm:             return "warm";
+        case PipelineState::StartingPlayback: return "starting_playback";
+        case PipelineState::Playing:          return "playing";
+        case PipelineState::Closed:           return "closed";
+    }
+
+    unreachable ();
+    return "unknown";
+}
+
 mt_mutex (mutex) void
-GstStream::reportMetaData ()
+GstStream::setPipelineState (PipelineState::Value const new_state)
 {
-    logD (stream, _func_);
+    if (pipeline_state == PipelineState::Closed)
+        return;
 
-    if (metadata_reported) {
-	return;
+    logD (pipeline, _this_func, pipelineStateToString (pipeline_state), " -> ", pipelineStateToString (new_state));
+    pipeline_state = new_state;
+
+    if (start_request) {
+        switch (new_state) {
+            case PipelineState::SeekPending:
+            case PipelineState::Warm:
+            case PipelineState::StartingPlayback:
+            case PipelineState::Playing:
+            case PipelineState::Closed:
+                reconnect_scheduler->startDone (start_request);
+                break;
+            default:
+              // The pipeline is still being created.
+                ;
+        }
     }
-    metadata_reported = true;
+}
 
-    if (!playback_item->send_metadata)
-	return;
+mt_mutex (mutex) void
+GstStream::reportStreamFailure (bool const is_eos)
+{
+    if (!start_request || pipeline_state == PipelineState::Closed)
+        return;
 
-    VideoStream::VideoMessage msg;
-    if (!RtmpServer::encodeMetaData (&metadata, page_pool, &msg)) {
-	logE_ (_func, "encodeMetaData() failed");
-	return;
+    Time uptime = 0;
+    if (timings.first_frame_time) {
+        Time const cur_time = getCoarseTimeMilliseconds ();
+        // At least 1 ms, so that the scheduler knows there were frames.
+        uptime = (cur_time > timings.first_frame_time ? cur_time - timings.first_frame_time : 1);
     }
 
-    logD (stream, _func, "Firing video message");
-    // TODO unlock/lock? (locked event == WRONG)
-    video_stream->fireVideoMessage (&msg);
-
-    page_pool->msgUnref (msg.page_list.first);
+    reconnect_scheduler->streamFailed (start_request, uptime, is_eos);
+    reconnect_scheduler->startDone (start_request);
 }
 
-#if 0
-// Moved to libmoment_gst
-static void
-dumpBufferFlags (GstBuffer * const buffer)
+mt_mutex (mutex) void
+GstStream::recordFirstFrame ()
 {
-    Uint32 flags = (Uint32) GST_BUFFER_FLAGS (buffer);
-    if (flags != GST_BUFFER_FLAGS (buffer))
-	log__ (_func, "flags do not fit into Uint32");
+    first_frame_recorded.store (true, std::memory_order_relaxed);
+    if (timings.first_frame_time)
+        return;
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_READONLY)) {
-	log__ (_func, "GST_BUFFER_FLAG_READONLY");
-	flags ^= GST_BUFFER_FLAG_READONLY;
-    }
+    timings.first_frame_time = getCoarseTimeMilliseconds ();
 
-#if 0
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA4)) {
-	log__ (_func, "GST_BUFFER_FLAG_MEDIA4");
-	flags ^= GST_BUFFER_FLAG_MEDIA4;
+    if (timings.create_time) {
+        logD (pipeline, _this_func, "channel \"", channel_opts->channel_name, "\": "
+              "first frame in ", timings.first_frame_time - timings.create_time, " ms");
     }
-#endif
+}
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_PREROLL)) {
-	log__ (_func, "GST_BUFFER_FLAG_PREROLL");
-	flags ^= GST_BUFFER_FLAG_PREROLL;
-    }
+mt_mutex (mutex) void
+GstStream::pipelinePaused ()
+{
+    Time const cur_time = getCoarseTimeMilliseconds ();
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
-	log__ (_func, "GST_BUFFER_FLAG_DISCONT");
-	flags ^= GST_BUFFER_FLAG_DISCONT;
+    if (pipeline_state == PipelineState::Seeking) {
+        timings.seek_done_time = cur_time;
+    } else {
+        timings.paused_time = cur_time;
+        if (initial_seek > 0) {
+            setPipelineState (PipelineState::SeekPending);
+            return;
+        }
     }
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS)) {
-	log__ (_func, "GST_BUFFER_FLAG_IN_CAPS");
-	flags ^= GST_BUFFER_FLAG_IN_CAPS;
-    }
+    initial_seek_complete.store (true, std::memory_order_release);
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)) {
-	log__ (_func, "GST_BUFFER_FLAG_GAP");
-	flags ^= GST_BUFFER_FLAG_GAP;
+    if (warm.load (std::memory_order_relaxed)) {
+      // Staying in PAUSED state until adopt().
+        setPipelineState (PipelineState::Warm);
+        warm_ready_pending = true;
+        return;
     }
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
-	log__ (_func, "GST_BUFFER_FLAG_DELTA_UNIT");
-	flags ^= GST_BUFFER_FLAG_DELTA_UNIT;
-    }
+    setPipelineState (PipelineState::StartingPlayback);
+    play_pending = true;
+}
 
-#if 0
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA1)) {
-	log__ (_func, "GST_BUFFER_FLAG_MEDIA1");
-	flags ^= GST_BUFFER_FLAG_MEDIA1;
+bool
+GstStream::holdWarmBuffer (GstBuffer * const mt_nonnull buffer,
+                           bool        const is_audio)
+{
+    mutex.lock ();
+    // adopt() clears 'warm' under 'mutex'.
+    if (!warm.load (std::memory_order_relaxed)) {
+        mutex.unlock ();
+        return false;
     }
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA2)) {
-	log__ (_func, "GST_BUFFER_FLAG_MEDIA2");
-	flags ^= GST_BUFFER_FLAG_MEDIA2;
+    Count num_buffers = 0;
+    {
+        List<WarmBuffer>::Element *el = warm_buffers.getFirstElement();
+        while (el) {
+            ++num_buffers;
+            el = el->next;
+        }
     }
 
-    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA3)) {
-	log__ (_func, "GST_BUFFER_FLAG_MEDIA3");
-	flags ^= GST_BUFFER_FLAG_MEDIA3;
+    if (num_buffers >= MaxWarmBuffers) {
+        logD (pipeline, _this_func, "too many buffers before adopt(), dropping");
+        mutex.unlock ();
+        return true;
+    }
+
+    gst_buffer_ref (buffer);
+
+    WarmBuffer warm_buffer;
+    warm_buffer.buffer = buffer;
+    warm_buffer.is_audio = is_audio;
+    warm_buffers.append (warm_buffer);
+
+    mutex.unlock ();
+    return true;
+}
+
+void
+GstStream::releaseWarmBuffers ()
+{
+    mutex.lock ();
+    while (!warm_buffers.isEmpty()) {
+        gst_buffer_unref (warm_buffers.getFirst().buffer);
+        warm_buffers.remove (warm_buffers.getFirstElement());
+    }
+    mutex.unlock ();
+}
+
+void
+GstStream::prepare (CbDesc<WarmFrontend> const &warm_frontend)
+{
+    logD (pipeline, _this_func_);
+
+    mutex.lock ();
+    this->warm_frontend = warm_frontend;
+    warm.store (true, std::memory_order_relaxed);
+    mutex.unlock ();
+
+    createPipeline ();
+}
+
+void
+GstStream::adopt (CbDesc<MediaSource::Frontend> const &frontend,
+                  VideoStream                   * const video_stream)
+{
+    logD (pipeline, _this_func_);
+
+    List<WarmBuffer> tmp_buffers;
+
+    mutex.lock ();
+    this->frontend = frontend;
+    this->video_stream = video_stream;
+    bool const prerolled = (pipeline_state == PipelineState::Warm);
+
+  // Held buffers are replayed by this thread in arrival order. 'warm' stays
+  // set meanwhile, so that the streaming threads keep holding their buffers
+  // instead of entering doAudioData() and doVideoData() concurrently with
+  // the replay. 'warm' is cleared under 'mutex' once there's nothing left
+  // to replay, which makes the handoff atomic with respect to holdWarmBuffer().
+    for (;;) {
+        while (!warm_buffers.isEmpty()) {
+            tmp_buffers.append (warm_buffers.getFirst());
+            warm_buffers.remove (warm_buffers.getFirstElement());
+        }
+
+        if (tmp_buffers.isEmpty()) {
+          // From now on, frames go through doAudioData() and doVideoData().
+            warm.store (false, std::memory_order_release);
+            break;
+        }
+
+        mutex.unlock ();
+
+        while (!tmp_buffers.isEmpty()) {
+            WarmBuffer const warm_buffer = tmp_buffers.getFirst();
+            tmp_buffers.remove (tmp_buffers.getFirstElement());
+
+            if (warm_buffer.is_audio)
+                doAudioData (warm_buffer.buffer, true /* replay */);
+            else
+                doVideoData (warm_buffer.buffer, true /* replay */);
+
+            gst_buffer_unref (warm_buffer.buffer);
+        }
+
+        mutex.lock ();
+    }
+    mutex.unlock ();
+
+    if (prerolled) {
+        mutex.lock ();
+        setPipelineState (PipelineState::StartingPlayback);
+        play_pending = true;
+        mutex.unlock ();
+    }
+
+    // Also delivers events which have been held while the stream was warm.
+    reportStatusEvents ();
+}
+
+mt_mutex (mutex) void
+GstStream::reportMetaData ()
+{
+    logD (stream, _func_);
+
+    if (metadata_reported) {
+	return;
+    }
+    metadata_reported = true;
+
+    if (!playback_item->send_metadata)
+	return;
+
+    VideoStream::VideoMessage msg;
+    if (!RtmpServer::encodeMetaData (&metadata, page_pool, &msg)) {
+	logE_ (_func, "encodeMetaData() failed");
+	return;
+    }
+
+    logD (stream, _func, "Firing video message");
+    // TODO unlock/lock? (locked event == WRONG)
+    video_stream->fireVideoMessage (&msg);
+
+    page_pool->msgUnref (msg.page_list.first);
+}
+
+#if 0
+// Moved to libmoment_gst
+static void
+dumpBufferFlags (GstBuffer * const buffer)
+{
+    Uint32 flags = (Uint32) GST_BUFFER_FLAGS (buffer);
+    if (flags != GST_BUFFER_FLAGS (buffer))
+	log__ (_func, "flags do not fit into Uint32");
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_READONLY)) {
+	log__ (_func, "GST_BUFFER_FLAG_READONLY");
+	flags ^= GST_BUFFER_FLAG_READONLY;
+    }
+
+#if 0
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA4)) {
+	log__ (_func, "GST_BUFFER_FLAG_MEDIA4");
+	flags ^= GST_BUFFER_FLAG_MEDIA4;
+    }
+#endif
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_PREROLL)) {
+	log__ (_func, "GST_BUFFER_FLAG_PREROLL");
+	flags ^= GST_BUFFER_FLAG_PREROLL;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT)) {
+	log__ (_func, "GST_BUFFER_FLAG_DISCONT");
+	flags ^= GST_BUFFER_FLAG_DISCONT;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS)) {
+	log__ (_func, "GST_BUFFER_FLAG_IN_CAPS");
+	flags ^= GST_BUFFER_FLAG_IN_CAPS;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_GAP)) {
+	log__ (_func, "GST_BUFFER_FLAG_GAP");
+	flags ^= GST_BUFFER_FLAG_GAP;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+	log__ (_func, "GST_BUFFER_FLAG_DELTA_UNIT");
+	flags ^= GST_BUFFER_FLAG_DELTA_UNIT;
+    }
+
+#if 0
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA1)) {
+	log__ (_func, "GST_BUFFER_FLAG_MEDIA1");
+	flags ^= GST_BUFFER_FLAG_MEDIA1;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA2)) {
+	log__ (_func, "GST_BUFFER_FLAG_MEDIA2");
+	flags ^= GST_BUFFER_FLAG_MEDIA2;
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_MEDIA3)) {
+	log__ (_func, "GST_BUFFER_FLAG_MEDIA3");
+	flags ^= GST_BUFFER_FLAG_MEDIA3;
     }
 #endif
 
@@ -1287,6 +1821,202 @@ gstStateToString (GstState const state)
     return grab (new (std::nothrow) String (mem));
 }
 
+// All frame data passes through here on its way from GstBuffers to PagePool
+// pages. PagePool pages hold their data inline, so this is the single point
+// where ingested bytes are copied; 'copied_bytes' tracks the cost of it.
+//
+// TODO Zero-copy ingest. Needs PagePool pages which reference foreign memory
+// and call back when their refcount drops to zero, so that a page list could
+// hold a ref on the GstBuffer instead of a copy of its data. libmary has no
+// such pages yet. Prechunked messages interleave chunk headers with the data
+// and would still need copying.
+void
+GstStream::fillMessagePages (PagePool::PageListHead * const mt_nonnull page_list,
+                             ConstMemory              const mem,
+                             Size                     const prechunk_initial_offset,
+                             Uint32                   const chunk_stream_id,
+                             Uint64                   const prechunk_timestamp)
+{
+    RtmpConnection::PrechunkContext prechunk_ctx (prechunk_initial_offset);
+    appendMessagePages (page_list, &prechunk_ctx, mem, chunk_stream_id, prechunk_timestamp);
+}
+
+void
+GstStream::appendMessagePages (PagePool::PageListHead          * const mt_nonnull page_list,
+                               RtmpConnection::PrechunkContext * const mt_nonnull prechunk_ctx,
+                               ConstMemory                       const mem,
+                               Uint32                            const chunk_stream_id,
+                               Uint64                            const prechunk_timestamp)
+{
+    if (playback_item->enable_prechunking) {
+        RtmpConnection::fillPrechunkedPages (prechunk_ctx,
+                                             mem,
+                                             page_pool,
+                                             page_list,
+                                             chunk_stream_id,
+                                             prechunk_timestamp,
+                                             false /* first_chunk */);
+    } else {
+        page_pool->getFillPages (page_list, mem);
+    }
+
+    copied_bytes.fetch_add (mem.len(), std::memory_order_relaxed);
+}
+
+void
+GstStream::deliverAudioMessage (VideoStream::AudioMessage * const mt_nonnull msg)
+{
+    if (!delivery_consumer) {
+        video_stream->fireAudioMessage (msg);
+        fireRenditionAudioMessage (msg);
+        page_pool->msgUnref (msg->page_list.first);
+        return;
+    }
+
+    bool const is_codec_data = (msg->frame_type != VideoStream::AudioFrameType::RawData);
+    if (!is_codec_data
+        && audio_ring.getDepth() + RingReservedSlots >= audio_ring.getCapacity())
+    {
+        logD (frames, _func, "audio ring is full, dropping audio frame");
+        audio_frames_dropped.fetch_add (1, std::memory_order_relaxed);
+        MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioDrop, trace_id, msg->timestamp_nanosec, msg->msg_len, 0, 0);
+        page_pool->msgUnref (msg->page_list.first);
+        return;
+    }
+
+    QueuedAudioMessage entry;
+    entry.msg = *msg;
+    entry.seq = delivery_seq.fetch_add (1, std::memory_order_relaxed);
+    if (!audio_ring.push (entry)) {
+        logW_ (_func, "audio ring is full, dropping audio codec data");
+        audio_frames_dropped.fetch_add (1, std::memory_order_relaxed);
+        MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioDrop, trace_id, msg->timestamp_nanosec, msg->msg_len, 0, 0);
+        page_pool->msgUnref (msg->page_list.first);
+        return;
+    }
+
+    delivery_pool->wakeup (delivery_consumer);
+}
+
+void
+GstStream::deliverVideoMessage (VideoStream::VideoMessage * const mt_nonnull msg)
+{
+    if (!delivery_consumer) {
+        recordVideoLatency (msg);
+        video_stream->fireVideoMessage (msg);
+        page_pool->msgUnref (msg->page_list.first);
+        return;
+    }
+
+    bool const is_codec_data = (msg->frame_type == VideoStream::VideoFrameType::AvcSequenceHeader);
+    bool const is_keyframe   = (msg->frame_type == VideoStream::VideoFrameType::KeyFrame);
+
+    if (!is_codec_data) {
+        Size const depth = video_ring.getDepth();
+
+        bool drop = false;
+        if (is_keyframe) {
+            video_gop_broken = false;
+
+            if (depth + RingReservedSlots >= video_ring.getCapacity()) {
+              // Not even keyframes fit: dropping the whole GOP.
+                logD (frames, _func, "video ring is full, dropping GOP");
+                video_gops_dropped.fetch_add (1, std::memory_order_relaxed);
+                drop = true;
+            }
+        } else {
+            if (!video_gop_broken && depth >= video_ring_drop_depth) {
+                logD (frames, _func, "video ring depth ", depth, " is over the watermark, "
+                      "dropping frames up to the next keyframe");
+                drop = true;
+            }
+
+            if (video_gop_broken)
+                drop = true;
+        }
+
+        if (drop) {
+          // Frames following a dropped one can't be decoded until the next keyframe.
+            video_gop_broken = true;
+            video_frames_dropped.fetch_add (1, std::memory_order_relaxed);
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoDrop, trace_id, msg->timestamp_nanosec, msg->msg_len, 0, 0);
+            page_pool->msgUnref (msg->page_list.first);
+            return;
+        }
+    }
+
+    QueuedVideoMessage entry;
+    entry.msg = *msg;
+    entry.seq = delivery_seq.fetch_add (1, std::memory_order_relaxed);
+    if (!video_ring.push (entry)) {
+        logW_ (_func, "video ring is full, dropping AVC sequence header");
+        video_frames_dropped.fetch_add (1, std::memory_order_relaxed);
+        MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoDrop, trace_id, msg->timestamp_nanosec, msg->msg_len, 0, 0);
+        page_pool->msgUnref (msg->page_list.first);
+        return;
+    }
+
+    delivery_pool->wakeup (delivery_consumer);
+}
+
+FrameDeliveryPool::Frontend const GstStream::delivery_frontend = {
+    deliverFrames
+};
+
+bool
+GstStream::deliverFrames (void * const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+
+    // Limits the batch size so that other streams bound to the same delivery
+    // thread get their turn.
+    Count const max_batch = 64;
+
+    for (Count i = 0; i < max_batch; ++i) {
+        QueuedAudioMessage const * const audio = self->audio_ring.peek ();
+        QueuedVideoMessage const * const video = self->video_ring.peek ();
+
+        // Frames pushed concurrently by the two streaming threads may come
+        // out of order, which is no worse than firing them synchronously.
+        if (audio && (!video || audio->seq < video->seq)) {
+            QueuedAudioMessage entry;
+            self->audio_ring.pop (&entry);
+
+            self->video_stream->fireAudioMessage (&entry.msg);
+            self->fireRenditionAudioMessage (&entry.msg);
+            self->page_pool->msgUnref (entry.msg.page_list.first);
+        } else
+        if (video) {
+            QueuedVideoMessage entry;
+            self->video_ring.pop (&entry);
+
+            self->recordVideoLatency (&entry.msg);
+            self->video_stream->fireVideoMessage (&entry.msg);
+            self->page_pool->msgUnref (entry.msg.page_list.first);
+        } else {
+            break;
+        }
+    }
+
+    return self->audio_ring.getDepth() > 0 || self->video_ring.getDepth() > 0;
+}
+
+void
+GstStream::releaseQueuedFrames ()
+{
+    {
+        QueuedAudioMessage entry;
+        while (audio_ring.pop (&entry))
+            page_pool->msgUnref (entry.msg.page_list.first);
+    }
+
+    {
+        QueuedVideoMessage entry;
+        while (video_ring.pop (&entry))
+            page_pool->msgUnref (entry.msg.page_list.first);
+    }
+}
+
 gboolean
 GstStream::inStatsDataCb (GstPad    * const /* pad */,
 			  GstBuffer * const buffer,
@@ -1294,15 +2024,14 @@ GstStream::inStatsDataCb (GstPad    * const /* pad */,
 {
     GstStream * const self = static_cast <GstStream*> (_self);
 
-    self->mutex.lock ();
-    self->rx_bytes += GST_BUFFER_SIZE (buffer);
-    self->mutex.unlock ();
+    self->rx_bytes.fetch_add (GST_BUFFER_SIZE (buffer), std::memory_order_relaxed);
 
     return TRUE;
 }
 
 void
-GstStream::doAudioData (GstBuffer * const buffer)
+GstStream::doAudioData (GstBuffer * const buffer,
+                        bool        const replay)
 {
 #if 0
     {
@@ -1320,8 +2049,19 @@ GstStream::doAudioData (GstBuffer * const buffer)
     }
 #endif
 
-    // TODO Update current time efficiently.
-    updateTime ();
+    if (!replay
+        && warm.load (std::memory_order_acquire)
+        && holdWarmBuffer (buffer, true /* is_audio */))
+    {
+        return;
+    }
+
+    if (frames_closed.load (std::memory_order_relaxed))
+        return;
+
+    // Thread-local time is only needed for debug log output here.
+    if (logLevelOn (frames, LogLevel::D))
+        updateTime ();
 
     logD (frames, _func, "stream 0x", fmt_hex, (UintPtr) this, ", "
 	  "timestamp 0x", fmt_hex, GST_BUFFER_TIMESTAMP (buffer), ", "
@@ -1339,12 +2079,14 @@ GstStream::doAudioData (GstBuffer * const buffer)
 	}
     }
 
-    mutex.lock ();
-
-    rx_audio_bytes += GST_BUFFER_SIZE (buffer);
+    rx_audio_bytes.fetch_add (GST_BUFFER_SIZE (buffer), std::memory_order_relaxed);
+    MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioFrame, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), 0);
 
-    last_frame_time = getTime ();
-    logD (frames, _func, "last_frame_time: 0x", fmt_hex, last_frame_time);
+    {
+        Time const cur_time = getCoarseTime ();
+        no_video_watch->frameReceived (cur_time);
+        logD (frames, _func, "last_frame_time: 0x", fmt_hex, cur_time);
+    }
 
     if (prv_audio_timestamp > GST_BUFFER_TIMESTAMP (buffer)) {
 	logW_ (_func, "backwards timestamp: prv 0x", fmt_hex, prv_audio_timestamp,
@@ -1354,11 +2096,16 @@ GstStream::doAudioData (GstBuffer * const buffer)
 
     VideoStream::AudioFrameType codec_data_type = VideoStream::AudioFrameType::Unknown;
     GstBuffer *codec_data_buffers [2];
-    // Should be unrefed on return.
-    GstBuffer *codec_data_buffer = NULL;
     Count num_codec_data_buffers = 0;
-    if (first_audio_frame) {
-	GstCaps * const caps = gst_buffer_get_caps (buffer);
+    GstCaps * const caps = GST_BUFFER_CAPS (buffer);
+    if (caps && audio_caps_cache.update (caps)) {
+      // Caps have changed, or this is the first frame. This is the only place
+      // where audio caps structures are looked up.
+
+        AudioParams new_audio_params;
+        bool const was_adts_aac_stream = is_adts_aac_stream;
+        is_adts_aac_stream = false;
+
 	{
 	    gchar * const str = gst_caps_to_string (caps);
 	    logD (stream, _func, "caps: ", str);
@@ -1391,10 +2138,10 @@ GstStream::doAudioData (GstBuffer * const buffer)
 
 	    if (mpegversion == 1 && layer == 3) {
 	      // MP3
-		audio_codec_id = VideoStream::AudioCodecId::MP3;
+		new_audio_params.codec_id = VideoStream::AudioCodecId::MP3;
 	    } else {
 	      // AAC
-		audio_codec_id = VideoStream::AudioCodecId::AAC;
+		new_audio_params.codec_id = VideoStream::AudioCodecId::AAC;
 
                 if (char const * const stream_format = gst_structure_get_string (structure, "stream-format")) {
                     logD_ (_func, "stream-format: ", stream_format);
@@ -1426,7 +2173,7 @@ GstStream::doAudioData (GstBuffer * const buffer)
 	} else
 	if (equal (structure_name_mem, "audio/x-speex")) {
 	  // Speex
-	    audio_codec_id = VideoStream::AudioCodecId::Speex;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::Speex;
 
 	    do {
 	      // Processing Speex stream headers.
@@ -1444,7 +2191,12 @@ GstStream::doAudioData (GstBuffer * const buffer)
 
 		codec_data_type = VideoStream::AudioFrameType::SpeexHeader;
 
-		guint const arr_size = gst_value_array_get_size (val);
+		guint arr_size = gst_value_array_get_size (val);
+                if (arr_size > sizeof (codec_data_buffers) / sizeof (codec_data_buffers [0])) {
+                    logW_ (_func, "Speex streamheader: ignoring extra array elements: ", arr_size);
+                    arr_size = sizeof (codec_data_buffers) / sizeof (codec_data_buffers [0]);
+                }
+
 		for (guint i = 0; i < arr_size; ++i) {
 		    GValue const * const elem_val = gst_value_array_get_value (val, i);
 		    if (!elem_val) {
@@ -1453,7 +2205,7 @@ GstStream::doAudioData (GstBuffer * const buffer)
 		    if (!GST_VALUE_HOLDS_BUFFER (elem_val)) {
 			logW_ (_func, "Speex streamheader element #", i, " doesn't hold a buffer");
 		    } else {
-			codec_data_buffers [i] = gst_value_get_buffer (elem_val);
+			codec_data_buffers [num_codec_data_buffers] = gst_value_get_buffer (elem_val);
 			++num_codec_data_buffers;
 		    }
 		}
@@ -1463,48 +2215,90 @@ GstStream::doAudioData (GstBuffer * const buffer)
 	} else
 	if (equal (structure_name_mem, "audio/x-nellymoser")) {
 	  // Nellymoser
-	    audio_codec_id = VideoStream::AudioCodecId::Nellymoser;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::Nellymoser;
 	} else
 	if (equal (structure_name_mem, "audio/x-adpcm")) {
 	  // ADPCM
-	    audio_codec_id = VideoStream::AudioCodecId::ADPCM;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::ADPCM;
 	} else
 	if (equal (structure_name_mem, "audio/x-raw-int")) {
 	  // Linear PCM, little endian
-	    audio_codec_id = VideoStream::AudioCodecId::LinearPcmLittleEndian;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::LinearPcmLittleEndian;
 	} else
 	if (equal (structure_name_mem, "audio/x-alaw")) {
 	  // G.711 A-law logarithmic PCM
-	    audio_codec_id = VideoStream::AudioCodecId::G711ALaw;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::G711ALaw;
 	} else
 	if (equal (structure_name_mem, "audio/x-mulaw")) {
 	  // G.711 mu-law logarithmic PCM
-	    audio_codec_id = VideoStream::AudioCodecId::G711MuLaw;
+	    new_audio_params.codec_id = VideoStream::AudioCodecId::G711MuLaw;
 	}
 
-        audio_rate = rate;
-        audio_channels = channels;
+        // ADTS config is compared with the last one in doAdtsAudioData(),
+        // unless another sequence header may have been sent meanwhile.
+        if (!was_adts_aac_stream || !is_adts_aac_stream)
+            got_adts_config = false;
+
+        {
+          // Upstream may allocate new caps which are equal to the old ones.
+          // Codec data is sent again only if it has actually changed.
+            bool same_codec_data = (codec_data_type == audio_codec_data_type
+                                    && num_codec_data_buffers == num_audio_codec_data_buffers);
+            for (Count i = 0; same_codec_data && i < num_codec_data_buffers; ++i) {
+                same_codec_data = equal (ConstMemory (GST_BUFFER_DATA (codec_data_buffers [i]),
+                                                      GST_BUFFER_SIZE (codec_data_buffers [i])),
+                                         ConstMemory (GST_BUFFER_DATA (audio_codec_data_buffers [i]),
+                                                      GST_BUFFER_SIZE (audio_codec_data_buffers [i])));
+            }
+
+            if (same_codec_data) {
+                logD (stream, _func, "caps have changed, but codec data has not");
+                num_codec_data_buffers = 0;
+            } else {
+                for (Count i = 0; i < num_audio_codec_data_buffers; ++i)
+                    gst_buffer_unref (audio_codec_data_buffers [i]);
+
+                for (Count i = 0; i < num_codec_data_buffers; ++i) {
+                    audio_codec_data_buffers [i] = codec_data_buffers [i];
+                    gst_buffer_ref (audio_codec_data_buffers [i]);
+                }
 
-	metadata.audio_sample_rate = (Uint32) rate;
+                audio_codec_data_type = codec_data_type;
+                num_audio_codec_data_buffers = num_codec_data_buffers;
+            }
+        }
+
+        new_audio_params.rate = rate;
+        new_audio_params.channels = channels;
+        audio_params.store (new_audio_params);
+    }
+
+    if (first_audio_frame.load (std::memory_order_acquire)) {
+        mutex.lock ();
+        frame_path_locks.fetch_add (1, std::memory_order_relaxed);
+
+        AudioParams const first_audio_params = audio_params.load ();
+
+	metadata.audio_sample_rate = (Uint32) first_audio_params.rate;
 	metadata.got_flags |= RtmpServer::MetaData::AudioSampleRate;
 
 	metadata.audio_sample_size = 16;
 	metadata.got_flags |= RtmpServer::MetaData::AudioSampleSize;
 
-	metadata.num_channels = (Uint32) channels;
+	metadata.num_channels = (Uint32) first_audio_params.channels;
 	metadata.got_flags |= RtmpServer::MetaData::NumChannels;
 
-	gst_caps_unref (caps);
-    }
-
-    if (first_audio_frame) {
-	first_audio_frame = false;
+	first_audio_frame.store (false, std::memory_order_release);
 
 	if (playback_item->send_metadata) {
 	    if (!got_video || !first_video_frame) {
 	      // There's no video or we've got the first video frame already.
 		reportMetaData ();
 		metadata_reported_cond.signal ();
+	    } else
+	    if (replay) {
+	      // Held video buffers are replayed by this thread after this one,
+	      // metadata is reported with the first of them.
 	    } else {
 	      // Waiting for the first video frame.
 		while (got_video && first_video_frame)
@@ -1512,120 +2306,48 @@ GstStream::doAudioData (GstBuffer * const buffer)
 		    metadata_reported_cond.wait (mutex);
 	    }
 	}
-    }
 
-    if (is_adts_aac_stream) {
-        if (GST_BUFFER_SIZE (buffer) >= 7) {
-            // Bit packing example:
-            // AAAA BBBB  CCCC DDDD
-            // 4321 4321  4321 4321
-            //
-            // 1234
-            // 0001 0010  0011 0100
-            // [] = { 0x12, 0x34 }
-
-            // AAC codec data:
-            //
-            // AAAA ABBB  BDDD DEFG
-            // 5432 1432  1432 1111
-            //
-            // A 5 AudioObjectType
-            // B 4 samplingFrequencyIndex
-            // if (samplingFrequencyIndex == 15) - forbidden
-            //     C 24 samplingFrequency
-            // D 4 channelConfiguration (0-7, last bit reserved)
-            // E 1 frameLengthFlag
-            // F 1 dependsOnCoreCoder = 0
-            // G 1 extensionFlag = 0
-
-            Byte * const adts_header = GST_BUFFER_DATA (buffer);
-            Byte codec_data [2] = { 0, 0 };
-
-            // 2 bits for object type in ADTS => possible values: 1 2 3 4
-            Byte const obj_type = ((adts_header [2] >> 6) & 0x3) + 1;
-            codec_data [0] |= obj_type << 3;
-
-            Byte const rate_idx = (adts_header [2] >> 2) & 0xf;
-            codec_data [0] |= rate_idx >> 1;
-            codec_data [1] |= (rate_idx & 0x1) << 7;
-
-            Byte const channel_config = ((adts_header [2] & 0x1) << 2) | ((adts_header [3] >> 6) & 0x3);
-            codec_data [1] |= channel_config << 3;
-
-            // Just use 1024 samples per frame.
-            // See http://spectralhole.blogspot.ru/2010/09/aac-bistream-flaws-part-2-aac-960-zero.html
-            codec_data [1] |= 0;
-
-            if (!got_adts_aac_codec_data
-                || adts_aac_codec_data [0] != codec_data [0]
-                || adts_aac_codec_data [1] != codec_data [1])
-            {
-                got_adts_aac_codec_data = true;
-                adts_aac_codec_data [0] = codec_data [0];
-                adts_aac_codec_data [1] = codec_data [1];
-
-                codec_data_buffer = gst_buffer_new_and_alloc (2);
-                assert (codec_data_buffer);
-                GST_BUFFER_TIMESTAMP (codec_data_buffer) = GST_BUFFER_TIMESTAMP (buffer);
-                GST_BUFFER_SIZE (codec_data_buffer) = 2;
-                GST_BUFFER_DURATION (codec_data_buffer) = 0;
-                memcpy (GST_BUFFER_DATA (codec_data_buffer), codec_data, 2);
-
-                codec_data_type = VideoStream::AudioFrameType::AacSequenceHeader;
-                codec_data_buffers [0] = codec_data_buffer;
-                num_codec_data_buffers = 1;
-
-                logD_ (_func, "New AAC codec data: 0x", fmt_hex, (Uint32) codec_data [0], " 0x", (Uint32) codec_data [1]);
-            }
-        } else {
-            logE_ (_func,
-                   "AAC ADTS packet is too short. "
-                   "AAC codec data was not extracted. Audio stream will not be playable.");
-        }
+        mutex.unlock ();
     }
 
     bool skip_frame = false;
     {
-	if (audio_skip_counter > 0) {
-	    --audio_skip_counter;
-	    logD (frames, _func, "Skipping audio frame, audio_skip_counter: ", audio_skip_counter, " left");
+	if (audio_skip_counter.load (std::memory_order_relaxed) > 0) {
+	    Count const left = audio_skip_counter.fetch_sub (1, std::memory_order_relaxed) - 1;
+	    logD (frames, _func, "Skipping audio frame, audio_skip_counter: ", left, " left");
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::SkipCounter);
 	    skip_frame = true;
 	}
 
 //	if (initial_play_pending && !play_pending) {
 //	if (initial_seek_pending && initial_seek > 0) {
-        if (!initial_seek_complete) {
+        if (!initial_seek_complete.load (std::memory_order_acquire)) {
 	    // We have not started playing yet. This is most likely a preroll frame.
 	    logD (frames, _func, "Skipping an early preroll frame");
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::Preroll);
 	    skip_frame = true;
 	}
     }
 
-    VideoStream::AudioCodecId const tmp_audio_codec_id = audio_codec_id;
-    unsigned const tmp_audio_rate = audio_rate;
-    unsigned const tmp_audio_channels = audio_channels;
-//    logD_ (_func, "rate: ", audio_rate, ", channels: ", audio_channels);
-    mutex.unlock ();
+    AudioParams const cur_audio_params = audio_params.load ();
 
     if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS) ||
 	GST_BUFFER_TIMESTAMP (buffer) == (GstClockTime) -1)
     {
+        MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::InCapsOrNoTimestamp);
 	skip_frame = true;
     }
 
-    if (tmp_audio_codec_id == VideoStream::AudioCodecId::Unknown) {
+    if (cur_audio_params.codec_id == VideoStream::AudioCodecId::Unknown) {
 	logD (frames, _func, "unknown codec id, dropping audio frame");
-	goto _return;
+	return;
     }
 
     if (num_codec_data_buffers > 0) {
       // Reporting codec data if needed.
 
 	for (Size i = 0; i < num_codec_data_buffers; ++i) {
-	    Size msg_len = 0;
-
-//	    Uint64 const cd_timestamp_nanosec = (Uint64) (GST_BUFFER_TIMESTAMP (codec_data_buffers [i]));
-	    Uint64 const cd_timestamp_nanosec = 0;
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioCodecData, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (codec_data_buffers [i]), 0, 0);
 
 	    if (logLevelOn (frames, LogLevel::D)) {
                 logLock ();
@@ -1634,109 +2356,116 @@ GstStream::doAudioData (GstBuffer * const buffer)
                 logUnlock ();
             }
 
-            PagePool::PageListHead page_list;
-
-            if (playback_item->enable_prechunking) {
-                Size msg_audio_hdr_len = 1;
-                if (codec_data_type == VideoStream::AudioFrameType::AacSequenceHeader)
-                    msg_audio_hdr_len = 2;
-
-                RtmpConnection::PrechunkContext prechunk_ctx (msg_audio_hdr_len /* initial_offset */);
-                RtmpConnection::fillPrechunkedPages (&prechunk_ctx,
-                                                     ConstMemory (GST_BUFFER_DATA (codec_data_buffers [i]),
-                                                                  GST_BUFFER_SIZE (codec_data_buffers [i])),
-                                                     page_pool,
-                                                     &page_list,
-                                                     RtmpConnection::DefaultAudioChunkStreamId,
-                                                     cd_timestamp_nanosec,
-                                                     false /* first_chunk */);
-            } else {
-                page_pool->getFillPages (&page_list,
-                                         ConstMemory (GST_BUFFER_DATA (codec_data_buffers [i]),
-                                                      GST_BUFFER_SIZE (codec_data_buffers [i])));
-            }
-	    msg_len += GST_BUFFER_SIZE (codec_data_buffers [i]);
-
-	    VideoStream::AudioMessage msg;
-	    msg.timestamp_nanosec = cd_timestamp_nanosec;
-	    msg.prechunk_size = (playback_item->enable_prechunking ? RtmpConnection::PrechunkSize : 0);
-	    msg.frame_type = codec_data_type;
-	    msg.codec_id = tmp_audio_codec_id;
-            msg.rate = tmp_audio_rate;
-            msg.channels = tmp_audio_channels;
-
-	    msg.page_pool = page_pool;
-	    msg.page_list = page_list;
-	    msg.msg_len = msg_len;
-	    msg.msg_offset = 0;
-
-	    video_stream->fireAudioMessage (&msg);
-
-	    page_pool->msgUnref (page_list.first);
+            // TODO Timestamps for codec data buffers are seemingly random,
+            //      hence zero.
+            sendAudioMessage (ConstMemory (GST_BUFFER_DATA (codec_data_buffers [i]),
+                                           GST_BUFFER_SIZE (codec_data_buffers [i])),
+                              0 /* timestamp_nanosec */,
+                              codec_data_type,
+                              cur_audio_params);
 	}
     }
 
     if (skip_frame)
-        goto _return;
-
-  {
-    Size msg_len = 0;
-
-    Uint64 const timestamp_nanosec = (Uint64) (GST_BUFFER_TIMESTAMP (buffer));
-//    logD_ (_func, "timestamp: 0x", fmt_hex, timestamp_nanosec, ", size: ", fmt_def, GST_BUFFER_SIZE (buffer));
-//    logD_ (_func, "tmp_audio_codec_id: ", tmp_audio_codec_id);
-
-    PagePool::PageListHead page_list;
+        return;
 
-    Byte *buffer_data = GST_BUFFER_DATA (buffer);
-    Size  buffer_size = GST_BUFFER_SIZE (buffer);
-    if (is_adts_aac_stream && buffer_size >= 7) {
-        bool const protection_absent = buffer_data [1] & 0x1;
-        Size const adts_header_len = (protection_absent ? 7 : 9);
+    if (!first_frame_recorded.load (std::memory_order_relaxed)) {
+        mutex.lock ();
+        frame_path_locks.fetch_add (1, std::memory_order_relaxed);
+        recordFirstFrame ();
+        mutex.unlock ();
+    }
 
-        buffer_data += adts_header_len;
-        buffer_size -= adts_header_len;
+    if (is_adts_aac_stream) {
+        doAdtsAudioData (buffer, cur_audio_params);
+        return;
     }
 
-    if (playback_item->enable_prechunking) {
-        Size gen_audio_hdr_len = 1;
-        if (tmp_audio_codec_id == VideoStream::AudioCodecId::AAC)
-            gen_audio_hdr_len = 2;
+    sendAudioMessage (ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)),
+                      (Uint64) GST_BUFFER_TIMESTAMP (buffer),
+                      VideoStream::AudioFrameType::RawData,
+                      cur_audio_params);
+}
 
-        RtmpConnection::PrechunkContext prechunk_ctx (gen_audio_hdr_len /* initial_offset */);
-        RtmpConnection::fillPrechunkedPages (&prechunk_ctx,
-                                             ConstMemory (buffer_data, buffer_size),
-                                             page_pool,
-                                             &page_list,
-                                             RtmpConnection::DefaultAudioChunkStreamId,
-                                             timestamp_nanosec / 1000000,
-                                             false /* first_chunk */);
-    } else {
-        page_pool->getFillPages (&page_list, ConstMemory (buffer_data, buffer_size));
-    }
-    msg_len += buffer_size;
+void
+GstStream::sendAudioMessage (ConstMemory                const mem,
+                             Uint64                     const timestamp_nanosec,
+                             VideoStream::AudioFrameType const frame_type,
+                             AudioParams                const &params)
+{
+    PagePool::PageListHead page_list;
+    fillMessagePages (&page_list,
+                      mem,
+                      (params.codec_id == VideoStream::AudioCodecId::AAC ? 2 : 1),
+                      RtmpConnection::DefaultAudioChunkStreamId,
+                      timestamp_nanosec / 1000000);
 
     VideoStream::AudioMessage msg;
     msg.timestamp_nanosec = timestamp_nanosec;
     msg.prechunk_size = (playback_item->enable_prechunking ? RtmpConnection::PrechunkSize : 0);
-    msg.frame_type = VideoStream::AudioFrameType::RawData;
-    msg.codec_id = tmp_audio_codec_id;
+    msg.frame_type = frame_type;
+    msg.codec_id = params.codec_id;
 
     msg.page_pool = page_pool;
     msg.page_list = page_list;
-    msg.msg_len = msg_len;
+    msg.msg_len = mem.len();
     msg.msg_offset = 0;
-    msg.rate = tmp_audio_rate;
-    msg.channels = tmp_audio_channels;
+    msg.rate = params.rate;
+    msg.channels = params.channels;
 
-    video_stream->fireAudioMessage (&msg);
+    deliverAudioMessage (&msg);
+}
 
-    page_pool->msgUnref (page_list.first);
-  }
+void
+GstStream::doAdtsAudioData (GstBuffer   * const buffer,
+                            AudioParams   const &params)
+{
+    // A buffer may hold any number of ADTS frames. Each one becomes
+    // a separate RTMP audio message: FLV AAC tags carry one raw frame each.
+
+    Byte const * const data = GST_BUFFER_DATA (buffer);
+    Size         const size = GST_BUFFER_SIZE (buffer);
+
+    Uint64 const base_timestamp = (Uint64) GST_BUFFER_TIMESTAMP (buffer);
+    // Counting samples from the start of the buffer rather than accumulating
+    // per-frame durations, which would accumulate rounding errors.
+    Uint64 num_samples = 0;
+
+    Size pos = 0;
+    while (pos < size) {
+        AdtsHeader hdr;
+        if (!parseAdtsHeader (ConstMemory (data + pos, size - pos), &hdr)) {
+            logW_ (_func, "Malformed or truncated ADTS frame at offset ", pos, ", "
+                   "dropping ", size - pos, " bytes");
+            break;
+        }
 
-_return:
-    if (codec_data_buffer)
-        gst_buffer_unref (codec_data_buffer);
+        Uint64 const timestamp_nanosec =
+                base_timestamp + (hdr.rate ? num_samples * 1000000000 / hdr.rate : 0);
+
+        if (!got_adts_config || hdr.config_bits != adts_config_bits) {
+            got_adts_config = true;
+            adts_config_bits = hdr.config_bits;
+
+            Byte codec_data [2];
+            adtsMakeCodecData (data + pos, codec_data);
+            logD_ (_func, "New AAC codec data: 0x", fmt_hex, (Uint32) codec_data [0], " 0x", (Uint32) codec_data [1]);
+
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::AudioCodecData, trace_id, timestamp_nanosec, sizeof (codec_data), 0, 0);
+            sendAudioMessage (ConstMemory (codec_data, sizeof (codec_data)),
+                              timestamp_nanosec,
+                              VideoStream::AudioFrameType::AacSequenceHeader,
+                              params);
+        }
+
+        sendAudioMessage (ConstMemory (data + pos + hdr.header_len, hdr.frame_len - hdr.header_len),
+                          timestamp_nanosec,
+                          VideoStream::AudioFrameType::RawData,
+                          params);
+
+        num_samples += hdr.num_samples;
+        pos += hdr.frame_len;
+    }
 }
 
 gboolean
@@ -1760,10 +2489,22 @@ GstStream::handoffAudioDataCb (GstElement * const /* element */,
 }
 
 void
-GstStream::doVideoData (GstBuffer * const buffer)
+GstStream::doVideoData (GstBuffer * const buffer,
+                        bool        const replay)
 {
-    // TODO Update current time efficiently.
-    updateTime ();
+    if (!replay
+        && warm.load (std::memory_order_acquire)
+        && holdWarmBuffer (buffer, false /* is_audio */))
+    {
+        return;
+    }
+
+    if (frames_closed.load (std::memory_order_relaxed))
+        return;
+
+    // Thread-local time is only needed for debug log output here.
+    if (logLevelOn (frames, LogLevel::D))
+        updateTime ();
 
     logD (frames, _func, "stream 0x", fmt_hex, (UintPtr) this, ", "
 	  "timestamp 0x", fmt_hex, GST_BUFFER_TIMESTAMP (buffer),
@@ -1799,23 +2540,31 @@ GstStream::doVideoData (GstBuffer * const buffer)
 	if (st_name_mem.len() >= audio_str.len()
 	    && memcmp (st_name_mem.mem(), audio_str.mem(), audio_str.len()) == 0)
 	{
-	    doAudioData (buffer);
+	    doAudioData (buffer, replay);
 	    return;
 	}
     }
 #endif
 
-    mutex.lock ();
+    rx_video_bytes.fetch_add (GST_BUFFER_SIZE (buffer), std::memory_order_relaxed);
+    MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoFrame, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), 0);
 
-    rx_video_bytes += GST_BUFFER_SIZE (buffer);
+    {
+        Time const cur_time = getCoarseTime ();
+        no_video_watch->frameReceived (cur_time);
+        logD (frames, _func, "last_frame_time: 0x", fmt_hex, cur_time);
+    }
 
-    last_frame_time = getTime ();
-    logD (frames, _func, "last_frame_time: 0x", fmt_hex, last_frame_time);
+    bool report_avc_codec_data = false;
+    GstCaps * const caps = GST_BUFFER_CAPS (buffer);
+    if (caps && video_caps_cache.update (caps)) {
+      // Caps have changed, or this is the first frame. This is the only place
+      // where video caps structures are looked up.
 
-    if (first_video_frame) {
-	first_video_frame = false;
+        VideoParams new_video_params;
+        is_h264_stream = false;
+        is_annexb_stream = false;
 
-	GstCaps * const caps = gst_buffer_get_caps (buffer);
 	{
 	    gchar * const str = gst_caps_to_string (caps);
 	    logD (frames, _func, "caps: ", str);
@@ -1828,10 +2577,10 @@ GstStream::doVideoData (GstBuffer * const buffer)
 	ConstMemory const st_name_mem (st_name, strlen (st_name));
 
 	if (equal (st_name_mem, "video/x-flash-video")) {
-	   video_codec_id = VideoStream::VideoCodecId::SorensonH263;
+	   new_video_params.codec_id = VideoStream::VideoCodecId::SorensonH263;
 	} else
 	if (equal (st_name_mem, "video/x-h264")) {
-	   video_codec_id = VideoStream::VideoCodecId::AVC;
+	   new_video_params.codec_id = VideoStream::VideoCodecId::AVC;
            is_h264_stream = true;
 
 #if 0
@@ -1855,20 +2604,64 @@ GstStream::doVideoData (GstBuffer * const buffer)
 	   } while (0);
 #endif
 	} else
-	if (equal (st_name_mem, "video/x-vp6")) {
-	   video_codec_id = VideoStream::VideoCodecId::VP6;
+	if (equal (st_name_mem, "video/x-vp6") || equal (st_name_mem, "video/x-vp6-flash")) {
+	   new_video_params.codec_id = VideoStream::VideoCodecId::VP6;
 	} else
 	if (equal (st_name_mem, "video/x-flash-screen")) {
-	   video_codec_id = VideoStream::VideoCodecId::ScreenVideo;
+	   new_video_params.codec_id = VideoStream::VideoCodecId::ScreenVideo;
 	}
 
-        gst_caps_unref (caps);
+        if (is_h264_stream) {
+            do {
+                GValue const * const val = gst_structure_get_value (st, "codec_data");
+                if (!val || !GST_VALUE_HOLDS_BUFFER (val)) {
+                  // No codec data in caps means that SPS/PPS come in-band.
+                    gchar const * const stream_format = gst_structure_get_string (st, "stream-format");
+                    if (!stream_format || equal (ConstMemory (stream_format, strlen (stream_format)), "byte-stream")) {
+                        logD (frames, _func, "Annex B byte stream");
+                        is_annexb_stream = true;
+                    }
+                    break;
+                }
+
+                GstBuffer * const new_buffer = gst_value_get_buffer (val);
+                if (avc_codec_data_buffer) {
+                    if (equal (ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
+                                            GST_BUFFER_SIZE (avc_codec_data_buffer)),
+                               ConstMemory (GST_BUFFER_DATA (new_buffer),
+                                            GST_BUFFER_SIZE (new_buffer))))
+                    {
+                      // Caps have changed, but codec data has not.
+                        break;
+                    }
+
+                    gst_buffer_unref (avc_codec_data_buffer);
+                }
+
+                avc_codec_data_buffer = new_buffer;
+                gst_buffer_ref (avc_codec_data_buffer);
+                report_avc_codec_data = true;
+            } while (0);
+        }
+
+        video_params.store (new_video_params);
+    }
+
+    if (first_video_frame.load (std::memory_order_acquire)) {
+        mutex.lock ();
+        frame_path_locks.fetch_add (1, std::memory_order_relaxed);
+
+	first_video_frame.store (false, std::memory_order_release);
 
 	if (playback_item->send_metadata) {
 	    if (!got_audio || !first_audio_frame) {
 	      // There's no video or we've got the first video frame already.
 		reportMetaData ();
 		metadata_reported_cond.signal ();
+	    } else
+	    if (replay) {
+	      // Held audio buffers are replayed by this thread after this one,
+	      // metadata is reported with the first of them.
 	    } else {
 	      // Waiting for the first audio frame.
 		while (got_audio && first_audio_frame)
@@ -1876,71 +2669,83 @@ GstStream::doVideoData (GstBuffer * const buffer)
 		    metadata_reported_cond.wait (mutex);
 	    }
 	}
+
+        mutex.unlock ();
     }
 
     bool skip_frame = false;
     {
-	if (video_skip_counter > 0) {
-	    --video_skip_counter;
-	    logD (frames, _func, "Skipping frame, video_skip_counter: ", video_skip_counter);
+	if (video_skip_counter.load (std::memory_order_relaxed) > 0) {
+	    Count const left = video_skip_counter.fetch_sub (1, std::memory_order_relaxed) - 1;
+	    logD (frames, _func, "Skipping frame, video_skip_counter: ", left);
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::SkipCounter);
 	    skip_frame = true;
 	}
 
 //	if (initial_play_pending && !play_pending) {
 //	if (initial_seek_pending && initial_seek > 0) {
-        if (!initial_seek_complete) {
+        if (!initial_seek_complete.load (std::memory_order_acquire)) {
 	    // We have not started playing yet. This is most likely a preroll frame.
 	    logD (frames, _func, "Skipping an early preroll frame");
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::Preroll);
 	    skip_frame = true;
 	}
     }
 
-    VideoStream::VideoCodecId const tmp_video_codec_id = video_codec_id;
-    mutex.unlock ();
+    VideoStream::VideoCodecId const tmp_video_codec_id = video_params.load().codec_id;
 
     if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS) ||
 	GST_BUFFER_TIMESTAMP (buffer) == (GstClockTime) -1)
     {
         logD (frames, _func, "Skipping frame by in_caps/timestamp: ", GST_BUFFER_TIMESTAMP (buffer));
+        MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::InCapsOrNoTimestamp);
 	skip_frame = true;
     }
 
-    if (is_h264_stream) {
-      // Reporting AVC codec data if needed.
+    if (!skip_frame && qos.isEnabled()) {
+        qos.reportVideoFrame (GST_BUFFER_TIMESTAMP (buffer),
+                              getCoarseTimeMilliseconds (),
+                              GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DISCONT));
 
-        bool report_avc_codec_data = false;
+        if (qos.shouldDropNonReferenceFrames ()
+            && isDisposableVideoFrame (buffer))
         {
-            GstCaps * const caps = gst_buffer_get_caps (buffer);
-            GstStructure * const st = gst_caps_get_structure (caps, 0);
-
-            do {
-                GValue const * const val = gst_structure_get_value (st, "codec_data");
-                if (!val || !GST_VALUE_HOLDS_BUFFER (val))
-                   break;
-
-                GstBuffer * const new_buffer = gst_value_get_buffer (val);
-                if (avc_codec_data_buffer) {
-                    if (equal (ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
-                                            GST_BUFFER_SIZE (avc_codec_data_buffer)),
-                               ConstMemory (GST_BUFFER_DATA (new_buffer),
-                                            GST_BUFFER_SIZE (new_buffer))))
-                    {
-                      // Codec data has not changed.
-                        break;
-                    }
-
-                    gst_buffer_unref (avc_codec_data_buffer);
-                }
+            logD (frames, _func, "Dropping a non-reference frame");
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::Qos);
+            qos.nonReferenceFrameDropped ();
+            skip_frame = true;
+        }
+    }
 
-                avc_codec_data_buffer = new_buffer;
-                gst_buffer_ref (avc_codec_data_buffer);
-                report_avc_codec_data = true;
-            } while (0);
+    // For Annex B input, NAL units are written to 'annexb_page_list' with
+    // four-byte length prefixes, and codec data is made out of in-band SPS/PPS.
+    PagePool::PageListHead annexb_page_list;
+    Size annexb_msg_len = 0;
+    bool annexb_is_keyframe = false;
+    if (is_annexb_stream) {
+        if (convertAnnexBVideoData (buffer,
+                                    (skip_frame ? NULL : &annexb_page_list),
+                                    &annexb_msg_len,
+                                    &annexb_is_keyframe))
+        {
+            report_avc_codec_data = true;
+        }
 
-            gst_caps_unref (caps);
+        if (!skip_frame && !avc_codec_data_buffer) {
+            logD (frames, _func, "Skipping frame: no SPS/PPS yet");
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoSkip, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (buffer), GST_BUFFER_FLAGS (buffer), FrameTraceSkipReason::NoCodecData);
+            if (annexb_page_list.first)
+                page_pool->msgUnref (annexb_page_list.first);
+            skip_frame = true;
         }
+    }
+
+    if (is_h264_stream) {
+      // Reporting AVC codec data if needed.
 
         if (report_avc_codec_data) {
+            MOMENT_GST__FRAME_TRACE (FrameTraceEvent::VideoCodecData, trace_id, GST_BUFFER_TIMESTAMP (buffer), GST_BUFFER_SIZE (avc_codec_data_buffer), 0, 0);
+
             // TODO vvv This doesn't sound correct.
             //
             // Timestamps for codec data buffers are seemingly random.
@@ -1957,22 +2762,12 @@ GstStream::doVideoData (GstBuffer * const buffer)
             }
 
             PagePool::PageListHead page_list;
-
-            if (playback_item->enable_prechunking) {
-                RtmpConnection::PrechunkContext prechunk_ctx (5 /* initial_offset: FLV AVC header length */);
-                RtmpConnection::fillPrechunkedPages (&prechunk_ctx,
-                                                     ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
-                                                                  GST_BUFFER_SIZE (avc_codec_data_buffer)),
-                                                     page_pool,
-                                                     &page_list,
-                                                     RtmpConnection::DefaultVideoChunkStreamId,
-                                                     timestamp_nanosec / 1000000,
-                                                     false /* first_chunk */);
-            } else {
-                page_pool->getFillPages (&page_list,
-                                         ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
-                                                      GST_BUFFER_SIZE (avc_codec_data_buffer)));
-            }
+            fillMessagePages (&page_list,
+                              ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
+                                           GST_BUFFER_SIZE (avc_codec_data_buffer)),
+                              5 /* FLV AVC header length */,
+                              RtmpConnection::DefaultVideoChunkStreamId,
+                              timestamp_nanosec / 1000000);
             msg_len += GST_BUFFER_SIZE (avc_codec_data_buffer);
 
             VideoStream::VideoMessage msg;
@@ -1993,9 +2788,7 @@ GstStream::doVideoData (GstBuffer * const buffer)
                 logUnlock ();
             }
 
-            video_stream->fireVideoMessage (&msg);
-
-            page_pool->msgUnref (page_list.first);
+            deliverVideoMessage (&msg);
         } // if (report_avc_codec_data)
     } // if (is_h264_stream)
 
@@ -2004,6 +2797,19 @@ GstStream::doVideoData (GstBuffer * const buffer)
 	return;
     }
 
+    if (!first_frame_recorded.load (std::memory_order_relaxed)) {
+        mutex.lock ();
+        frame_path_locks.fetch_add (1, std::memory_order_relaxed);
+        recordFirstFrame ();
+        mutex.unlock ();
+    }
+
+    if (is_annexb_stream && annexb_msg_len == 0) {
+      // Only parameter sets and access unit delimiters in the buffer.
+        logD (frames, _func, "no slice data");
+        return;
+    }
+
     Size msg_len = 0;
 
     Uint64 const timestamp_nanosec = (Uint64) (GST_BUFFER_TIMESTAMP (buffer));
@@ -2041,7 +2847,9 @@ GstStream::doVideoData (GstBuffer * const buffer)
 	}
     } else
 #endif
-    {
+    if (is_annexb_stream) {
+        is_keyframe = annexb_is_keyframe;
+    } else {
 	is_keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
     }
 
@@ -2053,24 +2861,17 @@ GstStream::doVideoData (GstBuffer * const buffer)
     }
 
     PagePool::PageListHead page_list;
-
-    if (playback_item->enable_prechunking) {
-        Size gen_video_hdr_len = 1;
-        if (tmp_video_codec_id == VideoStream::VideoCodecId::AVC)
-            gen_video_hdr_len = 5;
-
-        RtmpConnection::PrechunkContext prechunk_ctx (gen_video_hdr_len /* initial_offset */);
-        RtmpConnection::fillPrechunkedPages (&prechunk_ctx,
-                                             ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)),
-                                             page_pool,
-                                             &page_list,
-                                             RtmpConnection::DefaultVideoChunkStreamId,
-                                             timestamp_nanosec / 1000000,
-                                             false /* first_chunk */);
+    if (is_annexb_stream) {
+        page_list = annexb_page_list;
+        msg_len += annexb_msg_len;
     } else {
-        page_pool->getFillPages (&page_list, ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)));
+        fillMessagePages (&page_list,
+                          ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)),
+                          (tmp_video_codec_id == VideoStream::VideoCodecId::AVC ? 5 : 1),
+                          RtmpConnection::DefaultVideoChunkStreamId,
+                          timestamp_nanosec / 1000000);
+        msg_len += GST_BUFFER_SIZE (buffer);
     }
-    msg_len += GST_BUFFER_SIZE (buffer);
 
     msg.timestamp_nanosec = timestamp_nanosec;
     msg.prechunk_size = (playback_item->enable_prechunking ? RtmpConnection::PrechunkSize : 0);
@@ -2089,9 +2890,85 @@ GstStream::doVideoData (GstBuffer * const buffer)
     }
 #endif
 
-    video_stream->fireVideoMessage (&msg);
+    deliverVideoMessage (&msg);
+}
+
+// Returns true if in-band SPS/PPS differ from the current codec data,
+// in which case 'avc_codec_data_buffer' is replaced.
+bool
+GstStream::convertAnnexBVideoData (GstBuffer              * const buffer,
+                                   PagePool::PageListHead * const page_list,
+                                   Size                   * const mt_nonnull ret_msg_len,
+                                   bool                   * const mt_nonnull ret_is_keyframe)
+{
+    *ret_msg_len = 0;
+    *ret_is_keyframe = false;
+
+    Uint64 const prechunk_timestamp = (Uint64) GST_BUFFER_TIMESTAMP (buffer) / 1000000;
+    RtmpConnection::PrechunkContext prechunk_ctx (5 /* FLV AVC header length */);
+
+    ConstMemory sps;
+    ConstMemory pps;
+
+    AnnexBNalIterator nal_iter (ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)));
+    ConstMemory nal;
+    while (nal_iter.next (&nal)) {
+        switch (h264NalType (nal)) {
+            case H264NalType::Sps:
+                if (sps.len() == 0)
+                    sps = nal;
+                continue;
+            case H264NalType::Pps:
+                if (pps.len() == 0)
+                    pps = nal;
+                continue;
+            case H264NalType::Aud:
+                continue;
+            case H264NalType::IdrSlice:
+                *ret_is_keyframe = true;
+                break;
+            default:
+                break;
+        }
+
+        if (page_list) {
+            Byte const nal_len [4] = { (Byte) (nal.len() >> 24),
+                                       (Byte) (nal.len() >> 16),
+                                       (Byte) (nal.len() >>  8),
+                                       (Byte) (nal.len() >>  0) };
+            appendMessagePages (page_list, &prechunk_ctx, ConstMemory (nal_len, sizeof (nal_len)),
+                                RtmpConnection::DefaultVideoChunkStreamId, prechunk_timestamp);
+            appendMessagePages (page_list, &prechunk_ctx, nal,
+                                RtmpConnection::DefaultVideoChunkStreamId, prechunk_timestamp);
+        }
+        *ret_msg_len += 4 + nal.len();
+    }
+
+    if (sps.len() < 4 || sps.len() > 0xffff
+        || pps.len() == 0 || pps.len() > 0xffff)
+    {
+        return false;
+    }
+
+    GstBuffer * const new_buffer = gst_buffer_new_and_alloc (avcDecoderConfigurationRecordLength (sps, pps));
+    avcMakeDecoderConfigurationRecord (sps, pps, GST_BUFFER_DATA (new_buffer));
+
+    if (avc_codec_data_buffer) {
+        if (equal (ConstMemory (GST_BUFFER_DATA (avc_codec_data_buffer),
+                                GST_BUFFER_SIZE (avc_codec_data_buffer)),
+                   ConstMemory (GST_BUFFER_DATA (new_buffer),
+                                GST_BUFFER_SIZE (new_buffer))))
+        {
+          // SPS/PPS are repeated, but have not changed.
+            gst_buffer_unref (new_buffer);
+            return false;
+        }
+
+        gst_buffer_unref (avc_codec_data_buffer);
+    }
 
-    page_pool->msgUnref (page_list.first);
+    avc_codec_data_buffer = new_buffer;
+    return true;
 }
 
 gboolean
@@ -2114,17 +2991,133 @@ GstStream::handoffVideoDataCb (GstElement * const /* element */,
     self->doVideoData (buffer);
 }
 
+void
+GstStream::fireRenditionAudioMessage (VideoStream::AudioMessage * const mt_nonnull msg)
+{
+    for (Count i = 0; i < num_rendition_outputs; ++i)
+        rendition_outputs [i].video_stream->fireAudioMessage (msg);
+}
+
+void
+GstStream::fireRenditionVideoMessage (RenditionOutput             * const mt_nonnull output,
+                                      ConstMemory                   const mem,
+                                      Uint64                        const timestamp_nanosec,
+                                      VideoStream::VideoFrameType   const frame_type)
+{
+    PagePool::PageListHead page_list;
+    fillMessagePages (&page_list,
+                      mem,
+                      5 /* FLV AVC header length */,
+                      RtmpConnection::DefaultVideoChunkStreamId,
+                      timestamp_nanosec / 1000000);
+
+    VideoStream::VideoMessage msg;
+    msg.timestamp_nanosec = timestamp_nanosec;
+    msg.prechunk_size = (playback_item->enable_prechunking ? RtmpConnection::PrechunkSize : 0);
+    msg.frame_type = frame_type;
+    msg.codec_id = VideoStream::VideoCodecId::AVC;
+
+    msg.page_pool = page_pool;
+    msg.page_list = page_list;
+    msg.msg_len = mem.len();
+    msg.msg_offset = 0;
+
+    // Renditions are fired into directly from their streaming threads, which
+    // are separate from the main stream's one thanks to the ladder's queues.
+    output->video_stream->fireVideoMessage (&msg);
+    page_pool->msgUnref (msg.page_list.first);
+}
+
+void
+GstStream::doRenditionVideoData (RenditionOutput * const mt_nonnull output,
+                                 GstBuffer       * const buffer)
+{
+    // Unlike the main stream, renditions are not held for adopt(): they
+    // start with the first keyframe after the stream has started playing.
+    if (warm.load (std::memory_order_acquire)
+        || frames_closed.load (std::memory_order_relaxed)
+        || !initial_seek_complete.load (std::memory_order_acquire))
+    {
+        return;
+    }
+
+    GstCaps * const caps = GST_BUFFER_CAPS (buffer);
+    if (caps && output->caps_cache.update (caps)) {
+        GstStructure * const st = gst_caps_get_structure (caps, 0);
+        GValue const * const val = gst_structure_get_value (st, "codec_data");
+        if (val && GST_VALUE_HOLDS_BUFFER (val)) {
+            GstBuffer * const new_buffer = gst_value_get_buffer (val);
+            if (!output->avc_codec_data_buffer
+                || !equal (ConstMemory (GST_BUFFER_DATA (output->avc_codec_data_buffer),
+                                        GST_BUFFER_SIZE (output->avc_codec_data_buffer)),
+                           ConstMemory (GST_BUFFER_DATA (new_buffer),
+                                        GST_BUFFER_SIZE (new_buffer))))
+            {
+                if (output->avc_codec_data_buffer)
+                    gst_buffer_unref (output->avc_codec_data_buffer);
+
+                output->avc_codec_data_buffer = new_buffer;
+                gst_buffer_ref (output->avc_codec_data_buffer);
+
+                fireRenditionVideoMessage (output,
+                                           ConstMemory (GST_BUFFER_DATA (new_buffer),
+                                                        GST_BUFFER_SIZE (new_buffer)),
+                                           0 /* timestamp_nanosec */,
+                                           VideoStream::VideoFrameType::AvcSequenceHeader);
+            }
+        }
+    }
+
+    if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_IN_CAPS)
+        || GST_BUFFER_TIMESTAMP (buffer) == (GstClockTime) -1
+        || !output->avc_codec_data_buffer)
+    {
+        logD (frames, _func, "skipping rendition frame");
+        return;
+    }
+
+    bool const is_keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    fireRenditionVideoMessage (output,
+                               ConstMemory (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer)),
+                               (Uint64) GST_BUFFER_TIMESTAMP (buffer),
+                               (is_keyframe ? VideoStream::VideoFrameType::KeyFrame
+                                            : VideoStream::VideoFrameType::InterFrame));
+}
+
+gboolean
+GstStream::renditionVideoDataCb (GstPad    * const /* pad */,
+                                 GstBuffer * const buffer,
+                                 gpointer    const _output)
+{
+    RenditionOutput * const output = static_cast <RenditionOutput*> (_output);
+    output->stream->doRenditionVideoData (output, buffer);
+    return TRUE;
+}
+
 GstBusSyncReply
 GstStream::busSyncHandler (GstBus     * const /* bus */,
 			   GstMessage * const msg,
 			   gpointer     const _self)
 {
-    updateTime ();
+    if (logLevelOn (bus, LogLevel::D))
+        updateTime ();
+
     logD (bus, _func, gst_message_type_get_name (GST_MESSAGE_TYPE (msg)), ", src: 0x", fmt_hex, (UintPtr) GST_MESSAGE_SRC (msg));
 
     GstStream * const self = static_cast <GstStream*> (_self);
     logD (bus, _func, "self->playbin: 0x", fmt_hex, (UintPtr) self->playbin);
 
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_QOS) {
+        gint64  jitter     = 0;
+        gdouble proportion = 0.0;
+        gint    quality    = 0;
+        gst_message_parse_qos_values (msg, &jitter, &proportion, &quality);
+        logD (bus, _func, "QOS jitter: ", jitter, ", quality: ", quality);
+
+        self->qos.reportQosMessage ((Int64) jitter);
+        return GST_BUS_PASS;
+    }
+
     self->mutex.lock ();
     if (GST_MESSAGE_SRC (msg) == GST_OBJECT (self->playbin)) {
 	logD (bus, _func, "PIPELINE MESSAGE: ", gst_message_type_get_name (GST_MESSAGE_TYPE (msg)));
@@ -2142,39 +3135,48 @@ GstStream::busSyncHandler (GstBus     * const /* bus */,
 		    if (new_state == GST_STATE_PAUSED) {
 			logD (bus, _func, "PAUSED");
 
-			if (self->initial_seek_pending) {
-//                            logD_ (_func, "setting 'initial_seek_pending' to 'false'");
-                            self->initial_seek_pending = false;
-			    if (self->initial_seek > 0) {
-				self->seek_pending = true;
-			    } else {
-                                self->initial_seek_complete = true;
-				if (self->initial_play_pending) {
-				    self->initial_play_pending = false;
-				    self->play_pending = true;
-				}
-			    }
-			} else {
-                            self->initial_seek_complete = true;
-			    if (self->initial_play_pending) {
-				self->initial_play_pending = false;
-				self->play_pending = true;
-			    }
-			}
-
-			self->mutex.unlock ();
-
-                        self->reportStatusEvents ();
-			goto _return;
+                        if (self->pipeline_state == PipelineState::SettingPaused ||
+                            self->pipeline_state == PipelineState::Prerolling    ||
+                            self->pipeline_state == PipelineState::Seeking)
+                        {
+                            self->pipelinePaused ();
+                            self->mutex.unlock ();
+
+                            self->reportStatusEvents ();
+                            goto _return;
+                        }
 		    } else
 		    if (new_state == GST_STATE_PLAYING) {
 			logD (bus, _func, "PLAYING");
+
+                        if (self->pipeline_state == PipelineState::StartingPlayback) {
+                            self->timings.playing_time = getCoarseTimeMilliseconds ();
+                            self->setPipelineState (PipelineState::Playing);
+                        }
 		    }
 		}
 	    } break;
+	    case GST_MESSAGE_ASYNC_DONE: {
+		logD (bus, _func, "ASYNC_DONE");
+
+              // Whichever comes first of ASYNC_DONE and STATE_CHANGED moves
+              // the state machine forward, the other one is ignored.
+                if (self->pipeline_state == PipelineState::SettingPaused ||
+                    self->pipeline_state == PipelineState::Prerolling    ||
+                    self->pipeline_state == PipelineState::Seeking)
+                {
+                    self->pipelinePaused ();
+                    self->mutex.unlock ();
+
+                    self->reportStatusEvents ();
+                    goto _return;
+                }
+	    } break;
 	    case GST_MESSAGE_EOS: {
 		logD (stream, _func, "EOS");
 
+                self->reportStreamFailure (true /* is_eos */);
+
 		self->eos_pending = true;
 		self->mutex.unlock ();
 
@@ -2184,6 +3186,8 @@ GstStream::busSyncHandler (GstBus     * const /* bus */,
 	    case GST_MESSAGE_ERROR: {
 		logD (stream, _func, "ERROR");
 
+                self->reportStreamFailure (false /* is_eos */);
+
 		self->error_pending = true;
 		self->mutex.unlock ();
 
@@ -2203,41 +3207,112 @@ _return:
     return GST_BUS_PASS;
 }
 
+gboolean
+GstStream::latencyStampCb (GstPad    * const /* pad */,
+                           GstBuffer * const buffer,
+                           gpointer    const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+    self->latency.stamp ((Uint64) GST_BUFFER_TIMESTAMP (buffer));
+    return TRUE;
+}
+
 void
-GstStream::noVideoTimerTick (void * const _self)
+GstStream::recordVideoLatency (VideoStream::VideoMessage const * const mt_nonnull msg)
+{
+    if (!latency.isEnabled())
+        return;
+
+    if (msg->frame_type == VideoStream::VideoFrameType::KeyFrame ||
+        msg->frame_type == VideoStream::VideoFrameType::InterFrame)
+    {
+        latency.frameFired (msg->timestamp_nanosec);
+    }
+}
+
+QosTicker::Frontend const GstStream::qos_ticker_frontend = {
+    qosTick
+};
+
+void
+GstStream::qosTick (void * const _self)
 {
     GstStream * const self = static_cast <GstStream*> (_self);
+    self->qos.tick (self->channel_opts->channel_name->mem());
+}
+
+// Only H.264 frames are looked into. Demuxers don't tell disposable
+// Sorenson H.263 frames apart, and other codecs don't have them.
+bool
+GstStream::isDisposableVideoFrame (GstBuffer * const mt_nonnull buffer)
+{
+    if (!is_h264_stream)
+        return false;
 
-    Time const time = getTime();
+    ConstMemory const mem (GST_BUFFER_DATA (buffer), GST_BUFFER_SIZE (buffer));
+    if (is_annexb_stream)
+        return annexBIsDisposableAccessUnit (mem);
 
-    self->mutex.lock ();
-    logD (novideo, _self_func, "time: 0x", fmt_hex, time, ", last_frame_time: 0x", self->last_frame_time);
+    if (!avc_codec_data_buffer || GST_BUFFER_SIZE (avc_codec_data_buffer) < 5)
+        return false;
+
+    // lengthSizeMinusOne of AVCDecoderConfigurationRecord.
+    unsigned const nal_length_size = (GST_BUFFER_DATA (avc_codec_data_buffer) [4] & 0x03) + 1;
+    return avcIsDisposableAccessUnit (mem, nal_length_size);
+}
+
+gboolean
+GstStream::qosRawVideoDataCb (GstPad    * const /* pad */,
+                              GstBuffer * const /* buffer */,
+                              gpointer    const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+    return self->qos.dropEncoderInputFrame () ? FALSE : TRUE;
+}
+
+FrameTimeoutWheel::Frontend const GstStream::no_video_frontend = {
+    noVideoTimeout,
+    noVideoFramesFlowing
+};
 
+void
+GstStream::noVideoTimeout (void * const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
+
+    self->mutex.lock ();
     if (self->stream_closed) {
 	self->mutex.unlock ();
 	return;
     }
 
-    if (time > self->last_frame_time &&
-	time - self->last_frame_time >= 15 /* TODO Config param for the timeout */)
-    {
-	logD (novideo, _func, "firing \"no video\" event");
+    logD (novideo, _self_func, "firing \"no video\" event");
 
-	if (self->no_video_timer) {
-	    self->timers->deleteTimer (self->no_video_timer);
-	    self->no_video_timer = NULL;
-	}
+    self->no_video_pending = true;
+    self->mutex.unlock ();
 
-	self->no_video_pending = true;
-	self->mutex.unlock ();
+    // Runs on the wheel thread, which is shared by all streams.
+    self->reportStatusEvents ();
+}
 
-	self->doReportStatusEvents ();
-    } else {
-	self->got_video_pending = true;
-	self->mutex.unlock ();
+void
+GstStream::noVideoFramesFlowing (void * const _self)
+{
+    GstStream * const self = static_cast <GstStream*> (_self);
 
-	self->doReportStatusEvents ();
+    self->mutex.lock ();
+    if (self->stream_closed) {
+	self->mutex.unlock ();
+	return;
     }
+
+    logD (novideo, _self_func, "frames are flowing");
+
+    self->got_video_pending = true;
+    self->mutex.unlock ();
+
+    // Runs on the wheel thread, which is shared by all streams.
+    self->reportStatusEvents ();
 }
 
 VideoStream::EventHandler GstStream::mix_stream_handler = {
@@ -2341,6 +3416,12 @@ GstStream::doCreatePipeline ()
 {
     logD (pipeline, _this_func_);
 
+    mutex.lock ();
+    timings = PipelineTimings ();
+    timings.create_time = getCoarseTimeMilliseconds ();
+    setPipelineState (PipelineState::Creating);
+    mutex.unlock ();
+
     if (playback_item->spec_kind == PlaybackItem::SpecKind::Chain) {
 	createPipelineForChainSpec ();
     } else
@@ -2349,6 +3430,12 @@ GstStream::doCreatePipeline ()
 	createSmartPipelineForUri ();
     } else {
         assert (playback_item->spec_kind == PlaybackItem::SpecKind::None);
+
+        // Nothing to start.
+        mutex.lock ();
+        if (start_request)
+            reconnect_scheduler->startDone (start_request);
+        mutex.unlock ();
     }
 }
 
@@ -2359,6 +3446,13 @@ GstStream::createPipeline ()
 
     mutex.lock ();
 
+    // A prepared stream has its pipeline already.
+    if (pipeline_requested) {
+        mutex.unlock ();
+        return;
+    }
+    pipeline_requested = true;
+
     while (!workqueue_list.isEmpty()) {
         Ref<WorkqueueItem> &last_item = workqueue_list.getLast();
         switch (last_item->item_type) {
@@ -2377,8 +3471,11 @@ GstStream::createPipeline ()
     new_item->item_type = WorkqueueItem::ItemType_CreatePipeline;
 
     workqueue_list.prepend (new_item);
-    workqueue_cond.signal ();
 
+    // The scheduler puts the task on the pipeline pool when it's time to
+    // start. 'start_request' is set before a worker could pick the task up,
+    // since the worker takes 'mutex' first.
+    start_request = reconnect_scheduler->requestStart (channel_opts->channel_name->mem(), workqueue_task);
     mutex.unlock ();
 }
 
@@ -2398,8 +3495,9 @@ GstStream::doReportStatusEvents ()
 	   error_pending     ||
 	   no_video_pending  ||
 	   got_video_pending ||
-	   seek_pending      ||
-	   play_pending)
+	   pipeline_state == PipelineState::SeekPending ||
+	   play_pending      ||
+	   warm_ready_pending)
     {
 	if (close_notified) {
 	    logD (stream, _func, "close_notified");
@@ -2408,6 +3506,32 @@ GstStream::doReportStatusEvents ()
 	    return;
 	}
 
+        if (warm.load (std::memory_order_relaxed)) {
+          // Not adopted yet. Only the initial seek is made, other events
+          // are held until adopt().
+            if (!warm_notified && (warm_ready_pending || eos_pending || error_pending)) {
+                bool const ok = !eos_pending && !error_pending;
+                warm_notified = true;
+                warm_ready_pending = false;
+
+                logD (stream, _func, "firing warmReady, ok: ", ok);
+                mt_unlocks_locks (mutex) warm_frontend.call_mutex (warm_frontend->warmReady, mutex, /*(*/ this, ok /*)*/);
+                continue;
+            }
+
+            warm_ready_pending = false;
+
+            // There is no frontend to report EOS and errors to. They are
+            // held for adopt(), and the seek is pointless.
+            if (eos_pending || error_pending)
+                break;
+
+            if (pipeline_state != PipelineState::SeekPending)
+                break;
+        } else {
+            warm_ready_pending = false;
+        }
+
 	if (eos_pending) {
 	    logD (stream, _func, "eos_pending");
 	    eos_pending = false;
@@ -2462,46 +3586,48 @@ GstStream::doReportStatusEvents ()
 		mt_unlocks_locks (mutex) frontend.call_mutex (frontend->gotVideo, mutex);
 	}
 
-	if (seek_pending) {
-	    logD (stream, _func, "seek_pending");
+	if (pipeline_state == PipelineState::SeekPending) {
+	    logD (stream, _func, "seek pending");
 	    assert (!play_pending);
-	    seek_pending = false;
 	    if (stream_closed) {
 		mutex.unlock ();
 		return;
 	    }
 
-	    if (initial_seek > 0) {
-		logD (stream, _func, "initial_seek: ", initial_seek);
+            logD (stream, _func, "initial_seek: ", initial_seek);
 
-		Time const tmp_initial_seek = initial_seek;
+            Time const tmp_initial_seek = initial_seek;
 
-		GstElement * const tmp_playbin = playbin;
-		gst_object_ref (tmp_playbin);
-		mutex.unlock ();
+            GstElement * const tmp_playbin = playbin;
+            gst_object_ref (tmp_playbin);
 
-		bool seek_failed = false;
-		if (!gst_element_seek_simple (tmp_playbin,
-					      GST_FORMAT_TIME,
-					      (GstSeekFlags) (GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
-					      (GstClockTime) tmp_initial_seek * 1000000000LL))
-		{
-		    seek_failed = true;
-		    logE_ (_func, "Seek failed");
-		}
+            // Completion is reported with ASYNC_DONE.
+            setPipelineState (PipelineState::Seeking);
+            mutex.unlock ();
 
-		gst_object_unref (tmp_playbin);
-		mutex.lock ();
-		if (seek_failed)
-		    play_pending = true;
-	    } else {
-		play_pending = true;
-	    }
+            bool seek_failed = false;
+            if (!gst_element_seek_simple (tmp_playbin,
+                                          GST_FORMAT_TIME,
+                                          (GstSeekFlags) (GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT),
+                                          (GstClockTime) tmp_initial_seek * 1000000000LL))
+            {
+                seek_failed = true;
+                logE_ (_func, "Seek failed");
+            }
+
+            gst_object_unref (tmp_playbin);
+            mutex.lock ();
+            if (seek_failed && pipeline_state == PipelineState::Seeking) {
+              // Playing from where the pipeline is.
+                initial_seek_complete.store (true, std::memory_order_release);
+                setPipelineState (PipelineState::StartingPlayback);
+                play_pending = true;
+            }
 	}
 
 	if (play_pending) {
 	    logD (stream, _func, "play_pending");
-	    assert (!seek_pending);
+	    assert (pipeline_state != PipelineState::SeekPending);
 	    play_pending = false;
 	    if (stream_closed) {
 		mutex.unlock ();
@@ -2529,19 +3655,61 @@ GstStream::doReportStatusEvents ()
 void
 GstStream::getTrafficStats (TrafficStats * const mt_nonnull ret_traffic_stats)
 {
-    mutex.lock ();
-    ret_traffic_stats->rx_bytes = rx_bytes;
-    ret_traffic_stats->rx_audio_bytes = rx_audio_bytes;
-    ret_traffic_stats->rx_video_bytes = rx_video_bytes;
-    mutex.unlock ();
+    ret_traffic_stats->rx_bytes       = rx_bytes.load (std::memory_order_relaxed);
+    ret_traffic_stats->rx_audio_bytes = rx_audio_bytes.load (std::memory_order_relaxed);
+    ret_traffic_stats->rx_video_bytes = rx_video_bytes.load (std::memory_order_relaxed);
 }
 
 void
 GstStream::resetTrafficStats ()
 {
-    rx_bytes = 0;
-    rx_audio_bytes = 0;
-    rx_video_bytes = 0;
+    rx_bytes.store (0, std::memory_order_relaxed);
+    rx_audio_bytes.store (0, std::memory_order_relaxed);
+    rx_video_bytes.store (0, std::memory_order_relaxed);
+}
+
+// Returns 0 if either of the stages has not been reached.
+static Time stageTime (Time const from,
+                       Time const to)
+{
+    if (!from || !to || to < from)
+        return 0;
+
+    return to - from;
+}
+
+void
+GstStream::getStreamStats (StreamStats * const mt_nonnull ret_stats)
+{
+    ret_stats->rx_bytes         = rx_bytes.load (std::memory_order_relaxed);
+    ret_stats->rx_audio_bytes   = rx_audio_bytes.load (std::memory_order_relaxed);
+    ret_stats->rx_video_bytes   = rx_video_bytes.load (std::memory_order_relaxed);
+    ret_stats->copied_bytes     = copied_bytes.load (std::memory_order_relaxed);
+    ret_stats->frame_path_locks = frame_path_locks.load (std::memory_order_relaxed);
+    ret_stats->trace_id         = trace_id;
+
+    ret_stats->async_delivery       = (bool) delivery_consumer;
+    ret_stats->audio_ring_depth     = (delivery_consumer ? audio_ring.getDepth() : 0);
+    ret_stats->video_ring_depth     = (delivery_consumer ? video_ring.getDepth() : 0);
+    ret_stats->audio_frames_dropped = audio_frames_dropped.load (std::memory_order_relaxed);
+    ret_stats->video_frames_dropped = video_frames_dropped.load (std::memory_order_relaxed);
+    ret_stats->video_gops_dropped   = video_gops_dropped.load (std::memory_order_relaxed);
+
+    qos.getStats (&ret_stats->qos);
+
+    ret_stats->low_latency = stream_opts->low_latency;
+    latency.getStats (&ret_stats->latency);
+
+    mutex.lock ();
+    ret_stats->pipeline_state = pipelineStateToString (pipeline_state);
+
+    Time const start_time = (timings.seek_done_time ? timings.seek_done_time : timings.paused_time);
+    ret_stats->preroll_time     = stageTime (timings.create_time, timings.paused_time);
+    ret_stats->seek_time        = stageTime (timings.paused_time, timings.seek_done_time);
+    ret_stats->play_time        = stageTime (start_time, timings.playing_time);
+    ret_stats->first_frame_time = stageTime (timings.playing_time ? timings.playing_time : start_time,
+                                             timings.first_frame_time);
+    mutex.unlock ();
 }
 
 mt_const void
@@ -2553,7 +3721,16 @@ GstStream::init (CbDesc<MediaSource::Frontend> const &frontend,
 		 VideoStream       * const mix_video_stream,
 		 Time                const initial_seek,
                  ChannelOptions    * const channel_opts,
-                 PlaybackItem      * const playback_item)
+                 PlaybackItem      * const playback_item,
+                 GstStreamOptions  * const stream_opts,
+                 FrameDeliveryPool * const delivery_pool,
+                 PipelineControlPool * const mt_nonnull pipeline_pool,
+                 ChainTemplateCache  * const mt_nonnull chain_cache,
+                 ReconnectScheduler  * const mt_nonnull reconnect_scheduler,
+                 PipelineReaper      * const mt_nonnull reaper,
+                 EncoderScheduler    * const encoder_scheduler,
+                 FrameTimeoutWheel   * const mt_nonnull timeout_wheel,
+                 QosTicker           * const mt_nonnull qos_ticker)
 {
     logD (pipeline, _this_func_);
 
@@ -2567,20 +3744,58 @@ GstStream::init (CbDesc<MediaSource::Frontend> const &frontend,
     this->channel_opts  = channel_opts;
     this->playback_item = playback_item;
 
+    this->stream_opts = stream_opts;
+    qos.init (stream_opts->qos);
+    latency.init (stream_opts->measure_latency);
+
+    if (stream_opts->renditions && stream_opts->renditions->getNumRenditions() > 0) {
+        num_rendition_outputs = stream_opts->renditions->getNumRenditions();
+        rendition_outputs = new (std::nothrow) RenditionOutput [num_rendition_outputs];
+        assert (rendition_outputs);
+        for (Count i = 0; i < num_rendition_outputs; ++i) {
+            rendition_outputs [i].stream = this;
+            rendition_outputs [i].video_stream = stream_opts->renditions->getRendition (i)->video_stream;
+        }
+    }
+
+    if (stream_opts->async_delivery && delivery_pool) {
+        Size ring_size = stream_opts->frame_ring_size;
+        if (ring_size < 4 * RingReservedSlots)
+            ring_size = 4 * RingReservedSlots;
+
+        audio_ring.init (ring_size);
+        video_ring.init (ring_size);
+
+        Count watermark = stream_opts->frame_ring_drop_watermark;
+        if (watermark > 100)
+            watermark = 100;
+
+        video_ring_drop_depth = video_ring.getCapacity() * watermark / 100;
+        if (video_ring_drop_depth + RingReservedSlots > video_ring.getCapacity())
+            video_ring_drop_depth = video_ring.getCapacity() - RingReservedSlots;
+
+        this->delivery_pool = delivery_pool;
+        delivery_consumer = delivery_pool->addConsumer (
+                CbDesc<FrameDeliveryPool::Frontend> (&delivery_frontend, this, this));
+    }
+
     this->initial_seek = initial_seek;
     if (initial_seek == 0)
-        initial_seek_complete = true;
+        initial_seek_complete.store (true, std::memory_order_relaxed);
 
     deferred_reg.setDeferredProcessor (deferred_processor);
 
-    {
-        workqueue_thread =
-                grab (new (std::nothrow) Thread (CbDesc<Thread::ThreadFunc> (workqueueThreadFunc,
-                                                                             this,
-                                                                             this)));
-        if (!workqueue_thread->spawn (true /* joinable */))
-            logE_ (_func, "Failed to spawn workqueue thread: ", exc->toString());
-    }
+    this->pipeline_pool = pipeline_pool;
+    this->chain_cache = chain_cache;
+    this->reconnect_scheduler = reconnect_scheduler;
+    this->reaper = reaper;
+    this->encoder_scheduler = encoder_scheduler;
+    this->timeout_wheel = timeout_wheel;
+    no_video_watch = timeout_wheel->createWatch (
+            CbDesc<FrameTimeoutWheel::Frontend> (&no_video_frontend, this, this));
+    this->qos_ticker = qos_ticker;
+    workqueue_task = pipeline_pool->createTask (
+            CbDesc<PipelineControlPool::Frontend> (&pipeline_pool_frontend, this, this));
 
     if (mix_video_stream) {
 	mix_audio_caps = gst_caps_new_simple ("audio/x-speex",
@@ -2611,13 +3826,15 @@ GstStream::GstStream ()
     : timers    (this /* coderef_container */),
       page_pool (this /* coderef_container */),
 
+      trace_id (frameTraceNewStreamId ()),
+
       video_stream (NULL),
       mix_video_stream (NULL),
 
       mix_audio_caps (NULL),
       mix_video_caps (NULL),
 
-      no_video_timer (NULL),
+      pipeline_released (false),
 
       playbin (NULL),
       audio_probe_id (0),
@@ -2630,42 +3847,16 @@ GstStream::GstStream ()
       mix_video_src (NULL),
 
       initial_seek (0),
-      initial_seek_pending  (true),
-      initial_seek_complete (false),
-      initial_play_pending  (true),
 
       metadata_reported (false),
 
-      last_frame_time (0),
-
-      audio_codec_id (VideoStream::AudioCodecId::Unknown),
-      audio_rate (44100),
-      audio_channels (1),
-
-      video_codec_id (VideoStream::VideoCodecId::Unknown),
-
       got_in_stats (false),
       got_video (false),
       got_audio (false),
 
-      first_audio_frame (true),
-      first_video_frame (true),
-
-      audio_skip_counter (0),
-      video_skip_counter (0),
-
-      is_adts_aac_stream (false),
-      got_adts_aac_codec_data (false),
-
-      is_h264_stream (false),
-      avc_codec_data_buffer (NULL),
-
-      prv_audio_timestamp (0),
-
-      changing_state_to_playing (false),
+      pipeline_state (PipelineState::Idle),
       reporting_status_events (false),
 
-      seek_pending (false),
       play_pending (false),
 
       no_video_pending (false),
@@ -2676,11 +3867,54 @@ GstStream::GstStream ()
 
       stream_closed (false),
 
+      pipeline_requested (false),
+      warm_ready_pending (false),
+      warm_notified (false),
+      video_transcoded (false),
+
+      initial_seek_complete (false),
+      warm (false),
+      frames_closed (false),
+      first_frame_recorded (false),
+      first_audio_frame (true),
+      first_video_frame (true),
+
+
+      audio_params (AudioParams ()),
+      video_params (VideoParams ()),
+
+      audio_skip_counter (0),
+      video_skip_counter (0),
+
       rx_bytes (0),
       rx_audio_bytes (0),
       rx_video_bytes (0),
 
-      tlocal (NULL)
+      copied_bytes (0),
+      frame_path_locks (0),
+
+      is_adts_aac_stream (false),
+      got_adts_config (false),
+      adts_config_bits (0),
+      prv_audio_timestamp (0),
+      audio_codec_data_type (VideoStream::AudioFrameType::Unknown),
+      num_audio_codec_data_buffers (0),
+
+      is_h264_stream (false),
+      is_annexb_stream (false),
+      avc_codec_data_buffer (NULL),
+
+      rendition_outputs (NULL),
+      num_rendition_outputs (0),
+
+      video_ring_drop_depth (0),
+
+      delivery_seq (0),
+      audio_frames_dropped (0),
+      video_frames_dropped (0),
+      video_gops_dropped (0),
+
+      video_gop_broken (false)
 {
     logD (pipeline, _this_func_);
 
@@ -2693,7 +3927,6 @@ GstStream::~GstStream ()
 
     mutex.lock ();
     assert (stream_closed);
-    assert (!workqueue_thread);
     mutex.unlock ();
 
     if (mix_audio_caps)
@@ -2704,6 +3937,18 @@ GstStream::~GstStream ()
     if (avc_codec_data_buffer)
         gst_buffer_unref (avc_codec_data_buffer);
 
+    for (Count i = 0; i < num_audio_codec_data_buffers; ++i)
+        gst_buffer_unref (audio_codec_data_buffers [i]);
+
+    releaseWarmBuffers ();
+
+    if (delivery_consumer) {
+        delivery_pool->removeConsumer (delivery_consumer);
+        releaseQueuedFrames ();
+    }
+
+    delete[] rendition_outputs;
+
     deferred_reg.release ();
 }
 
@@ -22,19 +22,87 @@
 
 
 #include <libmary/types.h>
+#include <atomic>
 #include <gst/gst.h>
 #include <gst/app/gstappsrc.h>
 
 #include <moment/libmoment.h>
 
+#include <moment-gst/seqlock.h>
+#include <moment-gst/spsc_ring.h>
+#include <moment-gst/frame_delivery.h>
+#include <moment-gst/pipeline_pool.h>
+#include <moment-gst/chain_template.h>
+#include <moment-gst/reconnect_scheduler.h>
+#include <moment-gst/pipeline_reaper.h>
+#include <moment-gst/transcode_profile.h>
+#include <moment-gst/rendition_set.h>
+#include <moment-gst/encoder_scheduler.h>
+#include <moment-gst/frame_timeout_wheel.h>
+#include <moment-gst/qos_controller.h>
+#include <moment-gst/latency_tracker.h>
+
 
 namespace MomentGst {
 
 using namespace M;
 using namespace Moment;
 
+// mod_gst-specific stream options which have no place in ChannelOptions.
+class GstStreamOptions : public Referenced
+{
+public:
+    // If 'true', then frames are fired into VideoStream by a FrameDeliveryPool
+    // thread instead of GStreamer streaming threads.
+    bool async_delivery;
+    // Capacity of each of the audio and video frame rings.
+    Count frame_ring_size;
+    // Percentage of video ring capacity at which non-keyframes start being
+    // dropped. Whole GOPs are dropped when the ring is full.
+    Count frame_ring_drop_watermark;
+    // Encoders for raw audio and video. Never NULL.
+    Ref<TranscodeProfile> transcode_profile;
+    // Additional encodings of raw video. NULL if there are none.
+    Ref<RenditionSet> renditions;
+    // Load shedding for streams which fall behind real time.
+    QosController::Options qos;
+    // Minimal buffering along the chain: low source latency, small decodebin
+    // and ladder queues, x264enc tuned for zero latency, sinks not synced
+    // to the clock. Chain-spec pipelines are left as is.
+    bool low_latency;
+    // Latency of network sources (rtspsrc) and decodebin queue limit
+    // in low latency mode.
+    Uint32 source_latency_millisec;
+    // Measure the time video frames spend in the stream.
+    bool measure_latency;
+    // "No video" is reported after this many seconds without frames.
+    Time no_video_threshold;
+
+    GstStreamOptions ()
+        : async_delivery (false),
+          frame_ring_size (256),
+          frame_ring_drop_watermark (75),
+          transcode_profile (grab (new (std::nothrow) TranscodeProfile)),
+          low_latency (false),
+          source_latency_millisec (200),
+          measure_latency (false),
+          no_video_threshold (15)
+    {}
+};
+
 class GstStream : public MediaSource
 {
+public:
+    // For streams prepared ahead of time with prepare().
+    struct WarmFrontend
+    {
+        // Called once, when the pipeline has prerolled ('ok' is true) or
+        // has failed to.
+        void (*warmReady) (GstStream *stream,
+                           bool       ok,
+                           void      *cb_data);
+    };
+
 private:
     StateMutex mutex;
 
@@ -53,19 +121,187 @@ private:
         mt_const ItemType item_type;
     };
 
+    struct WarmBuffer
+    {
+        GstBuffer *buffer;
+        bool       is_audio;
+    };
+
+    // Preroll gives at most one buffer per sink, plus whatever queues hold.
+    enum { MaxWarmBuffers = 32 };
+
+    // Pipeline startup goes through these states in order. Once
+    // gst_element_set_state (PAUSED) has returned, transitions are driven
+    // by ASYNC_DONE and STATE_CHANGED bus messages, and no thread waits
+    // for the pipeline to preroll.
+    struct PipelineState
+    {
+        enum Value {
+            // No pipeline yet.
+            Idle,
+            // The pipeline is being built.
+            Creating,
+            // gst_element_set_state (PAUSED) is in progress. The pipeline
+            // should not be set to NULL state concurrently.
+            SettingPaused,
+            // Waiting for the pipeline to preroll.
+            Prerolling,
+            // Initial seek should be initiated in reportStatusEvents().
+            SeekPending,
+            // Waiting for the initial seek to complete.
+            Seeking,
+            // Prerolled, with the initial seek done. Waiting for adopt().
+            Warm,
+            // Waiting for STATE_CHANGED to PLAYING.
+            StartingPlayback,
+            Playing,
+            Closed
+        };
+    };
+
+    static char const * pipelineStateToString (PipelineState::Value state);
+
+    // Times of state transitions, in milliseconds. Zero if the transition
+    // has not happened yet.
+    struct PipelineTimings
+    {
+        Time create_time;
+        Time paused_time;
+        Time seek_done_time;
+        Time playing_time;
+        Time first_frame_time;
+
+        PipelineTimings ()
+            : create_time      (0),
+              paused_time      (0),
+              seek_done_time   (0),
+              playing_time     (0),
+              first_frame_time (0)
+        {}
+    };
+
+    // Codec parameters are set by the streaming threads whenever buffer caps
+    // change and are read for every frame without locking.
+    struct AudioParams
+    {
+        VideoStream::AudioCodecId codec_id;
+        unsigned rate;
+        unsigned channels;
+
+        AudioParams ()
+            : codec_id (VideoStream::AudioCodecId::Unknown),
+              rate     (44100),
+              channels (1)
+        {}
+    };
+
+    struct VideoParams
+    {
+        VideoStream::VideoCodecId codec_id;
+
+        VideoParams ()
+            : codec_id (VideoStream::VideoCodecId::Unknown)
+        {}
+    };
+
+    // Remembers the last seen caps of a stream. Holding a reference to the
+    // caps guarantees that the pointer can't be reused for different caps,
+    // so comparing pointers is enough to detect a caps change.
+    class CapsCache
+    {
+    private:
+        GstCaps *caps;
+
+    public:
+        // Returns true if 'new_caps' differ from the caps seen previously.
+        bool update (GstCaps * mt_nonnull new_caps)
+        {
+            if (new_caps == caps)
+                return false;
+
+            gst_caps_ref (new_caps);
+            if (caps)
+                gst_caps_unref (caps);
+
+            caps = new_caps;
+            return true;
+        }
+
+        CapsCache ()
+            : caps (NULL)
+        {}
+
+        ~CapsCache ()
+        {
+            if (caps)
+                gst_caps_unref (caps);
+        }
+    };
+
+    // Output of one of the encoders of 'stream_opts->renditions'. Fields
+    // below 'video_stream' are accessed from the rendition's streaming
+    // thread only.
+    class RenditionOutput
+    {
+    public:
+        GstStream   *stream;
+        VideoStream *video_stream;
+
+        GstBuffer *avc_codec_data_buffer;
+        CapsCache  caps_cache;
+
+        RenditionOutput ()
+            : stream (NULL),
+              video_stream (NULL),
+              avc_codec_data_buffer (NULL)
+        {}
+
+        ~RenditionOutput ()
+        {
+            if (avc_codec_data_buffer)
+                gst_buffer_unref (avc_codec_data_buffer);
+        }
+    };
+
     mt_const Ref<ChannelOptions> channel_opts;
     mt_const Ref<PlaybackItem>   playback_item;
 
     mt_const DataDepRef<Timers> timers;
     mt_const DataDepRef<PagePool> page_pool;
 
+    // Identifies this stream in frame trace records.
+    mt_const Uint32 trace_id;
+
+    // Set in adopt() for streams made with prepare().
     mt_const Ref<VideoStream> video_stream;
     mt_const Ref<VideoStream> mix_video_stream;
 
     mt_const GstCaps *mix_audio_caps;
     mt_const GstCaps *mix_video_caps;
 
-    mt_const Ref<Thread> workqueue_thread;
+    mt_const Ref<PipelineControlPool> pipeline_pool;
+    mt_const Ref<PipelineControlPool::Task> workqueue_task;
+
+    mt_const Ref<ChainTemplateCache> chain_cache;
+
+    mt_const Ref<ReconnectScheduler> reconnect_scheduler;
+    mt_const Ref<PipelineReaper> reaper;
+    // NULL if encoder threads are not scheduled.
+    mt_const Ref<EncoderScheduler> encoder_scheduler;
+
+    mt_const Ref<FrameTimeoutWheel> timeout_wheel;
+    mt_const Ref<FrameTimeoutWheel::Watch> no_video_watch;
+
+    mt_const Ref<QosTicker> qos_ticker;
+
+    struct ScheduledEncoder
+    {
+        Ref<EncoderScheduler::Encoder> encoder;
+        // Name of the encoder element in the video bin.
+        Ref<String> element_name;
+        // Name of the queue which feeds the encoder.
+        Ref<String> queue_name;
+    };
 
     DeferredProcessor::Task deferred_task;
     DeferredProcessor::Registration deferred_reg;
@@ -77,9 +313,13 @@ private:
     mt_begin
 
       List< Ref<WorkqueueItem> > workqueue_list;
-      Cond workqueue_cond;
+      // Set when a ReleasePipeline item has been processed.
+      bool pipeline_released;
+      // Signalled when 'pipeline_released' is set.
+      Cond release_cond;
 
-      Timers::TimerKey no_video_timer;
+      // Set while the pipeline is running if QoS is enabled.
+      Ref<QosTicker::Entry> qos_entry;
 
       GstElement *playbin;
       gulong audio_probe_id;
@@ -92,51 +332,24 @@ private:
       GstAppSrc *mix_video_src;
 
       Time initial_seek;
-      bool initial_seek_pending;
-      bool initial_seek_complete;
-      bool initial_play_pending;
 
       RtmpServer::MetaData metadata;
       Cond metadata_reported_cond;
       bool metadata_reported;
 
-      Time last_frame_time;
-
-      VideoStream::AudioCodecId audio_codec_id;
-      unsigned audio_rate;
-      unsigned audio_channels;
-
-      VideoStream::VideoCodecId video_codec_id;
-
       bool got_in_stats;
       bool got_video;
       bool got_audio;
 
-      bool first_audio_frame;
-      bool first_video_frame;
-
-      Count audio_skip_counter;
-      Count video_skip_counter;
-
-      bool is_adts_aac_stream;
-      bool got_adts_aac_codec_data;
-      Byte adts_aac_codec_data [2];
-
-      bool is_h264_stream;
-      GstBuffer *avc_codec_data_buffer;
+      PipelineState::Value pipeline_state;
+      PipelineTimings timings;
 
-      Uint64 prv_audio_timestamp;
-
-      // This flag helps to prevent concurrent pipeline state transition
-      // requests (to NULL and to PLAYING states).
-      // TODO FIXME chaning_state_to_playing is not used in all cases where it should be.
-      bool changing_state_to_playing;
+      // Holds a start slot from 'reconnect_scheduler' while the pipeline
+      // is being created.
+      Ref<ReconnectScheduler::Request> start_request;
 
       bool reporting_status_events;
 
-      // If 'true', then a seek to 'initial_seek' position should be initiated
-      // in reportStatusEvents().
-      bool seek_pending;
       // If 'true', then the pipeline should be set to PLAYING state
       // in reportStatusEvents().
       bool play_pending;
@@ -157,20 +370,163 @@ private:
       // objects should be released.
       bool stream_closed;
 
-      // Bytes received (in_stats_el's sink pad).
-      Uint64 rx_bytes;
-      // Bytes generated (audio fakesink's sink pad).
-      Uint64 rx_audio_bytes;
-      // Bytes generated (video fakesink's sink pad).
-      Uint64 rx_video_bytes;
+      // Set by the first createPipeline() call.
+      bool pipeline_requested;
+
+      Cb<WarmFrontend> warm_frontend;
+      bool warm_ready_pending;
+      bool warm_notified;
+      // Buffers which have reached the sinks before adopt(), in order.
+      List<WarmBuffer> warm_buffers;
+
+      // Video encoders of the pipeline registered with 'encoder_scheduler'.
+      List<ScheduledEncoder> scheduled_encoders;
 
-      LibMary_ThreadLocal *tlocal;
+      // Set by setRawVideoPad(): video is decoded and encoded again.
+      bool video_transcoded;
 
     mt_end
 
+  // Per-frame state. The steady-state frame path takes no locks: counters
+  // are atomic, codec parameters are published through seqlocks. 'mutex'
+  // is only taken for the first frame of each kind.
+
+    // Set under 'mutex', read locklessly.
+    std::atomic<bool> initial_seek_complete;
+    // Set from prepare() until adopt(). Frames are held while it's set.
+    std::atomic<bool> warm;
+    // Set when the pipeline is handed over to 'reaper'. Frames which
+    // the dying pipeline still produces are dropped.
+    std::atomic<bool> frames_closed;
+    // Set once the first frame after the initial seek has been seen.
+    std::atomic<bool> first_frame_recorded;
+    std::atomic<bool> first_audio_frame;
+    std::atomic<bool> first_video_frame;
+
+    Seqlock<AudioParams> audio_params;
+    Seqlock<VideoParams> video_params;
+
+    std::atomic<Count> audio_skip_counter;
+    std::atomic<Count> video_skip_counter;
+
+    // Bytes received (in_stats_el's sink pad).
+    std::atomic<Uint64> rx_bytes;
+    // Bytes generated (audio fakesink's sink pad).
+    std::atomic<Uint64> rx_audio_bytes;
+    // Bytes generated (video fakesink's sink pad).
+    std::atomic<Uint64> rx_video_bytes;
+
+    // Bytes copied from GstBuffers into PagePool pages.
+    std::atomic<Uint64> copied_bytes;
+
+    // How many times the frame path had to take 'mutex'. This should stop
+    // growing once the first audio and video frames have been processed.
+    std::atomic<Uint64> frame_path_locks;
+
+  // Accessed from the audio streaming thread only.
+
+    bool is_adts_aac_stream;
+    bool got_adts_config;
+    Uint32 adts_config_bits;
+    Uint64 prv_audio_timestamp;
+    CapsCache audio_caps_cache;
+    // Codec data of the last audio caps, to tell new but equal caps apart.
+    VideoStream::AudioFrameType audio_codec_data_type;
+    GstBuffer *audio_codec_data_buffers [2];
+    Count num_audio_codec_data_buffers;
+
+  // Accessed from the video streaming thread only.
+
+    bool is_h264_stream;
+    // H.264 in Annex B byte stream format, converted to AVC in doVideoData().
+    bool is_annexb_stream;
+    GstBuffer *avc_codec_data_buffer;
+    CapsCache video_caps_cache;
+
+    // Set in adopt() for streams made with prepare().
     mt_const Cb<MediaSource::Frontend> frontend;
 
-    static void workqueueThreadFunc (void *_self);
+  // Asynchronous frame delivery. The audio and video streaming threads are
+  // the producers for 'audio_ring' and 'video_ring' respectively, the
+  // delivery thread which 'delivery_consumer' is bound to is the consumer.
+  // Frames are stamped with 'delivery_seq' when pushed, and the consumer
+  // merges the two rings by it to keep audio and video interleaved.
+
+    struct QueuedAudioMessage
+    {
+        VideoStream::AudioMessage msg;
+        Uint64 seq;
+    };
+
+    struct QueuedVideoMessage
+    {
+        VideoStream::VideoMessage msg;
+        Uint64 seq;
+    };
+
+    // Ring slots which only codec data may occupy, so that sequence headers
+    // are never dropped because of media frames.
+    enum { RingReservedSlots = 4 };
+
+    mt_const Ref<GstStreamOptions> stream_opts;
+    mt_const Ref<FrameDeliveryPool> delivery_pool;
+
+    // One per rendition in 'stream_opts->renditions'.
+    mt_const RenditionOutput *rendition_outputs;
+    mt_const Count num_rendition_outputs;
+    mt_const Ref<FrameDeliveryPool::Consumer> delivery_consumer;
+
+    mt_const Size video_ring_drop_depth;
+
+    SpscRing<QueuedAudioMessage> audio_ring;
+    SpscRing<QueuedVideoMessage> video_ring;
+
+    std::atomic<Uint64> delivery_seq;
+
+    std::atomic<Uint64> audio_frames_dropped;
+    std::atomic<Uint64> video_frames_dropped;
+    std::atomic<Uint64> video_gops_dropped;
+
+    // Accessed from the video streaming thread only. Set when a video frame
+    // has been dropped; the rest of the GOP is dropped up to the next keyframe.
+    bool video_gop_broken;
+
+    QosController qos;
+
+    LatencyTracker latency;
+
+    static gboolean latencyStampCb (GstPad    *pad,
+                                    GstBuffer *buffer,
+                                    gpointer   _self);
+
+    void recordVideoLatency (VideoStream::VideoMessage const * mt_nonnull msg);
+
+    // Sinks are synced to the clock for 'sync_to_clock' playback items,
+    // unless the stream is in low latency mode.
+    bool syncToClock () const
+        { return playback_item->sync_to_clock && !stream_opts->low_latency; }
+
+    static QosTicker::Frontend const qos_ticker_frontend;
+
+    static void qosTick (void *_self);
+
+    // Called from the video streaming thread.
+    bool isDisposableVideoFrame (GstBuffer * mt_nonnull buffer);
+
+    // Probe on the input of the video encoding bin.
+    static gboolean qosRawVideoDataCb (GstPad    *pad,
+                                       GstBuffer *buffer,
+                                       gpointer   _self);
+
+    static FrameDeliveryPool::Frontend const delivery_frontend;
+
+    static bool deliverFrames (void *_self);
+
+    void releaseQueuedFrames ();
+
+    static PipelineControlPool::Frontend const pipeline_pool_frontend;
+
+    static bool processWorkItem (void *_self);
 
   // Pipeline manipulation
 
@@ -189,13 +545,54 @@ private:
 
     mt_mutex (mutex) void reportMetaData ();
 
+    mt_mutex (mutex) void setPipelineState (PipelineState::Value new_state);
+
+    // Tells 'reconnect_scheduler' that the stream has failed, which makes
+    // the next start of the channel delayed.
+    mt_mutex (mutex) void reportStreamFailure (bool is_eos);
+
+    mt_mutex (mutex) void recordFirstFrame ();
+
+    // Called when the pipeline reaches PAUSED state, either after preroll
+    // or after the initial seek.
+    mt_mutex (mutex) void pipelinePaused ();
+
+    void sendAudioMessage (ConstMemory                 mem,
+                           Uint64                      timestamp_nanosec,
+                           VideoStream::AudioFrameType frame_type,
+                           AudioParams const          &params);
+
+    // Both methods take ownership of msg->page_list.
+    void deliverAudioMessage (VideoStream::AudioMessage * mt_nonnull msg);
+    void deliverVideoMessage (VideoStream::VideoMessage * mt_nonnull msg);
+
+    void fillMessagePages (PagePool::PageListHead * mt_nonnull page_list,
+                           ConstMemory             mem,
+                           Size                    prechunk_initial_offset,
+                           Uint32                  chunk_stream_id,
+                           Uint64                  prechunk_timestamp);
+
+    // Appends 'mem' to a message which is being filled piece by piece.
+    void appendMessagePages (PagePool::PageListHead          * mt_nonnull page_list,
+                             RtmpConnection::PrechunkContext * mt_nonnull prechunk_ctx,
+                             ConstMemory                       mem,
+                             Uint32                            chunk_stream_id,
+                             Uint64                            prechunk_timestamp);
+
     static gboolean inStatsDataCb (GstPad    *pad,
 				   GstBuffer *buffer,
 				   gpointer   _self);
 
   // Audio data handling
 
-    mt_mutex (mutex) void doAudioData (GstBuffer *buffer);
+    // 'replay' is set for buffers held while the stream was warm: they are
+    // replayed by adopt() and do not wait for the first frame of the other
+    // kind before sending metadata.
+    void doAudioData (GstBuffer *buffer,
+                      bool       replay = false);
+
+    void doAdtsAudioData (GstBuffer         *buffer,
+                          AudioParams const &params);
 
     static gboolean audioDataCb (GstPad    *pad,
 				 GstBuffer *buffer,
@@ -208,7 +605,13 @@ private:
 
   // Video data handling
 
-    mt_mutex (mutex) void doVideoData (GstBuffer *buffer);
+    void doVideoData (GstBuffer *buffer,
+                      bool       replay = false);
+
+    bool convertAnnexBVideoData (GstBuffer              *buffer,
+                                 PagePool::PageListHead *page_list,
+                                 Size                   * mt_nonnull ret_msg_len,
+                                 bool                   * mt_nonnull ret_is_keyframe);
 
     static gboolean videoDataCb (GstPad    *pad,
 				 GstBuffer *buffer,
@@ -219,6 +622,23 @@ private:
 				    GstPad     *pad,
 				    gpointer    _self);
 
+  // Rendition data handling
+
+    // Audio of the main stream goes to all renditions.
+    void fireRenditionAudioMessage (VideoStream::AudioMessage * mt_nonnull msg);
+
+    void fireRenditionVideoMessage (RenditionOutput           * mt_nonnull output,
+                                    ConstMemory                mem,
+                                    Uint64                     timestamp_nanosec,
+                                    VideoStream::VideoFrameType frame_type);
+
+    void doRenditionVideoData (RenditionOutput * mt_nonnull output,
+                               GstBuffer       *buffer);
+
+    static gboolean renditionVideoDataCb (GstPad    *pad,
+                                          GstBuffer *buffer,
+                                          gpointer   _output);
+
   // State management
 
     static GstBusSyncReply busSyncHandler (GstBus     *bus,
@@ -234,6 +654,15 @@ private:
                                    GstPad     *new_pad,
                                    gpointer    _self);
 
+    // Low latency setup of uridecodebin's source and decodebin.
+    static void uriDecodebinSourceNotify (GObject    *uridecodebin,
+                                          GParamSpec *pspec,
+                                          gpointer    _self);
+
+    static void uriDecodebinElementAdded (GstBin     *bin,
+                                          GstElement *element,
+                                          gpointer    _self);
+
     mt_mutex (mutex) void doSetPad (GstPad            *pad,
                                     ConstMemory        sink_el_name,
                                     MediaDataCallback  media_data_cb,
@@ -245,12 +674,27 @@ private:
     void doSetVideoPad (GstPad      *pad,
                         ConstMemory  chain);
 
+    Uint32 scheduleEncoder (ConstMemory              sink_name,
+                            List<ScheduledEncoder> * mt_nonnull encoder_list);
+
     void setRawAudioPad (GstPad *pad);
     void setRawVideoPad (GstPad *pad);
     void setAudioPad (GstPad *pad);
     void setVideoPad (GstPad *pad);
 
-    static void noVideoTimerTick (void *_self);
+  mt_iface (FrameTimeoutWheel::Frontend)
+    static FrameTimeoutWheel::Frontend const no_video_frontend;
+
+    static void noVideoTimeout (void *_self);
+
+    static void noVideoFramesFlowing (void *_self);
+  mt_iface_end
+
+    // Returns 'true' if the buffer has been held for adopt().
+    bool holdWarmBuffer (GstBuffer * mt_nonnull buffer,
+                         bool        is_audio);
+
+    void releaseWarmBuffers ();
 
   mt_iface (VideoStream::EventHandler)
 
@@ -265,6 +709,36 @@ private:
   mt_iface_end
 
 public:
+    struct StreamStats
+    {
+        Uint64 rx_bytes;
+        Uint64 rx_audio_bytes;
+        Uint64 rx_video_bytes;
+
+        Uint64 copied_bytes;
+        Uint64 frame_path_locks;
+        Uint32 trace_id;
+
+        bool   async_delivery;
+        Size   audio_ring_depth;
+        Size   video_ring_depth;
+        Uint64 audio_frames_dropped;
+        Uint64 video_frames_dropped;
+        Uint64 video_gops_dropped;
+
+        QosController::Stats qos;
+
+        bool low_latency;
+        LatencyTracker::Stats latency;
+
+        char const *pipeline_state;
+        // Time spent in each startup stage, in milliseconds.
+        Time preroll_time;
+        Time seek_time;
+        Time play_time;
+        Time first_frame_time;
+    };
+
   mt_iface (MediaSource)
     void createPipeline ();
     void releasePipeline ();
@@ -273,6 +747,27 @@ public:
     void resetTrafficStats ();
   mt_iface_end
 
+    void getStreamStats (StreamStats * mt_nonnull ret_stats);
+
+    ConstMemory getChannelName () const
+        { return channel_opts->channel_name->mem(); }
+
+    PlaybackItem* getPlaybackItem () const { return playback_item; }
+
+    Time getInitialSeek () const { return initial_seek; }
+
+    // Creates the pipeline and brings it to PAUSED state, with the initial
+    // seek applied, without delivering anything. Should be called instead of
+    // createPipeline() for a stream which has been initialized without
+    // a frontend and a video stream.
+    void prepare (CbDesc<WarmFrontend> const &warm_frontend);
+
+    // Makes a prepared stream deliver frames to 'video_stream' and report
+    // events to 'frontend'. If the pipeline has prerolled already, this is
+    // just a switch to PLAYING state.
+    void adopt (CbDesc<MediaSource::Frontend> const &frontend,
+                VideoStream                         *video_stream);
+
     mt_const void init (CbDesc<MediaSource::Frontend> const &frontend,
                         Timers            *timers,
                         DeferredProcessor *deferred_processor,
@@ -281,7 +776,16 @@ public:
 			VideoStream       *mix_video_stream,
 			Time               initial_seek,
                         ChannelOptions    *channel_opts,
-                        PlaybackItem      *playback_item);
+                        PlaybackItem      *playback_item,
+                        GstStreamOptions  *stream_opts,
+                        FrameDeliveryPool *delivery_pool,
+                        PipelineControlPool *pipeline_pool,
+                        ChainTemplateCache  *chain_cache,
+                        ReconnectScheduler  *reconnect_scheduler,
+                        PipelineReaper      *reaper,
+                        EncoderScheduler    *encoder_scheduler,
+                        FrameTimeoutWheel   *timeout_wheel,
+                        QosTicker           *qos_ticker);
 
      GstStream ();
     ~GstStream ();
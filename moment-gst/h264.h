@@ -0,0 +1,234 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__H264__H__
+#define MOMENT_GST__H264__H__
+
+
+#include <libmary/libmary.h>
+
+
+// For reference, see ISO/IEC 14496-10 Annex B (byte stream format)
+// and ISO/IEC 14496-15 5.2.4.1 (AVCDecoderConfigurationRecord).
+
+namespace MomentGst {
+
+using namespace M;
+
+struct H264NalType
+{
+    enum Value {
+        NonIdrSlice = 1,
+        IdrSlice    = 5,
+        Sei         = 6,
+        Sps         = 7,
+        Pps         = 8,
+        Aud         = 9
+    };
+};
+
+static inline unsigned
+h264NalType (ConstMemory const nal)
+{
+    return nal.mem() [0] & 0x1f;
+}
+
+static inline unsigned
+h264NalRefIdc (ConstMemory const nal)
+{
+    return (nal.mem() [0] >> 5) & 0x03;
+}
+
+// Slices with nal_ref_idc 0 are not used for prediction of other pictures.
+// Returns false for NAL units other than coded slices.
+static inline bool
+h264IsNonReferenceSlice (ConstMemory const nal,
+                         bool      * const mt_nonnull ret_is_slice)
+{
+    unsigned const nal_type = h264NalType (nal);
+    *ret_is_slice = (nal_type >= H264NalType::NonIdrSlice && nal_type <= H264NalType::IdrSlice);
+    return *ret_is_slice && h264NalRefIdc (nal) == 0;
+}
+
+// Iterates over NAL units of an Annex B byte stream buffer.
+class AnnexBNalIterator
+{
+private:
+    Byte const * const buf;
+    Size         const len;
+    Size pos;
+
+    // Returns the offset of the first byte after the next start code,
+    // or 'len' if there are no more start codes.
+    Size skipToNalStart (Size offs) const
+    {
+        while (offs + 3 <= len) {
+            if (buf [offs + 2] > 1) {
+                offs += 3;
+            } else
+            if (buf [offs + 2] == 1 && buf [offs + 1] == 0 && buf [offs] == 0) {
+                return offs + 3;
+            } else {
+                ++offs;
+            }
+        }
+
+        return len;
+    }
+
+public:
+    // Returns false when there are no more NAL units. Trailing zero bytes
+    // (and the leading zero of a four-byte start code) are not included
+    // in 'ret_nal'. Empty NAL units are skipped.
+    bool next (ConstMemory * const mt_nonnull ret_nal)
+    {
+        for (;;) {
+            if (pos >= len)
+                return false;
+
+            Size const nal_start = pos;
+            Size const next_start = skipToNalStart (nal_start);
+
+            Size nal_end;
+            if (next_start < len) {
+                nal_end = next_start - 3;
+                pos = next_start;
+            } else {
+                nal_end = len;
+                pos = len;
+            }
+
+            while (nal_end > nal_start && buf [nal_end - 1] == 0)
+                --nal_end;
+
+            if (nal_end > nal_start) {
+                *ret_nal = ConstMemory (buf + nal_start, nal_end - nal_start);
+                return true;
+            }
+        }
+    }
+
+    AnnexBNalIterator (ConstMemory const mem)
+        : buf (mem.mem()),
+          len (mem.len()),
+          pos (0)
+    {
+        pos = skipToNalStart (0);
+    }
+};
+
+// Returns true if the access unit in 'mem' has slices, and none of them
+// is a reference slice, which means that it may be dropped without
+// affecting other frames.
+static inline bool
+annexBIsDisposableAccessUnit (ConstMemory const mem)
+{
+    bool got_slice = false;
+
+    AnnexBNalIterator nal_iter (mem);
+    ConstMemory nal;
+    while (nal_iter.next (&nal)) {
+        bool is_slice;
+        bool const is_non_ref = h264IsNonReferenceSlice (nal, &is_slice);
+        if (!is_slice)
+            continue;
+
+        if (!is_non_ref)
+            return false;
+
+        got_slice = true;
+    }
+
+    return got_slice;
+}
+
+// Same as annexBIsDisposableAccessUnit() for NAL units with 'nal_length_size'
+// bytes long length prefixes (AVC format).
+static inline bool
+avcIsDisposableAccessUnit (ConstMemory const mem,
+                           unsigned    const nal_length_size)
+{
+    bool got_slice = false;
+
+    Size pos = 0;
+    while (pos + nal_length_size <= mem.len()) {
+        Size nal_len = 0;
+        for (unsigned i = 0; i < nal_length_size; ++i)
+            nal_len = (nal_len << 8) | mem.mem() [pos + i];
+        pos += nal_length_size;
+
+        if (nal_len == 0 || nal_len > mem.len() - pos)
+            return false;
+
+        bool is_slice;
+        bool const is_non_ref = h264IsNonReferenceSlice (ConstMemory (mem.mem() + pos, nal_len), &is_slice);
+        if (is_slice) {
+            if (!is_non_ref)
+                return false;
+
+            got_slice = true;
+        }
+
+        pos += nal_len;
+    }
+
+    return got_slice;
+}
+
+static inline Size
+avcDecoderConfigurationRecordLength (ConstMemory const sps,
+                                     ConstMemory const pps)
+{
+    return 11 + sps.len() + pps.len();
+}
+
+// Writes an AVCDecoderConfigurationRecord with a single SPS and a single PPS
+// to 'buf', which should be at least avcDecoderConfigurationRecordLength()
+// bytes long. 'sps' must be at least 4 bytes long.
+static inline void
+avcMakeDecoderConfigurationRecord (ConstMemory   const sps,
+                                   ConstMemory   const pps,
+                                   Byte        * const mt_nonnull buf)
+{
+    Byte *p = buf;
+
+    *p++ = 1;              // configurationVersion
+    *p++ = sps.mem() [1];  // AVCProfileIndication
+    *p++ = sps.mem() [2];  // profile_compatibility
+    *p++ = sps.mem() [3];  // AVCLevelIndication
+    *p++ = 0xff;           // 4-byte NAL unit lengths
+    *p++ = 0xe1;           // 1 SPS
+
+    *p++ = (Byte) (sps.len() >> 8);
+    *p++ = (Byte) (sps.len() & 0xff);
+    memcpy (p, sps.mem(), sps.len());
+    p += sps.len();
+
+    *p++ = 1;              // 1 PPS
+
+    *p++ = (Byte) (pps.len() >> 8);
+    *p++ = (Byte) (pps.len() & 0xff);
+    memcpy (p, pps.mem(), pps.len());
+}
+
+}
+
+
+#endif /* MOMENT_GST__H264__H__ */
+
@@ -0,0 +1,120 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/coarse_clock.h>
+
+#include <moment-gst/latency_tracker.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+// Marks an unused stamp slot.
+static Uint64 const no_timestamp = (Uint64) -1;
+
+void
+LatencyTracker::stamp (Uint64 const timestamp_nanosec)
+{
+    if (!enabled || timestamp_nanosec == no_timestamp)
+        return;
+
+    Count const slot = stamp_pos;
+    stamp_pos = (stamp_pos + 1) % NumStamps;
+
+    // The slot is invalidated first, so that a concurrent lookup doesn't pair
+    // the new time with the old timestamp.
+    stamp_timestamps [slot].store (no_timestamp, std::memory_order_relaxed);
+    stamp_times [slot].store (getMonotonicTimeMicroseconds (), std::memory_order_relaxed);
+    stamp_timestamps [slot].store (timestamp_nanosec, std::memory_order_release);
+}
+
+void
+LatencyTracker::frameFired (Uint64 const timestamp_nanosec)
+{
+    if (!enabled)
+        return;
+
+    Time const cur_time = getMonotonicTimeMicroseconds ();
+
+    for (Count i = 0; i < NumStamps; ++i) {
+        if (stamp_timestamps [i].load (std::memory_order_acquire) != timestamp_nanosec)
+            continue;
+
+        Time const stamp_time = stamp_times [i].load (std::memory_order_relaxed);
+        // Each stamp is matched once. If the slot has been reused meanwhile,
+        // the frame is counted as unmatched.
+        Uint64 expected = timestamp_nanosec;
+        if (!stamp_timestamps [i].compare_exchange_strong (expected, no_timestamp, std::memory_order_relaxed))
+            break;
+
+        Time const latency = (cur_time > stamp_time ? cur_time - stamp_time : 0);
+
+        unsigned bucket = 0;
+        for (Time millisec = latency / 1000; millisec > 0 && bucket < NumBuckets - 1; millisec >>= 1)
+            ++bucket;
+
+        buckets [bucket].fetch_add (1, std::memory_order_relaxed);
+        num_frames.fetch_add (1, std::memory_order_relaxed);
+        total_microsec.fetch_add (latency, std::memory_order_relaxed);
+
+        Time prv_max = max_microsec.load (std::memory_order_relaxed);
+        while (latency > prv_max
+               && !max_microsec.compare_exchange_weak (prv_max, latency, std::memory_order_relaxed))
+        {
+        }
+
+        return;
+    }
+
+    num_unmatched.fetch_add (1, std::memory_order_relaxed);
+}
+
+void
+LatencyTracker::getStats (Stats * const mt_nonnull ret_stats)
+{
+    ret_stats->num_frames    = num_frames.load (std::memory_order_relaxed);
+    ret_stats->num_unmatched = num_unmatched.load (std::memory_order_relaxed);
+    ret_stats->max_microsec  = max_microsec.load (std::memory_order_relaxed);
+    ret_stats->avg_microsec  = (ret_stats->num_frames ?
+                                        total_microsec.load (std::memory_order_relaxed) / ret_stats->num_frames : 0);
+
+    for (Count i = 0; i < NumBuckets; ++i)
+        ret_stats->buckets [i] = buckets [i].load (std::memory_order_relaxed);
+}
+
+LatencyTracker::LatencyTracker ()
+    : enabled (false),
+      stamp_pos (0),
+      num_frames (0),
+      num_unmatched (0),
+      total_microsec (0),
+      max_microsec (0)
+{
+    for (Count i = 0; i < NumStamps; ++i) {
+        stamp_timestamps [i].store (no_timestamp, std::memory_order_relaxed);
+        stamp_times [i].store (0, std::memory_order_relaxed);
+    }
+
+    for (Count i = 0; i < NumBuckets; ++i)
+        buckets [i].store (0, std::memory_order_relaxed);
+}
+
+}
+
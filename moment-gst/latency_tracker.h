@@ -0,0 +1,95 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__LATENCY_TRACKER__H__
+#define MOMENT_GST__LATENCY_TRACKER__H__
+
+
+#include <libmary/libmary.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Measures how long video frames take from the input of a stream's encoding
+// bin to the moment they are fired into the VideoStream.
+//
+// Frames are stamped on input with their timestamp and the time of arrival,
+// and stamps are looked up by timestamp on output. The last 'NumStamps'
+// stamps are kept, which is enough to cover encoder delay and the delivery
+// ring. Stamping and lookup may happen on different threads; neither takes
+// a lock.
+class LatencyTracker
+{
+public:
+    enum {
+        NumStamps  = 64,
+        // Bucket 0 counts latencies below 1 ms, bucket i counts latencies
+        // in [2^(i-1), 2^i) ms, and the last bucket counts the rest.
+        NumBuckets = 14
+    };
+
+    struct Stats
+    {
+        Uint64 num_frames;
+        // Frames fired without a matching stamp.
+        Uint64 num_unmatched;
+        Time   avg_microsec;
+        Time   max_microsec;
+        Uint64 buckets [NumBuckets];
+    };
+
+private:
+    mt_const bool enabled;
+
+    std::atomic<Uint64> stamp_timestamps [NumStamps];
+    std::atomic<Time>   stamp_times      [NumStamps];
+
+    // Accessed from the stamping thread only.
+    Count stamp_pos;
+
+    std::atomic<Uint64> buckets [NumBuckets];
+    std::atomic<Uint64> num_frames;
+    std::atomic<Uint64> num_unmatched;
+    std::atomic<Uint64> total_microsec;
+    std::atomic<Time>   max_microsec;
+
+public:
+    bool isEnabled () const { return enabled; }
+
+    // Called when a frame enters the stream.
+    void stamp (Uint64 timestamp_nanosec);
+
+    // Called right before the frame is fired.
+    void frameFired (Uint64 timestamp_nanosec);
+
+    void getStats (Stats * mt_nonnull ret_stats);
+
+    mt_const void init (bool enabled) { this->enabled = enabled; }
+
+    LatencyTracker ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__LATENCY_TRACKER__H__ */
+
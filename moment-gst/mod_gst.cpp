@@ -25,13 +25,25 @@ using namespace Moment;
 
 namespace MomentGst {
 
+static void configReload (MConfig::Config *new_config,
+                          void            *_gst_module);
+
 static void serverDestroy (void *_gst_module);
 
 static MomentServer::Events const server_events = {
-    NULL /* configReload */,
+    configReload,
     serverDestroy
 };
 
+static void configReload (MConfig::Config * const new_config,
+                          void            * const _gst_module)
+{
+    MomentGstModule * const gst_module = static_cast <MomentGstModule*> (_gst_module);
+
+    logH_ (_func_);
+    gst_module->configReload (new_config);
+}
+
 static void serverDestroy (void * const _gst_module)
 {
     MomentGstModule * const gst_module = static_cast <MomentGstModule*> (_gst_module);
@@ -19,10 +19,14 @@
 
 #include <libmary/types.h>
 #include <cctype>
+#include <cstring>
 #include <gst/gst.h>
 
 #include <moment/libmoment.h>
 
+#include <moment-gst/coarse_clock.h>
+#include <moment-gst/frame_trace.h>
+
 #include <moment-gst/moment_gst_module.h>
 
 
@@ -71,6 +75,46 @@ static StRef<String> this_rtmp_server_addr;
 static StRef<String> this_rtmpt_server_addr;
 static StRef<String> this_hls_server_addr;
 
+// Content length of an HTTP reply body.
+static Size getPageListLength (PagePool::PageListHead const &page_list)
+{
+    Size len = 0;
+    PagePool::Page *page = page_list.first;
+    while (page) {
+        len += page->data_len;
+        page = page->getNextMsgPage();
+    }
+
+    return len;
+}
+
+// Escapes 'mem' for use within a JSON string.
+static StRef<String> jsonEscape (ConstMemory const mem)
+{
+    StRef<String> str = st_grab (new (std::nothrow) String);
+
+    Size seg_start = 0;
+    for (Size i = 0; i < mem.len(); ++i) {
+        Byte const c = mem.mem() [i];
+        if (c != '"' && c != '\\' && c >= 0x20)
+            continue;
+
+        ConstMemory const seg (mem.mem() + seg_start, i - seg_start);
+        if (c == '"' || c == '\\') {
+            Byte const esc [2] = { '\\', c };
+            str = st_makeString (str->mem(), seg, ConstMemory (esc, 2));
+        } else {
+            static char const hex_digits [] = "0123456789abcdef";
+            Byte const esc [6] = { '\\', 'u', '0', '0', (Byte) hex_digits [c >> 4], (Byte) hex_digits [c & 0xf] };
+            str = st_makeString (str->mem(), seg, ConstMemory (esc, 6));
+        }
+
+        seg_start = i + 1;
+    }
+
+    return st_makeString (str->mem(), ConstMemory (mem.mem() + seg_start, mem.len() - seg_start));
+}
+
 Result
 MomentGstModule::updatePlaylist (ConstMemory   const channel_name,
 				 bool          const keep_cur_item,
@@ -162,16 +206,18 @@ MomentGstModule::setPosition (ConstMemory const channel_name,
 }
 
 void
-MomentGstModule::createPlaylistChannel (ConstMemory      const playlist_filename,
-                                        bool             const is_dir,
-                                        bool             const dir_re_read,
-                                        ChannelOptions * const channel_opts,
-                                        PushAgent      * const push_agent,
-                                        FetchAgent     * const fetch_agent)
+MomentGstModule::doCreatePlaylistChannel (ConstMemory      const playlist_filename,
+                                          bool             const is_dir,
+                                          bool             const dir_re_read,
+                                          ChannelOptions * const channel_opts,
+                                          PushAgent      * const push_agent,
+                                          FetchAgent     * const fetch_agent,
+                                          ConstMemory      const config_sig)
 {
     ChannelEntry * const channel_entry = new (std::nothrow) ChannelEntry;
     assert (channel_entry);
     channel_entry->channel_opts = channel_opts;
+    channel_entry->config_sig = grab (new (std::nothrow) String (config_sig));
 
     channel_entry->channel_name  = grab (new (std::nothrow) String (channel_opts->channel_name->mem()));
     channel_entry->channel_title = grab (new (std::nothrow) String (channel_opts->channel_title->mem()));
@@ -188,8 +234,8 @@ MomentGstModule::createPlaylistChannel (ConstMemory      const playlist_filename
 
     mutex.lock ();
     channel_entry_hash.add (channel_entry);
+    channel_entry->channel_set_key = channel_set.addChannel (channel, channel_opts->channel_name->mem());
     mutex.unlock ();
-    channel_set.addChannel (channel, channel_opts->channel_name->mem());
 
     if (is_dir) {
         if (!channel->getPlayback()->loadPlaylistDirectory (playlist_filename,
@@ -218,14 +264,16 @@ MomentGstModule::createPlaylistChannel (ConstMemory      const playlist_filename
 }
 
 void
-MomentGstModule::createStreamChannel (ChannelOptions * const channel_opts,
-                                      PlaybackItem   * const playback_item,
-                                      PushAgent      * const push_agent,
-                                      FetchAgent     * const fetch_agent)
+MomentGstModule::doCreateStreamChannel (ChannelOptions * const channel_opts,
+                                        PlaybackItem   * const playback_item,
+                                        PushAgent      * const push_agent,
+                                        FetchAgent     * const fetch_agent,
+                                        ConstMemory      const config_sig)
 {
     ChannelEntry * const channel_entry = new (std::nothrow) ChannelEntry;
     assert (channel_entry);
     channel_entry->channel_opts = channel_opts;
+    channel_entry->config_sig = grab (new (std::nothrow) String (config_sig));
 
     channel_entry->channel_name  = grab (new (std::nothrow) String (channel_opts->channel_name->mem()));
     channel_entry->channel_title = grab (new (std::nothrow) String (channel_opts->channel_title->mem()));
@@ -242,8 +290,8 @@ MomentGstModule::createStreamChannel (ChannelOptions * const channel_opts,
 
     mutex.lock ();
     channel_entry_hash.add (channel_entry);
+    channel_entry->channel_set_key = channel_set.addChannel (channel, channel_opts->channel_name->mem());
     mutex.unlock ();
-    channel_set.addChannel (channel, channel_opts->channel_name->mem());
 
     channel->getPlayback()->setSingleItem (playback_item);
 
@@ -255,14 +303,300 @@ MomentGstModule::createStreamChannel (ChannelOptions * const channel_opts,
 }
 
 void
-MomentGstModule::createDummyChannel (ConstMemory   const channel_name,
-                                     ConstMemory   const channel_title,
-				     ConstMemory   const channel_desc,
-                                     PushAgent   * const push_agent,
-                                     FetchAgent  * const fetch_agent)
+MomentGstModule::createPlaylistChannel (ConstMemory        const playlist_filename,
+                                        bool               const is_dir,
+                                        bool               const dir_re_read,
+                                        ChannelOptions   * const channel_opts,
+                                        ConstMemory        const config_sig,
+                                        PushAgent        * const push_agent,
+                                        FetchAgent       * const fetch_agent,
+                                        GstStreamOptions * const stream_opts)
+{
+    BringupJob * const job = new (std::nothrow) BringupJob;
+    assert (job);
+    job->channel_opts = channel_opts;
+    job->dummy = false;
+    job->playlist_filename = grab (new (std::nothrow) String (playlist_filename));
+    job->is_dir = is_dir;
+    job->dir_re_read = dir_re_read;
+    job->push_agent  = push_agent;
+    job->fetch_agent = fetch_agent;
+    job->config_sig = grab (new (std::nothrow) String (config_sig));
+    job->stream_opts = stream_opts;
+
+    if (queueBringupJob (job))
+        return;
+
+    runBringupJob (job);
+    delete job;
+}
+
+void
+MomentGstModule::createStreamChannel (ChannelOptions   * const channel_opts,
+                                      PlaybackItem     * const playback_item,
+                                      ConstMemory        const config_sig,
+                                      PushAgent        * const push_agent,
+                                      FetchAgent       * const fetch_agent,
+                                      GstStreamOptions * const stream_opts)
+{
+    BringupJob * const job = new (std::nothrow) BringupJob;
+    assert (job);
+    job->channel_opts  = channel_opts;
+    job->playback_item = playback_item;
+    job->dummy = false;
+    job->is_dir = false;
+    job->dir_re_read = false;
+    job->push_agent  = push_agent;
+    job->fetch_agent = fetch_agent;
+    job->config_sig = grab (new (std::nothrow) String (config_sig));
+    job->stream_opts = stream_opts;
+
+    if (queueBringupJob (job))
+        return;
+
+    runBringupJob (job);
+    delete job;
+}
+
+bool
+MomentGstModule::jobListHasChannel (List<BringupJob*> * const mt_nonnull job_list,
+                                    ConstMemory         const channel_name)
+{
+    List<BringupJob*>::Element *el = job_list->getFirstElement();
+    while (el) {
+        if (equal (el->data->channel_opts->channel_name->mem(), channel_name))
+            return true;
+
+        el = el->next;
+    }
+
+    return false;
+}
+
+bool
+MomentGstModule::queueBringupJob (BringupJob * const mt_nonnull job)
+{
+    bringup_mutex.lock ();
+
+    if (collect_job_list) {
+        if (jobListHasChannel (collect_job_list, job->channel_opts->channel_name->mem())) {
+            bringup_mutex.unlock ();
+            logW_ (_func, "Duplicate channel \"", job->channel_opts->channel_name, "\", ignoring");
+            delete job;
+            return true;
+        }
+
+        collect_job_list->append (job);
+        bringup_mutex.unlock ();
+        return true;
+    }
+
+    if (!bringup_queueing) {
+        bringup_mutex.unlock ();
+        return false;
+    }
+
+    bringup_job_list.append (job);
+    ++bringup_num_channels;
+    bringup_cond.signal ();
+    bringup_mutex.unlock ();
+
+    return true;
+}
+
+void
+MomentGstModule::runBringupJob (BringupJob * const mt_nonnull job)
+{
+    if (job->stream_opts)
+        setStreamOptions (job->channel_opts->channel_name->mem(), job->stream_opts);
+
+    if (job->dummy) {
+        doCreateDummyChannel (job->channel_opts->channel_name->mem(),
+                              job->channel_opts->channel_title->mem(),
+                              job->channel_opts->channel_desc->mem(),
+                              job->push_agent,
+                              job->fetch_agent,
+                              job->config_sig->mem());
+    } else
+    if (job->playback_item) {
+        doCreateStreamChannel (job->channel_opts,
+                               job->playback_item,
+                               job->push_agent,
+                               job->fetch_agent,
+                               job->config_sig->mem());
+    } else {
+        doCreatePlaylistChannel (job->playlist_filename->mem(),
+                                 job->is_dir,
+                                 job->dir_re_read,
+                                 job->channel_opts,
+                                 job->push_agent,
+                                 job->fetch_agent,
+                                 job->config_sig->mem());
+    }
+}
+
+void
+MomentGstModule::bringupThreadFunc (void * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    updateTime ();
+
+    self->bringup_mutex.lock ();
+    for (;;) {
+        while (self->bringup_job_list.isEmpty()
+               && self->bringup_queueing
+               && !self->bringup_stop)
+        {
+            self->bringup_cond.wait (self->bringup_mutex);
+        }
+
+        if (self->bringup_stop || self->bringup_job_list.isEmpty())
+            break;
+
+        BringupJob * const job = self->bringup_job_list.getFirst();
+        self->bringup_job_list.remove (self->bringup_job_list.getFirstElement());
+        ++self->bringup_num_active;
+        self->bringup_mutex.unlock ();
+
+        Time const start_time = getCoarseTimeMilliseconds ();
+
+        self->runBringupJob (job);
+
+        logD_ (_func, "channel \"", job->channel_opts->channel_name, "\" is up in ",
+               getCoarseTimeMilliseconds() - start_time, " ms");
+
+        delete job;
+
+        self->bringup_mutex.lock ();
+        --self->bringup_num_active;
+        if (!self->bringup_queueing
+            && !self->bringup_complete
+            && self->bringup_job_list.isEmpty()
+            && self->bringup_num_active == 0)
+        {
+            self->bringup_complete = true;
+            self->bringup_mutex.unlock ();
+
+            self->bringupComplete ();
+
+            self->bringup_mutex.lock ();
+        }
+    }
+    self->bringup_mutex.unlock ();
+}
+
+void
+MomentGstModule::beginBringup ()
+{
+    bringup_mutex.lock ();
+
+    bringup_start_time = getCoarseTimeMilliseconds ();
+
+    if (bringup_threads <= 1) {
+      // Channels are created right away on the init thread.
+        bringup_mutex.unlock ();
+        return;
+    }
+
+    bringup_queueing = true;
+
+    for (Count i = 0; i < bringup_threads; ++i) {
+        Ref<Thread> const thread = grab (new (std::nothrow) Thread (
+                CbDesc<Thread::ThreadFunc> (bringupThreadFunc, this, this)));
+        if (!thread->spawn (true /* joinable */)) {
+            logE_ (_func, "Failed to spawn channel bring-up thread: ", exc->toString());
+            continue;
+        }
+
+        bringup_thread_list.append (thread);
+    }
+
+    if (bringup_thread_list.isEmpty())
+        bringup_queueing = false;
+
+    bringup_mutex.unlock ();
+}
+
+void
+MomentGstModule::endBringupQueueing ()
+{
+    bringup_mutex.lock ();
+
+    bringup_queueing = false;
+    for (Count i = 0; i < bringup_threads; ++i)
+        bringup_cond.signal ();
+
+    if (bringup_complete
+        || !bringup_job_list.isEmpty()
+        || bringup_num_active > 0)
+    {
+      // The last bring-up thread to finish will call bringupComplete().
+        bringup_mutex.unlock ();
+        return;
+    }
+
+    bringup_complete = true;
+    bringup_mutex.unlock ();
+
+    bringupComplete ();
+}
+
+void
+MomentGstModule::bringupComplete ()
+{
+    bringup_mutex.lock ();
+    Count const num_channels = bringup_num_channels;
+    Time  const start_time   = bringup_start_time;
+    bringup_mutex.unlock ();
+
+    logI_ (_func, num_channels, " channels are up in ", getCoarseTimeMilliseconds() - start_time, " ms");
+
+  // Channel recorders refer to channels by name, hence the channels
+  // should exist by now.
+    parseRecordingsConfigSection ();
+}
+
+void
+MomentGstModule::releaseBringup ()
+{
+    bringup_mutex.lock ();
+    bringup_stop = true;
+    bringup_queueing = false;
+    for (Count i = 0; i < bringup_threads; ++i)
+        bringup_cond.signal ();
+
+    List< Ref<Thread> > tmp_thread_list;
+    while (!bringup_thread_list.isEmpty()) {
+        tmp_thread_list.append (bringup_thread_list.getFirst());
+        bringup_thread_list.remove (bringup_thread_list.getFirstElement());
+    }
+    bringup_mutex.unlock ();
+
+    while (!tmp_thread_list.isEmpty()) {
+        tmp_thread_list.getFirst()->join ();
+        tmp_thread_list.remove (tmp_thread_list.getFirstElement());
+    }
+
+    bringup_mutex.lock ();
+    while (!bringup_job_list.isEmpty()) {
+        delete bringup_job_list.getFirst();
+        bringup_job_list.remove (bringup_job_list.getFirstElement());
+    }
+    bringup_mutex.unlock ();
+}
+
+void
+MomentGstModule::doCreateDummyChannel (ConstMemory   const channel_name,
+                                       ConstMemory   const channel_title,
+                                       ConstMemory   const channel_desc,
+                                       PushAgent   * const push_agent,
+                                       FetchAgent  * const fetch_agent,
+                                       ConstMemory   const config_sig)
 {
     ChannelEntry * const channel_entry = new (std::nothrow) ChannelEntry;
     assert (channel_entry);
+    channel_entry->config_sig = grab (new (std::nothrow) String (config_sig));
 
     channel_entry->channel_name  = grab (new (std::nothrow) String (channel_name));
     channel_entry->channel_title = grab (new (std::nothrow) String (channel_title));
@@ -301,13 +635,74 @@ MomentGstModule::createDummyChannel (ConstMemory   const channel_name,
 
     mutex.lock ();
     channel_entry_hash.add (channel_entry);
+    channel_entry->channel_set_key = channel_set.addChannel (channel, channel_name);
     mutex.unlock ();
-    channel_set.addChannel (channel, channel_name);
 
     if (!fetch_agent)
         channel->getPlayback()->setSingleItem (item);
 }
 
+void
+MomentGstModule::createDummyChannel (ConstMemory        const channel_name,
+                                     ConstMemory        const channel_title,
+				     ConstMemory        const channel_desc,
+                                     ConstMemory        const config_sig,
+                                     PushAgent        * const push_agent,
+                                     FetchAgent       * const fetch_agent,
+                                     GstStreamOptions * const stream_opts)
+{
+    BringupJob * const job = new (std::nothrow) BringupJob;
+    assert (job);
+
+    Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
+    opts->channel_name  = st_grab (new (std::nothrow) String (channel_name));
+    opts->channel_title = st_grab (new (std::nothrow) String (channel_title));
+    opts->channel_desc  = st_grab (new (std::nothrow) String (channel_desc));
+
+    job->channel_opts = opts;
+    job->dummy = true;
+    job->is_dir = false;
+    job->dir_re_read = false;
+    job->push_agent  = push_agent;
+    job->fetch_agent = fetch_agent;
+    job->config_sig = grab (new (std::nothrow) String (config_sig));
+    job->stream_opts = stream_opts;
+
+    if (queueBringupJob (job))
+        return;
+
+    runBringupJob (job);
+    delete job;
+}
+
+void
+MomentGstModule::setStreamOptions (ConstMemory        const channel_name,
+                                   GstStreamOptions * const mt_nonnull stream_opts)
+{
+    Ref<RenditionSet> old_renditions;
+    streams_mutex.lock ();
+    {
+        StreamOptionsEntry *entry = stream_opts_hash.lookup (channel_name);
+        if (!entry) {
+            entry = new (std::nothrow) StreamOptionsEntry;
+            assert (entry);
+            entry->channel_name = grab (new (std::nothrow) String (channel_name));
+            stream_opts_hash.add (entry);
+        } else {
+            old_renditions = entry->stream_opts->renditions;
+        }
+        entry->stream_opts = stream_opts;
+    }
+    streams_mutex.unlock ();
+
+    // Renditions of the channel's previous incarnation have the same names.
+    if (old_renditions)
+        old_renditions->release ();
+
+    if (stream_opts->renditions)
+        stream_opts->renditions->publish (moment);
+}
+
 void
 MomentGstModule::createPlaylistRecorder (ConstMemory const recorder_name,
 					 ConstMemory const playlist_filename,
@@ -404,6 +799,91 @@ MomentGstModule::printChannelInfoJson (PagePool::PageListHead * const page_list,
     page_pool->getFillPages (page_list, close_str);
 }
 
+void
+MomentGstModule::printStreamStatsJson (PagePool::PageListHead * const page_list)
+{
+    page_pool->getFillPages (page_list, "[\n");
+
+    streams_mutex.lock ();
+    {
+        bool first_line = true;
+        List< WeakRef<GstStream> >::Element *el = stream_list.getFirstElement();
+        while (el) {
+            List< WeakRef<GstStream> >::Element * const next_el = el->next;
+
+            Ref<GstStream> const gst_stream = el->data.getRef ();
+            if (!gst_stream) {
+                el = next_el;
+                continue;
+            }
+
+            GstStream::StreamStats stats;
+            gst_stream->getStreamStats (&stats);
+
+            ReconnectScheduler::BackoffInfo backoff;
+            if (!reconnect_scheduler->getBackoffInfo (gst_stream->getChannelName(), &backoff)) {
+                backoff.num_failures = 0;
+                backoff.num_starts   = 0;
+                backoff.last_delay   = 0;
+                backoff.wait_time    = 0;
+                backoff.waiting      = false;
+            }
+
+            if (!first_line)
+                page_pool->getFillPages (page_list, ",\n");
+            first_line = false;
+
+            StRef<String> latency_hist = st_grab (new (std::nothrow) String);
+            for (unsigned i = 0; i < LatencyTracker::NumBuckets; ++i)
+                latency_hist = st_makeString (latency_hist->mem(), (i > 0 ? ", " : ""), stats.latency.buckets [i]);
+
+            StRef<String> const line = st_makeString (
+                    "{ \"channel\": \"", jsonEscape (gst_stream->getChannelName())->mem(), "\", "
+                    "\"trace_id\": ", stats.trace_id, ", "
+                    "\"rx_bytes\": ", stats.rx_bytes, ", "
+                    "\"rx_audio_bytes\": ", stats.rx_audio_bytes, ", "
+                    "\"rx_video_bytes\": ", stats.rx_video_bytes, ", "
+                    "\"copied_bytes\": ", stats.copied_bytes, ", "
+                    "\"frame_path_locks\": ", stats.frame_path_locks, ", "
+                    "\"async_delivery\": ", (stats.async_delivery ? "true" : "false"), ", "
+                    "\"audio_ring_depth\": ", stats.audio_ring_depth, ", "
+                    "\"video_ring_depth\": ", stats.video_ring_depth, ", "
+                    "\"audio_frames_dropped\": ", stats.audio_frames_dropped, ", "
+                    "\"video_frames_dropped\": ", stats.video_frames_dropped, ", "
+                    "\"video_gops_dropped\": ", stats.video_gops_dropped, ", "
+                    "\"qos_level\": \"", stats.qos.level, "\", "
+                    "\"qos_lag_ms\": ", stats.qos.lag_millisec, ", "
+                    "\"qos_max_lag_ms\": ", stats.qos.max_lag_millisec, ", "
+                    "\"qos_messages\": ", stats.qos.num_qos_messages, ", "
+                    "\"qos_nonref_dropped\": ", stats.qos.nonref_frames_dropped, ", "
+                    "\"qos_encoder_dropped\": ", stats.qos.encoder_frames_dropped, ", "
+                    "\"qos_level_changes\": ", stats.qos.num_level_changes, ", "
+                    "\"low_latency\": ", (stats.low_latency ? "true" : "false"), ", "
+                    "\"latency_frames\": ", stats.latency.num_frames, ", "
+                    "\"latency_unmatched\": ", stats.latency.num_unmatched, ", "
+                    "\"latency_avg_us\": ", stats.latency.avg_microsec, ", "
+                    "\"latency_max_us\": ", stats.latency.max_microsec, ", "
+                    "\"latency_hist_ms\": [ ", latency_hist->mem(), " ], "
+                    "\"pipeline_state\": \"", stats.pipeline_state, "\", "
+                    "\"preroll_ms\": ", stats.preroll_time, ", "
+                    "\"seek_ms\": ", stats.seek_time, ", "
+                    "\"play_ms\": ", stats.play_time, ", "
+                    "\"first_frame_ms\": ", stats.first_frame_time, ", "
+                    "\"reconnect_failures\": ", backoff.num_failures, ", "
+                    "\"reconnect_starts\": ", backoff.num_starts, ", "
+                    "\"reconnect_delay_ms\": ", backoff.last_delay, ", "
+                    "\"reconnect_waiting\": ", (backoff.waiting ? "true" : "false"), ", "
+                    "\"reconnect_wait_ms\": ", backoff.wait_time, " }");
+            page_pool->getFillPages (page_list, line->mem());
+
+            el = next_el;
+        }
+    }
+    streams_mutex.unlock ();
+
+    page_pool->getFillPages (page_list, "\n]\n");
+}
+
 Result
 MomentGstModule::httpGetChannelsStat (HttpRequest  * const mt_nonnull req,
 				      Sender       * const mt_nonnull conn_sender,
@@ -532,14 +1012,7 @@ MomentGstModule::httpGetChannelsStat (HttpRequest  * const mt_nonnull req,
 
     self->page_pool->getFillPages (&page_list, ConstMemory (suffix, sizeof (suffix) - 1));
 
-    Size content_len = 0;
-    {
-	PagePool::Page *page = page_list.first;
-	while (page) {
-	    content_len += page->data_len;
-	    page = page->getNextMsgPage();
-	}
-    }
+    Size const content_len = getPageListLength (page_list);
 
     conn_sender->send (self->page_pool,
 		       false /* do_flush */,
@@ -555,10 +1028,104 @@ MomentGstModule::httpGetChannelsStat (HttpRequest  * const mt_nonnull req,
     return Result::Success;
 }
 
+// Options of "mod_gst/streams" config section which "add_channel" admin
+// request accepts as parameters.
+static char const * const stream_option_names [] = {
+    "name",
+    "title",
+    "desc",
+    "chain",
+    "uri",
+    "playlist",
+    "dir",
+    "dir_re_read",
+    "record_path",
+    "connect_on_demand",
+    "connect_on_demand_timeout",
+    "push_uri",
+    "push_server",
+    "push_port",
+    "push_username",
+    "push_password",
+    "fetch_uri",
+    "no_audio",
+    "no_video",
+    "force_transcode",
+    "force_transcode_audio",
+    "force_transcode_video",
+    "aac_perfect_timestamp",
+    "sync_to_clock",
+    "async_delivery",
+    "frame_ring_size",
+    "frame_ring_drop_watermark",
+    "qos",
+    "low_latency",
+    "source_latency",
+    "measure_latency",
+    "no_video_threshold",
+    "transcoding_profile",
+    "renditions"
+};
+
+// Cuts the next line off 'body', without the line terminator.
+static ConstMemory cutLine (ConstMemory * const mt_nonnull body)
+{
+    Byte const * const nl = (Byte const *) memchr (body->mem(), '\n', body->len());
+    Size const line_len = (nl ? (Size) (nl - body->mem()) : body->len());
+
+    ConstMemory line (body->mem(), line_len);
+    if (nl)
+        *body = ConstMemory (nl + 1, body->len() - line_len - 1);
+    else
+        *body = ConstMemory ();
+
+    if (line.len() > 0 && line.mem() [line.len() - 1] == '\r')
+        line = ConstMemory (line.mem(), line.len() - 1);
+
+    return line;
+}
+
+// Body of "add_channels" request: "option=value" lines, channels are
+// separated with empty lines. Lines starting with '#' are ignored.
+static void parseChannelBatch (ConstMemory       body,
+                               MConfig::Config * const mt_nonnull config)
+{
+    Count channel_idx = 0;
+    bool got_options = false;
+
+    while (body.len() > 0) {
+        ConstMemory const line = cutLine (&body);
+
+        if (line.len() == 0) {
+            if (got_options) {
+                ++channel_idx;
+                got_options = false;
+            }
+            continue;
+        }
+
+        if (line.mem() [0] == '#')
+            continue;
+
+        Byte const * const eq = (Byte const *) memchr (line.mem(), '=', line.len());
+        if (!eq) {
+            logW_ (_func, "Bad line in channel batch: ", line);
+            continue;
+        }
+
+        Size const name_len = eq - line.mem();
+        ConstMemory const opt_name  (line.mem(), name_len);
+        ConstMemory const opt_value (eq + 1, line.len() - name_len - 1);
+
+        config->setOption (makeString ("channels/", channel_idx, "/", opt_name)->mem(), opt_value);
+        got_options = true;
+    }
+}
+
 Result
 MomentGstModule::adminHttpRequest (HttpRequest  * const mt_nonnull req,
 				   Sender       * const mt_nonnull conn_sender,
-				   Memory const & /* msg_body */,
+				   Memory const &msg_body,
 				   void        ** const mt_nonnull /* ret_msg_data */,
 				   void         * const _self)
 {
@@ -650,14 +1217,7 @@ MomentGstModule::adminHttpRequest (HttpRequest  * const mt_nonnull req,
       // TODO Below is the common code for finishing HTTP requests.
       //      Put it into an utility method.
 
-	Size content_len = 0;
-	{
-	    PagePool::Page *page = page_list.first;
-	    while (page) {
-		content_len += page->data_len;
-		page = page->getNextMsgPage();
-	    }
-	}
+	Size const content_len = getPageListLength (page_list);
 
 	conn_sender->send (self->page_pool,
 			   false /* do_flush */,
@@ -694,14 +1254,7 @@ MomentGstModule::adminHttpRequest (HttpRequest  * const mt_nonnull req,
 	static char const suffix [] = "]\n";
 	self->page_pool->getFillPages (&page_list, suffix);
 
-	Size content_len = 0;
-	{
-	    PagePool::Page *page = page_list.first;
-	    while (page) {
-		content_len += page->data_len;
-		page = page->getNextMsgPage();
-	    }
-	}
+	Size const content_len = getPageListLength (page_list);
 
 	conn_sender->send (self->page_pool,
 			   false /* do_flush */,
@@ -753,7 +1306,7 @@ MomentGstModule::adminHttpRequest (HttpRequest  * const mt_nonnull req,
 		goto _channel_reconnect__done;
 	    }
 
-	    channel_entry->channel->restartStream ();
+	    self->reconnectChannel (channel_entry);
 //	    channel_entry->channel->resetTrafficStats ();
 	}
 
@@ -769,70 +1322,280 @@ _channel_reconnect__done:
 	logA_ ("mod_gst 302 ", req->getClientAddress(), " ", req->getRequestLine());
     } else
     if (req->getNumPathElems() >= 2
-	&& equal (req->getPath (1), "channels_stat"))
+        && (equal (req->getPath (1), "add_channel") ||
+            equal (req->getPath (1), "add_channels") ||
+            equal (req->getPath (1), "remove_channel") ||
+            equal (req->getPath (1), "remove_channels")))
     {
-	return httpGetChannelsStat (req, conn_sender, _self);
-    } else {
-	logE_ (_func, "Unknown admin HTTP request: ", req->getFullPath());
+        Ref<String> report;
+        Result res = Result::Failure;
 
-	ConstMemory const reply_body = "Unknown command";
-	conn_sender->send (self->page_pool,
-			   true /* do_flush */,
-			   MOMENT_GST__404_HEADERS (reply_body.len()),
-			   "\r\n",
-			   reply_body);
+        if (equal (req->getPath (1), "add_channel") ||
+            equal (req->getPath (1), "add_channels"))
+        {
+            MConfig::Config channels_config;
+            if (equal (req->getPath (1), "add_channel")) {
+                for (unsigned i = 0; i < sizeof (stream_option_names) / sizeof (stream_option_names [0]); ++i) {
+                    ConstMemory const value = req->getParameter (stream_option_names [i]);
+                    if (value.mem() != NULL)
+                        channels_config.setOption (makeString ("channels/0/", stream_option_names [i])->mem(), value);
+                }
+            } else {
+                parseChannelBatch (msg_body, &channels_config);
+            }
 
-	logA_ ("gst_admin 404 ", req->getClientAddress(), " ", req->getRequestLine());
-    }
+            MConfig::Section * const channels_section = channels_config.getSection ("channels");
+            if (channels_section)
+                res = self->addChannels (channels_section, &report);
+            else
+                report = grab (new (std::nothrow) String ("No channels specified\n"));
+        } else {
+            List< Ref<String> > channel_names;
+            if (equal (req->getPath (1), "remove_channel")) {
+                ConstMemory const channel_name = req->getParameter ("name");
+                if (channel_name.mem() != NULL)
+                    channel_names.append (grab (new (std::nothrow) String (channel_name)));
+            } else {
+              // One channel name per line.
+                ConstMemory body = msg_body;
+                while (body.len() > 0) {
+                    ConstMemory const line = cutLine (&body);
+                    if (line.len() > 0)
+                        channel_names.append (grab (new (std::nothrow) String (line)));
+                }
+            }
 
-    if (!req->getKeepalive())
-        conn_sender->closeAfterFlush();
+            if (!channel_names.isEmpty())
+                res = self->removeChannels (&channel_names, &report);
+            else
+                report = grab (new (std::nothrow) String ("No channels specified\n"));
+        }
 
-    return Result::Success;
+        if (res) {
+            conn_sender->send (self->page_pool,
+                               true /* do_flush */,
+                               MOMENT_GST__OK_HEADERS ("text/plain", report->len()),
+                               "\r\n",
+                               report->mem());
 
-_bad_request:
-    {
-	MOMENT_GST__HEADERS_DATE
-	ConstMemory const reply_body = "400 Bad Request";
-	conn_sender->send (
-		self->page_pool,
-		true /* do_flush */,
-		MOMENT_GST__400_HEADERS (reply_body.len()),
-		"\r\n",
-		reply_body);
-    }
+            logA_ ("gst_admin 200 ", req->getClientAddress(), " ", req->getRequestLine());
+        } else {
+            conn_sender->send (self->page_pool,
+                               true /* do_flush */,
+                               MOMENT_GST__500_HEADERS (report->len()),
+                               "\r\n",
+                               report->mem());
 
-    if (!req->getKeepalive())
-        conn_sender->closeAfterFlush();
+            logA_ ("gst_admin 500 ", req->getClientAddress(), " ", req->getRequestLine());
+        }
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "channels_stat"))
+    {
+	return httpGetChannelsStat (req, conn_sender, _self);
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "stream_stats"))
+    {
+	PagePool::PageListHead page_list;
+	self->printStreamStatsJson (&page_list);
 
-    return Result::Success;
-}
+	Size const content_len = getPageListLength (page_list);
 
-HttpService::HttpHandler MomentGstModule::http_handler = {
-    httpRequest,
-    NULL /* httpMessageBody */
-};
+	conn_sender->send (self->page_pool,
+			   false /* do_flush */,
+			   MOMENT_GST__OK_HEADERS ("text/plain", content_len),
+			   "\r\n");
+	conn_sender->sendPages (self->page_pool, page_list.first, true /* do_flush */);
 
-Result
-MomentGstModule::httpRequest (HttpRequest  * const mt_nonnull req,
-			      Sender       * const mt_nonnull conn_sender,
-			      Memory const & /* msg_body */,
-			      void        ** const mt_nonnull /* ret_msg_data */,
-			      void         * const _self)
-{
-    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+	logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "reaper_stats"))
+    {
+	PipelineReaper::Stats stats;
+	self->reaper->getStats (&stats);
 
-    logD_ (_func_);
+	StRef<String> const reply = st_makeString (
+		"{ \"pending\": ", stats.num_pending, ", "
+		"\"reaped\": ", stats.num_reaped, ", "
+		"\"slow\": ", stats.num_slow, ", "
+		"\"oldest_pending_ms\": ", stats.oldest_pending_time, ", "
+		"\"max_reap_ms\": ", stats.max_reap_time, " }\n");
 
-    MOMENT_GST__HEADERS_DATE
+	conn_sender->send (self->page_pool,
+			   true /* do_flush */,
+			   MOMENT_GST__OK_HEADERS ("text/plain", reply->len()),
+			   "\r\n",
+			   reply->mem());
 
+	logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+    } else
     if (req->getNumPathElems() >= 2
-        && equal (req->getPath (1), "playlist.json")
-        && self->serve_playlist_json)
+	&& equal (req->getPath (1), "novideo_stats"))
     {
-        PagePool::PageListHead page_list;
+	FrameTimeoutWheel::Stats stats;
+	self->timeout_wheel->getStats (&stats);
 
-        static char const prefix [] = "[\n";
+	StRef<String> const reply = st_makeString (
+		"{ \"watches\": ", stats.num_watches, ", "
+		"\"timeouts\": ", stats.num_timeouts, ", "
+		"\"rescheduled\": ", stats.num_rescheduled, " }\n");
+
+	conn_sender->send (self->page_pool,
+			   true /* do_flush */,
+			   MOMENT_GST__OK_HEADERS ("text/plain", reply->len()),
+			   "\r\n",
+			   reply->mem());
+
+	logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "encoder_stats"))
+    {
+	List<EncoderScheduler::EncoderStats> stats_list;
+	if (self->encoder_scheduler)
+	    self->encoder_scheduler->getStats (&stats_list);
+
+	StRef<String> reply = st_makeString (
+		"{ \"enabled\": ", (self->encoder_scheduler ? "true" : "false"), ", "
+		"\"cores\": ", (self->encoder_scheduler ? self->encoder_scheduler->getNumCpus() : 0), ", "
+		"\"encoders\": [");
+	{
+	    bool first = true;
+	    List<EncoderScheduler::EncoderStats>::Element *el = stats_list.getFirstElement();
+	    while (el) {
+		EncoderScheduler::EncoderStats const &stats = el->data;
+		reply = st_makeString (reply->mem(), (first ? "" : ","), "\n  "
+			"{ \"name\": \"", jsonEscape (stats.name->mem())->mem(), "\", "
+			"\"threads\": ", stats.num_threads, ", "
+			"\"first_cpu\": ", stats.cpu_first, ", "
+			"\"cpus\": ", stats.cpu_count, ", "
+			"\"fps\": ", stats.fps_milli / 1000, ".", stats.fps_milli % 1000 / 100, ", "
+			"\"target_fps\": ", stats.target_fps_milli / 1000, ".", stats.target_fps_milli % 1000 / 100, " }");
+		first = false;
+		el = el->next;
+	    }
+	}
+	reply = st_makeString (reply->mem(), " ] }\n");
+
+	conn_sender->send (self->page_pool,
+			   true /* do_flush */,
+			   MOMENT_GST__OK_HEADERS ("text/plain", reply->len()),
+			   "\r\n",
+			   reply->mem());
+
+	logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "source_stats"))
+    {
+	SourceRegistry::Stats stats;
+	stats.num_sources = 0;
+	stats.num_subscribers = 0;
+	if (self->source_registry)
+	    self->source_registry->getStats (&stats);
+
+	StRef<String> const reply = st_makeString (
+		"{ \"enabled\": ", (self->source_registry ? "true" : "false"), ", "
+		"\"sources\": ", stats.num_sources, ", "
+		"\"subscribers\": ", stats.num_subscribers, " }\n");
+
+	conn_sender->send (self->page_pool,
+			   true /* do_flush */,
+			   MOMENT_GST__OK_HEADERS ("text/plain", reply->len()),
+			   "\r\n",
+			   reply->mem());
+
+	logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+    } else
+    if (req->getNumPathElems() >= 2
+	&& equal (req->getPath (1), "frame_trace"))
+    {
+        if (!frameTraceEnabled ()) {
+            ConstMemory const reply_body = "Frame tracing is disabled (configure with --enable-frame-trace)";
+            conn_sender->send (self->page_pool,
+                               true /* do_flush */,
+                               MOMENT_GST__404_HEADERS (reply_body.len()),
+                               "\r\n",
+                               reply_body);
+
+            logA_ ("mod_gst 404 ", req->getClientAddress(), " ", req->getRequestLine());
+        } else {
+            PagePool::PageListHead page_list;
+            frameTraceDump (self->page_pool, &page_list);
+
+            Size const content_len = getPageListLength (page_list);
+
+            conn_sender->send (self->page_pool,
+                               false /* do_flush */,
+                               MOMENT_GST__OK_HEADERS ("application/octet-stream", content_len),
+                               "\r\n");
+            conn_sender->sendPages (self->page_pool, page_list.first, true /* do_flush */);
+
+            logA_ ("mod_gst 200 ", req->getClientAddress(), " ", req->getRequestLine());
+        }
+    } else {
+	logE_ (_func, "Unknown admin HTTP request: ", req->getFullPath());
+
+	ConstMemory const reply_body = "Unknown command";
+	conn_sender->send (self->page_pool,
+			   true /* do_flush */,
+			   MOMENT_GST__404_HEADERS (reply_body.len()),
+			   "\r\n",
+			   reply_body);
+
+	logA_ ("gst_admin 404 ", req->getClientAddress(), " ", req->getRequestLine());
+    }
+
+    if (!req->getKeepalive())
+        conn_sender->closeAfterFlush();
+
+    return Result::Success;
+
+_bad_request:
+    {
+	MOMENT_GST__HEADERS_DATE
+	ConstMemory const reply_body = "400 Bad Request";
+	conn_sender->send (
+		self->page_pool,
+		true /* do_flush */,
+		MOMENT_GST__400_HEADERS (reply_body.len()),
+		"\r\n",
+		reply_body);
+    }
+
+    if (!req->getKeepalive())
+        conn_sender->closeAfterFlush();
+
+    return Result::Success;
+}
+
+HttpService::HttpHandler MomentGstModule::http_handler = {
+    httpRequest,
+    NULL /* httpMessageBody */
+};
+
+Result
+MomentGstModule::httpRequest (HttpRequest  * const mt_nonnull req,
+			      Sender       * const mt_nonnull conn_sender,
+			      Memory const & /* msg_body */,
+			      void        ** const mt_nonnull /* ret_msg_data */,
+			      void         * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    logD_ (_func_);
+
+    MOMENT_GST__HEADERS_DATE
+
+    if (req->getNumPathElems() >= 2
+        && equal (req->getPath (1), "playlist.json")
+        && self->serve_playlist_json)
+    {
+        PagePool::PageListHead page_list;
+
+        static char const prefix [] = "[\n";
         static char const suffix [] = "]\n";
 
         self->page_pool->getFillPages (&page_list, prefix);
@@ -864,14 +1627,7 @@ MomentGstModule::httpRequest (HttpRequest  * const mt_nonnull req,
 
         self->page_pool->getFillPages (&page_list, suffix);
 
-	Size content_len = 0;
-	{
-	    PagePool::Page *page = page_list.first;
-	    while (page) {
-		content_len += page->data_len;
-		page = page->getNextMsgPage();
-	    }
-	}
+	Size const content_len = getPageListLength (page_list);
 
 	conn_sender->send (self->page_pool,
 			   false /* do_flush */,
@@ -969,14 +1725,7 @@ MomentGstModule::httpRequest (HttpRequest  * const mt_nonnull req,
 
 	self->page_pool->getFillPages (&page_list, ConstMemory (suffix, sizeof (suffix) - 1));
 
-	Size content_len = 0;
-	{
-	    PagePool::Page *page = page_list.first;
-	    while (page) {
-		content_len += page->data_len;
-		page = page->getNextMsgPage();
-	    }
-	}
+	Size const content_len = getPageListLength (page_list);
 
 	conn_sender->send (self->page_pool,
 			   false /* do_flush */,
@@ -1100,14 +1849,7 @@ MomentGstModule::httpRequest (HttpRequest  * const mt_nonnull req,
 
 	self->page_pool->getFillPages (&page_list, ConstMemory (suffix, sizeof (suffix) - 1));
 
-	Size content_len = 0;
-	{
-	    PagePool::Page *page = page_list.first;
-	    while (page) {
-		content_len += page->data_len;
-		page = page->getNextMsgPage();
-	    }
-	}
+	Size const content_len = getPageListLength (page_list);
 
 	conn_sender->send (self->page_pool,
 			   false /* do_flush */,
@@ -1153,12 +1895,311 @@ _bad_request:
 #endif
 }
 
-void
-MomentGstModule::parseSourcesConfigSection ()
+// Leaves '*ret_val' as is if the option is not set.
+static Result configGetUint64 (MConfig::Config * const mt_nonnull config,
+                               ConstMemory       const opt_name,
+                               Uint64          * const mt_nonnull ret_val)
+{
+    MConfig::GetResult const res = config->getUint64_default (opt_name, ret_val, *ret_val);
+    if (!res) {
+        logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+        return Result::Failure;
+    }
+
+    logI_ (_func, opt_name, ": ", *ret_val);
+    return Result::Success;
+}
+
+static Result sectionGetUint32 (MConfig::Section * const mt_nonnull section,
+                                ConstMemory        const opt_name,
+                                Uint32           * const mt_nonnull ret_val)
+{
+    MConfig::Option * const opt = section->getOption (opt_name);
+    if (!opt || !opt->getValue())
+        return Result::Success;
+
+    Uint64 tmp_uint64;
+    if (!opt->getValue()->getAsUint64 (&tmp_uint64) || tmp_uint64 > (Uint32) -1) {
+        logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
+        return Result::Failure;
+    }
+
+    *ret_val = (Uint32) tmp_uint64;
+    return Result::Success;
+}
+
+static void sectionGetString (MConfig::Section * const mt_nonnull section,
+                              ConstMemory        const opt_name,
+                              Ref<String>      * const mt_nonnull ret_val)
+{
+    MConfig::Option * const opt = section->getOption (opt_name);
+    if (opt && opt->getValue())
+        *ret_val = grab (new (std::nothrow) String (opt->getValue()->mem()));
+}
+
+Result
+MomentGstModule::parseTranscodeProfile (MConfig::Section * const mt_nonnull section,
+                                        TranscodeProfile * const mt_nonnull profile)
+{
+    sectionGetString (section, "video_encoder",        &profile->video_encoder);
+    sectionGetString (section, "preset",               &profile->speed_preset);
+    sectionGetString (section, "tune",                 &profile->tune);
+    sectionGetString (section, "profile",              &profile->h264_profile);
+    sectionGetString (section, "video_encoder_params", &profile->video_encoder_params);
+    sectionGetString (section, "audio_encoder",        &profile->audio_encoder);
+    sectionGetString (section, "audio_encoder_params", &profile->audio_encoder_params);
+
+    if (!sectionGetUint32 (section, "video_bitrate",     &profile->video_bitrate)     ||
+        !sectionGetUint32 (section, "keyframe_interval", &profile->keyframe_interval) ||
+        !sectionGetUint32 (section, "threads",           &profile->threads)           ||
+        !sectionGetUint32 (section, "width",             &profile->width)             ||
+        !sectionGetUint32 (section, "height",            &profile->height)            ||
+        !sectionGetUint32 (section, "audio_bitrate",     &profile->audio_bitrate)     ||
+        !sectionGetUint32 (section, "audio_channels",    &profile->audio_channels)    ||
+        !sectionGetUint32 (section, "audio_rate",        &profile->audio_rate))
+    {
+        return Result::Failure;
+    }
+
+    if (!configSectionGetBoolean (section, "sliced_threads", &profile->sliced_threads, profile->sliced_threads))
+        return Result::Failure;
+
+    if (!TranscodeProfile::isSupportedVideoEncoder (profile->video_encoder->mem())) {
+        logE_ (_func, "Unsupported video encoder \"", profile->video_encoder, "\"");
+        return Result::Failure;
+    }
+
+    if (!TranscodeProfile::isSupportedAudioEncoder (profile->audio_encoder->mem())) {
+        logE_ (_func, "Unsupported audio encoder \"", profile->audio_encoder, "\"");
+        return Result::Failure;
+    }
+
+    if (profile->keyframe_interval == 0)
+        profile->keyframe_interval = 1;
+    if (profile->audio_channels == 0)
+        profile->audio_channels = 1;
+
+    return Result::Success;
+}
+
+// Options of a config section, nested sections included, in order.
+static Ref<String> makeSectionSignature (MConfig::Section * const mt_nonnull section)
+{
+    Ref<String> sig = grab (new (std::nothrow) String);
+
+    MConfig::Section::iter iter (*section);
+    while (!section->iter_done (iter)) {
+        MConfig::SectionEntry * const section_entry = section->iter_next (iter);
+        if (section_entry->getType() == MConfig::SectionEntry::Type_Option) {
+            MConfig::Option * const option = static_cast <MConfig::Option*> (section_entry);
+            if (option->getValue())
+                sig = makeString (sig->mem(), option->getName(), "=", option->getValue()->mem(), ";");
+            else
+                sig = makeString (sig->mem(), option->getName(), ";");
+        } else
+        if (section_entry->getType() == MConfig::SectionEntry::Type_Section) {
+            MConfig::Section * const subsection = static_cast <MConfig::Section*> (section_entry);
+            Ref<String> const sub_sig = makeSectionSignature (subsection);
+            sig = makeString (sig->mem(), subsection->getName(), "{", sub_sig->mem(), "}");
+        }
+    }
+
+    return sig;
+}
+
+// Takes the next item of a comma-separated list off 'rest', with spaces
+// around it trimmed.
+static ConstMemory takeListItem (ConstMemory * const mt_nonnull rest)
+{
+    Byte const * const comma = (Byte const *) memchr (rest->mem(), ',', rest->len());
+    Size const item_len = (comma ? (Size) (comma - rest->mem()) : rest->len());
+
+    ConstMemory item (rest->mem(), item_len);
+    if (comma)
+        *rest = ConstMemory (comma + 1, rest->len() - item_len - 1);
+    else
+        *rest = ConstMemory ();
+
+    while (item.len() > 0 && item.mem() [0] == ' ')
+        item = ConstMemory (item.mem() + 1, item.len() - 1);
+    while (item.len() > 0 && item.mem() [item.len() - 1] == ' ')
+        item = ConstMemory (item.mem(), item.len() - 1);
+
+    return item;
+}
+
+Result
+MomentGstModule::parseTranscodingProfilesConfigSection (MConfig::Config           * const mt_nonnull config,
+                                                        TranscodeProfileEntryHash * const mt_nonnull ret_profile_hash)
 {
     logD_ (_func_);
 
-    MConfig::Config * const config = moment->getConfig();
+    MConfig::Section * const profiles_section = config->getSection ("mod_gst/transcoding_profiles");
+    if (!profiles_section)
+        return Result::Success;
+
+    MConfig::Section::iter iter (*profiles_section);
+    while (!profiles_section->iter_done (iter)) {
+        MConfig::SectionEntry * const section_entry = profiles_section->iter_next (iter);
+        if (section_entry->getType() != MConfig::SectionEntry::Type_Section)
+            continue;
+
+        MConfig::Section * const section = static_cast <MConfig::Section*> (section_entry);
+
+        MConfig::Option * const name_opt = section->getOption ("name");
+        if (!name_opt || !name_opt->getValue()) {
+            logE_ (_func, "Unnamed transcoding profile in section mod_gst/transcoding_profiles");
+            return Result::Failure;
+        }
+
+        ConstMemory const profile_name = name_opt->getValue()->mem();
+        if (ret_profile_hash->lookup (profile_name)) {
+            logE_ (_func, "Duplicate transcoding profile \"", profile_name, "\"");
+            return Result::Failure;
+        }
+
+        Ref<TranscodeProfile> const profile = grab (new (std::nothrow) TranscodeProfile);
+        profile->name = grab (new (std::nothrow) String (profile_name));
+        if (!parseTranscodeProfile (section, profile)) {
+            logE_ (_func, "Invalid transcoding profile \"", profile_name, "\"");
+            return Result::Failure;
+        }
+
+        TranscodeProfileEntry * const entry = new (std::nothrow) TranscodeProfileEntry;
+        assert (entry);
+        entry->profile_name = profile->name;
+        entry->profile = profile;
+        entry->config_sig = makeSectionSignature (section);
+        ret_profile_hash->add (entry);
+
+        logI_ (_func, "transcoding profile \"", profile_name, "\": ",
+               profile->makeVideoChain (false /* sync_to_clock */), "; ",
+               profile->makeAudioChain (false /* aac_perfect_timestamp */, false /* sync_to_clock */));
+    }
+
+    return Result::Success;
+}
+
+void
+MomentGstModule::releaseTranscodeProfiles (TranscodeProfileEntryHash * const mt_nonnull profile_hash)
+{
+    TranscodeProfileEntryHash::iter iter (*profile_hash);
+    while (!profile_hash->iter_done (iter)) {
+        TranscodeProfileEntry * const entry = profile_hash->iter_next (iter);
+        delete entry;
+    }
+
+    delete profile_hash;
+}
+
+TranscodeProfile*
+MomentGstModule::lookupTranscodeProfile (ConstMemory const profile_name)
+{
+    TranscodeProfileEntry * const entry = transcode_profile_hash->lookup (profile_name);
+    if (!entry)
+        return NULL;
+
+    return entry->profile;
+}
+
+Ref<String>
+MomentGstModule::makeProfilesSignature (MConfig::Section * const mt_nonnull item_section)
+{
+    ConstMemory profile_name = default_stream_opts->transcode_profile->name->mem();
+    {
+        MConfig::Option * const opt = item_section->getOption ("transcoding_profile");
+        if (opt && opt->getValue())
+            profile_name = opt->getValue()->mem();
+    }
+
+    Ref<String> sig;
+    {
+        TranscodeProfileEntry * const entry = transcode_profile_hash->lookup (profile_name);
+        sig = makeString ("profile=", profile_name, "{",
+                          (entry ? entry->config_sig->mem() : ConstMemory()), "}");
+    }
+
+    MConfig::Option * const opt = item_section->getOption ("renditions");
+    if (opt && opt->getValue()) {
+        ConstMemory rest = opt->getValue()->mem();
+        while (rest.len() > 0) {
+            ConstMemory const item = takeListItem (&rest);
+            if (item.len() == 0)
+                continue;
+
+            TranscodeProfileEntry * const entry = transcode_profile_hash->lookup (item);
+            sig = makeString (sig->mem(), "rendition=", item, "{",
+                              (entry ? entry->config_sig->mem() : ConstMemory()), "}");
+        }
+    }
+
+    return sig;
+}
+
+Result
+MomentGstModule::parseRenditions (ConstMemory         const stream_name,
+                                  ConstMemory         const value,
+                                  Uint32              const gop_size,
+                                  Ref<RenditionSet> * const mt_nonnull ret_renditions)
+{
+    List< Ref<TranscodeProfile> > profile_list;
+
+    ConstMemory rest = value;
+    while (rest.len() > 0) {
+        ConstMemory const item = takeListItem (&rest);
+        if (item.len() == 0)
+            continue;
+
+        TranscodeProfile * const profile = lookupTranscodeProfile (item);
+        if (!profile) {
+            logE_ (_func, "Unknown transcoding profile in renditions of stream ", stream_name, ": ", item);
+            return Result::Failure;
+        }
+
+        profile_list.append (profile);
+    }
+
+    if (profile_list.isEmpty()) {
+        *ret_renditions = NULL;
+        return Result::Success;
+    }
+
+    Ref<RenditionSet> const renditions = grab (new (std::nothrow) RenditionSet);
+    renditions->init (stream_name, &profile_list, gop_size);
+    logI_ (_func, "stream ", stream_name, ": ", renditions->getNumRenditions(), " renditions, "
+           "gop_size: ", gop_size);
+
+    *ret_renditions = renditions;
+    return Result::Success;
+}
+
+bool
+MomentGstModule::isUnchangedChannel (ConstMemory const channel_name,
+                                     ConstMemory const config_sig)
+{
+    mutex.lock ();
+
+    ChannelEntry * const channel_entry = channel_entry_hash.lookup (channel_name);
+    if (!channel_entry
+        || !channel_entry->config_sig
+        || !equal (channel_entry->config_sig->mem(), config_sig))
+    {
+        mutex.unlock ();
+        return false;
+    }
+
+    channel_entry->reload_seen = true;
+
+    mutex.unlock ();
+
+    return true;
+}
+
+void
+MomentGstModule::parseSourcesConfigSection (MConfig::Config * const mt_nonnull config,
+                                            bool              const reload)
+{
+    logD_ (_func_);
 
     MConfig::Section * const src_section = config->getSection ("mod_gst/sources");
     if (!src_section) {
@@ -1180,6 +2221,10 @@ MomentGstModule::parseSourcesConfigSection ()
 
 	    logD_ (_func, "Stream name: ", stream_name, "; stream uri: ", stream_uri);
 
+            Ref<String> const config_sig = makeString ("uri=", stream_uri);
+            if (reload && isUnchangedChannel (stream_name, config_sig->mem()))
+                continue;
+
             Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
             {
                 *opts = *default_channel_opts;
@@ -1196,18 +2241,17 @@ MomentGstModule::parseSourcesConfigSection ()
                 item->spec_kind = PlaybackItem::SpecKind::Uri;
             }
 
-	    createStreamChannel (opts, item);
+	    createStreamChannel (opts, item, config_sig->mem());
         }
     }
 }
 
 void
-MomentGstModule::parseChainsConfigSection ()
+MomentGstModule::parseChainsConfigSection (MConfig::Config * const mt_nonnull config,
+                                           bool              const reload)
 {
     logD_ (_func_);
 
-    MConfig::Config * const config = moment->getConfig();
-
 #if 0
 // Debugging
     do {
@@ -1270,6 +2314,10 @@ MomentGstModule::parseChainsConfigSection ()
 	    ConstMemory const stream_name = chain_option->getName();
 	    ConstMemory const chain_spec = chain_option->getValue()->mem();
 
+            Ref<String> const config_sig = makeString ("chain=", chain_spec);
+            if (reload && isUnchangedChannel (stream_name, config_sig->mem()))
+                continue;
+
             Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
             {
                 *opts = *default_channel_opts;
@@ -1286,7 +2334,10 @@ MomentGstModule::parseChainsConfigSection ()
                 item->spec_kind = PlaybackItem::SpecKind::Chain;
             }
 
-	    createStreamChannel (opts, item);
+            // Invalid chains are reported here rather than on first connect.
+            chain_cache->getTemplate (item->stream_spec->mem(), true /* validate */);
+
+	    createStreamChannel (opts, item, config_sig->mem());
 	} else
 	if (section_entry->getType() == MConfig::SectionEntry::Type_Section) {
 	    MConfig::Section * const section = static_cast <MConfig::Section*> (section_entry);
@@ -1344,6 +2395,10 @@ MomentGstModule::parseChainsConfigSection ()
 		continue;
 	    }
 
+            Ref<String> const config_sig = makeSectionSignature (section);
+            if (reload && isUnchangedChannel (stream_name, config_sig->mem()))
+                continue;
+
             Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
             {
                 *opts = *default_channel_opts;
@@ -1363,392 +2418,537 @@ MomentGstModule::parseChainsConfigSection ()
                 item->spec_kind = PlaybackItem::SpecKind::Chain;
             }
 
-	    createStreamChannel (opts, item);
+            // Invalid chains are reported here rather than on first connect.
+            chain_cache->getTemplate (item->stream_spec->mem(), true /* validate */);
+
+	    createStreamChannel (opts, item, config_sig->mem());
 	}
     }
 }
 
 Result
-MomentGstModule::parseStreamsConfigSection ()
+MomentGstModule::parseStreamSection (MConfig::Section * const mt_nonnull item_section,
+                                     bool               const reload)
 {
-    logD_ (_func_);
+    StRef<String> stream_name;
+    {
+	MConfig::Option * const opt = item_section->getOption ("name");
+	if (opt && opt->getValue()) {
+	    stream_name = opt->getValue()->getAsString();
+	    logD_ (_func, "stream_name: ", stream_name);
+	}
 
-    MConfig::Config * const config = moment->getConfig();
+	if (!stream_name) {
+	    logW_ (_func, "Unnamed stream in section mod_gst/streams");
+	    stream_name = st_grab (new (std::nothrow) String);
+	}
+    }
 
-    MConfig::Section * const streams_section = config->getSection ("mod_gst/streams");
-    if (!streams_section)
-	return Result::Success;
+    Ref<String> const config_sig = makeString (makeSectionSignature (item_section)->mem(),
+                                               makeProfilesSignature (item_section)->mem());
+    if (reload && isUnchangedChannel (stream_name->mem(), config_sig->mem()))
+        return Result::Success;
 
-    MConfig::Section::iter streams_iter (*streams_section);
-    while (!streams_section->iter_done (streams_iter)) {
-	MConfig::SectionEntry * const item_entry = streams_section->iter_next (streams_iter);
-	if (item_entry->getType() == MConfig::SectionEntry::Type_Section) {
-	    MConfig::Section* const item_section = static_cast <MConfig::Section*> (item_entry);
+    StRef<String> channel_title;
+    {
+        MConfig::Option * const opt = item_section->getOption ("title");
+        if (opt && opt->getValue()) {
+            channel_title = opt->getValue()->getAsString();
+            logD_ (_func, "channel_title: ", channel_title);
+        }
 
-	    logD_ (_func, "section");
+        if (!channel_title)
+            channel_title = stream_name;
+    }
 
-	    StRef<String> stream_name;
-	    {
-		MConfig::Option * const opt = item_section->getOption ("name");
-		if (opt && opt->getValue()) {
-		    stream_name = opt->getValue()->getAsString();
-		    logD_ (_func, "stream_name: ", stream_name);
-		}
+    StRef<String> channel_desc;
+    {
+	MConfig::Option * const opt = item_section->getOption ("desc");
+	if (opt && opt->getValue()) {
+	    channel_desc = opt->getValue()->getAsString();
+	    logD_ (_func, "channel_desc: ", channel_desc);
+	}
 
-		if (!stream_name) {
-		    logW_ (_func, "Unnamed stream in section mod_gst/streams");
-		    stream_name = st_grab (new (std::nothrow) String);
-		}
+	if (!channel_desc)
+	    channel_desc = st_grab (new (std::nothrow) String);
+    }
+
+    StRef<String> chain;
+    StRef<String> uri;
+    StRef<String> playlist;
+    StRef<String> playlist_dir;
+    {
+	int num_set_opts = 0;
+
+	{
+	    MConfig::Option * const opt = item_section->getOption ("chain");
+	    if (opt && opt->getValue()) {
+		chain = opt->getValue()->getAsString();
+		logD_ (_func, "chain: ", chain);
+		++num_set_opts;
 	    }
+	}
 
-            StRef<String> channel_title;
-            {
-                MConfig::Option * const opt = item_section->getOption ("title");
-                if (opt && opt->getValue()) {
-                    channel_title = opt->getValue()->getAsString();
-                    logD_ (_func, "channel_title: ", channel_title);
-                }
+	{
+	    MConfig::Option * const opt = item_section->getOption ("uri");
+	    if (opt && opt->getValue()) {
+		uri = opt->getValue()->getAsString();
+		logD_ (_func, "uri: ", uri);
+		++num_set_opts;
+	    }
+	}
+
+	{
+	    MConfig::Option * const opt = item_section->getOption ("playlist");
+	    if (opt && opt->getValue()) {
+		playlist = opt->getValue()->getAsString();
+		logD_ (_func, "playlist: ", playlist);
+		++num_set_opts;
+	    }
+	}
 
-                if (!channel_title)
-                    channel_title = stream_name;
+        {
+            MConfig::Option * const opt = item_section->getOption ("dir");
+            if (opt && opt->getValue()) {
+                playlist_dir = opt->getValue()->getAsString();
+                logD_ (_func, "dir: ", playlist_dir);
+                ++num_set_opts;
             }
+        }
 
-	    StRef<String> channel_desc;
-	    {
-		MConfig::Option * const opt = item_section->getOption ("desc");
-		if (opt && opt->getValue()) {
-		    channel_desc = opt->getValue()->getAsString();
-		    logD_ (_func, "channel_desc: ", channel_desc);
-		}
+	if (num_set_opts > 1) {
+	    logW_ (_func, "Only one of uri/chain/playlist "
+		   "should be specified for stream \"", stream_name, "\"");
+	}
+    }
 
-		if (!channel_desc)
-		    channel_desc = st_grab (new (std::nothrow) String);
-	    }
+    bool playlist_dir_re_read = true;
+    {
+        ConstMemory const opt_name = "dir_re_read";
+        if (!configSectionGetBoolean (item_section, opt_name, &playlist_dir_re_read, playlist_dir_re_read))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", playlist_dir_re_read);
+    }
 
-	    StRef<String> chain;
-	    StRef<String> uri;
-	    StRef<String> playlist;
-            StRef<String> playlist_dir;
-	    {
-		int num_set_opts = 0;
+    StRef<String> record_path;
+    {
+	MConfig::Option * const opt = item_section->getOption ("record_path");
+	if (opt && opt->getValue()) {
+	    record_path = opt->getValue()->getAsString();
+	    logD_ (_func, "record_path: ", record_path);
+	}
+    }
 
-		{
-		    MConfig::Option * const opt = item_section->getOption ("chain");
-		    if (opt && opt->getValue()) {
-			chain = opt->getValue()->getAsString();
-			logD_ (_func, "chain: ", chain);
-			++num_set_opts;
-		    }
-		}
+    bool connect_on_demand = default_channel_opts->connect_on_demand;
+    {
+        ConstMemory const opt_name = "connect_on_demand";
+        if (!configSectionGetBoolean (item_section, opt_name, &connect_on_demand, connect_on_demand))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", connect_on_demand);
+    }
 
-		{
-		    MConfig::Option * const opt = item_section->getOption ("uri");
-		    if (opt && opt->getValue()) {
-			uri = opt->getValue()->getAsString();
-			logD_ (_func, "uri: ", uri);
-			++num_set_opts;
-		    }
-		}
+    Time connect_on_demand_timeout = default_channel_opts->connect_on_demand_timeout;
+    {
+        ConstMemory const opt_name = "connect_on_demand_timeout";
+        MConfig::Option * const opt = item_section->getOption (opt_name);
+        if (opt && opt->getValue()) {
+            Uint64 tmp_uint64;
+            if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
+                logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
+                return Result::Failure;
+            }
+            connect_on_demand_timeout = (Time) tmp_uint64;
+        }
+    }
 
-		{
-		    MConfig::Option * const opt = item_section->getOption ("playlist");
-		    if (opt && opt->getValue()) {
-			playlist = opt->getValue()->getAsString();
-			logD_ (_func, "playlist: ", playlist);
-			++num_set_opts;
-		    }
-		}
+    Ref<PushAgent> push_agent;
+    {
+        Ref<String> push_uri;
+        {
+            ConstMemory const opt_name = "push_uri";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                push_uri = opt->getValue()->getAsString();
+                logD_ (_func, opt_name, ": ", push_uri);
+            }
+        }
 
-                {
-                    MConfig::Option * const opt = item_section->getOption ("dir");
-                    if (opt && opt->getValue()) {
-                        playlist_dir = opt->getValue()->getAsString();
-                        logD_ (_func, "dir: ", playlist_dir);
-                        ++num_set_opts;
-                    }
+#if 0
+// TODO Unused?
+        Ref<String> push_server;
+        {
+            ConstMemory const opt_name = "push_server";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                push_server = opt->getValue()->getAsString();
+                logD_ (_func, opt_name, ": ", push_server);
+            } else {
+                push_server = grab (new String);
+            }
+        }
+
+        Uint64 push_port = 1935;
+        {
+            ConstMemory const opt_name = "push_port";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                if (!opt->getValue()->getAsUint64 (&push_port)) {
+                    logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
+                    return Result::Failure;
                 }
+                logD_ (_func, opt_name, ": ", push_port);
+            } else {
+                if (push_server && !push_server->isNull())
+                    logD_ (_func, "Default push_port: ", push_port);
+            }
+        }
+#endif
 
-		if (num_set_opts > 1) {
-		    logW_ (_func, "Only one of uri/chain/playlist "
-			   "should be specified for stream \"", stream_name, "\"");
-		}
-	    }
+        StRef<String> push_username;
+        {
+            ConstMemory const opt_name = "push_username";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                push_username = opt->getValue()->getAsString();
+                logD_ (_func, opt_name, ": ", push_username);
+            } else {
+                push_username = st_grab (new (std::nothrow) String);
+            }
+        }
 
-            bool playlist_dir_re_read = true;
-            {
-                ConstMemory const opt_name = "dir_re_read";
-                if (!configSectionGetBoolean (item_section, opt_name, &playlist_dir_re_read, playlist_dir_re_read))
-                    return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", playlist_dir_re_read);
+        StRef<String> push_password;
+        {
+            ConstMemory const opt_name = "push_password";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                push_password = opt->getValue()->getAsString();
+                logD_ (_func, opt_name, ": ", push_password);
+            } else {
+                push_password = st_grab (new (std::nothrow) String);
             }
+        }
 
-	    StRef<String> record_path;
-	    {
-		MConfig::Option * const opt = item_section->getOption ("record_path");
-		if (opt && opt->getValue()) {
-		    record_path = opt->getValue()->getAsString();
-		    logD_ (_func, "record_path: ", record_path);
-		}
-	    }
+        if (push_uri) {
+            Ref<PushProtocol> const push_protocol = moment->getPushProtocolForUri (push_uri->mem());
+            if (push_protocol) {
+                push_agent = grab (new (std::nothrow) PushAgent);
+                push_agent->init (stream_name->mem(),
+                                  push_protocol,
+                                  push_uri      ? push_uri->mem()      : ConstMemory(),
+                                  push_username ? push_username->mem() : ConstMemory(),
+                                  push_password ? push_password->mem() : ConstMemory());
+            }
+        }
+    }
 
-            bool connect_on_demand = default_channel_opts->connect_on_demand;
-            {
-                ConstMemory const opt_name = "connect_on_demand";
-                if (!configSectionGetBoolean (item_section, opt_name, &connect_on_demand, connect_on_demand))
-                    return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", connect_on_demand);
+    Ref<FetchAgent> fetch_agent;
+    {
+        Ref<String> fetch_uri;
+        {
+            ConstMemory const opt_name = "fetch_uri";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                fetch_uri = opt->getValue()->getAsString();
+                logD_ (_func, opt_name, ": ", fetch_uri);
             }
+        }
 
-            Time connect_on_demand_timeout = default_channel_opts->connect_on_demand_timeout;
-            {
-                ConstMemory const opt_name = "connect_on_demand_timeout";
-                MConfig::Option * const opt = item_section->getOption (opt_name);
-                if (opt && opt->getValue()) {
-                    Uint64 tmp_uint64;
-                    if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
-                        logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
-                        return Result::Failure;
-                    }
-                    connect_on_demand_timeout = (Time) tmp_uint64;
-                }
+        if (fetch_uri) {
+            Ref<FetchProtocol> const fetch_protocol = moment->getFetchProtocolForUri (fetch_uri->mem());
+            if (fetch_protocol) {
+                fetch_agent = grab (new (std::nothrow) FetchAgent);
+                fetch_agent->init (moment,
+                                   fetch_protocol,
+                                   stream_name->mem(),
+                                   fetch_uri->mem(),
+                                   fetch_reconnect_interval /* reconnect_interval_millisec */);
             }
+        }
+    }
 
-            Ref<PushAgent> push_agent;
-            {
-                Ref<String> push_uri;
-                {
-                    ConstMemory const opt_name = "push_uri";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        push_uri = opt->getValue()->getAsString();
-                        logD_ (_func, opt_name, ": ", push_uri);
-                    }
-                }
+    bool no_audio = default_channel_opts->default_item->no_audio;
+    {
+        ConstMemory const opt_name = "no_audio";
+        if (!configSectionGetBoolean (item_section, opt_name, &no_audio, no_audio))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", no_audio);
+    }
 
-#if 0
-// TODO Unused?
-                Ref<String> push_server;
-                {
-                    ConstMemory const opt_name = "push_server";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        push_server = opt->getValue()->getAsString();
-                        logD_ (_func, opt_name, ": ", push_server);
-                    } else {
-                        push_server = grab (new String);
-                    }
-                }
+    bool no_video = default_channel_opts->default_item->no_video;
+    {
+        ConstMemory const opt_name = "no_video";
+        if (!configSectionGetBoolean (item_section, opt_name, &no_video, no_video))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", no_video);
+    }
 
-                Uint64 push_port = 1935;
-                {
-                    ConstMemory const opt_name = "push_port";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        if (!opt->getValue()->getAsUint64 (&push_port)) {
-                            logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
-                            return Result::Failure;
-                        }
-                        logD_ (_func, opt_name, ": ", push_port);
-                    } else {
-                        if (push_server && !push_server->isNull())
-                            logD_ (_func, "Default push_port: ", push_port);
-                    }
-                }
-#endif
+    bool force_transcode = default_channel_opts->default_item->force_transcode;
+    {
+        ConstMemory const opt_name = "force_transcode";
+        if (!configSectionGetBoolean (item_section, opt_name, &force_transcode, force_transcode))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode);
+    }
 
-                StRef<String> push_username;
-                {
-                    ConstMemory const opt_name = "push_username";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        push_username = opt->getValue()->getAsString();
-                        logD_ (_func, opt_name, ": ", push_username);
-                    } else {
-                        push_username = st_grab (new (std::nothrow) String);
-                    }
-                }
+    bool force_transcode_audio = default_channel_opts->default_item->force_transcode_audio;
+    {
+        ConstMemory const opt_name = "force_transcode_audio";
+        if (!configSectionGetBoolean (item_section, opt_name, &force_transcode_audio, force_transcode_audio))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode_audio);
+    }
 
-                StRef<String> push_password;
-                {
-                    ConstMemory const opt_name = "push_password";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        push_password = opt->getValue()->getAsString();
-                        logD_ (_func, opt_name, ": ", push_password);
-                    } else {
-                        push_password = st_grab (new (std::nothrow) String);
-                    }
-                }
+    bool force_transcode_video = default_channel_opts->default_item->force_transcode_video;
+    {
+        ConstMemory const opt_name = "force_transcode_video";
+        if (!configSectionGetBoolean (item_section, opt_name, &force_transcode_video, force_transcode_video))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode_video);
+    }
 
-                if (push_uri) {
-                    Ref<PushProtocol> const push_protocol = moment->getPushProtocolForUri (push_uri->mem());
-                    if (push_protocol) {
-                        push_agent = grab (new (std::nothrow) PushAgent);
-                        push_agent->init (stream_name->mem(),
-                                          push_protocol,
-                                          push_uri      ? push_uri->mem()      : ConstMemory(),
-                                          push_username ? push_username->mem() : ConstMemory(),
-                                          push_password ? push_password->mem() : ConstMemory());
-                    }
-                }
-            }
+    bool aac_perfect_timestamp = default_channel_opts->default_item->aac_perfect_timestamp;
+    {
+        ConstMemory const opt_name = "aac_perfect_timestamp";
+        if (!configSectionGetBoolean (item_section, opt_name, &aac_perfect_timestamp, aac_perfect_timestamp))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", aac_perfect_timestamp);
+    }
 
-            Ref<FetchAgent> fetch_agent;
-            {
-                Ref<String> fetch_uri;
-                {
-                    ConstMemory const opt_name = "fetch_uri";
-                    MConfig::Option * const opt = item_section->getOption (opt_name);
-                    if (opt && opt->getValue()) {
-                        fetch_uri = opt->getValue()->getAsString();
-                        logD_ (_func, opt_name, ": ", fetch_uri);
-                    }
-                }
+    bool sync_to_clock = default_channel_opts->default_item->sync_to_clock;
+    {
+        ConstMemory const opt_name = "sync_to_clock";
+        if (!configSectionGetBoolean (item_section, opt_name, &sync_to_clock, sync_to_clock))
+            return Result::Failure;
+        logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", sync_to_clock);
+    }
 
-                if (fetch_uri) {
-                    Ref<FetchProtocol> const fetch_protocol = moment->getFetchProtocolForUri (fetch_uri->mem());
-                    if (fetch_protocol) {
-                        fetch_agent = grab (new (std::nothrow) FetchAgent);
-                        fetch_agent->init (moment,
-                                           fetch_protocol,
-                                           stream_name->mem(),
-                                           fetch_uri->mem(),
-                                           1000 /* reconnect_interval_millisec */ /* TODO Config parameter */);
-                    }
-                }
-            }
+    Ref<GstStreamOptions> const stream_opts = grab (new (std::nothrow) GstStreamOptions);
+    {
+        *stream_opts = *default_stream_opts;
 
-            bool no_audio = default_channel_opts->default_item->no_audio;
-            {
-                ConstMemory const opt_name = "no_audio";
-                if (!configSectionGetBoolean (item_section, opt_name, &no_audio, no_audio))
-                    return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", no_audio);
-            }
+        // Profiles are parsed anew on config reload.
+        if (TranscodeProfile * const profile = lookupTranscodeProfile (stream_opts->transcode_profile->name->mem()))
+            stream_opts->transcode_profile = profile;
 
-            bool no_video = default_channel_opts->default_item->no_video;
-            {
-                ConstMemory const opt_name = "no_video";
-                if (!configSectionGetBoolean (item_section, opt_name, &no_video, no_video))
+        {
+            ConstMemory const opt_name = "async_delivery";
+            if (!configSectionGetBoolean (item_section, opt_name, &stream_opts->async_delivery, stream_opts->async_delivery))
+                return Result::Failure;
+            logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", stream_opts->async_delivery);
+        }
+
+        {
+            ConstMemory const opt_name = "frame_ring_size";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                Uint64 tmp_uint64;
+                if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
+                    logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", no_video);
+                }
+                stream_opts->frame_ring_size = (Count) tmp_uint64;
             }
+        }
 
-            bool force_transcode = default_channel_opts->default_item->force_transcode;
-            {
-                ConstMemory const opt_name = "force_transcode";
-                if (!configSectionGetBoolean (item_section, opt_name, &force_transcode, force_transcode))
+        {
+            ConstMemory const opt_name = "frame_ring_drop_watermark";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                Uint64 tmp_uint64;
+                if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
+                    logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode);
+                }
+                stream_opts->frame_ring_drop_watermark = (Count) tmp_uint64;
             }
+        }
 
-            bool force_transcode_audio = default_channel_opts->default_item->force_transcode_audio;
-            {
-                ConstMemory const opt_name = "force_transcode_audio";
-                if (!configSectionGetBoolean (item_section, opt_name, &force_transcode_audio, force_transcode_audio))
+        {
+            ConstMemory const opt_name = "qos";
+            if (!configSectionGetBoolean (item_section, opt_name, &stream_opts->qos.enable, stream_opts->qos.enable))
+                return Result::Failure;
+            logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", stream_opts->qos.enable);
+        }
+
+        {
+            ConstMemory const opt_name = "low_latency";
+            if (!configSectionGetBoolean (item_section, opt_name, &stream_opts->low_latency, stream_opts->low_latency))
+                return Result::Failure;
+            logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", stream_opts->low_latency);
+        }
+
+        {
+            ConstMemory const opt_name = "source_latency";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                Uint64 tmp_uint64;
+                if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
+                    logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode_audio);
+                }
+                stream_opts->source_latency_millisec = (Uint32) tmp_uint64;
             }
+        }
 
-            bool force_transcode_video = default_channel_opts->default_item->force_transcode_video;
-            {
-                ConstMemory const opt_name = "force_transcode_video";
-                if (!configSectionGetBoolean (item_section, opt_name, &force_transcode_video, force_transcode_video))
+        {
+            ConstMemory const opt_name = "measure_latency";
+            if (!configSectionGetBoolean (item_section, opt_name, &stream_opts->measure_latency, stream_opts->measure_latency))
+                return Result::Failure;
+            logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", stream_opts->measure_latency);
+        }
+
+        {
+            ConstMemory const opt_name = "no_video_threshold";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                Uint64 tmp_uint64;
+                if (!opt->getValue()->getAsUint64 (&tmp_uint64)) {
+                    logE_ (_func, "Bad value for \"", opt_name, "\" option: ", opt->getValue()->mem());
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", force_transcode_video);
+                }
+                stream_opts->no_video_threshold = (Time) tmp_uint64;
             }
+        }
 
-            bool aac_perfect_timestamp = default_channel_opts->default_item->aac_perfect_timestamp;
-            {
-                ConstMemory const opt_name = "aac_perfect_timestamp";
-                if (!configSectionGetBoolean (item_section, opt_name, &aac_perfect_timestamp, aac_perfect_timestamp))
+        {
+            ConstMemory const opt_name = "transcoding_profile";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                TranscodeProfile * const profile = lookupTranscodeProfile (opt->getValue()->mem());
+                if (!profile) {
+                    logE_ (_func, "Unknown transcoding profile for stream ", stream_name->mem(), ": ",
+                           opt->getValue()->mem());
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", aac_perfect_timestamp);
+                }
+                stream_opts->transcode_profile = profile;
             }
+        }
 
-            bool sync_to_clock = default_channel_opts->default_item->sync_to_clock;
-            {
-                ConstMemory const opt_name = "sync_to_clock";
-                if (!configSectionGetBoolean (item_section, opt_name, &sync_to_clock, sync_to_clock))
+        {
+            ConstMemory const opt_name = "renditions";
+            MConfig::Option * const opt = item_section->getOption (opt_name);
+            if (opt && opt->getValue()) {
+                // Renditions share the main stream's keyframe interval.
+                if (!parseRenditions (stream_name->mem(),
+                                      opt->getValue()->mem(),
+                                      stream_opts->transcode_profile->keyframe_interval,
+                                      &stream_opts->renditions))
+                {
                     return Result::Failure;
-                logI_ (_func, "stream ", stream_name->mem(), ": ", opt_name, ": ", sync_to_clock);
+                }
             }
+        }
+    }
 
-            Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
-            {
-                *opts = *default_channel_opts;
-                opts->channel_name  = st_grab (new (std::nothrow) String (stream_name->mem()));
-                opts->channel_title = st_grab (new (std::nothrow) String (channel_title->mem()));
-                opts->channel_desc  = st_grab (new (std::nothrow) String (channel_desc->mem()));
+    // Stream options are set when the channel is created. On config reload,
+    // that is after the channel's previous incarnation has been released.
+    Ref<ChannelOptions> const opts = grab (new (std::nothrow) ChannelOptions);
+    {
+        *opts = *default_channel_opts;
+        opts->channel_name  = st_grab (new (std::nothrow) String (stream_name->mem()));
+        opts->channel_title = st_grab (new (std::nothrow) String (channel_title->mem()));
+        opts->channel_desc  = st_grab (new (std::nothrow) String (channel_desc->mem()));
 
-                opts->recording = (record_path ? true : false);
-                opts->record_path = st_grab (new (std::nothrow) String (record_path ? record_path->mem() : ConstMemory()));
+        opts->recording = (record_path ? true : false);
+        opts->record_path = st_grab (new (std::nothrow) String (record_path ? record_path->mem() : ConstMemory()));
 
-                opts->connect_on_demand = connect_on_demand;
-                opts->connect_on_demand_timeout = connect_on_demand_timeout;
-            }
+        opts->connect_on_demand = connect_on_demand;
+        opts->connect_on_demand_timeout = connect_on_demand_timeout;
+    }
 
-            Ref<PlaybackItem> const item = grab (new (std::nothrow) PlaybackItem);
-            opts->default_item = item;
-            {
-                *item = *default_channel_opts->default_item;
+    Ref<PlaybackItem> const item = grab (new (std::nothrow) PlaybackItem);
+    opts->default_item = item;
+    {
+        *item = *default_channel_opts->default_item;
 
-                item->no_audio = no_audio;
-                item->no_video = no_video;
-                item->force_transcode = force_transcode;
-                item->force_transcode_audio = force_transcode_audio;
-                item->force_transcode_video = force_transcode_video;
-                item->aac_perfect_timestamp = aac_perfect_timestamp;
-                item->sync_to_clock = sync_to_clock;
-            }
+        item->no_audio = no_audio;
+        item->no_video = no_video;
+        item->force_transcode = force_transcode;
+        item->force_transcode_audio = force_transcode_audio;
+        item->force_transcode_video = force_transcode_video;
+        item->aac_perfect_timestamp = aac_perfect_timestamp;
+        item->sync_to_clock = sync_to_clock;
+    }
 
-            if (!Moment::parseOverlayConfig (item_section, opts))
-                return Result::Failure;
+    if (!Moment::parseOverlayConfig (item_section, opts))
+        return Result::Failure;
 
-	    if (chain && !chain->isNull()) {
-                logD_ (_func, "chain, channel \"", opts->channel_name, "\"");
+    if (chain && !chain->isNull()) {
+        logD_ (_func, "chain, channel \"", opts->channel_name, "\"");
 
-                item->stream_spec = st_grab (new (std::nothrow) String (chain->mem()));
-                item->spec_kind = PlaybackItem::SpecKind::Chain;
+        item->stream_spec = st_grab (new (std::nothrow) String (chain->mem()));
+        item->spec_kind = PlaybackItem::SpecKind::Chain;
 
-		createStreamChannel (opts, item, push_agent, fetch_agent);
-	    } else
-	    if (uri && !uri->isNull()) {
-                logD_ (_func, "uri, channel \"", opts->channel_name, "\"");
+        // Invalid chains are reported here rather than on first connect.
+        chain_cache->getTemplate (item->stream_spec->mem(), true /* validate */);
 
-                item->stream_spec = st_grab (new (std::nothrow) String (uri->mem()));
-                item->spec_kind = PlaybackItem::SpecKind::Uri;
+	createStreamChannel (opts, item, config_sig->mem(), push_agent, fetch_agent, stream_opts);
+    } else
+    if (uri && !uri->isNull()) {
+        logD_ (_func, "uri, channel \"", opts->channel_name, "\"");
 
-		createStreamChannel (opts, item, push_agent, fetch_agent);
-	    } else
-	    if (playlist && !playlist->isNull()) {
-                logD_ (_func, "playlist, channel \"", opts->channel_name, "\"");
-
-		createPlaylistChannel (playlist->mem(),
-                                       false /* is_dir */,
-                                       false /* dir_re_read */,
-                                       opts,
-                                       push_agent,
-                                       fetch_agent);
-            } else
-            if (playlist_dir && !playlist_dir->isNull()) {
-                logD_ (_func, "playlist dir, channel \"", opts->channel_name, "\"");
-
-                createPlaylistChannel (playlist_dir->mem(),
-                                       true /* is_dir */,
-                                       playlist_dir_re_read,
-                                       opts,
-                                       push_agent,
-                                       fetch_agent);
-	    } else {
-		logW_ (_func, "None of chain/uri/playlist specified for stream \"", stream_name, "\"");
-		createDummyChannel (stream_name->mem(),
-                                    channel_title->mem(),
-                                    channel_desc->mem(),
-                                    push_agent,
-                                    fetch_agent);
-	    }
+        item->stream_spec = st_grab (new (std::nothrow) String (uri->mem()));
+        item->spec_kind = PlaybackItem::SpecKind::Uri;
+
+	createStreamChannel (opts, item, config_sig->mem(), push_agent, fetch_agent, stream_opts);
+    } else
+    if (playlist && !playlist->isNull()) {
+        logD_ (_func, "playlist, channel \"", opts->channel_name, "\"");
+
+	createPlaylistChannel (playlist->mem(),
+                               false /* is_dir */,
+                               false /* dir_re_read */,
+                               opts,
+                               config_sig->mem(),
+                               push_agent,
+                               fetch_agent,
+                               stream_opts);
+    } else
+    if (playlist_dir && !playlist_dir->isNull()) {
+        logD_ (_func, "playlist dir, channel \"", opts->channel_name, "\"");
+
+        createPlaylistChannel (playlist_dir->mem(),
+                               true /* is_dir */,
+                               playlist_dir_re_read,
+                               opts,
+                               config_sig->mem(),
+                               push_agent,
+                               fetch_agent,
+                               stream_opts);
+    } else {
+	logW_ (_func, "None of chain/uri/playlist specified for stream \"", stream_name, "\"");
+	createDummyChannel (stream_name->mem(),
+                            channel_title->mem(),
+                            channel_desc->mem(),
+                            config_sig->mem(),
+                            push_agent,
+                            fetch_agent,
+                            stream_opts);
+    }
+
+    return Result::Success;
+}
+
+Result
+MomentGstModule::parseStreamsConfigSection (MConfig::Config * const mt_nonnull config,
+                                            bool              const reload)
+{
+    logD_ (_func_);
+
+    MConfig::Section * const streams_section = config->getSection ("mod_gst/streams");
+    if (!streams_section)
+	return Result::Success;
+
+    MConfig::Section::iter streams_iter (*streams_section);
+    while (!streams_section->iter_done (streams_iter)) {
+	MConfig::SectionEntry * const item_entry = streams_section->iter_next (streams_iter);
+	if (item_entry->getType() == MConfig::SectionEntry::Type_Section) {
+	    MConfig::Section* const item_section = static_cast <MConfig::Section*> (item_entry);
+
+	    logD_ (_func, "section");
 
+            if (!parseStreamSection (item_section, reload))
+                return Result::Failure;
 	}
     }
 
@@ -1865,28 +3065,1073 @@ MomentGstModule::parseRecordingsConfigSection ()
     }
 }
 
-Ref<MediaSource>
-MomentGstModule::createMediaSource (CbDesc<MediaSource::Frontend> const &frontend,
-                                    Timers            * const timers,
-                                    DeferredProcessor * const deferred_processor,
-                                    PagePool          * const page_pool,
-                                    VideoStream       * const video_stream,
-                                    VideoStream       * const mix_video_stream,
-                                    Time                const initial_seek,
-                                    ChannelOptions    * const channel_opts,
-                                    PlaybackItem      * const playback_item)
-{
-    Ref<GstStream> const gst_stream = grab (new (std::nothrow) GstStream);
-    gst_stream->init (frontend,
-                      timers,
-                      deferred_processor,
-                      page_pool,
-                      video_stream,
-                      mix_video_stream,
-                      initial_seek,
-                      channel_opts,
-                      playback_item);
-    return gst_stream;
+// Streams with equal keys decode to the same frames.
+Ref<String>
+MomentGstModule::makeSourceKey (ChannelOptions * const mt_nonnull channel_opts,
+                                PlaybackItem   * const mt_nonnull playback_item)
+{
+    Ref<GstStreamOptions> const stream_opts = getStreamOptions (channel_opts->channel_name->mem());
+
+    // Renditions are published under the channel's name.
+    if (stream_opts->renditions)
+        return NULL;
+
+    StRef<String> const uri = SourceRegistry::normalizeUri (playback_item->stream_spec->mem());
+    return makeString (uri->mem(), " ",
+                       (playback_item->no_audio              ? "1" : "0"),
+                       (playback_item->no_video              ? "1" : "0"),
+                       (playback_item->force_transcode       ? "1" : "0"),
+                       (playback_item->force_transcode_audio ? "1" : "0"),
+                       (playback_item->force_transcode_video ? "1" : "0"),
+                       (playback_item->aac_perfect_timestamp ? "1" : "0"),
+                       (playback_item->sync_to_clock         ? "1" : "0"),
+                       (playback_item->enable_prechunking    ? "1" : "0"),
+                       (playback_item->send_metadata         ? "1" : "0"),
+                       (stream_opts->low_latency             ? "1" : "0"),
+                       (stream_opts->async_delivery          ? "1" : "0"),
+                       (stream_opts->measure_latency         ? "1" : "0"),
+                       (stream_opts->qos.enable              ? "1" : "0"),
+                       " ", stream_opts->qos.lag_threshold_millisec,
+                       " ", stream_opts->qos.recover_threshold_millisec,
+                       " ", stream_opts->qos.recover_ticks,
+                       " ", stream_opts->frame_ring_size,
+                       " ", stream_opts->frame_ring_drop_watermark,
+                       " ", stream_opts->source_latency_millisec,
+                       " ", stream_opts->no_video_threshold,
+                       " ", channel_opts->no_video_timeout,
+                       " ", playback_item->default_width,
+                       "x", playback_item->default_height,
+                       " ", playback_item->default_bitrate,
+                       " ", stream_opts->transcode_profile->name->mem());
+}
+
+Ref<String>
+MomentGstModule::getSharedSourceKey (ChannelOptions * const mt_nonnull channel_opts,
+                                     PlaybackItem   * const mt_nonnull playback_item,
+                                     Time             const initial_seek)
+{
+    // Only live URI sources are shared: seeking is per channel.
+    if (!source_registry
+        || initial_seek != 0
+        || playback_item->spec_kind != PlaybackItem::SpecKind::Uri)
+    {
+        return NULL;
+    }
+
+    return makeSourceKey (channel_opts, playback_item);
+}
+
+SourceRegistry::Frontend const MomentGstModule::source_registry_frontend = {
+    createSourceStream
+};
+
+Ref<GstStream>
+MomentGstModule::createSourceStream (ConstMemory         const source_key,
+                                     CbDesc<MediaSource::Frontend> const &frontend,
+                                     Timers            * const timers,
+                                     DeferredProcessor * const deferred_processor,
+                                     PagePool          * const page_pool,
+                                     VideoStream       * const video_stream,
+                                     ChannelOptions    * const channel_opts,
+                                     PlaybackItem      * const playback_item,
+                                     void              * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    // Options which make up the source key are the same for every
+    // subscriber, so it doesn't matter whose stream section is used.
+    Ref<GstStreamOptions> const stream_opts = self->getStreamOptions (channel_opts->channel_name->mem());
+
+    // The stream outlives the channel which it was created for. Backoff,
+    // stream stats and "no video" reports go under the name of the source.
+    Ref<ChannelOptions> const source_opts = grab (new (std::nothrow) ChannelOptions);
+    *source_opts = *channel_opts;
+    source_opts->channel_name = st_makeString ("source:", source_key);
+
+    return self->newGstStream (frontend,
+                               timers,
+                               deferred_processor,
+                               page_pool,
+                               video_stream,
+                               NULL /* mix_video_stream */,
+                               0    /* initial_seek */,
+                               source_opts,
+                               playback_item,
+                               stream_opts);
+}
+
+GstStream::WarmFrontend const MomentGstModule::warm_frontend = {
+    warmReady
+};
+
+void
+MomentGstModule::warmReady (GstStream * const stream,
+                            bool        const ok,
+                            void      * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    Ref<GstStream> failed_stream;
+    bool restart = false;
+
+    self->streams_mutex.lock ();
+    {
+        List<WarmStreamEntry*>::Element *el = self->warm_list.getFirstElement();
+        while (el) {
+            WarmStreamEntry * const entry = el->data;
+            if (entry->gst_stream == stream) {
+                restart = entry->restart_on_ready;
+                entry->restart_on_ready = false;
+
+                if (ok) {
+                    entry->ready = true;
+                } else {
+                    failed_stream = entry->gst_stream;
+                    self->warm_list.remove (el);
+                    delete entry;
+                }
+
+                break;
+            }
+
+            el = el->next;
+        }
+    }
+    self->streams_mutex.unlock ();
+
+    logD_ (_func, "channel \"", stream->getChannelName(), "\", ok: ", ok);
+
+    if (failed_stream)
+        failed_stream->releasePipeline ();
+
+    // On failure, restarting the usual way.
+    if (restart)
+        self->restartChannel (stream->getChannelName());
+}
+
+void
+MomentGstModule::warmTimerTick (void * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    Time const cur_time = getCoarseTime ();
+
+    List< Ref<GstStream> > expired_list;
+    List< Ref<String> > restart_list;
+
+    self->streams_mutex.lock ();
+    {
+        List<WarmStreamEntry*>::Element *el = self->warm_list.getFirstElement();
+        while (el) {
+            List<WarmStreamEntry*>::Element * const next_el = el->next;
+
+            WarmStreamEntry * const entry = el->data;
+            if (cur_time >= entry->prepare_time + self->warm_pipeline_timeout) {
+                expired_list.append (entry->gst_stream);
+                if (entry->restart_on_ready)
+                    restart_list.append (grab (new (std::nothrow) String (entry->gst_stream->getChannelName())));
+
+                self->warm_list.remove (el);
+                delete entry;
+            }
+
+            el = next_el;
+        }
+    }
+    self->streams_mutex.unlock ();
+
+    while (!expired_list.isEmpty()) {
+        logD_ (_func, "releasing unused warm pipeline, channel \"", expired_list.getFirst()->getChannelName(), "\"");
+        expired_list.getFirst()->releasePipeline ();
+        expired_list.remove (expired_list.getFirstElement());
+    }
+
+    while (!restart_list.isEmpty()) {
+        self->restartChannel (restart_list.getFirst()->mem());
+        restart_list.remove (restart_list.getFirstElement());
+    }
+}
+
+bool
+MomentGstModule::prepareWarmStream (ChannelOptions * const mt_nonnull channel_opts,
+                                    PlaybackItem   * const mt_nonnull playback_item,
+                                    bool             const restart_on_ready)
+{
+    if (warm_pipelines == 0 || playback_item->spec_kind == PlaybackItem::SpecKind::None)
+        return false;
+
+    // The shared pipeline would be used anyway.
+    if (getSharedSourceKey (channel_opts, playback_item, 0 /* initial_seek */))
+        return false;
+
+    ConstMemory const channel_name = channel_opts->channel_name->mem();
+
+    streams_mutex.lock ();
+    {
+        Count num_warm = 0;
+        List<WarmStreamEntry*>::Element *el = warm_list.getFirstElement();
+        while (el) {
+            WarmStreamEntry * const entry = el->data;
+            if (equal (entry->gst_stream->getChannelName(), channel_name)) {
+                if (restart_on_ready && entry->restart_on_ready) {
+                  // A restart is in progress already.
+                    streams_mutex.unlock ();
+                    return true;
+                }
+
+                ++num_warm;
+            }
+
+            el = el->next;
+        }
+
+        if (num_warm >= warm_pipelines) {
+            streams_mutex.unlock ();
+            logD_ (_func, "channel \"", channel_name, "\": too many warm pipelines");
+            return false;
+        }
+    }
+    streams_mutex.unlock ();
+
+    ServerThreadContext * const thread_ctx = moment->getServerApp()->getServerContext()->getMainThreadContext();
+
+    Ref<GstStream> const gst_stream = newGstStream (CbDesc<MediaSource::Frontend> (),
+                                                    timers,
+                                                    thread_ctx->getDeferredProcessor(),
+                                                    page_pool,
+                                                    NULL /* video_stream */,
+                                                    NULL /* mix_video_stream */,
+                                                    0    /* initial_seek */,
+                                                    channel_opts,
+                                                    playback_item,
+                                                    getStreamOptions (channel_name));
+
+    WarmStreamEntry * const entry = new (std::nothrow) WarmStreamEntry;
+    assert (entry);
+    entry->gst_stream = gst_stream;
+    entry->prepare_time = getCoarseTime ();
+    entry->ready = false;
+    entry->restart_on_ready = restart_on_ready;
+
+    streams_mutex.lock ();
+    warm_list.append (entry);
+    streams_mutex.unlock ();
+
+    logD_ (_func, "preparing a pipeline for channel \"", channel_name, "\"");
+
+    gst_stream->prepare (CbDesc<GstStream::WarmFrontend> (&warm_frontend, this, this));
+
+    return true;
+}
+
+Ref<GstStream>
+MomentGstModule::takeWarmStream (ChannelOptions * const mt_nonnull channel_opts,
+                                 PlaybackItem   * const mt_nonnull playback_item,
+                                 Time             const initial_seek)
+{
+    ConstMemory const channel_name = channel_opts->channel_name->mem();
+
+    Ref<GstStream> gst_stream;
+
+    streams_mutex.lock ();
+    {
+        List<WarmStreamEntry*>::Element *el = warm_list.getFirstElement();
+        while (el) {
+            WarmStreamEntry * const entry = el->data;
+            PlaybackItem * const warm_item = entry->gst_stream->getPlaybackItem();
+
+          // A stream which has not prerolled yet would be handed out with
+          // its pipeline still going to PAUSED. It stays in 'warm_list'.
+            if (entry->ready
+                && equal (entry->gst_stream->getChannelName(), channel_name)
+                && entry->gst_stream->getInitialSeek() == initial_seek
+                && warm_item->spec_kind == playback_item->spec_kind
+                && equal (warm_item->stream_spec->mem(), playback_item->stream_spec->mem()))
+            {
+                gst_stream = entry->gst_stream;
+                warm_list.remove (el);
+                delete entry;
+                break;
+            }
+
+            el = el->next;
+        }
+    }
+    streams_mutex.unlock ();
+
+    return gst_stream;
+}
+
+void
+MomentGstModule::restartChannel (ConstMemory const channel_name)
+{
+    mutex.lock ();
+    ChannelEntry * const channel_entry = channel_entry_hash.lookup (channel_name);
+    if (channel_entry)
+        channel_entry->channel->restartStream ();
+    mutex.unlock ();
+}
+
+mt_mutex (mutex) void
+MomentGstModule::reconnectChannel (ChannelEntry * const mt_nonnull channel_entry)
+{
+    // Stream channels only: the next item of a playlist is not known here.
+    if (!channel_entry->playlist_filename
+        && channel_entry->channel_opts
+        && channel_entry->channel_opts->default_item
+        && prepareWarmStream (channel_entry->channel_opts,
+                              channel_entry->channel_opts->default_item,
+                              true /* restart_on_ready */))
+    {
+      // The current stream keeps playing until the new pipeline prerolls.
+        return;
+    }
+
+    channel_entry->channel->restartStream ();
+}
+
+void
+MomentGstModule::releaseWarmStreams ()
+{
+    List< Ref<GstStream> > tmp_list;
+
+    streams_mutex.lock ();
+    if (warm_timer) {
+        timers->deleteTimer (warm_timer);
+        warm_timer = NULL;
+    }
+
+    while (!warm_list.isEmpty()) {
+        WarmStreamEntry * const entry = warm_list.getFirst();
+        tmp_list.append (entry->gst_stream);
+        warm_list.remove (warm_list.getFirstElement());
+        delete entry;
+    }
+    streams_mutex.unlock ();
+
+    while (!tmp_list.isEmpty()) {
+        tmp_list.getFirst()->releasePipeline ();
+        tmp_list.remove (tmp_list.getFirstElement());
+    }
+}
+
+void
+MomentGstModule::dropWarmStreams (ConstMemory const channel_name)
+{
+    List< Ref<GstStream> > tmp_list;
+
+    streams_mutex.lock ();
+    {
+        List<WarmStreamEntry*>::Element *el = warm_list.getFirstElement();
+        while (el) {
+            List<WarmStreamEntry*>::Element * const next_el = el->next;
+
+            WarmStreamEntry * const entry = el->data;
+            if (equal (entry->gst_stream->getChannelName(), channel_name)) {
+                tmp_list.append (entry->gst_stream);
+                warm_list.remove (el);
+                delete entry;
+            }
+
+            el = next_el;
+        }
+    }
+    streams_mutex.unlock ();
+
+    while (!tmp_list.isEmpty()) {
+        tmp_list.getFirst()->releasePipeline ();
+        tmp_list.remove (tmp_list.getFirstElement());
+    }
+}
+
+Ref<MediaSource>
+MomentGstModule::createMediaSource (CbDesc<MediaSource::Frontend> const &frontend,
+                                    Timers            * const timers,
+                                    DeferredProcessor * const deferred_processor,
+                                    PagePool          * const page_pool,
+                                    VideoStream       * const video_stream,
+                                    VideoStream       * const mix_video_stream,
+                                    Time                const initial_seek,
+                                    ChannelOptions    * const channel_opts,
+                                    PlaybackItem      * const playback_item)
+{
+    // Shared sources come first: a channel which shares its source never
+    // gets a private pipeline, warm or not.
+    if (!mix_video_stream) {
+        Ref<String> const source_key = getSharedSourceKey (channel_opts, playback_item, initial_seek);
+        if (source_key) {
+            return source_registry->createSubscriber (frontend,
+                                                      source_key->mem(),
+                                                      timers,
+                                                      deferred_processor,
+                                                      page_pool,
+                                                      video_stream,
+                                                      channel_opts,
+                                                      playback_item);
+        }
+
+        Ref<GstStream> const gst_stream = takeWarmStream (channel_opts, playback_item, initial_seek);
+        if (gst_stream) {
+            logD_ (_func, "using a warm pipeline for channel \"", channel_opts->channel_name, "\"");
+            gst_stream->adopt (frontend, video_stream);
+            return gst_stream;
+        }
+    }
+
+    return newGstStream (frontend,
+                         timers,
+                         deferred_processor,
+                         page_pool,
+                         video_stream,
+                         mix_video_stream,
+                         initial_seek,
+                         channel_opts,
+                         playback_item,
+                         getStreamOptions (channel_opts->channel_name->mem()));
+}
+
+Ref<GstStreamOptions>
+MomentGstModule::getStreamOptions (ConstMemory const channel_name)
+{
+    Ref<GstStreamOptions> stream_opts = default_stream_opts;
+    streams_mutex.lock ();
+    if (StreamOptionsEntry * const entry = stream_opts_hash.lookup (channel_name))
+        stream_opts = entry->stream_opts;
+    streams_mutex.unlock ();
+
+    return stream_opts;
+}
+
+Ref<GstStream>
+MomentGstModule::newGstStream (CbDesc<MediaSource::Frontend> const &frontend,
+                               Timers            * const timers,
+                               DeferredProcessor * const deferred_processor,
+                               PagePool          * const page_pool,
+                               VideoStream       * const video_stream,
+                               VideoStream       * const mix_video_stream,
+                               Time                const initial_seek,
+                               ChannelOptions    * const channel_opts,
+                               PlaybackItem      * const playback_item,
+                               GstStreamOptions  * const mt_nonnull stream_opts)
+{
+    Ref<GstStream> const gst_stream = grab (new (std::nothrow) GstStream);
+    gst_stream->init (frontend,
+                      timers,
+                      deferred_processor,
+                      page_pool,
+                      video_stream,
+                      mix_video_stream,
+                      initial_seek,
+                      channel_opts,
+                      playback_item,
+                      stream_opts,
+                      delivery_pool,
+                      pipeline_pool,
+                      chain_cache,
+                      reconnect_scheduler,
+                      reaper,
+                      encoder_scheduler,
+                      timeout_wheel,
+                      qos_ticker);
+
+    streams_mutex.lock ();
+    {
+      // Dropping entries for streams which have already been destroyed.
+        List< WeakRef<GstStream> >::Element *el = stream_list.getFirstElement();
+        while (el) {
+            List< WeakRef<GstStream> >::Element * const next_el = el->next;
+            if (!el->data.getRef ())
+                stream_list.remove (el);
+
+            el = next_el;
+        }
+    }
+    stream_list.append (WeakRef<GstStream> (gst_stream));
+    streams_mutex.unlock ();
+
+    return gst_stream;
+}
+
+mt_mutex (mutex) void
+MomentGstModule::unlinkChannelEntry (ChannelEntry         * const mt_nonnull channel_entry,
+                                     List<RecorderEntry*> * const mt_nonnull ret_recorder_list)
+{
+    channel_entry_hash.remove (channel_entry);
+    channel_set.removeChannel (channel_entry->channel_set_key);
+
+    RecorderEntry * const recorder_entry = recorder_entry_hash.lookup (channel_entry->channel_name->mem());
+    if (recorder_entry && !recorder_entry->playlist_filename) {
+        recorder_entry_hash.remove (recorder_entry);
+        ret_recorder_list->append (recorder_entry);
+    }
+}
+
+void
+MomentGstModule::destroyChannelEntry (ChannelEntry * const mt_nonnull channel_entry,
+                                      bool           const drop_backoff)
+{
+    Ref<String> const channel_name_str = channel_entry->channel_name;
+    ConstMemory const channel_name = channel_name_str->mem();
+
+    {
+        streams_mutex.lock ();
+        Ref<RenditionSet> renditions;
+        if (StreamOptionsEntry * const entry = stream_opts_hash.lookup (channel_name)) {
+            renditions = entry->stream_opts->renditions;
+            stream_opts_hash.remove (entry);
+            delete entry;
+        }
+        streams_mutex.unlock ();
+
+        if (renditions)
+            renditions->release ();
+    }
+
+    dropWarmStreams (channel_name);
+
+    // Releases the channel along with its stream.
+    delete channel_entry;
+
+    if (drop_backoff)
+        reconnect_scheduler->removeChannel (channel_name);
+}
+
+void
+MomentGstModule::jobBatchThreadFunc (void * const _batch)
+{
+    JobBatch * const batch = static_cast <JobBatch*> (_batch);
+
+    updateTime ();
+
+    for (;;) {
+        batch->mutex.lock ();
+        if (batch->job_list->isEmpty()) {
+            batch->mutex.unlock ();
+            break;
+        }
+
+        BringupJob * const job = batch->job_list->getFirst();
+        batch->job_list->remove (batch->job_list->getFirstElement());
+        batch->mutex.unlock ();
+
+        batch->module->runBringupJob (job);
+        delete job;
+    }
+}
+
+void
+MomentGstModule::runBringupJobs (List<BringupJob*> * const mt_nonnull job_list)
+{
+    Count num_jobs = 0;
+    {
+        List<BringupJob*>::Element *el = job_list->getFirstElement();
+        while (el) {
+            ++num_jobs;
+            el = el->next;
+        }
+    }
+
+    JobBatch batch;
+    batch.module = this;
+    batch.job_list = job_list;
+
+    // The calling thread takes jobs as well.
+    Count const num_threads = (bringup_threads < num_jobs ? bringup_threads : num_jobs);
+
+    List< Ref<Thread> > thread_list;
+    for (Count i = 1; i < num_threads; ++i) {
+        Ref<Thread> const thread = grab (new (std::nothrow) Thread (
+                CbDesc<Thread::ThreadFunc> (jobBatchThreadFunc, &batch, this)));
+        if (!thread->spawn (true /* joinable */)) {
+            logE_ (_func, "Failed to spawn channel bring-up thread: ", exc->toString());
+            break;
+        }
+
+        thread_list.append (thread);
+    }
+
+    jobBatchThreadFunc (&batch);
+
+    while (!thread_list.isEmpty()) {
+        thread_list.getFirst()->join ();
+        thread_list.remove (thread_list.getFirstElement());
+    }
+}
+
+void
+MomentGstModule::configReload (MConfig::Config * const mt_nonnull new_config)
+{
+    if (!moment) {
+      // The module is disabled.
+        return;
+    }
+
+    logI_ (_func, "reloading mod_gst channels");
+
+    reload_mutex.lock ();
+
+    // Channels of admin requests which are still being added or removed
+    // would be missed when comparing against the new config.
+    waitAdminJobs ();
+
+    List<BringupJob*> job_list;
+
+    bringup_mutex.lock ();
+    if (!bringup_complete) {
+        bringup_mutex.unlock ();
+        reload_mutex.unlock ();
+        logW_ (_func, "channel bring-up is in progress, config reload skipped");
+        return;
+    }
+    collect_job_list = &job_list;
+    bringup_mutex.unlock ();
+
+    // Transcoding profiles are parsed anew, so that streams which use
+    // a changed profile are recreated. The old ones are put back if the
+    // config turns out to be invalid.
+    TranscodeProfileEntryHash * const old_profile_hash = transcode_profile_hash;
+
+    // Templates of chains which are gone from the config are dropped. Chains
+    // in the new config are compiled again while it is being parsed.
+    chain_cache->clear ();
+
+    transcode_profile_hash = new (std::nothrow) TranscodeProfileEntryHash;
+    assert (transcode_profile_hash);
+
+    // New and changed channels end up in 'job_list'. Unchanged channels
+    // are marked with 'reload_seen'. Nothing is applied while parsing.
+    bool parse_ok = parseTranscodingProfilesConfigSection (new_config, transcode_profile_hash);
+    if (parse_ok) {
+        parseSourcesConfigSection (new_config, true /* reload */);
+        parseChainsConfigSection (new_config, true /* reload */);
+        parse_ok = parseStreamsConfigSection (new_config, true /* reload */);
+    }
+
+    bringup_mutex.lock ();
+    collect_job_list = NULL;
+    bringup_mutex.unlock ();
+
+    if (!parse_ok) {
+        releaseTranscodeProfiles (transcode_profile_hash);
+        transcode_profile_hash = old_profile_hash;
+
+        mutex.lock ();
+        {
+            ChannelEntryHash::iter iter (channel_entry_hash);
+            while (!channel_entry_hash.iter_done (iter))
+                channel_entry_hash.iter_next (iter)->reload_seen = false;
+        }
+        mutex.unlock ();
+
+        while (!job_list.isEmpty()) {
+            delete job_list.getFirst();
+            job_list.remove (job_list.getFirstElement());
+        }
+
+        reload_mutex.unlock ();
+        logE_ (_func, "invalid mod_gst config, channels are left intact");
+        return;
+    }
+
+    // Streams hold references to the profiles which they use.
+    releaseTranscodeProfiles (old_profile_hash);
+
+    // Removed and changed channels. Changed channels are created anew.
+    List<ChannelEntry*>  removed_list;
+    List<RecorderEntry*> removed_recorder_list;
+    Count num_unchanged = 0;
+    Count num_removed = 0;
+
+    mutex.lock ();
+    {
+        List<ChannelEntry*> unseen_list;
+        {
+            ChannelEntryHash::iter iter (channel_entry_hash);
+            while (!channel_entry_hash.iter_done (iter)) {
+                ChannelEntry * const channel_entry = channel_entry_hash.iter_next (iter);
+                if (channel_entry->reload_seen)
+                    ++num_unchanged;
+                else
+                    unseen_list.append (channel_entry);
+
+                channel_entry->reload_seen = false;
+            }
+        }
+
+        while (!unseen_list.isEmpty()) {
+            ChannelEntry * const channel_entry = unseen_list.getFirst();
+            unseen_list.remove (unseen_list.getFirstElement());
+
+            bool const changed = jobListHasChannel (&job_list, channel_entry->channel_name->mem());
+            if (!changed && channel_entry->dynamic)
+                continue;
+
+            if (!changed) {
+                logI_ (_func, "channel \"", channel_entry->channel_name, "\" removed");
+                ++num_removed;
+            }
+
+            unlinkChannelEntry (channel_entry, &removed_recorder_list);
+            removed_list.append (channel_entry);
+        }
+    }
+    mutex.unlock ();
+
+    while (!removed_list.isEmpty()) {
+        ChannelEntry * const channel_entry = removed_list.getFirst();
+        // Changed channels get their new stream options when they are created.
+        bool const changed = jobListHasChannel (&job_list, channel_entry->channel_name->mem());
+        destroyChannelEntry (channel_entry, !changed /* drop_backoff */);
+        removed_list.remove (removed_list.getFirstElement());
+    }
+
+    while (!removed_recorder_list.isEmpty()) {
+        delete removed_recorder_list.getFirst();
+        removed_recorder_list.remove (removed_recorder_list.getFirstElement());
+    }
+
+    Count num_changed_or_added = 0;
+    {
+        List<BringupJob*>::Element *el = job_list.getFirstElement();
+        while (el) {
+            logI_ (_func, "channel \"", el->data->channel_opts->channel_name, "\" (re)created");
+            ++num_changed_or_added;
+            el = el->next;
+        }
+    }
+
+    runBringupJobs (&job_list);
+
+    reload_mutex.unlock ();
+
+    logI_ (_func, "mod_gst config reloaded: ", num_changed_or_added, " channels added or changed, ",
+           num_removed, " removed, ", num_unchanged, " unchanged");
+}
+
+static bool nameListHas (List< Ref<String> > * const mt_nonnull name_list,
+                         ConstMemory           const name)
+{
+    List< Ref<String> >::Element *el = name_list->getFirstElement();
+    while (el) {
+        if (equal (el->data->mem(), name))
+            return true;
+
+        el = el->next;
+    }
+
+    return false;
+}
+
+MomentGstModule::AdminJob::~AdminJob ()
+{
+    while (!job_list.isEmpty()) {
+        delete job_list.getFirst();
+        job_list.remove (job_list.getFirstElement());
+    }
+}
+
+void
+MomentGstModule::adminThreadFunc (void * const _self)
+{
+    MomentGstModule * const self = static_cast <MomentGstModule*> (_self);
+
+    self->admin_mutex.lock ();
+    for (;;) {
+        while (self->admin_job_list.isEmpty() && !self->admin_stop)
+            self->admin_cond.wait (self->admin_mutex);
+
+        if (self->admin_stop)
+            break;
+
+        AdminJob * const admin_job = self->admin_job_list.getFirst();
+        self->admin_mutex.unlock ();
+
+        self->runAdminJob (admin_job);
+
+        self->admin_mutex.lock ();
+        self->admin_job_list.remove (self->admin_job_list.getFirstElement());
+        delete admin_job;
+
+        if (self->admin_job_list.isEmpty())
+            self->admin_done_cond.signal ();
+    }
+    self->admin_mutex.unlock ();
+}
+
+void
+MomentGstModule::startAdminThread ()
+{
+    Ref<Thread> const thread = grab (new (std::nothrow) Thread (
+            CbDesc<Thread::ThreadFunc> (adminThreadFunc, this, this)));
+    if (!thread->spawn (true /* joinable */)) {
+        logE_ (_func, "Failed to spawn admin thread: ", exc->toString());
+        return;
+    }
+
+    admin_mutex.lock ();
+    admin_thread = thread;
+    admin_mutex.unlock ();
+}
+
+void
+MomentGstModule::releaseAdminThread ()
+{
+    admin_mutex.lock ();
+    admin_stop = true;
+    admin_cond.signal ();
+    Ref<Thread> const thread = admin_thread;
+    admin_thread = NULL;
+    admin_mutex.unlock ();
+
+    if (thread)
+        thread->join ();
+
+    admin_mutex.lock ();
+    while (!admin_job_list.isEmpty()) {
+        delete admin_job_list.getFirst();
+        admin_job_list.remove (admin_job_list.getFirstElement());
+    }
+    admin_done_cond.signal ();
+    admin_mutex.unlock ();
+}
+
+mt_mutex (admin_mutex) bool
+MomentGstModule::queueAdminJob (AdminJob * const mt_nonnull admin_job)
+{
+    if (!admin_thread || admin_stop)
+        return false;
+
+    admin_job_list.append (admin_job);
+    admin_cond.signal ();
+    return true;
+}
+
+void
+MomentGstModule::runAdminJob (AdminJob * const mt_nonnull admin_job)
+{
+    List<ChannelEntry*>  removed_list;
+    List<RecorderEntry*> removed_recorder_list;
+
+    mutex.lock ();
+    {
+        List< Ref<String> >::Element *el = admin_job->remove_names.getFirstElement();
+        while (el) {
+            ChannelEntry * const channel_entry = channel_entry_hash.lookup (el->data->mem());
+            if (channel_entry) {
+                unlinkChannelEntry (channel_entry, &removed_recorder_list);
+                removed_list.append (channel_entry);
+            }
+
+            el = el->next;
+        }
+    }
+    mutex.unlock ();
+
+    while (!removed_list.isEmpty()) {
+        logI_ (_func, "channel \"", removed_list.getFirst()->channel_name, "\" removed");
+        destroyChannelEntry (removed_list.getFirst(), true /* drop_backoff */);
+        removed_list.remove (removed_list.getFirstElement());
+    }
+
+    while (!removed_recorder_list.isEmpty()) {
+        delete removed_recorder_list.getFirst();
+        removed_recorder_list.remove (removed_recorder_list.getFirstElement());
+    }
+
+    runBringupJobs (&admin_job->job_list);
+
+    mutex.lock ();
+    {
+        List< Ref<String> >::Element *el = admin_job->add_names.getFirstElement();
+        while (el) {
+            ChannelEntry * const channel_entry = channel_entry_hash.lookup (el->data->mem());
+            if (channel_entry)
+                channel_entry->dynamic = true;
+
+            logI_ (_func, "channel \"", el->data, "\" added");
+            el = el->next;
+        }
+    }
+    mutex.unlock ();
+}
+
+void
+MomentGstModule::waitAdminJobs ()
+{
+    admin_mutex.lock ();
+    while (!admin_job_list.isEmpty())
+        admin_done_cond.wait (admin_mutex);
+    admin_mutex.unlock ();
+}
+
+mt_mutex (admin_mutex) bool
+MomentGstModule::adminChannelWillExist (ConstMemory const channel_name)
+{
+    // The admin thread only drops a job from the list once it's done,
+    // hence channels of the job being run are either in the hash or in
+    // the job.
+    mutex.lock ();
+    bool exists = (channel_entry_hash.lookup (channel_name) != NULL);
+    mutex.unlock ();
+
+    List<AdminJob*>::Element *el = admin_job_list.getFirstElement();
+    while (el) {
+        AdminJob * const admin_job = el->data;
+        if (nameListHas (&admin_job->remove_names, channel_name))
+            exists = false;
+        if (nameListHas (&admin_job->add_names, channel_name))
+            exists = true;
+
+        el = el->next;
+    }
+
+    return exists;
+}
+
+Result
+MomentGstModule::addChannels (MConfig::Section * const mt_nonnull channels_section,
+                              Ref<String>      * const mt_nonnull ret_report)
+{
+    Ref<String> report = grab (new (std::nothrow) String);
+    Result res = Result::Success;
+
+    reload_mutex.lock ();
+
+    bringup_mutex.lock ();
+    if (!bringup_complete) {
+        bringup_mutex.unlock ();
+        reload_mutex.unlock ();
+        *ret_report = grab (new (std::nothrow) String ("Channel bring-up is in progress\n"));
+        return Result::Failure;
+    }
+
+    AdminJob * const admin_job = new (std::nothrow) AdminJob;
+    assert (admin_job);
+    collect_job_list = &admin_job->job_list;
+    bringup_mutex.unlock ();
+
+    MConfig::Section::iter iter (*channels_section);
+    while (!channels_section->iter_done (iter)) {
+        MConfig::SectionEntry * const section_entry = channels_section->iter_next (iter);
+        if (section_entry->getType() != MConfig::SectionEntry::Type_Section)
+            continue;
+
+        MConfig::Section * const section = static_cast <MConfig::Section*> (section_entry);
+
+        MConfig::Option * const name_opt = section->getOption ("name");
+        if (!name_opt || !name_opt->getValue() || name_opt->getValue()->mem().len() == 0) {
+            report = makeString (report->mem(), "(unnamed): no channel name\n");
+            res = Result::Failure;
+            continue;
+        }
+
+        ConstMemory const channel_name = name_opt->getValue()->mem();
+
+        admin_mutex.lock ();
+        bool const exists = adminChannelWillExist (channel_name);
+        admin_mutex.unlock ();
+
+        bringup_mutex.lock ();
+        bool const duplicate = jobListHasChannel (&admin_job->job_list, channel_name);
+        bringup_mutex.unlock ();
+
+        if (exists || duplicate) {
+            report = makeString (report->mem(), channel_name, ": channel already exists\n");
+            res = Result::Failure;
+            continue;
+        }
+
+        // Nothing is applied while parsing, invalid channels leave no trace.
+        if (!parseStreamSection (section, false /* reload */)) {
+            report = makeString (report->mem(), channel_name, ": invalid channel options\n");
+            res = Result::Failure;
+            continue;
+        }
+
+        report = makeString (report->mem(), channel_name, ": OK\n");
+    }
+
+    bringup_mutex.lock ();
+    collect_job_list = NULL;
+    bringup_mutex.unlock ();
+
+    {
+        List<BringupJob*>::Element *el = admin_job->job_list.getFirstElement();
+        while (el) {
+            admin_job->add_names.append (grab (new (std::nothrow) String (el->data->channel_opts->channel_name->mem())));
+            el = el->next;
+        }
+    }
+
+    bool queued = false;
+    if (!admin_job->job_list.isEmpty()) {
+      // Queued before 'reload_mutex' is unlocked, so that the next request
+      // sees the channels.
+        admin_mutex.lock ();
+        queued = queueAdminJob (admin_job);
+        admin_mutex.unlock ();
+
+        if (!queued)
+            runAdminJob (admin_job);
+    }
+
+    if (!queued)
+        delete admin_job;
+
+    reload_mutex.unlock ();
+
+    *ret_report = report;
+    return res;
+}
+
+Result
+MomentGstModule::removeChannels (List< Ref<String> > * const mt_nonnull channel_names,
+                                 Ref<String>         * const mt_nonnull ret_report)
+{
+    Ref<String> report = grab (new (std::nothrow) String);
+    Result res = Result::Success;
+
+    AdminJob * const admin_job = new (std::nothrow) AdminJob;
+    assert (admin_job);
+
+    reload_mutex.lock ();
+
+    admin_mutex.lock ();
+    {
+        List< Ref<String> >::Element *el = channel_names->getFirstElement();
+        while (el) {
+            ConstMemory const channel_name = el->data->mem();
+
+            if (!adminChannelWillExist (channel_name)
+                || nameListHas (&admin_job->remove_names, channel_name))
+            {
+                report = makeString (report->mem(), channel_name, ": channel not found\n");
+                res = Result::Failure;
+            } else {
+                admin_job->remove_names.append (el->data);
+                report = makeString (report->mem(), channel_name, ": OK\n");
+            }
+
+            el = el->next;
+        }
+    }
+
+    bool queued = false;
+    if (!admin_job->remove_names.isEmpty())
+        queued = queueAdminJob (admin_job);
+    admin_mutex.unlock ();
+
+    if (!queued) {
+        if (!admin_job->remove_names.isEmpty())
+            runAdminJob (admin_job);
+
+        delete admin_job;
+    }
+
+    reload_mutex.unlock ();
+
+    *ret_report = report;
+    return res;
 }
 
 // TODO Always succeeds currently.
@@ -2090,6 +4335,385 @@ MomentGstModule::init (MomentServer * const moment)
         playlist_json_protocol = val_lowercase;
     }
 
+    if (!parseTranscodingProfilesConfigSection (config, transcode_profile_hash))
+        return Result::Failure;
+
+    {
+        ConstMemory const opt_name = "mod_gst/transcoding_profile";
+        ConstMemory const opt_val = config->getString (opt_name);
+        if (opt_val.len()) {
+            TranscodeProfile * const profile = lookupTranscodeProfile (opt_val);
+            if (!profile) {
+                logE_ (_func, "Invalid value for ", opt_name, ": no such profile: ", opt_val);
+                return Result::Failure;
+            }
+            default_stream_opts->transcode_profile = profile;
+        }
+        logI_ (_func, opt_name, ": ", default_stream_opts->transcode_profile->name);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/async_delivery";
+        MConfig::BooleanValue const val = config->getBoolean (opt_name);
+        if (val == MConfig::Boolean_Invalid) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+
+        if (val == MConfig::Boolean_True)
+            default_stream_opts->async_delivery = true;
+        else
+            default_stream_opts->async_delivery = false;
+
+        logI_ (_func, opt_name, ": ", default_stream_opts->async_delivery);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/frame_ring_size";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->frame_ring_size);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->frame_ring_size = (Count) tmp_uint64;
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/frame_ring_drop_watermark";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->frame_ring_drop_watermark);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->frame_ring_drop_watermark = (Count) tmp_uint64;
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/qos";
+        MConfig::BooleanValue const val = config->getBoolean (opt_name);
+        if (val == MConfig::Boolean_Invalid) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+
+        if (val == MConfig::Boolean_True)
+            default_stream_opts->qos.enable = true;
+        else
+            default_stream_opts->qos.enable = false;
+
+        logI_ (_func, opt_name, ": ", default_stream_opts->qos.enable);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/qos_lag_threshold";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->qos.lag_threshold_millisec);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->qos.lag_threshold_millisec = (Time) tmp_uint64;
+        logI_ (_func, opt_name, ": ", default_stream_opts->qos.lag_threshold_millisec);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/qos_recover_threshold";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->qos.recover_threshold_millisec);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->qos.recover_threshold_millisec = (Time) tmp_uint64;
+        logI_ (_func, opt_name, ": ", default_stream_opts->qos.recover_threshold_millisec);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/low_latency";
+        MConfig::BooleanValue const val = config->getBoolean (opt_name);
+        if (val == MConfig::Boolean_Invalid) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+
+        if (val == MConfig::Boolean_True)
+            default_stream_opts->low_latency = true;
+        else
+            default_stream_opts->low_latency = false;
+
+        logI_ (_func, opt_name, ": ", default_stream_opts->low_latency);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/source_latency";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->source_latency_millisec);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->source_latency_millisec = (Uint32) tmp_uint64;
+        logI_ (_func, opt_name, ": ", default_stream_opts->source_latency_millisec);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/measure_latency";
+        MConfig::BooleanValue const val = config->getBoolean (opt_name);
+        if (val == MConfig::Boolean_Invalid) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+
+        if (val == MConfig::Boolean_True)
+            default_stream_opts->measure_latency = true;
+        else
+            default_stream_opts->measure_latency = false;
+
+        logI_ (_func, opt_name, ": ", default_stream_opts->measure_latency);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/no_video_threshold";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, default_stream_opts->no_video_threshold);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        default_stream_opts->no_video_threshold = (Time) tmp_uint64;
+        logI_ (_func, opt_name, ": ", default_stream_opts->no_video_threshold);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/delivery_threads";
+        Uint64 num_threads = 2;
+        MConfig::GetResult const res = config->getUint64_default (opt_name, &num_threads, num_threads);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", num_threads);
+
+        // Delivery threads are only spawned when a stream with
+        // async_delivery enabled is created.
+        delivery_pool = grab (new (std::nothrow) FrameDeliveryPool);
+        delivery_pool->init ((Count) num_threads);
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/bringup_threads";
+        Uint64 num_threads = 8;
+        MConfig::GetResult const res = config->getUint64_default (opt_name, &num_threads, num_threads);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", num_threads);
+
+        // 0 or 1 means that channels are created one by one on the init thread.
+        bringup_threads = (Count) num_threads;
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/pipeline_threads";
+        Uint64 num_threads = 4;
+        MConfig::GetResult const res = config->getUint64_default (opt_name, &num_threads, num_threads);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", num_threads);
+
+        // Pipelines of all streams are created and released by this pool.
+        pipeline_pool = grab (new (std::nothrow) PipelineControlPool);
+        pipeline_pool->init ((Count) num_threads);
+    }
+
+    chain_cache = grab (new (std::nothrow) ChainTemplateCache);
+
+    {
+        ReconnectScheduler::Options reconnect_opts;
+
+        Uint64 min_delay             = reconnect_opts.min_delay_millisec;
+        Uint64 max_delay             = reconnect_opts.max_delay_millisec;
+        Uint64 jitter                = reconnect_opts.jitter_percent;
+        Uint64 reset_time            = reconnect_opts.reset_time_millisec;
+        Uint64 max_concurrent_starts = reconnect_opts.max_concurrent_starts;
+        Uint64 start_timeout         = reconnect_opts.start_timeout_millisec;
+
+        if (!configGetUint64 (config, "mod_gst/reconnect_min_delay",   &min_delay)             ||
+            !configGetUint64 (config, "mod_gst/reconnect_max_delay",   &max_delay)             ||
+            !configGetUint64 (config, "mod_gst/reconnect_jitter",      &jitter)                ||
+            !configGetUint64 (config, "mod_gst/reconnect_reset_time",  &reset_time)            ||
+            !configGetUint64 (config, "mod_gst/max_concurrent_starts", &max_concurrent_starts) ||
+            !configGetUint64 (config, "mod_gst/start_timeout",         &start_timeout))
+        {
+            return Result::Failure;
+        }
+
+        reconnect_opts.min_delay_millisec     = (Time)   min_delay;
+        reconnect_opts.max_delay_millisec     = (Time)   max_delay;
+        reconnect_opts.jitter_percent         = (Uint32) jitter;
+        reconnect_opts.reset_time_millisec    = (Time)   reset_time;
+        reconnect_opts.max_concurrent_starts  = (Count)  max_concurrent_starts;
+        reconnect_opts.start_timeout_millisec = (Time)   start_timeout;
+
+        reconnect_scheduler = grab (new (std::nothrow) ReconnectScheduler);
+        reconnect_scheduler->init (reconnect_opts, pipeline_pool, timers);
+    }
+
+    {
+        Uint64 num_threads = 2;
+        {
+            ConstMemory const opt_name = "mod_gst/reaper_threads";
+            MConfig::GetResult const res = config->getUint64_default (opt_name, &num_threads, num_threads);
+            if (!res) {
+                logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+                return Result::Failure;
+            }
+            logI_ (_func, opt_name, ": ", num_threads);
+        }
+
+        Uint64 watchdog_timeout = 5000;
+        {
+            ConstMemory const opt_name = "mod_gst/reaper_watchdog_timeout";
+            MConfig::GetResult const res = config->getUint64_default (opt_name, &watchdog_timeout, watchdog_timeout);
+            if (!res) {
+                logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+                return Result::Failure;
+            }
+            logI_ (_func, opt_name, ": ", watchdog_timeout);
+        }
+
+        // Released pipelines are set to NULL state by these threads.
+        reaper = grab (new (std::nothrow) PipelineReaper);
+        reaper->init ((Count) num_threads, (Time) watchdog_timeout, timers);
+    }
+
+    timeout_wheel = grab (new (std::nothrow) FrameTimeoutWheel);
+    timeout_wheel->init (timers);
+
+    qos_ticker = grab (new (std::nothrow) QosTicker);
+    qos_ticker->init (timers);
+
+    {
+        ConstMemory const opt_name = "mod_gst/share_sources";
+        MConfig::BooleanValue const val = config->getBoolean (opt_name);
+        if (val == MConfig::Boolean_Invalid) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+
+        // Channels with the same URI share one pipeline.
+        if (val == MConfig::Boolean_True) {
+            source_registry = grab (new (std::nothrow) SourceRegistry);
+            source_registry->init (CbDesc<SourceRegistry::Frontend> (&source_registry_frontend, this, this));
+        }
+
+        logI_ (_func, opt_name, ": ", (source_registry ? "true" : "false"));
+    }
+
+    {
+        bool enable = false;
+        {
+            ConstMemory const opt_name = "mod_gst/encoder_scheduler";
+            MConfig::BooleanValue const val = config->getBoolean (opt_name);
+            if (val == MConfig::Boolean_Invalid) {
+                logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+                return Result::Failure;
+            }
+            enable = (val == MConfig::Boolean_True);
+            logI_ (_func, opt_name, ": ", enable);
+        }
+
+        // 0 means all online cores.
+        Uint64 num_cpus = 0;
+        {
+            ConstMemory const opt_name = "mod_gst/encoder_cpus";
+            MConfig::GetResult const res = config->getUint64_default (opt_name, &num_cpus, num_cpus);
+            if (!res) {
+                logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+                return Result::Failure;
+            }
+            logI_ (_func, opt_name, ": ", num_cpus);
+        }
+
+        Uint64 max_threads = 4;
+        {
+            ConstMemory const opt_name = "mod_gst/encoder_max_threads";
+            MConfig::GetResult const res = config->getUint64_default (opt_name, &max_threads, max_threads);
+            if (!res) {
+                logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+                return Result::Failure;
+            }
+            logI_ (_func, opt_name, ": ", max_threads);
+        }
+
+        // Thread counts of transcoding profiles are used otherwise.
+        if (enable) {
+            encoder_scheduler = grab (new (std::nothrow) EncoderScheduler);
+            encoder_scheduler->init ((Count) num_cpus, (Uint32) max_threads, timers);
+        }
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/warm_pipelines";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, warm_pipelines);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", tmp_uint64);
+        warm_pipelines = (Count) tmp_uint64;
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/warm_pipeline_timeout";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, warm_pipeline_timeout);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", tmp_uint64);
+        warm_pipeline_timeout = (tmp_uint64 > 0 ? (Time) tmp_uint64 : 1);
+    }
+
+    if (warm_pipelines > 0) {
+        streams_mutex.lock ();
+        warm_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (warmTimerTick,
+                                                                      this /* cb_data */,
+                                                                      this /* coderef_container */),
+                                       warm_pipeline_timeout,
+                                       true  /* periodical */,
+                                       false /* auto_delete */);
+        streams_mutex.unlock ();
+    }
+
+    {
+        ConstMemory const opt_name = "mod_gst/fetch_reconnect_interval";
+        Uint64 tmp_uint64;
+        MConfig::GetResult const res = config->getUint64_default (
+                opt_name, &tmp_uint64, fetch_reconnect_interval);
+        if (!res) {
+            logE_ (_func, "Invalid value for ", opt_name, ": ", config->getString (opt_name));
+            return Result::Failure;
+        }
+        logI_ (_func, opt_name, ": ", tmp_uint64);
+        fetch_reconnect_interval = (Time) tmp_uint64;
+    }
+
     {
 	ConstMemory const opt_name = "moment/this_rtmp_server_addr";
 	ConstMemory const opt_val = config->getString (opt_name);
@@ -2164,16 +4788,25 @@ MomentGstModule::init (MomentServer * const moment)
 	    1 << 20 /* 1 Mb */ /* preassembly_limit */,
 	    true /* parse_body_params */);
 
-    parseSourcesConfigSection ();
-    parseChainsConfigSection ();
+    startAdminThread ();
 
-    if (!parseStreamsConfigSection ())
+    beginBringup ();
+
+    parseSourcesConfigSection (config, false /* reload */);
+    parseChainsConfigSection (config, false /* reload */);
+
+    if (!parseStreamsConfigSection (config, false /* reload */)) {
+        releaseBringup ();
         return Result::Failure;
+    }
 
-    if (!parseStreams ())
+    if (!parseStreams ()) {
+        releaseBringup ();
         return Result::Failure;
+    }
 
-    parseRecordingsConfigSection ();
+    // Recordings are set up by bringupComplete().
+    endBringupQueueing ();
 
     return Result::Success;
 }
@@ -2182,14 +4815,37 @@ MomentGstModule::MomentGstModule()
     : moment (NULL),
       timers (NULL),
       page_pool (NULL),
-      serve_playlist_json (true)
+      serve_playlist_json (true),
+      fetch_reconnect_interval (1000),
+      warm_pipelines (1),
+      warm_pipeline_timeout (30),
+      warm_timer (NULL),
+      bringup_threads (0),
+      bringup_queueing (false),
+      bringup_complete (false),
+      bringup_stop (false),
+      bringup_num_active (0),
+      bringup_num_channels (0),
+      bringup_start_time (0),
+      collect_job_list (NULL),
+      admin_stop (false)
 {
     default_channel_opts = grab (new (std::nothrow) ChannelOptions);
     default_channel_opts->default_item = grab (new (std::nothrow) PlaybackItem);
+    default_stream_opts = grab (new (std::nothrow) GstStreamOptions);
+
+    transcode_profile_hash = new (std::nothrow) TranscodeProfileEntryHash;
+    assert (transcode_profile_hash);
 }
 
 MomentGstModule::~MomentGstModule ()
 {
+    // Bring-up and admin threads take 'mutex'.
+    releaseBringup ();
+    releaseAdminThread ();
+
+    releaseWarmStreams ();
+
   StateMutexLock l (&mutex);
 
     {
@@ -2207,6 +4863,41 @@ MomentGstModule::~MomentGstModule ()
 	    delete recorder_entry;
 	}
     }
+
+    streams_mutex.lock ();
+    {
+        StreamOptionsEntryHash::iter iter (stream_opts_hash);
+        while (!stream_opts_hash.iter_done (iter)) {
+            StreamOptionsEntry * const entry = stream_opts_hash.iter_next (iter);
+            if (entry->stream_opts->renditions)
+                entry->stream_opts->renditions->release ();
+            delete entry;
+        }
+    }
+    streams_mutex.unlock ();
+
+    releaseTranscodeProfiles (transcode_profile_hash);
+
+    if (delivery_pool)
+        delivery_pool->release ();
+
+    if (reconnect_scheduler)
+        reconnect_scheduler->release ();
+
+    if (pipeline_pool)
+        pipeline_pool->release ();
+
+    if (reaper)
+        reaper->release ();
+
+    if (encoder_scheduler)
+        encoder_scheduler->release ();
+
+    if (timeout_wheel)
+        timeout_wheel->release ();
+
+    if (qos_ticker)
+        qos_ticker->release ();
 }
 
 } // namespace Moment
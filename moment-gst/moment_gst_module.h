@@ -23,6 +23,7 @@
 
 #include <moment/libmoment.h>
 #include <moment-gst/gst_stream.h>
+#include <moment-gst/source_registry.h>
 
 
 namespace MomentGst {
@@ -49,6 +50,24 @@ private:
 
         mt_const Ref<PushAgent>  push_agent;
         mt_const Ref<FetchAgent> fetch_agent;
+
+        mt_const ChannelSet::ChannelKey channel_set_key;
+
+        // Options of the channel's config section as a string. A channel is
+        // recreated on config reload only if its signature has changed.
+        mt_const Ref<String> config_sig;
+
+        // Set for channels which are present in the new config unchanged.
+        mt_mutex (MomentGstModule::mutex) bool reload_seen;
+
+        // Added with the admin API. Such channels are kept on config reload
+        // unless the new config has a channel with the same name.
+        mt_mutex (MomentGstModule::mutex) bool dynamic;
+
+        ChannelEntry ()
+            : reload_seen (false),
+              dynamic (false)
+        {}
     };
 
     typedef Hash< ChannelEntry,
@@ -84,6 +103,46 @@ private:
 		  MemoryComparator<> >
 	    RecorderEntryHash;
 
+    class StreamOptionsEntry : public HashEntry<>
+    {
+    public:
+        mt_const Ref<String> channel_name;
+        Ref<GstStreamOptions> stream_opts;
+    };
+
+    typedef Hash< StreamOptionsEntry,
+                  Memory,
+                  MemberExtractor< StreamOptionsEntry,
+                                   Ref<String>,
+                                   &StreamOptionsEntry::channel_name,
+                                   Memory,
+                                   AccessorExtractor< String,
+                                                      Memory,
+                                                      &String::mem > >,
+                  MemoryComparator<> >
+            StreamOptionsEntryHash;
+
+    class TranscodeProfileEntry : public HashEntry<>
+    {
+    public:
+        mt_const Ref<String> profile_name;
+        mt_const Ref<TranscodeProfile> profile;
+        // Signature of the profile's config section.
+        mt_const Ref<String> config_sig;
+    };
+
+    typedef Hash< TranscodeProfileEntry,
+                  Memory,
+                  MemberExtractor< TranscodeProfileEntry,
+                                   Ref<String>,
+                                   &TranscodeProfileEntry::profile_name,
+                                   Memory,
+                                   AccessorExtractor< String,
+                                                      Memory,
+                                                      &String::mem > >,
+                  MemoryComparator<> >
+            TranscodeProfileEntryHash;
+
     mt_const MomentServer *moment;
     mt_const Timers *timers;
     mt_const PagePool *page_pool;
@@ -92,12 +151,211 @@ private:
     mt_const StRef<String> playlist_json_protocol;
 
     mt_const Ref<ChannelOptions> default_channel_opts;
+    mt_const Ref<GstStreamOptions> default_stream_opts;
+
+    // From "mod_gst/transcoding_profiles" config section. Replaced as a whole
+    // on config reload, never NULL.
+    mt_mutex (reload_mutex) TranscodeProfileEntryHash *transcode_profile_hash;
+
+    mt_const Ref<FrameDeliveryPool> delivery_pool;
+    mt_const Ref<PipelineControlPool> pipeline_pool;
+    mt_const Ref<ChainTemplateCache> chain_cache;
+    mt_const Ref<ReconnectScheduler> reconnect_scheduler;
+    mt_const Ref<PipelineReaper> reaper;
+    // NULL unless "mod_gst/share_sources" is set.
+    mt_const Ref<SourceRegistry> source_registry;
+    // NULL unless "mod_gst/encoder_scheduler" is set.
+    mt_const Ref<EncoderScheduler> encoder_scheduler;
+    // "No video" detection for all streams.
+    mt_const Ref<FrameTimeoutWheel> timeout_wheel;
+    // QoS ticks for all streams.
+    mt_const Ref<QosTicker> qos_ticker;
+
+    // Passed to FetchAgent for "fetch_uri" streams.
+    mt_const Time fetch_reconnect_interval;
 
     mt_mutex (mutex) ChannelEntryHash channel_entry_hash;
     mt_mutex (mutex) RecorderEntryHash recorder_entry_hash;
 
+    // createMediaSource() may be called with 'mutex' held (restartStream(),
+    // setPosition() and playlist updates are made under it), hence a separate
+    // lock for the list of live GstStream instances.
+    StateMutex streams_mutex;
+    mt_mutex (streams_mutex) List< WeakRef<GstStream> > stream_list;
+    // Options from "mod_gst/streams" which GstStream instances are created with.
+    mt_mutex (streams_mutex) StreamOptionsEntryHash stream_opts_hash;
+
+    // A stream prepared ahead of time, which createMediaSource() hands out
+    // instead of building a new pipeline.
+    class WarmStreamEntry
+    {
+    public:
+        Ref<GstStream> gst_stream;
+        // In seconds, getCoarseTime().
+        Time prepare_time;
+        bool ready;
+        // Restart the channel once the stream has prerolled.
+        bool restart_on_ready;
+    };
+
+    // Max number of warm pipelines per channel. 0 disables warm pipelines.
+    mt_const Count warm_pipelines;
+    // Unused warm pipelines are released after this many seconds.
+    mt_const Time warm_pipeline_timeout;
+
+    mt_mutex (streams_mutex) List<WarmStreamEntry*> warm_list;
+    mt_mutex (streams_mutex) Timers::TimerKey warm_timer;
+
     ChannelSet channel_set;
 
+    // Channels configured in mod_gst sections are brought up by a bounded
+    // number of threads in parallel. Each channel is registered as soon as
+    // it is ready, so that it can be served before the rest are up.
+    class BringupJob
+    {
+    public:
+        Ref<ChannelOptions> channel_opts;
+        // NULL for playlist and dummy channels.
+        Ref<PlaybackItem>   playback_item;
+        bool                dummy;
+
+        Ref<String> playlist_filename;
+        bool        is_dir;
+        bool        dir_re_read;
+
+        Ref<PushAgent>  push_agent;
+        Ref<FetchAgent> fetch_agent;
+
+        Ref<String> config_sig;
+
+        // Options from the channel's stream section, applied right before
+        // the channel is created. NULL for channels from other sections.
+        Ref<GstStreamOptions> stream_opts;
+    };
+
+    mt_const Count bringup_threads;
+
+    StateMutex bringup_mutex;
+
+    mt_mutex (bringup_mutex)
+    mt_begin
+      List<BringupJob*> bringup_job_list;
+      List< Ref<Thread> > bringup_thread_list;
+      Cond bringup_cond;
+      // Set while the config is being parsed: createStreamChannel() and
+      // createPlaylistChannel() queue jobs instead of creating channels.
+      bool  bringup_queueing;
+      bool  bringup_complete;
+      bool  bringup_stop;
+      Count bringup_num_active;
+      Count bringup_num_channels;
+      Time  bringup_start_time;
+      // Set during config reload and when channels are added with the admin
+      // API: jobs are collected here, to be run once all of the channels'
+      // options have been parsed.
+      List<BringupJob*> *collect_job_list;
+    mt_end
+
+    // Serializes config reloads and admin API channel changes.
+    StateMutex reload_mutex;
+
+    // Jobs of a config reload or of an admin API request, run by a few
+    // threads at once.
+    class JobBatch
+    {
+    public:
+        MomentGstModule *module;
+
+        StateMutex mutex;
+        mt_mutex (mutex) List<BringupJob*> *job_list;
+    };
+
+    static void jobBatchThreadFunc (void *_batch);
+
+    // Runs and deletes the jobs.
+    void runBringupJobs (List<BringupJob*> * mt_nonnull job_list);
+
+    // Channel changes of an admin API request. The request is parsed on
+    // the HTTP thread, while channels are created and destroyed later by
+    // 'admin_thread', in the order of requests.
+    class AdminJob
+    {
+    public:
+        // Channels to release. Looked up by name when the job is run, before
+        // 'job_list' is.
+        List< Ref<String> > remove_names;
+        List<BringupJob*> job_list;
+        // Names of the channels in 'job_list', kept until all of them are up.
+        List< Ref<String> > add_names;
+
+        ~AdminJob ();
+    };
+
+    StateMutex admin_mutex;
+
+    mt_mutex (admin_mutex)
+    mt_begin
+      // The job which is being run stays first in the list until it's done.
+      List<AdminJob*> admin_job_list;
+      Ref<Thread> admin_thread;
+      Cond admin_cond;
+      Cond admin_done_cond;
+      bool admin_stop;
+    mt_end
+
+    static void adminThreadFunc (void *_self);
+
+    void startAdminThread ();
+    void releaseAdminThread ();
+
+    // Returns 'false' if there is no admin thread to run the job.
+    mt_mutex (admin_mutex) bool queueAdminJob (AdminJob * mt_nonnull admin_job);
+
+    void runAdminJob (AdminJob * mt_nonnull admin_job);
+
+    // Waits for queued admin jobs to complete.
+    void waitAdminJobs ();
+
+    // Whether the channel will exist once queued admin jobs are done.
+    mt_mutex (admin_mutex) bool adminChannelWillExist (ConstMemory channel_name);
+
+    static void bringupThreadFunc (void *_self);
+
+    void beginBringup ();
+    void endBringupQueueing ();
+    // Called once, when the last queued channel is up.
+    void bringupComplete ();
+    void releaseBringup ();
+
+    static bool jobListHasChannel (List<BringupJob*> * mt_nonnull job_list,
+                                   ConstMemory        channel_name);
+
+    // Returns 'true' if the job has been queued.
+    bool queueBringupJob (BringupJob * mt_nonnull job);
+
+    void runBringupJob (BringupJob * mt_nonnull job);
+
+    // Removes the channel from the hash and from 'channel_set'. Its channel
+    // recorder is returned in 'ret_recorder_list'.
+    mt_mutex (mutex) void unlinkChannelEntry (ChannelEntry         * mt_nonnull channel_entry,
+                                              List<RecorderEntry*> * mt_nonnull ret_recorder_list);
+
+    // Releases an unlinked channel along with its stream and stream options.
+    // 'drop_backoff' is set for channels which are gone, not replaced: their
+    // reconnect backoff state is dropped as well.
+    void destroyChannelEntry (ChannelEntry * mt_nonnull channel_entry,
+                              bool           drop_backoff);
+
+    // Each subsection of 'channels_section' holds options of one channel,
+    // the same as in "mod_gst/streams" config section. Only the options are
+    // checked here: channels are created by the admin thread afterwards.
+    Result addChannels (MConfig::Section * mt_nonnull channels_section,
+                        Ref<String>      * mt_nonnull ret_report);
+
+    // Channels are destroyed by the admin thread afterwards.
+    Result removeChannels (List< Ref<String> > * mt_nonnull channel_names,
+                           Ref<String>         * mt_nonnull ret_report);
+
     Result updatePlaylist (ConstMemory  channel_name,
 			   bool         keep_cur_item,
 			   Ref<String> * mt_nonnull ret_err_msg);
@@ -110,6 +368,8 @@ private:
     void printChannelInfoJson (PagePool::PageListHead *page_list,
 			       ChannelEntry           *channel_entry);
 
+    void printStreamStatsJson (PagePool::PageListHead *page_list);
+
     static Result httpGetChannelsStat (HttpRequest  * mt_nonnull req,
 				       Sender       * mt_nonnull conn_sender,
 				       void         *_self);
@@ -132,23 +392,122 @@ private:
 				 void         *_self);
     mt_iface_end
 
-    void createPlaylistChannel (ConstMemory     playlist_filename,
-                                bool            is_dir,
-                                bool            dir_re_read,
-                                ChannelOptions *channel_opts,
-                                PushAgent      *push_agent  = NULL,
-                                FetchAgent     *fetch_agent = NULL);
-
-    void createStreamChannel (ChannelOptions *channel_opts,
-                              PlaybackItem   *playback_item,
-                              PushAgent      *push_agent  = NULL,
-                              FetchAgent     *fetch_agent = NULL);
-
-    void createDummyChannel (ConstMemory  channel_name,
-                             ConstMemory  channel_title,
-			     ConstMemory  channel_desc,
-                             PushAgent   *push_agent  = NULL,
-                             FetchAgent  *fetch_agent = NULL);
+    void doCreatePlaylistChannel (ConstMemory     playlist_filename,
+                                  bool            is_dir,
+                                  bool            dir_re_read,
+                                  ChannelOptions *channel_opts,
+                                  PushAgent      *push_agent,
+                                  FetchAgent     *fetch_agent,
+                                  ConstMemory     config_sig);
+
+    void doCreateStreamChannel (ChannelOptions *channel_opts,
+                                PlaybackItem   *playback_item,
+                                PushAgent      *push_agent,
+                                FetchAgent     *fetch_agent,
+                                ConstMemory     config_sig);
+
+    void doCreateDummyChannel (ConstMemory  channel_name,
+                               ConstMemory  channel_title,
+                               ConstMemory  channel_desc,
+                               PushAgent   *push_agent,
+                               FetchAgent  *fetch_agent,
+                               ConstMemory  config_sig);
+
+    // 'stream_opts' are set for the channel when it is created.
+    void createPlaylistChannel (ConstMemory       playlist_filename,
+                                bool              is_dir,
+                                bool              dir_re_read,
+                                ChannelOptions   *channel_opts,
+                                ConstMemory       config_sig,
+                                PushAgent        *push_agent  = NULL,
+                                FetchAgent       *fetch_agent = NULL,
+                                GstStreamOptions *stream_opts = NULL);
+
+    void createStreamChannel (ChannelOptions   *channel_opts,
+                              PlaybackItem     *playback_item,
+                              ConstMemory       config_sig,
+                              PushAgent        *push_agent  = NULL,
+                              FetchAgent       *fetch_agent = NULL,
+                              GstStreamOptions *stream_opts = NULL);
+
+    void createDummyChannel (ConstMemory       channel_name,
+                             ConstMemory       channel_title,
+			     ConstMemory       channel_desc,
+                             ConstMemory       config_sig,
+                             PushAgent        *push_agent  = NULL,
+                             FetchAgent       *fetch_agent = NULL,
+                             GstStreamOptions *stream_opts = NULL);
+
+    // Replaces options of the channel's stream section. Renditions of the
+    // previous options are released, the new ones are published.
+    void setStreamOptions (ConstMemory       channel_name,
+                           GstStreamOptions * mt_nonnull stream_opts);
+
+    // Options of the channel's stream section, default options if there is
+    // no such section.
+    Ref<GstStreamOptions> getStreamOptions (ConstMemory channel_name);
+
+    Ref<GstStream> newGstStream (CbDesc<MediaSource::Frontend> const &frontend,
+                                 Timers            *timers,
+                                 DeferredProcessor *deferred_processor,
+                                 PagePool          *page_pool,
+                                 VideoStream       *video_stream,
+                                 VideoStream       *mix_video_stream,
+                                 Time               initial_seek,
+                                 ChannelOptions    *channel_opts,
+                                 PlaybackItem      *playback_item,
+                                 GstStreamOptions  * mt_nonnull stream_opts);
+
+    // Returns NULL if the stream should have a pipeline of its own.
+    Ref<String> makeSourceKey (ChannelOptions * mt_nonnull channel_opts,
+                               PlaybackItem   * mt_nonnull playback_item);
+
+    // Same as makeSourceKey(), also NULL if sources are not shared or if
+    // the item can't be shared at all.
+    Ref<String> getSharedSourceKey (ChannelOptions * mt_nonnull channel_opts,
+                                    PlaybackItem   * mt_nonnull playback_item,
+                                    Time             initial_seek);
+
+    static SourceRegistry::Frontend const source_registry_frontend;
+
+    static Ref<GstStream> createSourceStream (ConstMemory        source_key,
+                                              CbDesc<MediaSource::Frontend> const &frontend,
+                                              Timers            *timers,
+                                              DeferredProcessor *deferred_processor,
+                                              PagePool          *page_pool,
+                                              VideoStream       *video_stream,
+                                              ChannelOptions    *channel_opts,
+                                              PlaybackItem      *playback_item,
+                                              void              *_self);
+
+    static GstStream::WarmFrontend const warm_frontend;
+
+    static void warmReady (GstStream *stream,
+                           bool       ok,
+                           void      *_self);
+
+    static void warmTimerTick (void *_self);
+
+    // Returns 'false' if warm pipelines are disabled, or if the channel has
+    // too many of them.
+    bool prepareWarmStream (ChannelOptions * mt_nonnull channel_opts,
+                            PlaybackItem   * mt_nonnull playback_item,
+                            bool             restart_on_ready);
+
+    Ref<GstStream> takeWarmStream (ChannelOptions * mt_nonnull channel_opts,
+                                   PlaybackItem   * mt_nonnull playback_item,
+                                   Time             initial_seek);
+
+    void restartChannel (ConstMemory channel_name);
+
+    // Restarts the channel's stream, switching to a prepared pipeline
+    // when possible.
+    mt_mutex (mutex) void reconnectChannel (ChannelEntry * mt_nonnull channel_entry);
+
+    void releaseWarmStreams ();
+
+    // Releases warm pipelines of a channel which is being removed.
+    void dropWarmStreams (ConstMemory channel_name);
 
     void createPlaylistRecorder (ConstMemory recorder_name,
 				 ConstMemory playlist_filename,
@@ -158,9 +517,41 @@ private:
 				ConstMemory channel_name,
 				ConstMemory filename_prefix);
 
-    void parseSourcesConfigSection ();
-    void parseChainsConfigSection ();
-    Result parseStreamsConfigSection ();
+    Result parseTranscodeProfile (MConfig::Section * mt_nonnull section,
+                                  TranscodeProfile * mt_nonnull profile);
+
+    Result parseTranscodingProfilesConfigSection (MConfig::Config           * mt_nonnull config,
+                                                  TranscodeProfileEntryHash * mt_nonnull ret_profile_hash);
+
+    // Deletes the entries along with the hash.
+    static void releaseTranscodeProfiles (TranscodeProfileEntryHash * mt_nonnull profile_hash);
+
+    TranscodeProfile* lookupTranscodeProfile (ConstMemory profile_name);
+
+    // Signatures of the transcoding profile sections which a stream section
+    // refers to, so that the channel is recreated when any of them changes.
+    Ref<String> makeProfilesSignature (MConfig::Section * mt_nonnull item_section);
+
+    // 'value' is a comma-separated list of transcoding profile names.
+    Result parseRenditions (ConstMemory        stream_name,
+                            ConstMemory        value,
+                            Uint32             gop_size,
+                            Ref<RenditionSet> * mt_nonnull ret_renditions);
+
+    // Marks the channel as seen if it exists and has the same config
+    // signature. Used on config reload only.
+    bool isUnchangedChannel (ConstMemory channel_name,
+                             ConstMemory config_sig);
+
+    // With 'reload' set, channels which are unchanged are skipped.
+    void parseSourcesConfigSection (MConfig::Config * mt_nonnull config,
+                                    bool             reload);
+    void parseChainsConfigSection (MConfig::Config * mt_nonnull config,
+                                   bool             reload);
+    Result parseStreamSection (MConfig::Section * mt_nonnull item_section,
+                               bool              reload);
+    Result parseStreamsConfigSection (MConfig::Config * mt_nonnull config,
+                                      bool             reload);
     Result parseStreams ();
     void parseRecordingsConfigSection ();
 
@@ -177,6 +568,10 @@ public:
                                         PlaybackItem      *playback_item);
   mt_iface_end
 
+    // Re-reads channel sections of mod_gst config. Only channels which have
+    // been added, removed or changed are affected.
+    void configReload (MConfig::Config * mt_nonnull new_config);
+
     Result init (MomentServer *moment);
 
     MomentGstModule ();
@@ -0,0 +1,188 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/pipeline_pool.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_pipeline_pool ("mod_gst.pipeline_pool", LogLevel::I);
+
+static __thread bool in_pipeline_worker = false;
+
+void
+PipelineControlPool::workerThreadFunc (void * const _self)
+{
+    PipelineControlPool * const self = static_cast <PipelineControlPool*> (_self);
+
+    in_pipeline_worker = true;
+
+    updateTime ();
+
+    logD (pipeline_pool, _func, "worker started");
+
+    self->mutex.lock ();
+    for (;;) {
+        while (self->task_list.isEmpty() && !self->stop) {
+            self->cond.wait (self->mutex);
+            updateTime ();
+        }
+
+        if (self->stop)
+            break;
+
+        Ref<Task> const task = self->task_list.getFirst();
+        self->task_list.remove (self->task_list.getFirstElement());
+        task->reschedule = false;
+        self->mutex.unlock ();
+
+        // One item per turn, so that a stream with many pending items does
+        // not hold up the rest.
+        bool more = false;
+        if (!task->frontend.call_ret<bool> (&more, task->frontend->processWorkItem))
+            more = false;
+
+        self->mutex.lock ();
+        if (more || task->reschedule) {
+            task->reschedule = false;
+            self->task_list.append (task);
+        } else {
+            task->scheduled = false;
+        }
+    }
+    self->mutex.unlock ();
+
+    logD (pipeline_pool, _func, "worker stopped");
+}
+
+mt_mutex (mutex) void
+PipelineControlPool::startWorkers ()
+{
+    if (started)
+        return;
+
+    started = true;
+
+    logD (pipeline_pool, _func, "spawning ", num_threads, " pipeline control threads");
+
+    for (Count i = 0; i < num_threads; ++i) {
+        Ref<Thread> const thread = grab (new (std::nothrow) Thread (
+                CbDesc<Thread::ThreadFunc> (workerThreadFunc, this, this)));
+        if (!thread->spawn (true /* joinable */)) {
+            logE_ (_func, "Failed to spawn pipeline control thread: ", exc->toString());
+            continue;
+        }
+
+        thread_list.append (thread);
+    }
+}
+
+Ref<PipelineControlPool::Task>
+PipelineControlPool::createTask (CbDesc<Frontend> const &frontend)
+{
+    Ref<Task> const task = grab (new (std::nothrow) Task);
+    task->frontend = frontend;
+    return task;
+}
+
+bool
+PipelineControlPool::schedule (Task * const mt_nonnull task)
+{
+    mutex.lock ();
+
+    if (stop) {
+        mutex.unlock ();
+        return false;
+    }
+
+    startWorkers ();
+
+    if (thread_list.isEmpty()) {
+        mutex.unlock ();
+        return false;
+    }
+
+    if (task->scheduled) {
+      // Either queued already, or being processed by a worker which will
+      // requeue the task when it's done.
+        task->reschedule = true;
+        mutex.unlock ();
+        return true;
+    }
+
+    task->scheduled = true;
+    task_list.append (task);
+    cond.signal ();
+
+    mutex.unlock ();
+
+    return true;
+}
+
+bool
+PipelineControlPool::isWorkerThread ()
+{
+    return in_pipeline_worker;
+}
+
+mt_const void
+PipelineControlPool::init (Count const num_threads)
+{
+    this->num_threads = (num_threads > 0 ? num_threads : 1);
+}
+
+void
+PipelineControlPool::release ()
+{
+    mutex.lock ();
+    stop = true;
+    for (Count i = 0; i < num_threads; ++i)
+        cond.signal ();
+
+    List< Ref<Thread> > tmp_thread_list;
+    while (!thread_list.isEmpty()) {
+        tmp_thread_list.append (thread_list.getFirst());
+        thread_list.remove (thread_list.getFirstElement());
+    }
+
+    while (!task_list.isEmpty())
+        task_list.remove (task_list.getFirstElement());
+    mutex.unlock ();
+
+    while (!tmp_thread_list.isEmpty()) {
+        tmp_thread_list.getFirst()->join ();
+        tmp_thread_list.remove (tmp_thread_list.getFirstElement());
+    }
+}
+
+PipelineControlPool::PipelineControlPool ()
+    : num_threads (0),
+      started (false),
+      stop (false)
+{
+}
+
+PipelineControlPool::~PipelineControlPool ()
+{
+}
+
+}
+
@@ -0,0 +1,106 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__PIPELINE_POOL__H__
+#define MOMENT_GST__PIPELINE_POOL__H__
+
+
+#include <libmary/libmary.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// A fixed-size pool of threads which create and release GStreamer pipelines
+// for all streams. Each stream has a Task. A task is never processed by two
+// threads at once, so work items of a single stream are handled in order.
+class PipelineControlPool : public Object
+{
+public:
+    struct Frontend
+    {
+        // Processes one work item. Should return 'true' if there are more
+        // items pending.
+        bool (*processWorkItem) (void *cb_data);
+    };
+
+    class Task : public Referenced
+    {
+        friend class PipelineControlPool;
+
+    private:
+        mt_const Cb<Frontend> frontend;
+
+        // Set when the task is in 'task_list' or is being processed.
+        mt_mutex (PipelineControlPool::mutex) bool scheduled;
+        // Set when the task has been scheduled again while being processed.
+        mt_mutex (PipelineControlPool::mutex) bool reschedule;
+
+    public:
+        Task ()
+            : scheduled  (false),
+              reschedule (false)
+        {}
+    };
+
+private:
+    mt_const Count num_threads;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      List< Ref<Thread> > thread_list;
+      List< Ref<Task> > task_list;
+      Cond cond;
+      bool started;
+      bool stop;
+    mt_end
+
+    static void workerThreadFunc (void *_self);
+
+    mt_mutex (mutex) void startWorkers ();
+
+public:
+    Ref<Task> createTask (CbDesc<Frontend> const &frontend);
+
+    // Makes the pool call task's processWorkItem() until it returns 'false'.
+    // Returns 'false' if the pool has been stopped, in which case the task
+    // will not be processed.
+    bool schedule (Task * mt_nonnull task);
+
+    // Returns 'true' if called from one of the pool's threads.
+    static bool isWorkerThread ();
+
+    // Threads are spawned when the first task is scheduled.
+    mt_const void init (Count num_threads);
+
+    // Stops and joins the threads. Pending tasks are not processed.
+    void release ();
+
+     PipelineControlPool ();
+    ~PipelineControlPool ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__PIPELINE_POOL__H__ */
+
@@ -0,0 +1,279 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/coarse_clock.h>
+
+#include <moment-gst/pipeline_reaper.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_reaper ("mod_gst.reaper", LogLevel::I);
+
+void
+PipelineReaper::workerThreadFunc (void * const _self)
+{
+    PipelineReaper * const self = static_cast <PipelineReaper*> (_self);
+
+    updateTime ();
+
+    logD (reaper, _func, "worker started");
+
+    self->mutex.lock ();
+    for (;;) {
+        while (self->job_list.isEmpty() && !self->stop) {
+            self->cond.wait (self->mutex);
+            updateTime ();
+        }
+
+        // Queued pipelines are released before stopping.
+        if (self->job_list.isEmpty())
+            break;
+
+        Job * const job = self->job_list.getFirst();
+        self->job_list.remove (self->job_list.getFirstElement());
+        List<Job*>::Element * const active_el = self->active_list.append (job);
+        self->mutex.unlock ();
+
+        logD (reaper, _func, "setting pipeline \"", job->name, "\" to NULL state");
+
+        if (gst_element_set_state (job->pipeline, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
+            logE_ (_func, "gst_element_set_state() failed (NULL), pipeline \"", job->name, "\"");
+
+        gst_object_unref (job->pipeline);
+        job->pipeline = NULL;
+
+        Time const reap_time = getCoarseTimeMilliseconds () - job->queue_time;
+
+        // The owner may be destroyed here, which should happen without
+        // 'mutex' held.
+        job->owner = NULL;
+
+        self->mutex.lock ();
+        self->active_list.remove (active_el);
+
+        ++self->num_reaped;
+        if (reap_time > self->max_reap_time)
+            self->max_reap_time = reap_time;
+
+        if (reap_time >= self->watchdog_timeout_millisec) {
+            if (!job->reported_slow) {
+                ++self->num_slow;
+                logW_ (_func, "pipeline \"", job->name, "\" took ", reap_time, " ms to stop");
+            } else {
+                logI_ (_func, "pipeline \"", job->name, "\" stopped after ", reap_time, " ms");
+            }
+        }
+
+        delete job;
+    }
+    self->mutex.unlock ();
+
+    logD (reaper, _func, "worker stopped");
+}
+
+mt_mutex (mutex) void
+PipelineReaper::checkSlowJobs (List<Job*> * const job_list,
+                               Time         const cur_time)
+{
+    List<Job*>::Element *el = job_list->getFirstElement();
+    while (el) {
+        Job * const job = el->data;
+        if (cur_time < job->queue_time + watchdog_timeout_millisec)
+            break;
+
+        if (!job->reported_slow) {
+            job->reported_slow = true;
+            ++num_slow;
+            logW_ (_func, "pipeline \"", job->name, "\" has not stopped "
+                   "in ", cur_time - job->queue_time, " ms");
+        }
+
+        el = el->next;
+    }
+}
+
+void
+PipelineReaper::watchdogTimerTick (void * const _self)
+{
+    PipelineReaper * const self = static_cast <PipelineReaper*> (_self);
+
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    self->mutex.lock ();
+    self->checkSlowJobs (&self->active_list, cur_time);
+    self->checkSlowJobs (&self->job_list, cur_time);
+    self->mutex.unlock ();
+}
+
+mt_mutex (mutex) void
+PipelineReaper::startWorkers ()
+{
+    // No threads after release(): nobody would join them.
+    if (started || stop)
+        return;
+
+    started = true;
+
+    logD (reaper, _func, "spawning ", num_threads, " reaper threads");
+
+    for (Count i = 0; i < num_threads; ++i) {
+        Ref<Thread> const thread = grab (new (std::nothrow) Thread (
+                CbDesc<Thread::ThreadFunc> (workerThreadFunc, this, this)));
+        if (!thread->spawn (true /* joinable */)) {
+            logE_ (_func, "Failed to spawn reaper thread: ", exc->toString());
+            continue;
+        }
+
+        thread_list.append (thread);
+    }
+
+    watchdog_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (watchdogTimerTick,
+                                                                      this /* cb_data */,
+                                                                      this /* coderef_container */),
+                                       1     /* time_seconds */,
+                                       true  /* periodical */,
+                                       false /* auto_delete */);
+}
+
+void
+PipelineReaper::reap (GstElement  * const mt_nonnull pipeline,
+                      Object      * const owner,
+                      ConstMemory   const name)
+{
+    Job * const job = new (std::nothrow) Job;
+    assert (job);
+    job->pipeline = pipeline;
+    job->owner = owner;
+    job->name = grab (new (std::nothrow) String (name));
+    job->queue_time = getCoarseTimeMilliseconds ();
+    job->reported_slow = false;
+
+    mutex.lock ();
+
+    if (!stop)
+        startWorkers ();
+
+    if (stop || thread_list.isEmpty()) {
+        mutex.unlock ();
+
+      // Doing it the old way.
+        if (gst_element_set_state (pipeline, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE)
+            logE_ (_func, "gst_element_set_state() failed (NULL)");
+
+        gst_object_unref (pipeline);
+        delete job;
+        return;
+    }
+
+    job_list.append (job);
+    cond.signal ();
+
+    mutex.unlock ();
+}
+
+void
+PipelineReaper::getStats (Stats * const mt_nonnull ret_stats)
+{
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    mutex.lock ();
+
+    Count num_pending = 0;
+    Time oldest_time = cur_time;
+    {
+        List<Job*> * const lists [] = { &active_list, &job_list };
+        for (unsigned i = 0; i < sizeof (lists) / sizeof (lists [0]); ++i) {
+            List<Job*>::Element *el = lists [i]->getFirstElement();
+            while (el) {
+                ++num_pending;
+                if (el->data->queue_time < oldest_time)
+                    oldest_time = el->data->queue_time;
+
+                el = el->next;
+            }
+        }
+    }
+
+    ret_stats->num_pending = num_pending;
+    ret_stats->num_reaped = num_reaped;
+    ret_stats->num_slow = num_slow;
+    ret_stats->oldest_pending_time = cur_time - oldest_time;
+    ret_stats->max_reap_time = max_reap_time;
+
+    mutex.unlock ();
+}
+
+mt_const void
+PipelineReaper::init (Count    const num_threads,
+                      Time     const watchdog_timeout_millisec,
+                      Timers * const mt_nonnull timers)
+{
+    this->num_threads = (num_threads > 0 ? num_threads : 1);
+    this->watchdog_timeout_millisec = watchdog_timeout_millisec;
+    this->timers = timers;
+}
+
+void
+PipelineReaper::release ()
+{
+    mutex.lock ();
+    stop = true;
+    for (Count i = 0; i < num_threads; ++i)
+        cond.signal ();
+
+    if (watchdog_timer) {
+        timers->deleteTimer (watchdog_timer);
+        watchdog_timer = NULL;
+    }
+
+    List< Ref<Thread> > tmp_thread_list;
+    while (!thread_list.isEmpty()) {
+        tmp_thread_list.append (thread_list.getFirst());
+        thread_list.remove (thread_list.getFirstElement());
+    }
+    mutex.unlock ();
+
+    while (!tmp_thread_list.isEmpty()) {
+        tmp_thread_list.getFirst()->join ();
+        tmp_thread_list.remove (tmp_thread_list.getFirstElement());
+    }
+}
+
+PipelineReaper::PipelineReaper ()
+    : num_threads (0),
+      watchdog_timeout_millisec (0),
+      timers (NULL),
+      started (false),
+      stop (false),
+      num_reaped (0),
+      num_slow (0),
+      max_reap_time (0),
+      watchdog_timer (NULL)
+{
+}
+
+PipelineReaper::~PipelineReaper ()
+{
+}
+
+}
+
@@ -0,0 +1,121 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__PIPELINE_REAPER__H__
+#define MOMENT_GST__PIPELINE_REAPER__H__
+
+
+#include <libmary/libmary.h>
+#include <gst/gst.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Sets released pipelines to NULL state and unrefs them on dedicated
+// threads. Going to NULL may block for seconds while network sources tear
+// down their sockets, and nobody has to wait for that.
+class PipelineReaper : public Object
+{
+public:
+    struct Stats
+    {
+        // Pipelines queued or being set to NULL state.
+        Count  num_pending;
+        Uint64 num_reaped;
+        // Pipelines which have taken longer than the watchdog timeout.
+        Uint64 num_slow;
+        // Age of the oldest pending pipeline, in milliseconds.
+        Time   oldest_pending_time;
+        Time   max_reap_time;
+    };
+
+private:
+    class Job
+    {
+    public:
+        GstElement *pipeline;
+        // Keeps the owner of the pipeline's signal handlers alive until
+        // the pipeline is dead.
+        Ref<Object> owner;
+        Ref<String> name;
+        // In milliseconds, getCoarseTimeMilliseconds().
+        Time queue_time;
+        bool reported_slow;
+    };
+
+    mt_const Count num_threads;
+    mt_const Time watchdog_timeout_millisec;
+    mt_const Timers *timers;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      List< Ref<Thread> > thread_list;
+      // Queued jobs, then jobs being processed, both in order of queueing.
+      List<Job*> job_list;
+      List<Job*> active_list;
+      Cond cond;
+      bool started;
+      bool stop;
+
+      Uint64 num_reaped;
+      Uint64 num_slow;
+      Time   max_reap_time;
+
+      Timers::TimerKey watchdog_timer;
+    mt_end
+
+    static void workerThreadFunc (void *_self);
+
+    static void watchdogTimerTick (void *_self);
+
+    mt_mutex (mutex) void startWorkers ();
+
+    mt_mutex (mutex) void checkSlowJobs (List<Job*> *job_list,
+                                         Time        cur_time);
+
+public:
+    // Takes over a reference to 'pipeline'. 'owner' is released after
+    // the pipeline has reached NULL state.
+    void reap (GstElement  * mt_nonnull pipeline,
+               Object      *owner,
+               ConstMemory  name);
+
+    void getStats (Stats * mt_nonnull ret_stats);
+
+    // Threads are spawned when the first pipeline is queued.
+    mt_const void init (Count   num_threads,
+                        Time    watchdog_timeout_millisec,
+                        Timers * mt_nonnull timers);
+
+    // Waits for queued pipelines to be released.
+    void release ();
+
+     PipelineReaper ();
+    ~PipelineReaper ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__PIPELINE_REAPER__H__ */
+
@@ -0,0 +1,308 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/qos_controller.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_qos ("mod_gst.qos", LogLevel::I);
+
+// Lag this large means that timestamps have jumped without a discontinuity
+// being flagged, rather than that the stream is behind.
+static Time const resync_lag_millisec = 60000;
+
+char const *
+QosController::levelToString (Level::Value const level)
+{
+    switch (level) {
+        case Level::Normal:           return "normal";
+        case Level::DropNonReference: return "drop_nonref";
+        case Level::HalfFrameRate:    return "half_fps";
+        case Level::QuarterFrameRate: return "quarter_fps";
+    }
+
+    return "unknown";
+}
+
+static void atomicStoreMax (std::atomic<Time> * const mt_nonnull var,
+                            Time                const val)
+{
+    Time prv = var->load (std::memory_order_relaxed);
+    while (val > prv
+           && !var->compare_exchange_weak (prv, val, std::memory_order_relaxed))
+    {
+    }
+}
+
+void
+QosController::reportLag (Time const lag_millisec)
+{
+    atomicStoreMax (&period_lag, lag_millisec);
+    atomicStoreMax (&max_lag, lag_millisec);
+}
+
+void
+QosController::reportVideoFrame (Uint64 const timestamp_nanosec,
+                                 Time   const cur_time_millisec,
+                                 bool   const discont)
+{
+    if (!opts.enable)
+        return;
+
+    Int64 const offset = (Int64) cur_time_millisec - (Int64) (timestamp_nanosec / 1000000);
+    if (!got_min_offset || discont || offset < min_offset_millisec) {
+        got_min_offset = true;
+        min_offset_millisec = offset;
+        return;
+    }
+
+    Time const lag = (Time) (offset - min_offset_millisec);
+    if (lag >= resync_lag_millisec) {
+        logD (qos, _func, "resyncing, lag: ", lag);
+        min_offset_millisec = offset;
+        return;
+    }
+
+    reportLag (lag);
+}
+
+void
+QosController::reportQosMessage (Int64 const jitter_nanosec)
+{
+    if (!opts.enable)
+        return;
+
+    num_qos_messages.fetch_add (1, std::memory_order_relaxed);
+
+    if (jitter_nanosec > 0)
+        reportLag ((Time) (jitter_nanosec / 1000000));
+}
+
+bool
+QosController::dropEncoderInputFrame ()
+{
+    Count divisor;
+    switch (level.load (std::memory_order_relaxed)) {
+        case Level::HalfFrameRate:
+            divisor = 2;
+            break;
+        case Level::QuarterFrameRate:
+            divisor = 4;
+            break;
+        default:
+            encoder_frame_counter = 0;
+            return false;
+    }
+
+    Count const frame_no = encoder_frame_counter++;
+    if (frame_no % divisor == 0)
+        return false;
+
+    encoder_frames_dropped.fetch_add (1, std::memory_order_relaxed);
+    return true;
+}
+
+void
+QosController::tick (ConstMemory const name)
+{
+    if (!opts.enable)
+        return;
+
+    Time const lag = period_lag.exchange (0, std::memory_order_relaxed);
+    Time const prv_lag = last_lag.exchange (lag, std::memory_order_relaxed);
+
+    unsigned const cur_level = level.load (std::memory_order_relaxed);
+    unsigned const max_level = (can_reduce_frame_rate.load (std::memory_order_relaxed) ?
+                                        Level::QuarterFrameRate : Level::DropNonReference);
+
+    unsigned new_level = cur_level;
+    if (lag >= opts.lag_threshold_millisec) {
+        num_low_ticks = 0;
+        // Queued frames take a while to drain after a step up. The next step
+        // is only taken if that hasn't helped.
+        if (lag >= prv_lag && cur_level < max_level)
+            new_level = cur_level + 1;
+    } else
+    if (lag < opts.recover_threshold_millisec) {
+        ++num_low_ticks;
+        if (num_low_ticks >= opts.recover_ticks && cur_level > Level::Normal) {
+            num_low_ticks = 0;
+            new_level = cur_level - 1;
+        }
+    } else {
+        num_low_ticks = 0;
+    }
+
+    if (new_level == cur_level)
+        return;
+
+    level.store (new_level, std::memory_order_relaxed);
+    num_level_changes.fetch_add (1, std::memory_order_relaxed);
+
+    if (new_level > cur_level) {
+        logW_ (_func, "stream \"", name, "\" is behind by ", lag, " ms, "
+               "qos level: ", levelToString ((Level::Value) new_level));
+    } else {
+        logI_ (_func, "stream \"", name, "\": lag ", lag, " ms, "
+               "qos level: ", levelToString ((Level::Value) new_level));
+    }
+}
+
+void
+QosController::getStats (Stats * const mt_nonnull ret_stats)
+{
+    ret_stats->level                  = levelToString ((Level::Value) level.load (std::memory_order_relaxed));
+    ret_stats->lag_millisec           = last_lag.load (std::memory_order_relaxed);
+    ret_stats->max_lag_millisec       = max_lag.load (std::memory_order_relaxed);
+    ret_stats->num_qos_messages       = num_qos_messages.load (std::memory_order_relaxed);
+    ret_stats->nonref_frames_dropped  = nonref_frames_dropped.load (std::memory_order_relaxed);
+    ret_stats->encoder_frames_dropped = encoder_frames_dropped.load (std::memory_order_relaxed);
+    ret_stats->num_level_changes      = num_level_changes.load (std::memory_order_relaxed);
+}
+
+QosController::QosController ()
+    : can_reduce_frame_rate (false),
+      level (Level::Normal),
+      period_lag (0),
+      last_lag (0),
+      max_lag (0),
+      num_qos_messages (0),
+      nonref_frames_dropped (0),
+      encoder_frames_dropped (0),
+      num_level_changes (0),
+      got_min_offset (false),
+      min_offset_millisec (0),
+      encoder_frame_counter (0),
+      num_low_ticks (0)
+{
+}
+
+void
+QosTicker::tickTimer (void * const _self)
+{
+    QosTicker * const self = static_cast <QosTicker*> (_self);
+
+    // Streams are ticked without 'mutex' held: they may remove their entries
+    // concurrently.
+    List< Ref<Entry> > tmp_list;
+
+    self->mutex.lock ();
+    {
+        List< Ref<Entry> >::Element *el = self->entry_list.getFirstElement();
+        while (el) {
+            tmp_list.append (el->data);
+            el = el->next;
+        }
+    }
+    self->mutex.unlock ();
+
+    while (!tmp_list.isEmpty()) {
+        Entry * const entry = tmp_list.getFirst();
+        entry->frontend.call (entry->frontend->tick);
+        tmp_list.remove (tmp_list.getFirstElement());
+    }
+}
+
+Ref<QosTicker::Entry>
+QosTicker::addEntry (CbDesc<Frontend> const &frontend)
+{
+    Ref<Entry> const entry = grab (new (std::nothrow) Entry);
+    entry->frontend = frontend;
+
+    mutex.lock ();
+    entry->list_el = entry_list.append (entry);
+    mutex.unlock ();
+
+    return entry;
+}
+
+void
+QosTicker::removeEntry (Entry * const mt_nonnull entry)
+{
+    mutex.lock ();
+
+    if (!entry->list_el) {
+        mutex.unlock ();
+        return;
+    }
+
+    List< Ref<Entry> >::Element * const list_el = entry->list_el;
+    entry->list_el = NULL;
+    // May release the last reference to the entry, which the caller still holds.
+    entry_list.remove (list_el);
+
+    mutex.unlock ();
+}
+
+mt_const void
+QosTicker::init (Timers * const mt_nonnull timers)
+{
+    this->timers = timers;
+
+    mutex.lock ();
+    tick_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (tickTimer,
+                                                                  this /* cb_data */,
+                                                                  this /* coderef_container */),
+                                   1     /* time_seconds */,
+                                   true  /* periodical */,
+                                   false /* auto_delete */);
+    mutex.unlock ();
+}
+
+void
+QosTicker::release ()
+{
+    mutex.lock ();
+
+    if (tick_timer) {
+        timers->deleteTimer (tick_timer);
+        tick_timer = NULL;
+    }
+
+    // Entries are released after unlocking: their callbacks may hold
+    // the last references to their streams.
+    List< Ref<Entry> > tmp_list;
+    while (!entry_list.isEmpty()) {
+        Entry * const entry = entry_list.getFirst();
+        entry->list_el = NULL;
+        tmp_list.append (entry);
+        entry_list.remove (entry_list.getFirstElement());
+    }
+
+    mutex.unlock ();
+
+    while (!tmp_list.isEmpty())
+        tmp_list.remove (tmp_list.getFirstElement());
+}
+
+QosTicker::QosTicker ()
+    : timers (NULL),
+      tick_timer (NULL)
+{
+}
+
+QosTicker::~QosTicker ()
+{
+}
+
+}
+
@@ -0,0 +1,208 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__QOS_CONTROLLER__H__
+#define MOMENT_GST__QOS_CONTROLLER__H__
+
+
+#include <libmary/libmary.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Sheds load of a stream which falls behind real time.
+//
+// Lag is the delay of video frames against wall clock, relative to the
+// smallest delay seen so far, and the jitter of GST_MESSAGE_QOS messages.
+// Once a second, the worst lag of the last second is compared against the
+// thresholds. While the stream is behind and not catching up, the level is
+// raised by one step: first, non-reference frames are dropped, then raw
+// frames are dropped before the video encoders, halving and then quartering
+// the encoding frame rate. When lag stays low for 'recover_ticks' seconds,
+// the level is lowered by one step.
+class QosController
+{
+public:
+    struct Options
+    {
+        bool  enable;
+        Time  lag_threshold_millisec;
+        Time  recover_threshold_millisec;
+        Count recover_ticks;
+
+        Options ()
+            : enable (false),
+              lag_threshold_millisec     (500),
+              recover_threshold_millisec (100),
+              recover_ticks (3)
+        {}
+    };
+
+    struct Level
+    {
+        enum Value {
+            Normal,
+            DropNonReference,
+            HalfFrameRate,
+            QuarterFrameRate
+        };
+    };
+
+    static char const * levelToString (Level::Value level);
+
+    struct Stats
+    {
+        char const *level;
+        // Worst lag during the last second.
+        Time   lag_millisec;
+        Time   max_lag_millisec;
+        Uint64 num_qos_messages;
+        Uint64 nonref_frames_dropped;
+        Uint64 encoder_frames_dropped;
+        Uint64 num_level_changes;
+    };
+
+private:
+    mt_const Options opts;
+
+    // Streams without video encoders can only drop non-reference frames.
+    std::atomic<bool> can_reduce_frame_rate;
+
+    std::atomic<unsigned> level;
+
+    // Worst lag since the last tick.
+    std::atomic<Time> period_lag;
+    // Worst lag of the last complete period.
+    std::atomic<Time> last_lag;
+    std::atomic<Time> max_lag;
+
+    std::atomic<Uint64> num_qos_messages;
+    std::atomic<Uint64> nonref_frames_dropped;
+    std::atomic<Uint64> encoder_frames_dropped;
+    std::atomic<Uint64> num_level_changes;
+
+  // Accessed from the video streaming thread only.
+
+    bool  got_min_offset;
+    // Smallest difference between wall clock and frame timestamps.
+    Int64 min_offset_millisec;
+
+  // Accessed from the raw video streaming thread only.
+
+    Count encoder_frame_counter;
+
+  // Accessed from tick() only.
+
+    Count num_low_ticks;
+
+    void reportLag (Time lag_millisec);
+
+public:
+    bool isEnabled () const { return opts.enable; }
+
+    void setCanReduceFrameRate () { can_reduce_frame_rate.store (true, std::memory_order_relaxed); }
+
+    // Called for every video frame. A discontinuity restarts measurement.
+    void reportVideoFrame (Uint64 timestamp_nanosec,
+                           Time   cur_time_millisec,
+                           bool   discont);
+
+    // 'jitter' as in gst_message_parse_qos_values(), positive when late.
+    void reportQosMessage (Int64 jitter_nanosec);
+
+    bool shouldDropNonReferenceFrames () const
+        { return level.load (std::memory_order_relaxed) >= Level::DropNonReference; }
+
+    void nonReferenceFrameDropped ()
+        { nonref_frames_dropped.fetch_add (1, std::memory_order_relaxed); }
+
+    // Called for every raw frame which goes to the video encoders.
+    // Returns true if the frame should be dropped.
+    bool dropEncoderInputFrame ();
+
+    // Should be called once a second. 'name' is for logging.
+    void tick (ConstMemory name);
+
+    void getStats (Stats * mt_nonnull ret_stats);
+
+    mt_const void init (Options const &opts) { this->opts = opts; }
+
+    QosController ();
+};
+
+// Ticks QosController of every QoS-enabled stream of the module once
+// a second, with a single timer.
+class QosTicker : public Object
+{
+public:
+    struct Frontend
+    {
+        void (*tick) (void *cb_data);
+    };
+
+    class Entry : public Referenced
+    {
+        friend class QosTicker;
+
+    private:
+        mt_const Cb<Frontend> frontend;
+
+        mt_mutex (QosTicker::mutex) List< Ref<Entry> >::Element *list_el;
+
+    public:
+        Entry ()
+            : list_el (NULL)
+        {}
+    };
+
+private:
+    mt_const Timers *timers;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      List< Ref<Entry> > entry_list;
+      Timers::TimerKey tick_timer;
+    mt_end
+
+    static void tickTimer (void *_self);
+
+public:
+    Ref<Entry> addEntry (CbDesc<Frontend> const &frontend);
+
+    // May be called more than once.
+    void removeEntry (Entry * mt_nonnull entry);
+
+    mt_const void init (Timers * mt_nonnull timers);
+
+    void release ();
+
+     QosTicker ();
+    ~QosTicker ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__QOS_CONTROLLER__H__ */
+
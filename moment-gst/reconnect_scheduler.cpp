@@ -0,0 +1,411 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/coarse_clock.h>
+
+#include <moment-gst/reconnect_scheduler.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_reconnect ("mod_gst.reconnect", LogLevel::I);
+
+mt_mutex (mutex) Time
+ReconnectScheduler::randomizeDelay (Time const delay)
+{
+    Time const spread = delay * opts.jitter_percent / 100;
+    if (spread == 0)
+        return delay;
+
+    // Numerical Recipes LCG. Quality is not an issue here.
+    rand_state = rand_state * 1664525 + 1013904223;
+
+    Time const offs = (Time) (rand_state >> 8) % (2 * spread + 1);
+    if (delay + offs < spread)
+        return 0;
+
+    return delay + offs - spread;
+}
+
+mt_mutex (mutex) Time
+ReconnectScheduler::getDelay (Backoff * const mt_nonnull backoff)
+{
+    if (backoff->num_failures == 0)
+        return 0;
+
+    Time delay = opts.min_delay_millisec;
+    for (Count i = 1; i < backoff->num_failures && delay < opts.max_delay_millisec; ++i)
+        delay *= 2;
+
+    if (delay > opts.max_delay_millisec)
+        delay = opts.max_delay_millisec;
+
+    return randomizeDelay (delay);
+}
+
+mt_mutex (mutex) void
+ReconnectScheduler::expireStarts (Time const cur_time)
+{
+    while (!starting_list.isEmpty()) {
+        Ref<Request> const req = starting_list.getFirst();
+        if (cur_time < req->start_time + opts.start_timeout_millisec)
+            break;
+
+        logD (reconnect, _func, "channel \"", req->channel_name, "\": "
+              "start timed out, releasing the slot");
+
+        starting_list.remove (starting_list.getFirstElement());
+        req->list_el = NULL;
+        req->state = Request::State::Done;
+        assert (num_starting > 0);
+        --num_starting;
+    }
+}
+
+mt_mutex (mutex) void
+ReconnectScheduler::grantStarts (Time                                     const cur_time,
+                                 List< Ref<PipelineControlPool::Task> > * const mt_nonnull ret_task_list)
+{
+    List< Ref<Request> >::Element *el = wait_list.getFirstElement();
+    while (el) {
+        if (opts.max_concurrent_starts > 0 && num_starting >= opts.max_concurrent_starts)
+            break;
+
+        List< Ref<Request> >::Element * const next_el = el->next;
+
+        Ref<Request> const req = el->data;
+        if (req->due_time <= cur_time) {
+            wait_list.remove (el);
+            req->state = Request::State::Starting;
+            req->start_time = cur_time;
+            // Start times are non-decreasing, hence expireStarts() only
+            // needs to look at the head of the list.
+            req->list_el = starting_list.append (req);
+            ++num_starting;
+
+            logD (reconnect, _func, "starting \"", req->channel_name, "\", "
+                  "num_starting: ", num_starting);
+
+            ret_task_list->append (req->task);
+        }
+
+        el = next_el;
+    }
+}
+
+void
+ReconnectScheduler::scheduleTasks (List< Ref<PipelineControlPool::Task> > * const mt_nonnull task_list)
+{
+    while (!task_list->isEmpty()) {
+        pipeline_pool->schedule (task_list->getFirst());
+        task_list->remove (task_list->getFirstElement());
+    }
+}
+
+void
+ReconnectScheduler::tickTimer (void * const _self)
+{
+    ReconnectScheduler * const self = static_cast <ReconnectScheduler*> (_self);
+
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    List< Ref<PipelineControlPool::Task> > task_list;
+
+    self->mutex.lock ();
+    self->expireStarts (cur_time);
+    self->grantStarts (cur_time, &task_list);
+    self->mutex.unlock ();
+
+    self->scheduleTasks (&task_list);
+}
+
+Ref<ReconnectScheduler::Request>
+ReconnectScheduler::requestStart (ConstMemory                 const channel_name,
+                                  PipelineControlPool::Task * const mt_nonnull task)
+{
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    Ref<Request> const req = grab (new (std::nothrow) Request);
+    req->task = task;
+
+    List< Ref<PipelineControlPool::Task> > task_list;
+
+    mutex.lock ();
+
+    Backoff *backoff = backoff_hash.lookup (channel_name);
+    if (!backoff) {
+        backoff = new (std::nothrow) Backoff;
+        assert (backoff);
+        backoff->channel_name = grab (new (std::nothrow) String (channel_name));
+        backoff_hash.add (backoff);
+    }
+
+    req->channel_name = backoff->channel_name;
+
+    Time const delay = getDelay (backoff);
+    backoff->last_delay = delay;
+    ++backoff->num_starts;
+
+    if (delay > 0) {
+        logD (reconnect, _func, "channel \"", channel_name, "\": "
+              "failures: ", backoff->num_failures, ", delay: ", delay, " ms");
+    }
+
+    req->due_time = cur_time + delay;
+    req->list_el = wait_list.append (req);
+
+    grantStarts (cur_time, &task_list);
+
+    mutex.unlock ();
+
+    scheduleTasks (&task_list);
+
+    return req;
+}
+
+void
+ReconnectScheduler::startDone (Request * const mt_nonnull req)
+{
+    mutex.lock ();
+
+    switch (req->state) {
+        case Request::State::Waiting:
+            wait_list.remove (req->list_el);
+            break;
+        case Request::State::Starting:
+            starting_list.remove (req->list_el);
+            assert (num_starting > 0);
+            --num_starting;
+            break;
+        case Request::State::Done:
+            mutex.unlock ();
+            return;
+    }
+
+    req->list_el = NULL;
+    req->state = Request::State::Done;
+
+    List< Ref<PipelineControlPool::Task> > task_list;
+    grantStarts (getCoarseTimeMilliseconds (), &task_list);
+
+    mutex.unlock ();
+
+    scheduleTasks (&task_list);
+}
+
+void
+ReconnectScheduler::streamFailed (Request * const mt_nonnull req,
+                                  Time      const uptime_millisec,
+                                  bool      const is_eos)
+{
+    mutex.lock ();
+
+    if (req->outcome_reported) {
+        mutex.unlock ();
+        return;
+    }
+    req->outcome_reported = true;
+
+    Backoff * const backoff = backoff_hash.lookup (req->channel_name->mem());
+    if (!backoff) {
+      // The channel has been removed.
+        mutex.unlock ();
+        return;
+    }
+
+    if (uptime_millisec > 0 && is_eos) {
+      // End of a finite stream.
+        backoff->num_failures = 0;
+    } else
+    if (uptime_millisec >= opts.reset_time_millisec) {
+        backoff->num_failures = 1;
+    } else {
+        ++backoff->num_failures;
+    }
+
+    logD (reconnect, _func, "channel \"", backoff->channel_name, "\": "
+          "uptime: ", uptime_millisec, " ms, failures: ", backoff->num_failures);
+
+    mutex.unlock ();
+}
+
+void
+ReconnectScheduler::streamSucceeded (Request * const mt_nonnull req)
+{
+    mutex.lock ();
+
+    if (!req->outcome_reported) {
+        req->outcome_reported = true;
+        if (Backoff * const backoff = backoff_hash.lookup (req->channel_name->mem()))
+            backoff->num_failures = 0;
+    }
+
+    mutex.unlock ();
+}
+
+void
+ReconnectScheduler::removeChannel (ConstMemory const channel_name)
+{
+    mutex.lock ();
+
+    if (Backoff * const backoff = backoff_hash.lookup (channel_name)) {
+        backoff_hash.remove (backoff);
+        delete backoff;
+    }
+
+    mutex.unlock ();
+}
+
+bool
+ReconnectScheduler::getBackoffInfo (ConstMemory   const channel_name,
+                                    BackoffInfo * const mt_nonnull ret_info)
+{
+    Time const cur_time = getCoarseTimeMilliseconds ();
+
+    mutex.lock ();
+
+    Backoff * const backoff = backoff_hash.lookup (channel_name);
+    if (!backoff) {
+        mutex.unlock ();
+        return false;
+    }
+
+    ret_info->num_failures = backoff->num_failures;
+    ret_info->num_starts   = backoff->num_starts;
+    ret_info->last_delay   = backoff->last_delay;
+    ret_info->wait_time    = 0;
+    ret_info->waiting      = false;
+
+    List< Ref<Request> >::Element *el = wait_list.getFirstElement();
+    while (el) {
+        if (equal (el->data->channel_name->mem(), channel_name)) {
+            ret_info->waiting = true;
+            if (el->data->due_time > cur_time)
+                ret_info->wait_time = el->data->due_time - cur_time;
+            break;
+        }
+
+        el = el->next;
+    }
+
+    mutex.unlock ();
+
+    return true;
+}
+
+void
+ReconnectScheduler::getStartStats (Count * const mt_nonnull ret_num_starting,
+                                   Count * const mt_nonnull ret_num_waiting)
+{
+    mutex.lock ();
+
+    *ret_num_starting = num_starting;
+
+    Count num_waiting = 0;
+    List< Ref<Request> >::Element *el = wait_list.getFirstElement();
+    while (el) {
+        ++num_waiting;
+        el = el->next;
+    }
+    *ret_num_waiting = num_waiting;
+
+    mutex.unlock ();
+}
+
+mt_const void
+ReconnectScheduler::init (Options const       &opts,
+                          PipelineControlPool * const mt_nonnull pipeline_pool,
+                          Timers              * const mt_nonnull timers)
+{
+    this->opts = opts;
+    if (this->opts.min_delay_millisec == 0)
+        this->opts.min_delay_millisec = 1;
+    if (this->opts.max_delay_millisec < this->opts.min_delay_millisec)
+        this->opts.max_delay_millisec = this->opts.min_delay_millisec;
+    if (this->opts.start_timeout_millisec == 0)
+        this->opts.start_timeout_millisec = 1;
+    if (this->opts.jitter_percent > 100)
+        this->opts.jitter_percent = 100;
+
+    this->pipeline_pool = pipeline_pool;
+    this->timers = timers;
+
+    rand_state = (Uint32) getCoarseTimeMilliseconds () ^ (Uint32) (UintPtr) this;
+
+    // Delayed starts are granted with one second precision. Starts which
+    // wait for a free slot only are granted as soon as the slot is freed.
+    tick_timer = timers->addTimer (CbDesc<Timers::TimerCallback> (tickTimer,
+                                                                  this /* cb_data */,
+                                                                  this /* coderef_container */),
+                                   1     /* time_seconds */,
+                                   true  /* periodical */,
+                                   false /* auto_delete */);
+}
+
+void
+ReconnectScheduler::release ()
+{
+    mutex.lock ();
+
+    if (tick_timer) {
+        timers->deleteTimer (tick_timer);
+        tick_timer = NULL;
+    }
+
+    while (!wait_list.isEmpty()) {
+        wait_list.getFirst()->list_el = NULL;
+        wait_list.getFirst()->state = Request::State::Done;
+        wait_list.remove (wait_list.getFirstElement());
+    }
+
+    while (!starting_list.isEmpty()) {
+        starting_list.getFirst()->list_el = NULL;
+        starting_list.getFirst()->state = Request::State::Done;
+        starting_list.remove (starting_list.getFirstElement());
+    }
+    num_starting = 0;
+
+    mutex.unlock ();
+}
+
+ReconnectScheduler::ReconnectScheduler ()
+    : timers (NULL),
+      num_starting (0),
+      rand_state (1),
+      tick_timer (NULL)
+{
+}
+
+ReconnectScheduler::~ReconnectScheduler ()
+{
+    mutex.lock ();
+
+    BackoffHash::iter iter (backoff_hash);
+    while (!backoff_hash.iter_done (iter)) {
+        Backoff * const backoff = backoff_hash.iter_next (iter);
+        delete backoff;
+    }
+
+    mutex.unlock ();
+}
+
+}
+
@@ -0,0 +1,231 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__RECONNECT_SCHEDULER__H__
+#define MOMENT_GST__RECONNECT_SCHEDULER__H__
+
+
+#include <libmary/libmary.h>
+
+#include <moment-gst/pipeline_pool.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Decides when pipelines of restarting streams may be created.
+//
+// Every restart of a channel creates a new GstStream, so backoff state is
+// kept here per channel name. After a failure, the next pipeline of the
+// channel is created with a delay which doubles with every consecutive
+// failure, randomized by 'jitter_percent' so that streams which failed
+// together do not come back together. Independently of that, no more than
+// 'max_concurrent_starts' pipelines are being started at any moment.
+class ReconnectScheduler : public Object
+{
+public:
+    struct Options
+    {
+        Time  min_delay_millisec;
+        Time  max_delay_millisec;
+        Uint32 jitter_percent;
+        // A stream which has been delivering frames for this long is
+        // considered healthy, and its failure is counted as the first one.
+        Time  reset_time_millisec;
+        // 0 means no limit.
+        Count max_concurrent_starts;
+        // A pipeline which hangs in preroll gives up its start slot after
+        // this long, so that it doesn't hold up other streams.
+        Time  start_timeout_millisec;
+
+        Options ()
+            : min_delay_millisec    (1000),
+              max_delay_millisec    (30000),
+              jitter_percent        (50),
+              reset_time_millisec   (30000),
+              max_concurrent_starts (16),
+              start_timeout_millisec (10000)
+        {}
+    };
+
+    struct BackoffInfo
+    {
+        Count num_failures;
+        Count num_starts;
+        // Delay chosen for the last start, jitter included.
+        Time  last_delay;
+        // Time left until the pending start is due, 0 if not waiting.
+        Time  wait_time;
+        bool  waiting;
+    };
+
+private:
+    class Backoff : public HashEntry<>
+    {
+    public:
+        mt_const Ref<String> channel_name;
+
+        mt_mutex (ReconnectScheduler::mutex)
+        mt_begin
+          Count num_failures;
+          Count num_starts;
+          Time  last_delay;
+        mt_end
+
+        Backoff ()
+            : num_failures (0),
+              num_starts   (0),
+              last_delay   (0)
+        {}
+    };
+
+    typedef Hash< Backoff,
+                  Memory,
+                  MemberExtractor< Backoff,
+                                   Ref<String>,
+                                   &Backoff::channel_name,
+                                   Memory,
+                                   AccessorExtractor< String,
+                                                      Memory,
+                                                      &String::mem > >,
+                  MemoryComparator<> >
+            BackoffHash;
+
+public:
+    class Request : public Referenced
+    {
+        friend class ReconnectScheduler;
+
+    private:
+        struct State
+        {
+            enum Value {
+                Waiting,
+                Starting,
+                Done
+            };
+        };
+
+        // Backoff state is looked up by name: it is dropped when the channel
+        // is removed, while the request may live on with its stream.
+        mt_const Ref<String> channel_name;
+        mt_const Ref<PipelineControlPool::Task> task;
+
+        mt_mutex (ReconnectScheduler::mutex)
+        mt_begin
+          State::Value state;
+          Time due_time;
+          Time start_time;
+          // Element of 'wait_list' or 'starting_list', depending on 'state'.
+          List< Ref<Request> >::Element *list_el;
+          // Set once the outcome of the start has been accounted for.
+          bool outcome_reported;
+        mt_end
+
+    public:
+        Request ()
+            : state (State::Waiting),
+              due_time (0),
+              start_time (0),
+              list_el (NULL),
+              outcome_reported (false)
+        {}
+    };
+
+private:
+    mt_const Options opts;
+    mt_const Ref<PipelineControlPool> pipeline_pool;
+    mt_const Timers *timers;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex)
+    mt_begin
+      BackoffHash backoff_hash;
+      // In order of requestStart() calls.
+      List< Ref<Request> > wait_list;
+      List< Ref<Request> > starting_list;
+      Count num_starting;
+      Uint32 rand_state;
+      Timers::TimerKey tick_timer;
+    mt_end
+
+    mt_mutex (mutex) Time randomizeDelay (Time delay);
+
+    mt_mutex (mutex) Time getDelay (Backoff * mt_nonnull backoff);
+
+    mt_mutex (mutex) void expireStarts (Time cur_time);
+
+    // Tasks of granted requests are returned in 'ret_task_list', to be
+    // scheduled with scheduleTasks() after unlocking 'mutex'.
+    mt_mutex (mutex) void grantStarts (Time                                     cur_time,
+                                       List< Ref<PipelineControlPool::Task> > * mt_nonnull ret_task_list);
+
+    void scheduleTasks (List< Ref<PipelineControlPool::Task> > * mt_nonnull task_list);
+
+    static void tickTimer (void *_self);
+
+public:
+    // Queues creation of the pipeline which 'task' processes. The task is
+    // scheduled on the pipeline pool once the channel's backoff delay has
+    // passed and there is a free start slot.
+    Ref<Request> requestStart (ConstMemory                    channel_name,
+                               PipelineControlPool::Task * mt_nonnull task);
+
+    // Frees the start slot taken by the request, or cancels the request if
+    // it is still waiting. Should be called when the pipeline is up, or
+    // when it's being released. May be called more than once.
+    void startDone (Request * mt_nonnull req);
+
+    // 'uptime' is for how long the stream has been delivering frames,
+    // 0 if there was no frames at all.
+    void streamFailed (Request * mt_nonnull req,
+                       Time     uptime_millisec,
+                       bool     is_eos);
+
+    // The stream has been delivering frames and is being stopped normally.
+    void streamSucceeded (Request * mt_nonnull req);
+
+    // Forgets backoff state of a channel which has been removed.
+    void removeChannel (ConstMemory channel_name);
+
+    bool getBackoffInfo (ConstMemory  channel_name,
+                         BackoffInfo * mt_nonnull ret_info);
+
+    void getStartStats (Count * mt_nonnull ret_num_starting,
+                        Count * mt_nonnull ret_num_waiting);
+
+    Options const & getOptions () const { return opts; }
+
+    mt_const void init (Options const        &opts,
+                        PipelineControlPool * mt_nonnull pipeline_pool,
+                        Timers              * mt_nonnull timers);
+
+    void release ();
+
+     ReconnectScheduler ();
+    ~ReconnectScheduler ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__RECONNECT_SCHEDULER__H__ */
+
@@ -0,0 +1,119 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/rendition_set.h>
+
+
+using namespace M;
+using namespace Moment;
+
+namespace MomentGst {
+
+void
+RenditionSet::publish (MomentServer * const mt_nonnull moment)
+{
+    mutex.lock ();
+    if (published) {
+        mutex.unlock ();
+        return;
+    }
+    published = true;
+    this->moment = moment;
+
+    for (Count i = 0; i < num_renditions; ++i) {
+        Rendition * const rendition = &renditions [i];
+        logD_ (_func, "publishing \"", rendition->stream_name, "\"");
+        rendition->video_stream_key = moment->addVideoStream (rendition->video_stream,
+                                                              rendition->stream_name->mem());
+    }
+    mutex.unlock ();
+}
+
+void
+RenditionSet::release ()
+{
+    mutex.lock ();
+    if (!published) {
+        mutex.unlock ();
+        return;
+    }
+    published = false;
+
+    for (Count i = 0; i < num_renditions; ++i) {
+        Rendition * const rendition = &renditions [i];
+        if (rendition->video_stream_key) {
+            moment->removeVideoStream (rendition->video_stream_key);
+            rendition->video_stream_key = NULL;
+        }
+    }
+    mutex.unlock ();
+}
+
+mt_const void
+RenditionSet::init (ConstMemory                       const channel_name,
+                    List< Ref<TranscodeProfile> >   * const mt_nonnull profile_list,
+                    Uint32                            const gop_size)
+{
+    this->gop_size = gop_size;
+
+    num_renditions = 0;
+    {
+        List< Ref<TranscodeProfile> >::Element *el = profile_list->getFirstElement();
+        while (el) {
+            ++num_renditions;
+            el = el->next;
+        }
+    }
+
+    if (num_renditions == 0)
+        return;
+
+    renditions = new (std::nothrow) Rendition [num_renditions];
+    assert (renditions);
+
+    Count i = 0;
+    List< Ref<TranscodeProfile> >::Element *el = profile_list->getFirstElement();
+    while (el) {
+        Rendition * const rendition = &renditions [i];
+        rendition->profile = el->data;
+        rendition->stream_name = makeString (channel_name, "_", el->data->name->mem());
+        rendition->video_stream = grab (new (std::nothrow) VideoStream);
+
+        ++i;
+        el = el->next;
+    }
+}
+
+RenditionSet::RenditionSet ()
+    : renditions (NULL),
+      num_renditions (0),
+      gop_size (0),
+      moment (NULL),
+      published (false)
+{
+}
+
+RenditionSet::~RenditionSet ()
+{
+    release ();
+    delete[] renditions;
+}
+
+}
+
@@ -0,0 +1,108 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__RENDITION_SET__H__
+#define MOMENT_GST__RENDITION_SET__H__
+
+
+#include <libmary/libmary.h>
+
+#include <moment/libmoment.h>
+
+#include <moment-gst/transcode_profile.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+using namespace Moment;
+
+// Additional encodings of a channel's raw video ("renditions" stream option).
+// The source is decoded once, and the decoded frames are teed to an encoder
+// per rendition. Each rendition is published as a separate video stream named
+// "<channel>_<profile>", with audio of the main stream.
+//
+// All encoders are fed with the same frames and place keyframes every
+// 'gop_size' frames, hence keyframes are aligned across renditions and
+// clients may switch between them at any keyframe.
+class RenditionSet : public Referenced
+{
+public:
+    class Rendition
+    {
+    public:
+        mt_const Ref<TranscodeProfile> profile;
+        mt_const Ref<String> stream_name;
+        mt_const Ref<VideoStream> video_stream;
+
+        Rendition ()
+            : video_stream_key (NULL)
+        {}
+
+    private:
+        friend class RenditionSet;
+
+        mt_mutex (RenditionSet::mutex) MomentServer::VideoStreamKey video_stream_key;
+    };
+
+private:
+    StateMutex mutex;
+
+    mt_const Rendition *renditions;
+    mt_const Count num_renditions;
+    mt_const Uint32 gop_size;
+
+    mt_mutex (mutex)
+    mt_begin
+      MomentServer *moment;
+      bool published;
+    mt_end
+
+public:
+    Count getNumRenditions () const { return num_renditions; }
+
+    Rendition* getRendition (Count const idx) const
+    {
+        assert (idx < num_renditions);
+        return &renditions [idx];
+    }
+
+    Uint32 getGopSize () const { return gop_size; }
+
+    // Makes the renditions' video streams visible to clients.
+    void publish (MomentServer * mt_nonnull moment);
+
+    // Removes the video streams from 'moment'. Streams which still deliver
+    // to them are not affected. May be called more than once.
+    void release ();
+
+    // 'gop_size' is the main stream's keyframe interval.
+    mt_const void init (ConstMemory                       channel_name,
+                        List< Ref<TranscodeProfile> > * mt_nonnull profile_list,
+                        Uint32                            gop_size);
+
+     RenditionSet ();
+    ~RenditionSet ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__RENDITION_SET__H__ */
+
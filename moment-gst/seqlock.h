@@ -0,0 +1,79 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__SEQLOCK__H__
+#define MOMENT_GST__SEQLOCK__H__
+
+
+#include <libmary/types.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// A small POD-like value published by a rare writer and read on every frame.
+// Readers never block and never take a lock: they retry if they raced with
+// a writer. Writers must be serialized externally.
+template <class T>
+class Seqlock
+{
+private:
+    std::atomic<Uint32> seq;
+    T data;
+
+public:
+    mt_mutex (external) void store (T const &new_data)
+    {
+        Uint32 const s = seq.load (std::memory_order_relaxed);
+        seq.store (s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        data = new_data;
+
+        seq.store (s + 2, std::memory_order_release);
+    }
+
+    T load () const
+    {
+        for (;;) {
+            Uint32 const s0 = seq.load (std::memory_order_acquire);
+            if (s0 & 1)
+                continue;
+
+            T const tmp = data;
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+            if (seq.load (std::memory_order_relaxed) == s0)
+                return tmp;
+        }
+    }
+
+    Seqlock (T const &initial_data)
+        : seq  (0),
+          data (initial_data)
+    {}
+};
+
+}
+
+
+#endif /* MOMENT_GST__SEQLOCK__H__ */
+
@@ -0,0 +1,590 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/source_registry.h>
+
+
+using namespace M;
+using namespace Moment;
+
+namespace MomentGst {
+
+static LogGroup libMary_logGroup_sources ("mod_gst.sources", LogLevel::I);
+
+MediaSource::Frontend const SourceRegistry::gst_stream_frontend = {
+    sourceError,
+    sourceEos,
+    sourceNoVideo,
+    sourceGotVideo
+};
+
+VideoStream::EventHandler const SourceRegistry::source_stream_handler = {
+    sourceAudioMessage,
+    sourceVideoMessage,
+    NULL /* rtmpCommandMessage */,
+    NULL /* closed */,
+    NULL /* numWatchersChanged */
+};
+
+void
+SourceRegistry::fireAudioCodecData (Source * const mt_nonnull source,
+                                    Output * const mt_nonnull output)
+{
+    source->mutex.lock ();
+    if (!source->got_audio_codec_data) {
+        source->mutex.unlock ();
+        return;
+    }
+    VideoStream::AudioMessage msg = source->audio_codec_data;
+    msg.page_pool->msgRef (msg.page_list.first);
+    source->mutex.unlock ();
+
+    output->video_stream->fireAudioMessage (&msg);
+    msg.page_pool->msgUnref (msg.page_list.first);
+}
+
+void
+SourceRegistry::fireVideoCodecData (Source * const mt_nonnull source,
+                                    Output * const mt_nonnull output)
+{
+    source->mutex.lock ();
+    if (!source->got_video_codec_data) {
+        source->mutex.unlock ();
+        return;
+    }
+    VideoStream::VideoMessage msg = source->video_codec_data;
+    msg.page_pool->msgRef (msg.page_list.first);
+    source->mutex.unlock ();
+
+    output->video_stream->fireVideoMessage (&msg);
+    msg.page_pool->msgUnref (msg.page_list.first);
+}
+
+void
+SourceRegistry::sourceAudioMessage (VideoStream::AudioMessage * const mt_nonnull msg,
+                                    void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+
+    bool const codec_data = (msg->frame_type != VideoStream::AudioFrameType::RawData);
+
+    source->mutex.lock ();
+
+    if (codec_data) {
+        if (source->got_audio_codec_data)
+            source->audio_codec_data.page_pool->msgUnref (source->audio_codec_data.page_list.first);
+
+        source->audio_codec_data = *msg;
+        msg->page_pool->msgRef (msg->page_list.first);
+        source->got_audio_codec_data = true;
+    }
+
+    Ref<OutputList> const output_list = source->output_list;
+
+    source->mutex.unlock ();
+
+    List< Ref<Output> >::Element *el = output_list->list.getFirstElement();
+    while (el) {
+        Output * const output = el->data;
+        el = el->next;
+
+        if (output->audio_codec_data_pending) {
+            output->audio_codec_data_pending = false;
+            if (!codec_data)
+                fireAudioCodecData (source, output);
+        }
+
+        output->video_stream->fireAudioMessage (msg);
+    }
+}
+
+void
+SourceRegistry::sourceVideoMessage (VideoStream::VideoMessage * const mt_nonnull msg,
+                                    void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+
+    bool const codec_data = (msg->frame_type == VideoStream::VideoFrameType::AvcSequenceHeader);
+
+    source->mutex.lock ();
+
+    if (codec_data) {
+        if (source->got_video_codec_data)
+            source->video_codec_data.page_pool->msgUnref (source->video_codec_data.page_list.first);
+
+        source->video_codec_data = *msg;
+        msg->page_pool->msgRef (msg->page_list.first);
+        source->got_video_codec_data = true;
+    }
+
+    Ref<OutputList> const output_list = source->output_list;
+
+    source->mutex.unlock ();
+
+    List< Ref<Output> >::Element *el = output_list->list.getFirstElement();
+    while (el) {
+        Output * const output = el->data;
+        el = el->next;
+
+        if (output->video_codec_data_pending) {
+            output->video_codec_data_pending = false;
+            if (!codec_data)
+                fireVideoCodecData (source, output);
+        }
+
+        if (msg->frame_type == VideoStream::VideoFrameType::KeyFrame) {
+            output->got_keyframe = true;
+        } else
+        if (msg->frame_type == VideoStream::VideoFrameType::InterFrame
+            && !output->got_keyframe)
+        {
+            continue;
+        }
+
+        output->video_stream->fireVideoMessage (msg);
+    }
+}
+
+void
+SourceRegistry::fireSourceEvent (Source             * const mt_nonnull source,
+                                 SourceEvent::Value   const event)
+{
+    mutex.lock ();
+
+    if ((event == SourceEvent::Eos || event == SourceEvent::Error)
+        && !source->closed)
+    {
+        logD (sources, _func, "closing source \"", source->source_key, "\"");
+        closeSource (source);
+    }
+
+    source->mutex.lock ();
+    Ref<OutputList> const output_list = source->output_list;
+    source->mutex.unlock ();
+
+    mutex.unlock ();
+
+    List< Ref<Output> >::Element *el = output_list->list.getFirstElement();
+    while (el) {
+        Cb<MediaSource::Frontend> &frontend = el->data->frontend;
+        el = el->next;
+
+        if (frontend) {
+            switch (event) {
+                case SourceEvent::Eos:
+                    frontend.call (frontend->eos);
+                    break;
+                case SourceEvent::Error:
+                    frontend.call (frontend->error);
+                    break;
+                case SourceEvent::NoVideo:
+                    frontend.call (frontend->noVideo);
+                    break;
+                case SourceEvent::GotVideo:
+                    frontend.call (frontend->gotVideo);
+                    break;
+            }
+        }
+    }
+}
+
+void
+SourceRegistry::sourceEos (void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+    source->registry->fireSourceEvent (source, SourceEvent::Eos);
+}
+
+void
+SourceRegistry::sourceError (void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+    source->registry->fireSourceEvent (source, SourceEvent::Error);
+}
+
+void
+SourceRegistry::sourceNoVideo (void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+    source->registry->fireSourceEvent (source, SourceEvent::NoVideo);
+}
+
+void
+SourceRegistry::sourceGotVideo (void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+    source->registry->fireSourceEvent (source, SourceEvent::GotVideo);
+}
+
+bool
+SourceRegistry::sourceErrorTask (void * const _source)
+{
+    Source * const source = static_cast <Source*> (_source);
+    source->registry->fireSourceEvent (source, SourceEvent::Error);
+    return false /* do not reschedule */;
+}
+
+mt_mutex (mutex) void
+SourceRegistry::closeSource (Source * const mt_nonnull source)
+{
+    assert (!source->closed);
+    source->closed = true;
+    source_hash.remove (source);
+}
+
+void
+SourceRegistry::subscribe (Subscriber * const mt_nonnull subscriber)
+{
+    mutex.lock ();
+
+    if (subscriber->source) {
+        mutex.unlock ();
+        return;
+    }
+
+    bool new_source = false;
+    Ref<Source> source = source_hash.lookup (subscriber->source_key->mem());
+    if (!source) {
+        source = grab (new (std::nothrow) Source);
+        source->registry = this;
+        source->source_key = grab (new (std::nothrow) String (subscriber->source_key->mem()));
+        source->video_stream = grab (new (std::nothrow) VideoStream);
+        source->video_stream->getEventInformer()->subscribe (
+                CbDesc<VideoStream::EventHandler> (&source_stream_handler,
+                                                   source /* cb_data */,
+                                                   source /* coderef_container */));
+
+        source->error_task.cb = CbDesc<DeferredProcessor::TaskCallback> (sourceErrorTask, source, source);
+        source->deferred_reg.setDeferredProcessor (subscriber->deferred_processor);
+
+        source_hash.add (source);
+        new_source = true;
+
+        logD (sources, _func, "new source \"", source->source_key, "\" "
+              "for channel \"", subscriber->channel_opts->channel_name, "\"");
+    } else {
+        logD (sources, _func, "channel \"", subscriber->channel_opts->channel_name, "\" "
+              "joins source \"", source->source_key, "\"");
+    }
+
+    ++source->num_subscribers;
+    subscriber->source = source;
+
+    source->mutex.lock ();
+    {
+        Ref<OutputList> const output_list = grab (new (std::nothrow) OutputList);
+
+        List< Ref<Output> >::Element *el = source->output_list->list.getFirstElement();
+        while (el) {
+            output_list->list.append (el->data);
+            el = el->next;
+        }
+        output_list->list.append (subscriber->output);
+
+        source->output_list = output_list;
+    }
+    source->mutex.unlock ();
+
+    mutex.unlock ();
+
+    if (!new_source)
+        return;
+
+    // Subscribers which join while the stream is being created wait for it
+    // along with this one.
+    Ref<GstStream> gst_stream;
+    if (!frontend.call_ret< Ref<GstStream> > (&gst_stream,
+                                              frontend->createStream,
+                                              /*(*/ source->source_key->mem(),
+                                                    CbDesc<MediaSource::Frontend> (&gst_stream_frontend,
+                                                                                   source /* cb_data */,
+                                                                                   source /* coderef_container */),
+                                                    subscriber->timers,
+                                                    subscriber->deferred_processor,
+                                                    subscriber->page_pool,
+                                                    source->video_stream,
+                                                    subscriber->channel_opts,
+                                                    subscriber->playback_item /*)*/)
+        || !gst_stream)
+    {
+        logE_ (_func, "could not create a stream for source \"", source->source_key, "\"");
+        // Not calling the subscribers back from their createPipeline().
+        source->deferred_reg.scheduleTask (&source->error_task, false /* permanent */);
+        return;
+    }
+
+    mutex.lock ();
+    if (source->num_subscribers == 0) {
+      // Every subscriber has left while the stream was being created.
+        mutex.unlock ();
+        gst_stream->releasePipeline ();
+        return;
+    }
+    source->gst_stream = gst_stream;
+    mutex.unlock ();
+
+    gst_stream->createPipeline ();
+}
+
+void
+SourceRegistry::unsubscribe (Subscriber * const mt_nonnull subscriber)
+{
+    Ref<GstStream> gst_stream;
+
+    mutex.lock ();
+
+    Ref<Source> const source = subscriber->source;
+    if (!source) {
+        mutex.unlock ();
+        return;
+    }
+    subscriber->source = NULL;
+
+    source->mutex.lock ();
+    {
+        Ref<OutputList> const output_list = grab (new (std::nothrow) OutputList);
+
+        List< Ref<Output> >::Element *el = source->output_list->list.getFirstElement();
+        while (el) {
+            if (el->data.ptr() != subscriber->output.ptr())
+                output_list->list.append (el->data);
+
+            el = el->next;
+        }
+
+        source->output_list = output_list;
+    }
+    source->mutex.unlock ();
+
+    assert (source->num_subscribers > 0);
+    --source->num_subscribers;
+    if (source->num_subscribers == 0) {
+        if (!source->closed)
+            closeSource (source);
+
+        gst_stream = source->gst_stream;
+        source->gst_stream = NULL;
+    }
+
+    mutex.unlock ();
+
+    if (gst_stream) {
+        logD (sources, _func, "releasing source \"", source->source_key, "\"");
+        gst_stream->releasePipeline ();
+    }
+}
+
+void
+SourceRegistry::Subscriber::createPipeline ()
+{
+    registry->subscribe (this);
+}
+
+void
+SourceRegistry::Subscriber::releasePipeline ()
+{
+    registry->unsubscribe (this);
+}
+
+void
+SourceRegistry::Subscriber::getTrafficStats (TrafficStats * const mt_nonnull ret_traffic_stats)
+{
+    registry->mutex.lock ();
+    Ref<GstStream> const gst_stream = (source ? source->gst_stream : NULL);
+    registry->mutex.unlock ();
+
+    if (!gst_stream) {
+        ret_traffic_stats->rx_bytes = 0;
+        ret_traffic_stats->rx_audio_bytes = 0;
+        ret_traffic_stats->rx_video_bytes = 0;
+        return;
+    }
+
+    // Traffic of the shared pipeline.
+    gst_stream->getTrafficStats (ret_traffic_stats);
+}
+
+void
+SourceRegistry::Subscriber::resetTrafficStats ()
+{
+  // Other subscribers of the source rely on its counters.
+}
+
+SourceRegistry::Subscriber::Subscriber ()
+    : timers (NULL),
+      deferred_processor (NULL),
+      page_pool (NULL)
+{
+}
+
+SourceRegistry::Subscriber::~Subscriber ()
+{
+    if (registry)
+        registry->unsubscribe (this);
+}
+
+SourceRegistry::Source::~Source ()
+{
+    mutex.lock ();
+
+    if (got_audio_codec_data)
+        audio_codec_data.page_pool->msgUnref (audio_codec_data.page_list.first);
+
+    if (got_video_codec_data)
+        video_codec_data.page_pool->msgUnref (video_codec_data.page_list.first);
+
+    mutex.unlock ();
+
+    deferred_reg.release ();
+}
+
+StRef<String>
+SourceRegistry::normalizeUri (ConstMemory const uri)
+{
+    Byte const * const uri_buf = uri.mem();
+
+    Size scheme_len = 0;
+    while (scheme_len < uri.len() && uri_buf [scheme_len] != ':')
+        ++scheme_len;
+
+    if (scheme_len + 3 > uri.len()
+        || uri_buf [scheme_len + 1] != '/'
+        || uri_buf [scheme_len + 2] != '/')
+    {
+      // Not a hierarchical URI.
+        return st_grab (new (std::nothrow) String (uri));
+    }
+
+    Size const authority_begin = scheme_len + 3;
+    Size authority_end = authority_begin;
+    while (authority_end < uri.len()
+           && uri_buf [authority_end] != '/'
+           && uri_buf [authority_end] != '?'
+           && uri_buf [authority_end] != '#')
+    {
+        ++authority_end;
+    }
+
+    // User info is case-sensitive.
+    Size host_begin = authority_begin;
+    for (Size i = authority_begin; i < authority_end; ++i) {
+        if (uri_buf [i] == '@')
+            host_begin = i + 1;
+    }
+
+    StRef<String> const str = st_grab (new (std::nothrow) String (uri));
+    Byte * const buf = str->mem().mem();
+
+    for (Size i = 0; i < authority_end; ++i) {
+        if (i >= scheme_len && i < host_begin)
+            continue;
+
+        if (buf [i] >= 'A' && buf [i] <= 'Z')
+            buf [i] += 'a' - 'A';
+    }
+
+    ConstMemory const scheme (buf, scheme_len);
+    ConstMemory default_port;
+    if (equal (scheme, "rtsp"))
+        default_port = ":554";
+    else
+    if (equal (scheme, "http"))
+        default_port = ":80";
+    else
+    if (equal (scheme, "https"))
+        default_port = ":443";
+    else
+    if (equal (scheme, "rtmp"))
+        default_port = ":1935";
+
+    Size host_end = authority_end;
+    if (default_port.len() > 0
+        && authority_end - host_begin > default_port.len()
+        && equal (ConstMemory (buf + authority_end - default_port.len(), default_port.len()), default_port))
+    {
+        host_end = authority_end - default_port.len();
+    }
+
+    ConstMemory path (buf + authority_end, uri.len() - authority_end);
+    if (equal (path, "/"))
+        path = ConstMemory ();
+
+    return st_makeString (ConstMemory (buf, host_end), path);
+}
+
+Ref<SourceRegistry::Subscriber>
+SourceRegistry::createSubscriber (CbDesc<MediaSource::Frontend> const &frontend,
+                                  ConstMemory         const source_key,
+                                  Timers            * const timers,
+                                  DeferredProcessor * const deferred_processor,
+                                  PagePool          * const page_pool,
+                                  VideoStream       * const video_stream,
+                                  ChannelOptions    * const channel_opts,
+                                  PlaybackItem      * const playback_item)
+{
+    Ref<Subscriber> const subscriber = grab (new (std::nothrow) Subscriber);
+    subscriber->registry = this;
+    subscriber->source_key = grab (new (std::nothrow) String (source_key));
+    subscriber->timers = timers;
+    subscriber->deferred_processor = deferred_processor;
+    subscriber->page_pool = page_pool;
+
+    subscriber->output = grab (new (std::nothrow) Output);
+    subscriber->output->frontend = frontend;
+    subscriber->output->video_stream = video_stream;
+    subscriber->channel_opts = channel_opts;
+    subscriber->playback_item = playback_item;
+
+    return subscriber;
+}
+
+void
+SourceRegistry::getStats (Stats * const mt_nonnull ret_stats)
+{
+    ret_stats->num_sources = 0;
+    ret_stats->num_subscribers = 0;
+
+    mutex.lock ();
+
+    SourceHash::iter iter (source_hash);
+    while (!source_hash.iter_done (iter)) {
+        Source * const source = source_hash.iter_next (iter);
+        ++ret_stats->num_sources;
+        ret_stats->num_subscribers += source->num_subscribers;
+    }
+
+    mutex.unlock ();
+}
+
+mt_const void
+SourceRegistry::init (CbDesc<Frontend> const &frontend)
+{
+    this->frontend = frontend;
+}
+
+SourceRegistry::SourceRegistry ()
+{
+}
+
+SourceRegistry::~SourceRegistry ()
+{
+}
+
+}
+
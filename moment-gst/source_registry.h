@@ -0,0 +1,281 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__SOURCE_REGISTRY__H__
+#define MOMENT_GST__SOURCE_REGISTRY__H__
+
+
+#include <libmary/libmary.h>
+
+#include <moment/libmoment.h>
+
+#include <moment-gst/gst_stream.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+using namespace Moment;
+
+// Lets channels with the same upstream URI share one ingest pipeline.
+//
+// Channels get a Subscriber instead of a GstStream of their own. Subscribers
+// with the same key share a Source: a single GstStream which delivers to
+// a private VideoStream, and frames from it are fired into each subscriber's
+// video stream. The pipeline is created for the first subscriber and released
+// along with the last one. Late subscribers are given the last codec data
+// and start with the next keyframe.
+//
+// Frames are fired to a snapshot of the subscriber list, which is replaced
+// as a whole when subscribers come and go. A subscriber which has just left
+// may still get the frames that were being delivered at that moment.
+class SourceRegistry : public Object
+{
+public:
+    struct Frontend
+    {
+        // Creates a GstStream for the source, which is started separately.
+        // 'channel_opts' and 'playback_item' are those of the subscriber
+        // which the source is created for.
+        Ref<GstStream> (*createStream) (ConstMemory        source_key,
+                                        CbDesc<MediaSource::Frontend> const &frontend,
+                                        Timers            *timers,
+                                        DeferredProcessor *deferred_processor,
+                                        PagePool          *page_pool,
+                                        VideoStream       *video_stream,
+                                        ChannelOptions    *channel_opts,
+                                        PlaybackItem      *playback_item,
+                                        void              *cb_data);
+    };
+
+    struct Stats
+    {
+        Count num_sources;
+        Count num_subscribers;
+    };
+
+private:
+    class Source;
+
+    // Where frames of a source go for one subscriber.
+    class Output : public Referenced
+    {
+    public:
+        mt_const Cb<MediaSource::Frontend> frontend;
+        mt_const Ref<VideoStream> video_stream;
+
+        // Set before the output is added to a subscriber list. After that,
+        // accessed by the thread which fires frames of the source only.
+        // Inter frames are skipped up to the first keyframe.
+        bool got_keyframe;
+        bool audio_codec_data_pending;
+        bool video_codec_data_pending;
+
+        Output ()
+            : got_keyframe (false),
+              audio_codec_data_pending (true),
+              video_codec_data_pending (true)
+        {}
+    };
+
+    // Never modified once it has been set as Source::output_list.
+    class OutputList : public Referenced
+    {
+    public:
+        List< Ref<Output> > list;
+    };
+
+public:
+    class Subscriber : public MediaSource
+    {
+        friend class SourceRegistry;
+
+    private:
+        mt_const Ref<SourceRegistry> registry;
+        mt_const Ref<String> source_key;
+
+        mt_const Ref<Output> output;
+        mt_const Timers            *timers;
+        mt_const DeferredProcessor *deferred_processor;
+        mt_const PagePool          *page_pool;
+        mt_const Ref<ChannelOptions> channel_opts;
+        mt_const Ref<PlaybackItem>   playback_item;
+
+        mt_mutex (SourceRegistry::mutex) Ref<Source> source;
+
+    public:
+      mt_iface (MediaSource)
+        void createPipeline ();
+        void releasePipeline ();
+
+        void getTrafficStats (TrafficStats * mt_nonnull ret_traffic_stats);
+        void resetTrafficStats ();
+      mt_iface_end
+
+        Subscriber ();
+        ~Subscriber ();
+    };
+
+private:
+    class Source : public Object,
+                   public HashEntry<>
+    {
+    public:
+        mt_const SourceRegistry *registry;
+        mt_const Ref<String> source_key;
+        mt_const Ref<VideoStream> video_stream;
+
+        // Reports failure to create the stream to the subscribers.
+        DeferredProcessor::Task error_task;
+        DeferredProcessor::Registration deferred_reg;
+
+        mt_mutex (SourceRegistry::mutex)
+        mt_begin
+          // NULL while the stream is being created.
+          Ref<GstStream> gst_stream;
+          Count num_subscribers;
+          // Set on EOS or error. A closed source is not in 'source_hash',
+          // new subscribers get a new source.
+          bool closed;
+        mt_end
+
+        StateMutex mutex;
+
+        mt_mutex (mutex)
+        mt_begin
+          // Never NULL.
+          Ref<OutputList> output_list;
+
+          // Last codec data, for subscribers which come late.
+          bool got_audio_codec_data;
+          bool got_video_codec_data;
+          VideoStream::AudioMessage audio_codec_data;
+          VideoStream::VideoMessage video_codec_data;
+        mt_end
+
+        Source ()
+            : registry (NULL),
+              num_subscribers (0),
+              closed (false),
+              output_list (grab (new (std::nothrow) OutputList)),
+              got_audio_codec_data (false),
+              got_video_codec_data (false)
+        {}
+
+        ~Source ();
+    };
+
+    typedef Hash< Source,
+                  Memory,
+                  MemberExtractor< Source,
+                                   Ref<String>,
+                                   &Source::source_key,
+                                   Memory,
+                                   AccessorExtractor< String,
+                                                      Memory,
+                                                      &String::mem > >,
+                  MemoryComparator<> >
+            SourceHash;
+
+    mt_const Cb<Frontend> frontend;
+
+    StateMutex mutex;
+
+    mt_mutex (mutex) SourceHash source_hash;
+
+    void subscribe (Subscriber * mt_nonnull subscriber);
+
+    void unsubscribe (Subscriber * mt_nonnull subscriber);
+
+    mt_mutex (mutex) void closeSource (Source * mt_nonnull source);
+
+    // Fires the last codec data of the source, if any, to 'output' only.
+    static void fireAudioCodecData (Source * mt_nonnull source,
+                                    Output * mt_nonnull output);
+
+    static void fireVideoCodecData (Source * mt_nonnull source,
+                                    Output * mt_nonnull output);
+
+    static bool sourceErrorTask (void *_source);
+
+  mt_iface (VideoStream::EventHandler)
+    static VideoStream::EventHandler const source_stream_handler;
+
+    static void sourceAudioMessage (VideoStream::AudioMessage * mt_nonnull msg,
+                                    void *_source);
+
+    static void sourceVideoMessage (VideoStream::VideoMessage * mt_nonnull msg,
+                                    void *_source);
+  mt_iface_end
+
+  mt_iface (MediaSource::Frontend)
+    static MediaSource::Frontend const gst_stream_frontend;
+
+    static void sourceEos (void *_source);
+
+    static void sourceError (void *_source);
+
+    static void sourceNoVideo (void *_source);
+
+    static void sourceGotVideo (void *_source);
+  mt_iface_end
+
+    struct SourceEvent
+    {
+        enum Value {
+            Eos,
+            Error,
+            NoVideo,
+            GotVideo
+        };
+    };
+
+    // Passes the event on to the subscribers of 'source'. The source is
+    // closed on EOS and error.
+    void fireSourceEvent (Source            * mt_nonnull source,
+                          SourceEvent::Value event);
+
+public:
+    // Returns a uniform representation of 'uri', so that different
+    // spellings of the same URI map to the same source.
+    static StRef<String> normalizeUri (ConstMemory uri);
+
+    // 'source_key' identifies the URI and decoding options of the source.
+    Ref<Subscriber> createSubscriber (CbDesc<MediaSource::Frontend> const &frontend,
+                                      ConstMemory        source_key,
+                                      Timers            *timers,
+                                      DeferredProcessor *deferred_processor,
+                                      PagePool          *page_pool,
+                                      VideoStream       *video_stream,
+                                      ChannelOptions    *channel_opts,
+                                      PlaybackItem      *playback_item);
+
+    void getStats (Stats * mt_nonnull ret_stats);
+
+    mt_const void init (CbDesc<Frontend> const &frontend);
+
+     SourceRegistry ();
+    ~SourceRegistry ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__SOURCE_REGISTRY__H__ */
+
@@ -0,0 +1,124 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__SPSC_RING__H__
+#define MOMENT_GST__SPSC_RING__H__
+
+
+#include <libmary/types.h>
+#include <atomic>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Bounded lock-free ring with exactly one producer thread and exactly one
+// consumer thread. Capacity is rounded up to a power of two.
+template <class T>
+class SpscRing
+{
+private:
+    mt_const T    *slots;
+    mt_const Size  mask;
+
+    // Written by the consumer only.
+    std::atomic<Size> head;
+    // Keeps 'head' and 'tail' on separate cache lines.
+    Byte pad [64];
+    // Written by the producer only.
+    std::atomic<Size> tail;
+
+public:
+    Size getCapacity () const
+        { return mask + 1; }
+
+    // May be called from any thread. The result is approximate if the ring
+    // is being modified concurrently.
+    Size getDepth () const
+    {
+        Size const h = head.load (std::memory_order_acquire);
+        Size const t = tail.load (std::memory_order_acquire);
+        return (t >= h ? t - h : 0);
+    }
+
+    // Producer only. Returns false if the ring is full.
+    bool push (T const &item)
+    {
+        Size const t = tail.load (std::memory_order_relaxed);
+        if (t - head.load (std::memory_order_acquire) > mask)
+            return false;
+
+        slots [t & mask] = item;
+        tail.store (t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns the item which pop() would return, NULL if
+    // the ring is empty.
+    T const * peek () const
+    {
+        Size const h = head.load (std::memory_order_relaxed);
+        if (h == tail.load (std::memory_order_acquire))
+            return NULL;
+
+        return &slots [h & mask];
+    }
+
+    // Consumer only. Returns false if the ring is empty.
+    bool pop (T * const mt_nonnull ret_item)
+    {
+        Size const h = head.load (std::memory_order_relaxed);
+        if (h == tail.load (std::memory_order_acquire))
+            return false;
+
+        *ret_item = slots [h & mask];
+        head.store (h + 1, std::memory_order_release);
+        return true;
+    }
+
+    mt_const void init (Size const min_capacity)
+    {
+        Size capacity = 1;
+        while (capacity < min_capacity)
+            capacity <<= 1;
+
+        slots = new (std::nothrow) T [capacity];
+        assert (slots);
+        mask = capacity - 1;
+    }
+
+    SpscRing ()
+        : slots (NULL),
+          mask  (0),
+          head  (0),
+          tail  (0)
+    {}
+
+    ~SpscRing ()
+    {
+        delete[] slots;
+    }
+};
+
+}
+
+
+#endif /* MOMENT_GST__SPSC_RING__H__ */
+
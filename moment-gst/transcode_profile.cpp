@@ -0,0 +1,216 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#include <moment-gst/transcode_profile.h>
+
+
+using namespace M;
+
+namespace MomentGst {
+
+namespace {
+
+struct EncoderDesc
+{
+    char const *name;
+    // Caps of the encoded stream, as GstStream expects them.
+    char const *caps;
+    // Profile bitrates are converted to the encoder's units by dividing by
+    // 'bitrate_divisor', or multiplying by 'bitrate_multiplier'.
+    Uint32 bitrate_divisor;
+    Uint32 bitrate_multiplier;
+    // Sample rate forced if the profile doesn't set one, 0 for none.
+    Uint32 default_rate;
+};
+
+}
+
+// Video bitrate is in kbit/s in profiles.
+static EncoderDesc const video_encoders [] = {
+    { "x264enc",   "video/x-h264,alignment=au,stream-format=avc", 1, 1,    0 },
+    { "ffenc_flv", "video/x-flash-video",                         1, 1000, 0 }
+};
+
+// Audio bitrate is in bit/s in profiles. Flash plays Speex at 16 kHz only.
+static EncoderDesc const audio_encoders [] = {
+    { "faac",     "audio/mpeg,mpegversion=4",         1,    1, 0     },
+    { "lame",     "audio/mpeg,mpegversion=1,layer=3", 1000, 1, 0     },
+    { "speexenc", "audio/x-speex",                    1,    1, 16000 }
+};
+
+static EncoderDesc const *
+findEncoder (EncoderDesc const * const encoders,
+             Count               const num_encoders,
+             ConstMemory         const name)
+{
+    for (Count i = 0; i < num_encoders; ++i) {
+        if (equal (name, encoders [i].name))
+            return &encoders [i];
+    }
+
+    return NULL;
+}
+
+static EncoderDesc const *
+findVideoEncoder (ConstMemory const name)
+{
+    return findEncoder (video_encoders, sizeof (video_encoders) / sizeof (video_encoders [0]), name);
+}
+
+static EncoderDesc const *
+findAudioEncoder (ConstMemory const name)
+{
+    return findEncoder (audio_encoders, sizeof (audio_encoders) / sizeof (audio_encoders [0]), name);
+}
+
+bool
+TranscodeProfile::isSupportedVideoEncoder (ConstMemory const name)
+{
+    return findVideoEncoder (name) != NULL;
+}
+
+bool
+TranscodeProfile::isSupportedAudioEncoder (ConstMemory const name)
+{
+    return findAudioEncoder (name) != NULL;
+}
+
+StRef<String>
+TranscodeProfile::makeVideoChain (bool const sync_to_clock) const
+{
+    StRef<String> const encoder_chain = makeVideoEncoderChain ("video", sync_to_clock, 0 /* gop_size */);
+    return st_makeString ("ffmpegcolorspace ! ", encoder_chain->mem());
+}
+
+StRef<String>
+TranscodeProfile::makeVideoEncoderChain (ConstMemory const sink_name,
+                                         bool        const sync_to_clock,
+                                         Uint32      const gop_size,
+                                         Uint32      const threads,
+                                         bool        const low_latency) const
+{
+    StRef<String> scale = st_grab (new (std::nothrow) String);
+    if (width && height)
+        scale = st_makeString ("videoscale ! video/x-raw-yuv,width=", width, ",height=", height, " ! ");
+    else
+    if (width)
+        scale = st_makeString ("videoscale ! video/x-raw-yuv,width=", width, " ! ");
+    else
+    if (height)
+        scale = st_makeString ("videoscale ! video/x-raw-yuv,height=", height, " ! ");
+
+    EncoderDesc const * const desc = findVideoEncoder (video_encoder->mem());
+    assert (desc);
+
+    bool const is_x264 = equal (video_encoder->mem(), "x264enc");
+
+    StRef<String> encoder;
+    if (is_x264) {
+        // zerolatency disables B-frames and lookahead, which otherwise hold
+        // back dozens of frames.
+        ConstMemory const tune_mem = (low_latency ? ConstMemory ("zerolatency") : tune->mem());
+        encoder = st_makeString (video_encoder->mem(),
+                                 " name=", sink_name, "_enc",
+                                 " bitrate=", video_bitrate,
+                                 " speed-preset=", speed_preset->mem(),
+                                 (tune_mem.len() ? " tune=" : ""), tune_mem,
+                                 " profile=", h264_profile->mem(),
+                                 " key-int-max=", (gop_size ? gop_size : keyframe_interval),
+                                 " threads=", (threads ? threads : this->threads),
+                                 (sliced_threads ? " sliced-threads=true" : ""),
+                                 // Without scene cut detection, keyframes come
+                                 // every 'gop_size' frames from the first one.
+                                 (gop_size ? " option-string=scenecut=0" : ""));
+    } else {
+        // ffenc_* encoders place keyframes every 'gop-size' frames.
+        StRef<String> gop = st_grab (new (std::nothrow) String);
+        if (gop_size)
+            gop = st_makeString (" gop-size=", gop_size);
+
+        encoder = st_makeString (video_encoder->mem(), " name=", sink_name, "_enc",
+                                 " bitrate=", video_bitrate / desc->bitrate_divisor * desc->bitrate_multiplier,
+                                 gop->mem());
+    }
+
+    // x264enc produces constrained baseline streams with profile=baseline.
+    bool const is_baseline = equal (h264_profile->mem(), "baseline");
+
+    return st_makeString (scale->mem(),
+                          encoder->mem(),
+                          (video_encoder_params->len() ? " " : ""), video_encoder_params->mem(),
+                          " ! ", desc->caps,
+                          (is_x264 && is_baseline ? ",profile=constrained-baseline" : ""),
+                          " ! fakesink name=", sink_name,
+                          (sync_to_clock ? " sync=true" : ""));
+}
+
+StRef<String>
+TranscodeProfile::makeAudioChain (bool const aac_perfect_timestamp,
+                                  bool const sync_to_clock) const
+{
+    EncoderDesc const * const desc = findAudioEncoder (audio_encoder->mem());
+    assert (desc);
+
+    bool const is_faac = equal (audio_encoder->mem(), "faac");
+
+    Uint32 const rate_val = (audio_rate ? audio_rate : desc->default_rate);
+    StRef<String> rate = st_grab (new (std::nothrow) String);
+    if (rate_val)
+        rate = st_makeString (",rate=", rate_val);
+
+    StRef<String> bitrate = st_grab (new (std::nothrow) String);
+    if (audio_bitrate)
+        bitrate = st_makeString (" bitrate=", audio_bitrate / desc->bitrate_divisor * desc->bitrate_multiplier);
+
+    return st_makeString ("audioconvert ! audioresample ! "
+                          "audio/x-raw-int,channels=", audio_channels, rate->mem(),
+                          " ! ",
+                          audio_encoder->mem(),
+                          bitrate->mem(),
+                          (is_faac && aac_perfect_timestamp ? " perfect-timestamp=true" : ""),
+                          (audio_encoder_params->len() ? " " : ""), audio_encoder_params->mem(),
+                          " ! ", desc->caps, ",channels=", audio_channels,
+                          (is_faac ? ",base-profile=lc" : ""),
+                          " ! fakesink name=audio",
+                          (sync_to_clock ? " sync=true" : ""));
+}
+
+TranscodeProfile::TranscodeProfile ()
+    : name                 (grab (new (std::nothrow) String ("default"))),
+      video_encoder        (grab (new (std::nothrow) String ("x264enc"))),
+      video_bitrate        (500),
+      speed_preset         (grab (new (std::nothrow) String ("veryfast"))),
+      tune                 (grab (new (std::nothrow) String)),
+      h264_profile         (grab (new (std::nothrow) String ("baseline"))),
+      keyframe_interval    (30),
+      threads              (1),
+      sliced_threads       (true),
+      width                (0),
+      height               (0),
+      video_encoder_params (grab (new (std::nothrow) String)),
+      audio_encoder        (grab (new (std::nothrow) String ("faac"))),
+      audio_bitrate        (0),
+      audio_channels       (2),
+      audio_rate           (0),
+      audio_encoder_params (grab (new (std::nothrow) String))
+{
+}
+
+}
+
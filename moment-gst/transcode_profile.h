@@ -0,0 +1,100 @@
+/*  Moment-Gst - GStreamer support module for Moment Video Server
+    Copyright (C) 2011-2013 Dmitry Shatrov
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+
+#ifndef MOMENT_GST__TRANSCODE_PROFILE__H__
+#define MOMENT_GST__TRANSCODE_PROFILE__H__
+
+
+#include <libmary/libmary.h>
+
+
+namespace MomentGst {
+
+using namespace M;
+
+// Encoder settings for streams which deliver raw audio or video, configured
+// in "mod_gst/transcoding_profiles" section. Default values correspond to
+// the chains which used to be hard-coded in GstStream.
+class TranscodeProfile : public Referenced
+{
+public:
+    mt_const Ref<String> name;
+
+    // Element name, one of isSupportedVideoEncoder(). Options below which
+    // are specific to x264enc are only applied when the encoder is x264enc.
+    mt_const Ref<String> video_encoder;
+    // In kbit/s.
+    mt_const Uint32      video_bitrate;
+    mt_const Ref<String> speed_preset;
+    // Empty for no tuning.
+    mt_const Ref<String> tune;
+    mt_const Ref<String> h264_profile;
+    // Max number of frames between keyframes.
+    mt_const Uint32      keyframe_interval;
+    mt_const Uint32      threads;
+    mt_const bool        sliced_threads;
+    // 0 means that the source dimension is kept.
+    mt_const Uint32      width;
+    mt_const Uint32      height;
+    // Appended to the video encoder's properties as is.
+    mt_const Ref<String> video_encoder_params;
+
+    // One of isSupportedAudioEncoder().
+    mt_const Ref<String> audio_encoder;
+    // In bit/s, 0 for the encoder's default.
+    mt_const Uint32      audio_bitrate;
+    mt_const Uint32      audio_channels;
+    // 0 means that the source rate is kept.
+    mt_const Uint32      audio_rate;
+    mt_const Ref<String> audio_encoder_params;
+
+    // Chains in gst-launch syntax ending with "fakesink name=video" and
+    // "fakesink name=audio" respectively.
+    StRef<String> makeVideoChain (bool sync_to_clock) const;
+
+    // Encoding part of the video chain, from scaling to the fakesink called
+    // 'sink_name'. The encoder element is called "<sink_name>_enc". Input is
+    // expected to be converted by ffmpegcolorspace.
+    // If 'gop_size' is non-zero, keyframes are placed every 'gop_size' frames
+    // exactly, so that encoders fed with the same frames produce aligned
+    // keyframes (x264enc's key-int-max, ffenc's gop-size). Non-zero 'threads'
+    // overrides the profile's thread count. With 'low_latency', x264enc is
+    // tuned for zero latency regardless of the profile's 'tune'.
+    StRef<String> makeVideoEncoderChain (ConstMemory sink_name,
+                                         bool        sync_to_clock,
+                                         Uint32      gop_size,
+                                         Uint32      threads = 0,
+                                         bool        low_latency = false) const;
+
+    StRef<String> makeAudioChain (bool aac_perfect_timestamp,
+                                  bool sync_to_clock) const;
+
+    // Encoders which the chains know output caps and bitrate units of:
+    // x264enc and ffenc_flv for video, faac, lame and speexenc for audio.
+    static bool isSupportedVideoEncoder (ConstMemory name);
+    static bool isSupportedAudioEncoder (ConstMemory name);
+
+    TranscodeProfile ();
+};
+
+}
+
+
+#endif /* MOMENT_GST__TRANSCODE_PROFILE__H__ */
+